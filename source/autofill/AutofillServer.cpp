@@ -0,0 +1,372 @@
+#include "AutofillServer.h"
+#include "../database/CipherKey.h"
+#include "../database/DatabaseManager.h"
+#include "../database/ReaderPool.h"
+
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QFutureWatcher>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QMessageAuthenticationCode>
+#include <QRandomGenerator>
+#include <QSharedPointer>
+#include <QStandardPaths>
+#include <QtConcurrent>
+#include <algorithm>
+
+namespace {
+
+const int NonceBytes = 24;
+const int MinKeyBytes = 32;
+const int MaxClientIdLength = 128;
+
+QByteArray randomBytes(int size) {
+    QByteArray bytes(size, '\0');
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32*>(bytes.data()), size / (int)sizeof(quint32));
+    return bytes;
+}
+
+bool constantTimeEquals(const QByteArray& a, const QByteArray& b) {
+    if (a.size() != b.size()) return false;
+    unsigned char diff = 0;
+    for (int i = 0; i < a.size(); ++i) {
+        diff |= (unsigned char)(a.at(i) ^ b.at(i));
+    }
+    return diff == 0;
+}
+
+QString toBase64(const QByteArray& bytes) {
+    return QString::fromLatin1(bytes.toBase64());
+}
+
+}
+
+AutofillServer::AutofillServer(QObject* parent)
+    : QObject(parent) {
+    m_server = new QLocalServer(this);
+    connect(m_server, &QLocalServer::newConnection, this, &AutofillServer::onNewConnection);
+
+    // Edits come in bursts; the index is rebuilt once they have settled
+    m_rebuildTimer = new QTimer(this);
+    m_rebuildTimer->setSingleShot(true);
+    m_rebuildTimer->setInterval(RebuildDelayMs);
+    connect(m_rebuildTimer, &QTimer::timeout, this, &AutofillServer::rebuildDirty);
+}
+
+AutofillServer::~AutofillServer() {
+    m_server->close();
+}
+
+QString AutofillServer::socketPath() {
+#ifdef Q_OS_UNIX
+    QString directory = QStandardPaths::writableLocation(QStandardPaths::RuntimeLocation);
+    if (directory.isEmpty()) {
+        directory = QDir::tempPath();
+    }
+    return directory + "/keebox-autofill.sock";
+#else
+    return QStringLiteral("keebox-autofill");
+#endif
+}
+
+bool AutofillServer::listen() {
+    const QString path = socketPath();
+
+    // A socket someone still answers on belongs to another instance; otherwise it is left over from a crash
+    QLocalSocket probe;
+    probe.connectToServer(path);
+    if (probe.waitForConnected(100)) {
+        qInfo() << "Autofill server already running in another instance";
+        return false;
+    }
+    QLocalServer::removeServer(path);
+
+    m_server->setSocketOptions(QLocalServer::UserAccessOption);
+    if (!m_server->listen(path)) {
+        qWarning() << "Failed to start the autofill server:" << m_server->errorString();
+        return false;
+    }
+    qInfo() << "Autofill server listening on" << m_server->fullServerName();
+    return true;
+}
+
+void AutofillServer::addVault(DatabaseManager* database) {
+    m_vaults.append(database);
+    m_indexes.insert(database, VaultIndex());
+
+    connect(database, &DatabaseManager::databaseModified, this, [this, database]() {
+        m_indexes[database].dirty = true;
+        m_rebuildTimer->start();
+    });
+    connect(database, &QObject::destroyed, this, [this, database]() {
+        m_indexes.remove(database);
+        m_vaults.erase(std::remove_if(m_vaults.begin(), m_vaults.end(),
+                                      [](const QPointer<DatabaseManager>& vault) { return vault.isNull(); }),
+                       m_vaults.end());
+    });
+    m_rebuildTimer->start();
+}
+
+void AutofillServer::onNewConnection() {
+    while (QLocalSocket* socket = m_server->nextPendingConnection()) {
+        Session session;
+        session.nonce = randomBytes(NonceBytes);
+        m_sessions.insert(socket, session);
+
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { onReadyRead(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            m_sessions.remove(socket);
+            socket->deleteLater();
+        });
+
+        QJsonObject hello;
+        hello["action"] = "hello";
+        hello["version"] = ProtocolVersion;
+        hello["nonce"] = toBase64(session.nonce);
+        send(socket, hello);
+    }
+}
+
+void AutofillServer::onReadyRead(QLocalSocket* socket) {
+    auto it = m_sessions.find(socket);
+    if (it == m_sessions.end()) return;
+    it->buffer.append(socket->readAll());
+
+    while (true) {
+        // Handling a message can end the session
+        it = m_sessions.find(socket);
+        if (it == m_sessions.end()) return;
+
+        const int newline = it->buffer.indexOf('\n');
+        if (newline < 0) {
+            if (it->buffer.size() > MaxMessageBytes) {
+                sendError(socket, QString(), "Message too large");
+                socket->disconnectFromServer();
+            }
+            return;
+        }
+
+        const QByteArray line = it->buffer.left(newline);
+        it->buffer.remove(0, newline + 1);
+        if (line.trimmed().isEmpty()) continue;
+
+        QJsonParseError parseError;
+        QJsonDocument document = QJsonDocument::fromJson(line, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !document.isObject()) {
+            sendError(socket, QString(), "Malformed message");
+            continue;
+        }
+        handleMessage(socket, document.object());
+    }
+}
+
+void AutofillServer::handleMessage(QLocalSocket* socket, const QJsonObject& message) {
+    const QString action = message.value("action").toString();
+    if (action == "associate") {
+        associate(socket, message);
+    } else if (action == "test-associate") {
+        testAssociate(socket, message);
+    } else if (action == "get-logins") {
+        getLogins(socket, message);
+    } else {
+        sendError(socket, action, "Unknown action");
+    }
+}
+
+void AutofillServer::send(QLocalSocket* socket, QJsonObject reply) {
+    socket->write(QJsonDocument(reply).toJson(QJsonDocument::Compact));
+    socket->write("\n");
+}
+
+void AutofillServer::sendError(QLocalSocket* socket, const QString& action, const QString& error) {
+    QJsonObject reply;
+    reply["action"] = action;
+    reply["success"] = false;
+    reply["error"] = error;
+    send(socket, reply);
+}
+
+void AutofillServer::associate(QLocalSocket* socket, const QJsonObject& message) {
+    const QString clientId = message.value("id").toString();
+    QByteArray key = QByteArray::fromBase64(message.value("key").toString().toLatin1());
+    if (clientId.isEmpty() || clientId.size() > MaxClientIdLength || key.size() < MinKeyBytes) {
+        CipherKey::wipe(key);
+        sendError(socket, "associate", "An id and a key of at least 32 bytes are required");
+        return;
+    }
+    if (m_vaults.isEmpty()) {
+        CipherKey::wipe(key);
+        sendError(socket, "associate", "No vault is unlocked");
+        return;
+    }
+
+    // The user decides which vault, if any, the client may read
+    const quint64 request = m_nextRequest++;
+    m_pending.insert(request, PendingAssociation{socket, clientId, key});
+    emit associationRequested(request, clientId);
+}
+
+void AutofillServer::completeAssociation(quint64 request, DatabaseManager* database) {
+    PendingAssociation pending = m_pending.take(request);
+    const bool stored = pending.socket && database && database->addAutofillClient(pending.clientId, pending.key);
+    CipherKey::wipe(pending.key);
+    if (!pending.socket) return;
+
+    if (!stored) {
+        sendError(pending.socket, "associate", database ? "Failed to store the association" : "Denied by the user");
+        return;
+    }
+
+    qInfo() << "Associated autofill client" << pending.clientId << "with" << database->path();
+    QJsonObject reply;
+    reply["action"] = "associate";
+    reply["success"] = true;
+    reply["id"] = pending.clientId;
+    send(pending.socket, reply);
+}
+
+void AutofillServer::testAssociate(QLocalSocket* socket, const QJsonObject& message) {
+    Session& session = m_sessions[socket];
+    const QString clientId = message.value("id").toString();
+    const QByteArray proof = QByteArray::fromBase64(message.value("hmac").toString().toLatin1());
+
+    session.clientId = clientId;
+    session.vaults.clear();
+    for (const QPointer<DatabaseManager>& vault : std::as_const(m_vaults)) {
+        if (!vault) continue;
+        QByteArray key = vault->autofillClientKey(clientId);
+        if (key.isEmpty()) continue;
+        if (constantTimeEquals(QMessageAuthenticationCode::hash(session.nonce, key, QCryptographicHash::Sha256), proof)) {
+            session.vaults.append(vault);
+        }
+        CipherKey::wipe(key);
+    }
+
+    // Every proof is good for one nonce; the next one is needed to prove again, e.g. after another unlock
+    session.nonce = randomBytes(NonceBytes);
+
+    QJsonObject reply;
+    reply["action"] = "test-associate";
+    reply["success"] = !session.vaults.isEmpty();
+    reply["id"] = clientId;
+    reply["vaults"] = session.vaults.size();
+    reply["nonce"] = toBase64(session.nonce);
+    if (session.vaults.isEmpty()) {
+        reply["error"] = "Not associated";
+    }
+    send(socket, reply);
+}
+
+void AutofillServer::getLogins(QLocalSocket* socket, const QJsonObject& message) {
+    const Session& session = m_sessions[socket];
+    const QString url = message.value("url").toString();
+
+    bool authorized = false;
+    bool building = false;
+    QJsonArray logins;
+    for (const QPointer<DatabaseManager>& vault : session.vaults) {
+        if (!vault || !vault->isOpen()) continue;
+        authorized = true;
+
+        refreshIndex(vault);
+        const VaultIndex& index = m_indexes[vault];
+        if (!index.built) {
+            building = true;
+            continue;
+        }
+
+        const QList<int> ids = index.urls.lookup(url);
+        const QString vaultName = QFileInfo(vault->path()).completeBaseName();
+        for (const DatabaseManager::Entry& entry : vault->getEntriesByIds(ids)) {
+            // The index can be a rebuild behind, so an entry whose URL was edited since must not be handed out
+            UrlIndex saved;
+            saved.insert(entry.id, entry.url);
+            if (saved.lookup(url).isEmpty()) continue;
+
+            QJsonObject login;
+            login["name"] = entry.title;
+            login["login"] = entry.username;
+            login["password"] = entry.password;
+            login["url"] = entry.url;
+            login["vault"] = vaultName;
+            logins.append(login);
+        }
+    }
+
+    if (!authorized) {
+        sendError(socket, "get-logins", "Not associated");
+        return;
+    }
+    if (building && logins.isEmpty()) {
+        sendError(socket, "get-logins", "Busy");
+        return;
+    }
+
+    QJsonObject reply;
+    reply["action"] = "get-logins";
+    reply["success"] = true;
+    reply["count"] = logins.size();
+    reply["entries"] = logins;
+    send(socket, reply);
+}
+
+void AutofillServer::rebuildDirty() {
+    for (const QPointer<DatabaseManager>& vault : std::as_const(m_vaults)) {
+        if (vault && vault->isOpen()) {
+            refreshIndex(vault);
+        }
+    }
+}
+
+void AutofillServer::refreshIndex(DatabaseManager* database) {
+    VaultIndex& index = m_indexes[database];
+    if (index.building) return;
+
+    // data_version moves when another connection commits, e.g. a merge or a sync tool
+    const int version = database->dataVersion();
+    if (!index.dirty && version == index.dataVersion) return;
+
+    QSharedPointer<ReaderPool> readers = database->readerPool();
+    if (!readers) return;
+    index.dirty = false;
+    index.building = true;
+
+    const QPointer<DatabaseManager> vault(database);
+    auto* watcher = new QFutureWatcher<QSharedPointer<UrlIndex>>(this);
+    connect(watcher, &QFutureWatcher<QSharedPointer<UrlIndex>>::finished, this, [this, watcher, vault, version]() {
+        watcher->deleteLater();
+        auto it = m_indexes.find(vault.data());
+        if (!vault || it == m_indexes.end()) return;
+
+        it->building = false;
+        QSharedPointer<UrlIndex> urls = watcher->result();
+        if (!urls) {
+            // Left for the next lookup to retry, e.g. after the pool was shut down by a lock
+            it->dirty = true;
+            return;
+        }
+        it->urls = *urls;
+        it->dataVersion = version;
+        it->built = true;
+
+        // Edits made during the build are not in it
+        if (it->dirty) {
+            m_rebuildTimer->start();
+        }
+    });
+    watcher->setFuture(QtConcurrent::run([readers]() {
+        QSharedPointer<UrlIndex> urls;
+        ReaderPool::Lease lease = readers->acquire();
+        if (lease.isValid()) {
+            urls = QSharedPointer<UrlIndex>::create();
+            for (const QPair<int, QString>& url : DatabaseManager::getEntryUrls(lease.db())) {
+                urls->insert(url.first, url.second);
+            }
+        }
+        return urls;
+    }));
+}
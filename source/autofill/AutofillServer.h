@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QByteArray>
+#include <QHash>
+#include <QJsonObject>
+#include <QList>
+#include <QObject>
+#include <QPointer>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include "UrlIndex.h"
+
+class DatabaseManager;
+class QLocalServer;
+class QLocalSocket;
+
+// Answers login lookups from browser extensions over a local socket that only
+// this user can connect to. The protocol follows KeePassXC's browser protocol:
+// newline-delimited JSON, a client is associated once with the user's approval,
+// and afterwards proves itself on every connection with an HMAC over a fresh nonce.
+class AutofillServer : public QObject {
+    Q_OBJECT
+
+public:
+    static const int ProtocolVersion = 1;
+    static const int MaxMessageBytes = 64 * 1024;
+    static const int RebuildDelayMs = 250;
+
+    explicit AutofillServer(QObject* parent = nullptr);
+    ~AutofillServer() override;
+
+    static QString socketPath();
+    bool listen();
+
+    // Unlocked vaults to answer from; a vault drops out when it is locked
+    void addVault(DatabaseManager* database);
+
+public slots:
+    // Answers an associationRequested(); a null database denies it
+    void completeAssociation(quint64 request, DatabaseManager* database);
+
+signals:
+    void associationRequested(quint64 request, const QString& clientId);
+
+private:
+    struct Session {
+        QByteArray buffer;
+        QByteArray nonce;
+        QString clientId;
+        QList<QPointer<DatabaseManager>> vaults;  // the vaults the client proved itself to
+    };
+
+    struct PendingAssociation {
+        QPointer<QLocalSocket> socket;
+        QString clientId;
+        QByteArray key;
+    };
+
+    // Rebuilt on a reader connection in the background; lookups use the last finished build meanwhile
+    struct VaultIndex {
+        UrlIndex urls;
+        int dataVersion = -1;
+        bool built = false;
+        bool building = false;
+        bool dirty = true;
+    };
+
+    void onNewConnection();
+    void onReadyRead(QLocalSocket* socket);
+    void handleMessage(QLocalSocket* socket, const QJsonObject& message);
+    void send(QLocalSocket* socket, QJsonObject reply);
+    void sendError(QLocalSocket* socket, const QString& action, const QString& error);
+
+    void associate(QLocalSocket* socket, const QJsonObject& message);
+    void testAssociate(QLocalSocket* socket, const QJsonObject& message);
+    void getLogins(QLocalSocket* socket, const QJsonObject& message);
+
+    void rebuildDirty();
+    void refreshIndex(DatabaseManager* database);
+
+    QLocalServer* m_server = nullptr;
+    QHash<QLocalSocket*, Session> m_sessions;
+    QHash<quint64, PendingAssociation> m_pending;
+    quint64 m_nextRequest = 1;
+
+    QList<QPointer<DatabaseManager>> m_vaults;
+    QHash<DatabaseManager*, VaultIndex> m_indexes;
+    QTimer* m_rebuildTimer = nullptr;
+};
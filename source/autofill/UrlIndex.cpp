@@ -0,0 +1,110 @@
+#include "UrlIndex.h"
+
+#include <QHostAddress>
+#include <QUrl>
+#include <algorithm>
+
+namespace {
+
+// Second-level labels that country domains commonly sell below, as in example.co.uk.
+// A stand-in until the index learns the public suffix list.
+const char* const GenericSecondLevel[] = {"ac", "co", "com", "edu", "gov", "net", "org"};
+
+bool isGenericSecondLevel(const QString& label) {
+    for (const char* generic : GenericSecondLevel) {
+        if (label == QLatin1String(generic)) return true;
+    }
+    return false;
+}
+
+}
+
+UrlIndex::UrlIndex() {
+    clear();
+}
+
+QString UrlIndex::normalizeHost(const QString& url) {
+    const QString trimmed = url.trimmed();
+    if (trimmed.isEmpty()) return QString();
+
+    // Saved URLs are often bare hosts; fromUserInput() fills in the scheme
+    QString host = QUrl::fromUserInput(trimmed).host().toLower();
+    while (host.endsWith('.')) {
+        host.chop(1);
+    }
+    if (host.startsWith("www.")) {
+        host.remove(0, 4);
+    }
+    return host;
+}
+
+QStringList UrlIndex::reversedLabels(const QString& host) {
+    // Addresses have no hierarchy worth walking
+    if (!QHostAddress(host).isNull()) {
+        return {host};
+    }
+    QStringList labels = host.split('.', Qt::SkipEmptyParts);
+    std::reverse(labels.begin(), labels.end());
+    return labels;
+}
+
+int UrlIndex::registrableDepth(const QStringList& labels) {
+    int depth = 2;
+    if (labels.size() >= 3 && labels.at(0).size() == 2 && isGenericSecondLevel(labels.at(1))) {
+        depth = 3;
+    }
+    return std::min(depth, (int)labels.size());
+}
+
+void UrlIndex::clear() {
+    m_nodes.clear();
+    m_nodes.append(Node());
+    m_size = 0;
+}
+
+void UrlIndex::insert(int entryId, const QString& url) {
+    const QString host = normalizeHost(url);
+    if (host.isEmpty()) return;
+
+    int node = 0;
+    for (const QString& label : reversedLabels(host)) {
+        auto it = m_nodes[node].children.constFind(label);
+        if (it == m_nodes[node].children.constEnd()) {
+            m_nodes.append(Node());
+            const int child = m_nodes.size() - 1;
+            m_nodes[node].children.insert(label, child);
+            node = child;
+        } else {
+            node = it.value();
+        }
+    }
+    m_nodes[node].entries.append(entryId);
+    ++m_size;
+}
+
+QList<int> UrlIndex::lookup(const QString& url) const {
+    QList<int> ids;
+    const QString host = normalizeHost(url);
+    if (host.isEmpty()) return ids;
+
+    const QStringList labels = reversedLabels(host);
+    const int minDepth = registrableDepth(labels);
+
+    // Most specific first: entries for the exact host, then for its parent domains
+    QVector<int> path;
+    int node = 0;
+    for (const QString& label : labels) {
+        auto it = m_nodes.at(node).children.constFind(label);
+        if (it == m_nodes.at(node).children.constEnd()) break;
+        node = it.value();
+        path.append(node);
+    }
+    for (int depth = path.size(); depth >= minDepth && depth > 0; --depth) {
+        ids.append(m_nodes.at(path.at(depth - 1)).entries);
+    }
+    return ids;
+}
+
+int UrlIndex::size() const {
+    return m_size;
+}
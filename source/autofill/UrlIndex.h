@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+// Maps hosts to entry ids with a trie over reversed domain labels
+// (com -> example -> login), so a lookup costs one hash probe per label.
+// An entry saved for a domain also matches its subdomains, but never
+// anything above the registrable domain.
+class UrlIndex {
+public:
+    UrlIndex();
+
+    // Lower case host without "www." or a trailing dot; empty if there is none
+    static QString normalizeHost(const QString& url);
+
+    void clear();
+    void insert(int entryId, const QString& url);
+    QList<int> lookup(const QString& url) const;
+    int size() const;
+
+private:
+    struct Node {
+        QHash<QString, int> children;
+        QList<int> entries;
+    };
+
+    static QStringList reversedLabels(const QString& host);
+    static int registrableDepth(const QStringList& labels);
+
+    QVector<Node> m_nodes;  // m_nodes[0] is the root
+    int m_size = 0;
+};
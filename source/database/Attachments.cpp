@@ -0,0 +1,182 @@
+#include "Attachments.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QIODevice>
+
+namespace {
+
+// Hashes the rest of source and rewinds to where it started
+QByteArray hashContents(QIODevice* source, qint64* size) {
+    const qint64 start = source->pos();
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    QByteArray chunk(Attachments::ChunkSize, '\0');
+    *size = 0;
+    qint64 read;
+    while ((read = source->read(chunk.data(), chunk.size())) > 0) {
+        hash.addData(chunk.constData(), (int)read);
+        *size += read;
+    }
+    if (read < 0 || !source->seek(start)) return QByteArray();
+    return hash.result().toHex();
+}
+
+qint64 existingBlob(sqlite3* db, const QByteArray& sha256) {
+    qint64 id = -1;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id FROM attachment_blobs WHERE sha256 = ?", -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    sqlite3_bind_text(stmt, 1, sha256.constData(), sha256.size(), SQLITE_TRANSIENT);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        id = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return id;
+}
+
+// Reserves the blob with zeroblob() and fills it chunk by chunk
+qint64 storeBlob(sqlite3* db, const QByteArray& sha256, qint64 size, QIODevice* source) {
+    sqlite3_stmt* stmt;
+    const char* query = "INSERT INTO attachment_blobs (sha256, size, data) VALUES (?, ?, zeroblob(?))";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    sqlite3_bind_text(stmt, 1, sha256.constData(), sha256.size(), SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 2, size);
+    sqlite3_bind_int64(stmt, 3, size);
+    bool inserted = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    if (!inserted) return -1;
+
+    const qint64 id = sqlite3_last_insert_rowid(db);
+    sqlite3_blob* blob = nullptr;
+    if (sqlite3_blob_open(db, "main", "attachment_blobs", "data", id, 1, &blob) != SQLITE_OK) {
+        qCritical() << "Failed to open attachment blob:" << sqlite3_errmsg(db);
+        return -1;
+    }
+
+    QByteArray chunk(Attachments::ChunkSize, '\0');
+    qint64 offset = 0;
+    bool ok = true;
+    while (ok && offset < size) {
+        const qint64 read = source->read(chunk.data(), qMin<qint64>(chunk.size(), size - offset));
+        ok = read > 0 && sqlite3_blob_write(blob, chunk.constData(), (int)read, (int)offset) == SQLITE_OK;
+        offset += read;
+    }
+    sqlite3_blob_close(blob);
+    return ok ? id : -1;
+}
+
+}
+
+QList<DatabaseManager::Attachment> Attachments::list(sqlite3* db, int entryId) {
+    QList<DatabaseManager::Attachment> list;
+    if (!db) return list;
+
+    sqlite3_stmt* stmt;
+    const char* query = "SELECT a.id, a.name, b.size, b.sha256 FROM entry_attachments a "
+                        "JOIN attachment_blobs b ON b.id = a.blob_id WHERE a.entry_id = ? ORDER BY a.name";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return list;
+
+    sqlite3_bind_int(stmt, 1, entryId);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        DatabaseManager::Attachment a;
+        a.id = sqlite3_column_int(stmt, 0);
+        a.entryId = entryId;
+        a.name = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 1));
+        a.size = sqlite3_column_int64(stmt, 2);
+        a.sha256 = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 3));
+        list.append(a);
+    }
+
+    sqlite3_finalize(stmt);
+    return list;
+}
+
+int Attachments::add(sqlite3* db, int entryId, const QString& name, QIODevice* source) {
+    if (!db || !source || source->isSequential()) return -1;
+
+    // Hashing first means a file that is already stored is never written again
+    qint64 size = 0;
+    const QByteArray sha256 = hashContents(source, &size);
+    if (sha256.isEmpty() || size > sqlite3_limit(db, SQLITE_LIMIT_LENGTH, -1)) return -1;
+
+    // A replaced attachment goes through DELETE so the cleanup trigger sees it. This comes
+    // before the lookup, which then never picks a blob the trigger just released.
+    sqlite3_stmt* stmt;
+    const QByteArray utf8Name = name.toUtf8();
+    if (sqlite3_prepare_v2(db, "DELETE FROM entry_attachments WHERE entry_id = ? AND name = ?", -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    sqlite3_bind_int(stmt, 1, entryId);
+    sqlite3_bind_text(stmt, 2, utf8Name.constData(), -1, SQLITE_TRANSIENT);
+    bool ok = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    if (!ok) return -1;
+
+    qint64 blobId = existingBlob(db, sha256);
+    if (blobId < 0) {
+        blobId = storeBlob(db, sha256, size, source);
+        if (blobId < 0) return -1;
+    }
+
+    const char* query = "INSERT INTO entry_attachments (entry_id, name, blob_id) VALUES (?, ?, ?)";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    sqlite3_bind_int(stmt, 1, entryId);
+    sqlite3_bind_text(stmt, 2, utf8Name.constData(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_int64(stmt, 3, blobId);
+    ok = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    return ok ? (int)sqlite3_last_insert_rowid(db) : -1;
+}
+
+bool Attachments::write(sqlite3* db, int attachmentId, QIODevice* target) {
+    if (!db || !target) return false;
+
+    qint64 blobId = -1;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT blob_id FROM entry_attachments WHERE id = ?", -1, &stmt, nullptr) != SQLITE_OK) return false;
+    sqlite3_bind_int(stmt, 1, attachmentId);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        blobId = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    if (blobId < 0) return false;
+
+    sqlite3_blob* blob = nullptr;
+    if (sqlite3_blob_open(db, "main", "attachment_blobs", "data", blobId, 0, &blob) != SQLITE_OK) {
+        qCritical() << "Failed to open attachment blob:" << sqlite3_errmsg(db);
+        return false;
+    }
+
+    const int size = sqlite3_blob_bytes(blob);
+    QByteArray chunk(ChunkSize, '\0');
+    bool ok = true;
+    for (int offset = 0; ok && offset < size; offset += chunk.size()) {
+        const int length = qMin(chunk.size(), size - offset);
+        ok = sqlite3_blob_read(blob, chunk.data(), length, offset) == SQLITE_OK
+            && target->write(chunk.constData(), length) == length;
+    }
+    sqlite3_blob_close(blob);
+    return ok;
+}
+
+bool Attachments::remove(sqlite3* db, int attachmentId) {
+    if (!db) return false;
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "DELETE FROM entry_attachments WHERE id = ?", -1, &stmt, nullptr) != SQLITE_OK) return false;
+    sqlite3_bind_int(stmt, 1, attachmentId);
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE) && sqlite3_changes(db) > 0;
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+bool Attachments::copy(sqlite3* db, int fromEntryId, int toEntryId) {
+    if (!db) return false;
+
+    sqlite3_stmt* stmt;
+    const char* query = "INSERT INTO entry_attachments (entry_id, name, blob_id) "
+                        "SELECT ?, name, blob_id FROM entry_attachments WHERE entry_id = ?";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+    sqlite3_bind_int(stmt, 1, toEntryId);
+    sqlite3_bind_int(stmt, 2, fromEntryId);
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    return success;
+}
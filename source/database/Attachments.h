@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <sqlite3.h>
+
+#include "DatabaseManager.h"
+
+class QIODevice;
+
+// Files attached to entries. Contents live once per distinct SHA-256 in
+// attachment_blobs and are moved with incremental blob I/O, ChunkSize bytes
+// at a time, so a large file is never held in memory whole. Entry queries
+// never touch these tables.
+class Attachments {
+public:
+    static const int ChunkSize = 64 * 1024;
+
+    static QList<DatabaseManager::Attachment> list(sqlite3* db, int entryId);
+    // Reads source from its current position to the end; an attachment of the same name is replaced.
+    // Returns the new attachment id or -1. Runs inside the caller's transaction.
+    static int add(sqlite3* db, int entryId, const QString& name, QIODevice* source);
+    static bool write(sqlite3* db, int attachmentId, QIODevice* target);
+    static bool remove(sqlite3* db, int attachmentId);
+    // Points every attachment of one entry at another entry as well; the contents are shared
+    static bool copy(sqlite3* db, int fromEntryId, int toEntryId);
+};
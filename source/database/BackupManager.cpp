@@ -0,0 +1,208 @@
+#include "BackupManager.h"
+#include "BackupWorker.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSet>
+#include <QSettings>
+#include <QThread>
+
+namespace {
+
+const char* TimestampFormat = "yyyyMMdd-HHmmss";
+
+QDateTime timestampOf(const QString& fileName, const QString& baseName) {
+    return QDateTime::fromString(fileName.mid(baseName.size() + 1, 15), TimestampFormat);
+}
+
+}
+
+BackupManager::BackupManager(DatabaseManager& database, QObject* parent)
+    : QObject(parent), m_database(database) {
+    m_timer = new QTimer(this);
+    connect(m_timer, &QTimer::timeout, this, &BackupManager::onTimeout);
+    connect(&m_database, &DatabaseManager::databaseModified, this, &BackupManager::onDatabaseModified);
+
+    setPolicy(loadPolicy());
+}
+
+BackupManager::~BackupManager() {
+    if (m_thread) {
+        if (m_worker) {
+            m_worker->cancel();
+        }
+        m_thread->quit();
+        m_thread->wait();
+    }
+}
+
+BackupManager::Policy BackupManager::loadPolicy() {
+    Policy policy;
+    QSettings settings;
+    settings.beginGroup("backup");
+    policy.enabled = settings.value("enabled", policy.enabled).toBool();
+    policy.intervalMinutes = settings.value("intervalMinutes", policy.intervalMinutes).toInt();
+    policy.writesThreshold = settings.value("writesThreshold", policy.writesThreshold).toInt();
+    policy.keepLast = settings.value("keepLast", policy.keepLast).toInt();
+    policy.keepHourly = settings.value("keepHourly", policy.keepHourly).toInt();
+    policy.keepDaily = settings.value("keepDaily", policy.keepDaily).toInt();
+    settings.endGroup();
+    return policy;
+}
+
+void BackupManager::savePolicy(const Policy& policy) {
+    QSettings settings;
+    settings.beginGroup("backup");
+    settings.setValue("enabled", policy.enabled);
+    settings.setValue("intervalMinutes", policy.intervalMinutes);
+    settings.setValue("writesThreshold", policy.writesThreshold);
+    settings.setValue("keepLast", policy.keepLast);
+    settings.setValue("keepHourly", policy.keepHourly);
+    settings.setValue("keepDaily", policy.keepDaily);
+    settings.endGroup();
+}
+
+void BackupManager::setPolicy(const Policy& policy) {
+    m_policy = policy;
+    if (m_policy.enabled && m_policy.intervalMinutes > 0) {
+        m_timer->start(m_policy.intervalMinutes * 60 * 1000);
+    } else {
+        m_timer->stop();
+    }
+}
+
+BackupManager::Policy BackupManager::policy() const {
+    return m_policy;
+}
+
+bool BackupManager::isRunning() const {
+    return m_thread != nullptr;
+}
+
+QString BackupManager::backupDirectory(const QString& vaultPath) {
+    QFileInfo info(vaultPath);
+    return info.absoluteDir().filePath(info.completeBaseName() + ".backups");
+}
+
+QStringList BackupManager::backups(const QString& vaultPath) {
+    const QString baseName = QFileInfo(vaultPath).completeBaseName();
+    QDir dir(backupDirectory(vaultPath));
+
+    // The timestamp in the name sorts chronologically
+    QStringList files = dir.entryList({baseName + "-*.db"}, QDir::Files, QDir::Name | QDir::Reversed);
+    QStringList paths;
+    for (const QString& file : files) {
+        paths.append(dir.filePath(file));
+    }
+    return paths;
+}
+
+bool BackupManager::backupNow() {
+    if (m_thread || !m_database.isOpen()) return false;
+
+    const QString vaultPath = m_database.path();
+    QDir dir(backupDirectory(vaultPath));
+    if (!dir.exists() && !dir.mkpath(".")) {
+        qWarning() << "Failed to create backup directory:" << dir.path();
+        return false;
+    }
+
+    QString name = QFileInfo(vaultPath).completeBaseName() + "-" + QDateTime::currentDateTime().toString(TimestampFormat);
+    QString targetPath = dir.filePath(name + ".db");
+    for (int i = 1; QFile::exists(targetPath); ++i) {
+        targetPath = dir.filePath(QString("%1-%2.db").arg(name).arg(i));
+    }
+
+    m_writesSinceBackup = 0;
+    m_thread = new QThread();
+    m_worker = new BackupWorker(m_database.readerPool(), m_database.connectionInfo(), targetPath);
+    m_worker->moveToThread(m_thread);
+
+    connect(m_thread, &QThread::started, m_worker, &BackupWorker::run);
+    connect(m_worker, &BackupWorker::progress, this, [this](int remaining, int total) {
+        if (total > 0) {
+            emit backupProgress(100 - (int)((qint64)remaining * 100 / total));
+        }
+    });
+    connect(m_worker, &BackupWorker::finished, this, &BackupManager::onWorkerFinished);
+    connect(m_worker, &BackupWorker::finished, m_thread, &QThread::quit);
+    connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_thread, &QThread::finished, m_thread, &QObject::deleteLater);
+
+    m_thread->start(QThread::LowPriority);
+    return true;
+}
+
+void BackupManager::onDatabaseModified() {
+    ++m_writesSinceBackup;
+    if (m_policy.enabled && m_policy.writesThreshold > 0 && m_writesSinceBackup >= m_policy.writesThreshold) {
+        backupNow();
+    }
+}
+
+void BackupManager::onTimeout() {
+    // Nothing to capture if the vault has not changed since the last generation
+    if (m_writesSinceBackup > 0) {
+        backupNow();
+    }
+}
+
+void BackupManager::onWorkerFinished(bool success, const QString& path, qint64 bytes, qint64 msecs, const QString& error) {
+    m_worker = nullptr;
+    m_thread = nullptr;
+
+    double megabytesPerSecond = 0.0;
+    if (success) {
+        megabytesPerSecond = (bytes / (1024.0 * 1024.0)) / (qMax<qint64>(msecs, 1) / 1000.0);
+        qInfo() << "Backup written to" << path << "in" << msecs << "ms," << megabytesPerSecond << "MB/s";
+        rotate();
+    } else {
+        qWarning() << "Backup to" << path << "failed:" << error;
+    }
+
+    emit backupFinished(success, path, megabytesPerSecond);
+}
+
+void BackupManager::rotate() {
+    const QString baseName = QFileInfo(m_database.path()).completeBaseName();
+    const QStringList paths = backups(m_database.path());
+
+    // Keep the newest few, plus the newest backup of each recent hour and day
+    QSet<QString> keep;
+    QSet<QString> hours;
+    QSet<QString> days;
+    for (int i = 0; i < paths.size(); ++i) {
+        const QString& path = paths.at(i);
+        QDateTime taken = timestampOf(QFileInfo(path).fileName(), baseName);
+        if (i < m_policy.keepLast) {
+            keep.insert(path);
+        }
+        if (!taken.isValid()) {
+            continue;
+        }
+
+        QString hour = taken.toString("yyyyMMddHH");
+        if (hours.size() < m_policy.keepHourly && !hours.contains(hour)) {
+            hours.insert(hour);
+            keep.insert(path);
+        }
+
+        QString day = taken.toString("yyyyMMdd");
+        if (days.size() < m_policy.keepDaily && !days.contains(day)) {
+            days.insert(day);
+            keep.insert(path);
+        }
+    }
+
+    for (const QString& path : paths) {
+        if (keep.contains(path)) continue;
+        if (!QFile::remove(path)) {
+            qWarning() << "Failed to remove old backup:" << path;
+            continue;
+        }
+        QFile::remove(DatabaseManager::cipherProfilePath(path));
+    }
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+#include "DatabaseManager.h"
+
+class QThread;
+class BackupWorker;
+
+// Schedules encrypted online backups of an open vault and rotates old generations.
+class BackupManager : public QObject {
+    Q_OBJECT
+
+public:
+    struct Policy {
+        bool enabled = true;
+        int intervalMinutes = 30;   // 0 disables timed backups
+        int writesThreshold = 50;   // 0 disables backups after a number of writes
+        int keepLast = 5;
+        int keepHourly = 24;
+        int keepDaily = 7;
+    };
+
+    explicit BackupManager(DatabaseManager& database, QObject* parent = nullptr);
+    ~BackupManager() override;
+
+    static Policy loadPolicy();
+    static void savePolicy(const Policy& policy);
+    void setPolicy(const Policy& policy);
+    Policy policy() const;
+
+    bool backupNow();
+    bool isRunning() const;
+
+    static QString backupDirectory(const QString& vaultPath);
+    // Newest first
+    static QStringList backups(const QString& vaultPath);
+
+signals:
+    void backupProgress(int percent);
+    void backupFinished(bool success, const QString& path, double megabytesPerSecond);
+
+private:
+    void onDatabaseModified();
+    void onTimeout();
+    void onWorkerFinished(bool success, const QString& path, qint64 bytes, qint64 msecs, const QString& error);
+    void rotate();
+
+    DatabaseManager& m_database;
+    Policy m_policy;
+    QTimer* m_timer = nullptr;
+    int m_writesSinceBackup = 0;
+
+    QPointer<QThread> m_thread;
+    QPointer<BackupWorker> m_worker;
+};
@@ -0,0 +1,39 @@
+#include "./BackupSettingsDialog.h"
+#include "./ui_BackupSettingsDialog.h"
+
+BackupSettingsDialog::BackupSettingsDialog(const BackupManager::Policy& policy, const QString& directory, QWidget *parent)
+  : QDialog(parent), ui(new Ui::BackupSettingsDialog) {
+  ui->setupUi(this);
+  setWindowTitle(tr("Backup Settings"));
+
+  ui->enabledCheckBox->setChecked(policy.enabled);
+  ui->intervalSpinBox->setValue(policy.intervalMinutes);
+  ui->writesSpinBox->setValue(policy.writesThreshold);
+  ui->keepLastSpinBox->setValue(policy.keepLast);
+  ui->keepHourlySpinBox->setValue(policy.keepHourly);
+  ui->keepDailySpinBox->setValue(policy.keepDaily);
+  ui->directoryLabel->setText(tr("Backups are stored encrypted in %1").arg(directory));
+
+  // Rotation still applies to manual backups, only the schedule depends on the switch
+  auto updateSchedule = [this](bool enabled) {
+    ui->intervalSpinBox->setEnabled(enabled);
+    ui->writesSpinBox->setEnabled(enabled);
+  };
+  connect(ui->enabledCheckBox, &QCheckBox::toggled, this, updateSchedule);
+  updateSchedule(policy.enabled);
+}
+
+BackupSettingsDialog::~BackupSettingsDialog() {
+  delete ui;
+}
+
+BackupManager::Policy BackupSettingsDialog::getPolicy() const {
+  BackupManager::Policy policy;
+  policy.enabled = ui->enabledCheckBox->isChecked();
+  policy.intervalMinutes = ui->intervalSpinBox->value();
+  policy.writesThreshold = ui->writesSpinBox->value();
+  policy.keepLast = ui->keepLastSpinBox->value();
+  policy.keepHourly = ui->keepHourlySpinBox->value();
+  policy.keepDaily = ui->keepDailySpinBox->value();
+  return policy;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <QDialog>
+#include <QString>
+
+#include "./BackupManager.h"
+
+namespace Ui {
+  class BackupSettingsDialog;
+}
+
+class BackupSettingsDialog : public QDialog {
+  Q_OBJECT
+
+  public:
+    explicit BackupSettingsDialog(const BackupManager::Policy& policy, const QString& directory, QWidget *parent = nullptr);
+    ~BackupSettingsDialog();
+
+    BackupManager::Policy getPolicy() const;
+
+  private:
+    Ui::BackupSettingsDialog *ui;
+};
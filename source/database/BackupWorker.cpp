@@ -0,0 +1,96 @@
+#include "BackupWorker.h"
+#include "CipherKey.h"
+
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QThread>
+
+BackupWorker::BackupWorker(const QSharedPointer<ReaderPool>& readers, const DatabaseManager::ConnectionInfo& source,
+                           const QString& targetPath, QObject* parent)
+    : QObject(parent), m_readers(readers), m_source(source), m_targetPath(targetPath) {
+}
+
+BackupWorker::~BackupWorker() {
+    CipherKey::wipe(m_source.keySpec);
+}
+
+void BackupWorker::cancel() {
+    m_cancelled = true;
+}
+
+void BackupWorker::run() {
+    QElapsedTimer timer;
+    timer.start();
+
+    // Written under a temporary name so an interrupted run never looks like a generation
+    const QString partPath = m_targetPath + ".part";
+    QFile::remove(partPath);
+
+    QString error;
+    ReaderPool::Lease lease = m_readers ? m_readers->acquire(&error) : ReaderPool::Lease();
+    if (!lease.isValid()) {
+        emit finished(false, m_targetPath, 0, timer.elapsed(), error);
+        return;
+    }
+    sqlite3* source = lease.db();
+
+    // Same key spec, so the copy shares key and salt with the vault, as the backup API requires
+    DatabaseManager::ConnectionInfo targetInfo{partPath, m_source.keySpec, m_source.profile};
+    sqlite3* target = DatabaseManager::openConnection(targetInfo, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, &error);
+    if (!target) {
+        emit finished(false, m_targetPath, 0, timer.elapsed(), error);
+        return;
+    }
+
+    sqlite3_backup* backup = sqlite3_backup_init(target, "main", source, "main");
+    if (!backup) {
+        error = QString("Failed to start backup: %1").arg(sqlite3_errmsg(target));
+        sqlite3_close(target);
+        QFile::remove(partPath);
+        emit finished(false, m_targetPath, 0, timer.elapsed(), error);
+        return;
+    }
+
+    int rc;
+    do {
+        rc = sqlite3_backup_step(backup, PagesPerStep);
+        emit progress(sqlite3_backup_remaining(backup), sqlite3_backup_pagecount(backup));
+
+        // The reader keeps its snapshot across steps, so edits never restart the copy;
+        // busy results can only come from the target file
+        if (rc == SQLITE_BUSY || rc == SQLITE_LOCKED) {
+            QThread::msleep(50);
+        } else if (rc == SQLITE_OK) {
+            QThread::yieldCurrentThread();
+        }
+    } while ((rc == SQLITE_OK || rc == SQLITE_BUSY || rc == SQLITE_LOCKED) && !m_cancelled && !m_readers->isShutDown());
+
+    qint64 bytes = (qint64)sqlite3_backup_pagecount(backup) * m_source.profile.pageSize;
+    sqlite3_backup_finish(backup);
+
+    bool success = (rc == SQLITE_DONE);
+    if (!success) {
+        error = (m_cancelled || m_readers->isShutDown()) ? QString("Cancelled") : QString("Backup step failed: %1").arg(sqlite3_errstr(rc));
+    }
+
+    sqlite3_close(target);
+    lease.release();
+
+    if (success && !QFile::rename(partPath, m_targetPath)) {
+        error = QString("Failed to move the backup into place: %1").arg(m_targetPath);
+        success = false;
+    }
+    // The copy is keyed like the vault, so it needs the vault's profile to open
+    if (success && !DatabaseManager::saveCipherProfile(m_targetPath, m_source.profile)) {
+        error = QString("Failed to write the profile of %1").arg(m_targetPath);
+        QFile::remove(m_targetPath);
+        success = false;
+    }
+    if (!success) {
+        qWarning() << "Backup failed:" << error;
+        QFile::remove(partPath);
+    }
+
+    emit finished(success, m_targetPath, bytes, timer.elapsed(), error);
+}
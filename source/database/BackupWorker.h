@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <atomic>
+
+#include "DatabaseManager.h"
+#include "ReaderPool.h"
+
+// Copies an open vault with the online backup API, a few pages at a time.
+// The source is a pooled reader, so the copy is one consistent snapshot even
+// while the vault is being edited. Meant to run on a worker thread.
+class BackupWorker : public QObject {
+    Q_OBJECT
+
+public:
+    static const int PagesPerStep = 64;
+
+    BackupWorker(const QSharedPointer<ReaderPool>& readers, const DatabaseManager::ConnectionInfo& source,
+                 const QString& targetPath, QObject* parent = nullptr);
+    ~BackupWorker() override;
+
+    void cancel();
+
+public slots:
+    void run();
+
+signals:
+    void progress(int remaining, int total);
+    void finished(bool success, const QString& path, qint64 bytes, qint64 msecs, const QString& error);
+
+private:
+    QSharedPointer<ReaderPool> m_readers;
+    DatabaseManager::ConnectionInfo m_source;
+    QString m_targetPath;
+    std::atomic<bool> m_cancelled{false};
+};
@@ -0,0 +1,146 @@
+#include "./ChangePasswordDialog.h"
+#include "./ui_ChangePasswordDialog.h"
+#include "./DatabaseManager.h"
+
+#include <QFutureWatcher>
+#include <QPushButton>
+#include <QtConcurrent>
+
+ChangePasswordDialog::ChangePasswordDialog(DatabaseManager& database, QWidget *parent)
+  : QDialog(parent), ui(new Ui::ChangePasswordDialog), m_database(database) {
+  ui->setupUi(this);
+  setWindowTitle(tr("Change Master Password"));
+
+  // Start from the profile the vault is currently keyed with
+  DatabaseManager::CipherProfile profile = m_database.cipherProfile();
+  ui->kdfIterationsSpinBox->setValue(profile.kdfIterations);
+  for (int pageSize : {1024, 2048, 4096, 8192, 16384, 32768, 65536}) {
+    ui->pageSizeComboBox->addItem(QString::number(pageSize), pageSize);
+  }
+  ui->pageSizeComboBox->setCurrentIndex(ui->pageSizeComboBox->findData(profile.pageSize));
+
+  connect(ui->buttonBox, &QDialogButtonBox::accepted, this, &ChangePasswordDialog::accept);
+  connect(ui->buttonBox, &QDialogButtonBox::rejected, this, &ChangePasswordDialog::reject);
+  connect(ui->currentPasswordEdit, &QLineEdit::textChanged, this, &ChangePasswordDialog::validateInputs);
+  connect(ui->newPasswordEdit, &QLineEdit::textChanged, this, &ChangePasswordDialog::validateInputs);
+  connect(ui->confirmPasswordEdit, &QLineEdit::textChanged, this, &ChangePasswordDialog::validateInputs);
+
+  m_verifyWatcher = new QFutureWatcher<bool>(this);
+  connect(m_verifyWatcher, &QFutureWatcher<bool>::finished, this, &ChangePasswordDialog::onPasswordVerified);
+
+  connect(&m_database, &DatabaseManager::passwordChangeProgress, this, &ChangePasswordDialog::onProgress);
+  connect(&m_database, &DatabaseManager::passwordChangeFinished, this, &ChangePasswordDialog::onFinished);
+
+  validateInputs();
+}
+
+ChangePasswordDialog::~ChangePasswordDialog() {
+  delete ui;
+}
+
+void ChangePasswordDialog::accept() {
+  if (m_running || m_verifyWatcher->isRunning()) return;
+
+  // Checking the current password costs a full KDF run, so it happens on a worker thread
+  setVerifying(true);
+  const DatabaseManager::ConnectionInfo info = m_database.connectionInfo();
+  const QString password = ui->currentPasswordEdit->text();
+  m_verifyWatcher->setFuture(QtConcurrent::run([info, password]() {
+    return DatabaseManager::verifyPassword(info, password);
+  }));
+}
+
+void ChangePasswordDialog::onPasswordVerified() {
+  setVerifying(false);
+  if (!m_verifyWatcher->result()) {
+    ui->errorLabel->setText(tr("Current password is incorrect"));
+    return;
+  }
+
+  DatabaseManager::CipherProfile profile;
+  profile.kdfIterations = ui->kdfIterationsSpinBox->value();
+  profile.pageSize = ui->pageSizeComboBox->currentData().toInt();
+
+  ui->errorLabel->clear();
+  if (m_database.changePassword(ui->newPasswordEdit->text(), profile)) {
+    setRunning(true);
+  } else {
+    ui->errorLabel->setText(tr("Failed to start the password change"));
+  }
+}
+
+void ChangePasswordDialog::reject() {
+  // The KDF cannot be interrupted; its result is dropped when it finishes
+  if (m_verifyWatcher->isRunning()) {
+    m_verifyWatcher->disconnect(this);
+    QDialog::reject();
+    return;
+  }
+
+  // Closing waits for the worker to notice the cancellation and clean up
+  if (m_running) {
+    m_cancelRequested = true;
+    m_database.cancelPasswordChange();
+    return;
+  }
+  QDialog::reject();
+}
+
+void ChangePasswordDialog::validateInputs() {
+  bool valid = true;
+  QString error;
+
+  if (ui->currentPasswordEdit->text().isEmpty()) {
+    valid = false;
+  }
+
+  if (ui->newPasswordEdit->text() != ui->confirmPasswordEdit->text()) {
+    error = tr("Passwords do not match");
+    valid = false;
+  } else if (ui->newPasswordEdit->text().length() < 8) {
+    error = tr("Password must be at least 8 characters long");
+    valid = false;
+  }
+
+  ui->errorLabel->setText(error);
+  ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(valid);
+}
+
+void ChangePasswordDialog::onProgress(int percent) {
+  ui->progressBar->setValue(percent);
+}
+
+void ChangePasswordDialog::onFinished(bool success, const QString& error) {
+  setRunning(false);
+  if (success) {
+    QDialog::accept();
+    return;
+  }
+
+  // Cancelling leaves the vault untouched, so the dialog can simply go away
+  if (m_cancelRequested) {
+    QDialog::reject();
+    return;
+  }
+  ui->errorLabel->setText(error);
+}
+
+void ChangePasswordDialog::setRunning(bool running) {
+  m_running = running;
+  ui->passwordGroupBox->setEnabled(!running);
+  ui->profileGroupBox->setEnabled(!running);
+  ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!running);
+  ui->progressBar->setVisible(running);
+  ui->progressBar->setRange(0, 100);
+  ui->progressBar->setValue(0);
+}
+
+void ChangePasswordDialog::setVerifying(bool verifying) {
+  ui->passwordGroupBox->setEnabled(!verifying);
+  ui->profileGroupBox->setEnabled(!verifying);
+  ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!verifying);
+  ui->errorLabel->setText(verifying ? tr("Checking the current password...") : QString());
+  // No progress callback from the KDF, so the bar just shows it is busy
+  ui->progressBar->setRange(0, verifying ? 0 : 100);
+  ui->progressBar->setVisible(verifying);
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <QDialog>
+#include <QString>
+
+class DatabaseManager;
+template <typename T> class QFutureWatcher;
+
+namespace Ui {
+  class ChangePasswordDialog;
+}
+
+class ChangePasswordDialog : public QDialog {
+  Q_OBJECT
+
+  public:
+    explicit ChangePasswordDialog(DatabaseManager& database, QWidget *parent = nullptr);
+    ~ChangePasswordDialog();
+
+  public slots:
+    void accept() override;
+    void reject() override;
+
+  private slots:
+    void validateInputs();
+    void onProgress(int percent);
+    void onFinished(bool success, const QString& error);
+    void onPasswordVerified();
+
+  private:
+    void setRunning(bool running);
+    void setVerifying(bool verifying);
+
+    Ui::ChangePasswordDialog *ui;
+    DatabaseManager& m_database;
+    bool m_running = false;
+    bool m_cancelRequested = false;
+    QFutureWatcher<bool>* m_verifyWatcher = nullptr;
+};
@@ -0,0 +1,46 @@
+#include "CipherKey.h"
+
+#include <QDebug>
+#include <QFile>
+
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+
+QByteArray CipherKey::derive(const QString& path, const QByteArray& password, int kdfIterations) {
+    QByteArray salt = readSalt(path);
+    if (salt.size() != SaltLength) {
+        qWarning() << "Failed to read the vault salt:" << path;
+        return QByteArray();
+    }
+
+    QByteArray key(KeyLength, '\0');
+    int ok = PKCS5_PBKDF2_HMAC(password.constData(), password.size(),
+                               reinterpret_cast<const unsigned char*>(salt.constData()), salt.size(),
+                               kdfIterations, EVP_sha512(),
+                               key.size(), reinterpret_cast<unsigned char*>(key.data()));
+    if (!ok) {
+        qCritical() << "Key derivation failed";
+        wipe(key);
+        return QByteArray();
+    }
+
+    QByteArray hexKey = key.toHex();
+    QByteArray spec = "x'" + hexKey + salt.toHex() + "'";
+    wipe(key);
+    wipe(hexKey);
+    return spec;
+}
+
+QByteArray CipherKey::readSalt(const QString& path) {
+    // SQLCipher 4 stores the salt in the first bytes of the file
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) return QByteArray();
+    return file.read(SaltLength);
+}
+
+void CipherKey::wipe(QByteArray& key) {
+    if (!key.isEmpty()) {
+        OPENSSL_cleanse(key.data(), key.size());
+    }
+    key.clear();
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+// Raw SQLCipher key specs ("x'<key><salt>'").
+// Keying a connection with one skips the KDF, and connections keyed with the same
+// spec share key and salt, which the backup API requires.
+class CipherKey {
+public:
+    static const int KeyLength = 32;
+    static const int SaltLength = 16;
+
+    // Runs the KDF SQLCipher 4 would run (PBKDF2-HMAC-SHA512) against the salt in the vault header
+    static QByteArray derive(const QString& path, const QByteArray& password, int kdfIterations);
+    static QByteArray readSalt(const QString& path);
+
+    static void wipe(QByteArray& key);
+};
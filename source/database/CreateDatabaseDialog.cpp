@@ -1,5 +1,6 @@
 #include "./CreateDatabaseDialog.h"
 #include "./ui_CreateDatabaseDialog.h"
+#include "../utils/Trace.h"
 
 #include <QFileDialog>
 #include <QMessageBox>
@@ -7,6 +8,7 @@
 
 CreateDatabaseDialog::CreateDatabaseDialog(QWidget *parent)
   : QDialog(parent), ui(new Ui::CreateDatabaseDialog) {
+  Trace::Span span("CreateDatabaseDialog::CreateDatabaseDialog");
   ui->setupUi(this);
   setWindowTitle(tr("Create Database"));
 
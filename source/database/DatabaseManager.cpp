@@ -1,18 +1,278 @@
 #include "DatabaseManager.h"
+#include "RekeyWorker.h"
+#include "ReaderPool.h"
+#include "CipherKey.h"
+#include "EntryHistory.h"
+#include "Attachments.h"
+#include "SearchQuery.h"
+#include "RecycleBin.h"
+#include "TypedQuery.h"
+#include "../utils/Totp.h"
+#include "../utils/Trace.h"
 
 #include <QDebug>
 #include <QFile>
 #include <QFileInfo>
+#include <QThread>
+#include <QTimer>
+#include <QSettings>
+#include <QCryptographicHash>
 
-DatabaseManager& DatabaseManager::instance() {
-    static DatabaseManager instance;
-    return instance;
+#include <algorithm>
+#include <filesystem>
+
+namespace Sql {
+
+template <>
+struct Mapping<DatabaseManager::Entry> {
+    using Entry = DatabaseManager::Entry;
+    static constexpr auto columns = std::make_tuple(&Entry::id, &Entry::groupId, &Entry::title, &Entry::username,
+                                                    &Entry::password, &Entry::url, &Entry::notes, &Entry::otp);
+};
+
+template <>
+struct Mapping<DatabaseManager::Group> {
+    using Group = DatabaseManager::Group;
+    static constexpr auto columns = std::make_tuple(&Group::id, &Group::name, &Group::parentId);
+};
+
+}
+
+namespace {
+
+// Installed on the main connection while a password change copies the vault
+int denyWrites(void*, int action, const char*, const char*, const char*, const char*) {
+    switch (action) {
+    case SQLITE_INSERT:
+    case SQLITE_UPDATE:
+    case SQLITE_DELETE:
+    case SQLITE_CREATE_INDEX:
+    case SQLITE_CREATE_TABLE:
+    case SQLITE_CREATE_TRIGGER:
+    case SQLITE_DROP_INDEX:
+    case SQLITE_DROP_TABLE:
+    case SQLITE_DROP_TRIGGER:
+    case SQLITE_ALTER_TABLE:
+        return SQLITE_DENY;
+    default:
+        return SQLITE_OK;
+    }
+}
+
+// Where versions before the profile file kept it; read once to write the file
+QString legacyProfileKey(const QString& path) {
+    QByteArray absolutePath = QFileInfo(path).absoluteFilePath().toUtf8();
+    return "cipherProfiles/" + QCryptographicHash::hash(absolutePath, QCryptographicHash::Sha256).toHex();
+}
+
+// Schema changes applied in order on open; PRAGMA user_version counts how many have run
+const char* const Migrations[] = {
+    // 1: incremental reload looks entries up by modification time
+    "CREATE INDEX IF NOT EXISTS idx_entries_modified_at ON entries(modified_at);",
+    // 2: stable ids for merging copies of a vault. Existing rows get ids built from what
+    // diverged copies still share, so copies upgraded separately agree on them.
+    "ALTER TABLE groups ADD COLUMN uuid TEXT;"
+    "ALTER TABLE groups ADD COLUMN modified_at DATETIME;"
+    "ALTER TABLE entries ADD COLUMN uuid TEXT;"
+    "UPDATE groups SET uuid = 'legacy-group-' || id || '-' || name, modified_at = CURRENT_TIMESTAMP;"
+    "UPDATE entries SET uuid = 'legacy-entry-' || id || '-' || COALESCE(created_at, '');"
+    "CREATE UNIQUE INDEX idx_groups_uuid ON groups(uuid);"
+    "CREATE UNIQUE INDEX idx_entries_uuid ON entries(uuid);"
+    "CREATE TRIGGER groups_assign_uuid AFTER INSERT ON groups WHEN NEW.uuid IS NULL BEGIN"
+    "  UPDATE groups SET uuid = lower(hex(randomblob(16))), modified_at = CURRENT_TIMESTAMP WHERE id = NEW.id;"
+    " END;"
+    "CREATE TRIGGER entries_assign_uuid AFTER INSERT ON entries WHEN NEW.uuid IS NULL BEGIN"
+    "  UPDATE entries SET uuid = lower(hex(randomblob(16))) WHERE id = NEW.id;"
+    " END;",
+    // 3: browser extensions allowed to request logins, with the key each one proves itself with
+    "CREATE TABLE IF NOT EXISTS autofill_clients (id TEXT PRIMARY KEY, key BLOB NOT NULL, created_at DATETIME DEFAULT CURRENT_TIMESTAMP);",
+    // 4: lookup attributes of Secret Service items; the index answers each attribute of a search
+    "CREATE TABLE IF NOT EXISTS entry_attributes (entry_id INTEGER NOT NULL, name TEXT NOT NULL, value TEXT NOT NULL,"
+    " PRIMARY KEY (entry_id, name), FOREIGN KEY(entry_id) REFERENCES entries(id) ON DELETE CASCADE);"
+    "CREATE INDEX IF NOT EXISTS idx_entry_attributes_lookup ON entry_attributes(name, value, entry_id);",
+    // 5: one-time password settings, kept as an otpauth:// URI
+    "ALTER TABLE entries ADD COLUMN otp TEXT;",
+    // 6: past versions of entries, see EntryHistory; the index serves listing, rebuilding and pruning
+    "CREATE TABLE IF NOT EXISTS entry_history (id INTEGER PRIMARY KEY AUTOINCREMENT, entry_id INTEGER NOT NULL,"
+    " version INTEGER NOT NULL, changed_at DATETIME DEFAULT CURRENT_TIMESTAMP, snapshot INTEGER NOT NULL, data BLOB NOT NULL,"
+    " FOREIGN KEY(entry_id) REFERENCES entries(id) ON DELETE CASCADE);"
+    "CREATE UNIQUE INDEX IF NOT EXISTS idx_entry_history_version ON entry_history(entry_id, version);",
+    // 7: attachments, see Attachments. Contents are shared by hash and dropped with their last reference.
+    "CREATE TABLE IF NOT EXISTS attachment_blobs (id INTEGER PRIMARY KEY, sha256 TEXT NOT NULL UNIQUE,"
+    " size INTEGER NOT NULL, data BLOB NOT NULL);"
+    "CREATE TABLE IF NOT EXISTS entry_attachments (id INTEGER PRIMARY KEY AUTOINCREMENT, entry_id INTEGER NOT NULL,"
+    " name TEXT NOT NULL, blob_id INTEGER NOT NULL, added_at DATETIME DEFAULT CURRENT_TIMESTAMP, UNIQUE(entry_id, name),"
+    " FOREIGN KEY(entry_id) REFERENCES entries(id) ON DELETE CASCADE, FOREIGN KEY(blob_id) REFERENCES attachment_blobs(id));"
+    "CREATE INDEX IF NOT EXISTS idx_entry_attachments_blob ON entry_attachments(blob_id);"
+    "CREATE TRIGGER IF NOT EXISTS attachment_blobs_release AFTER DELETE ON entry_attachments BEGIN"
+    "  DELETE FROM attachment_blobs WHERE id = OLD.blob_id"
+    "   AND NOT EXISTS (SELECT 1 FROM entry_attachments WHERE blob_id = OLD.blob_id);"
+    " END;",
+    // 8: tags, see TagIndex. Names are stored normalized; a tag goes away with its last entry.
+    "CREATE TABLE IF NOT EXISTS tags (id INTEGER PRIMARY KEY, name TEXT NOT NULL UNIQUE);"
+    "CREATE TABLE IF NOT EXISTS entry_tags (entry_id INTEGER NOT NULL, tag_id INTEGER NOT NULL,"
+    " PRIMARY KEY(entry_id, tag_id), FOREIGN KEY(entry_id) REFERENCES entries(id) ON DELETE CASCADE,"
+    " FOREIGN KEY(tag_id) REFERENCES tags(id) ON DELETE CASCADE) WITHOUT ROWID;"
+    "CREATE INDEX IF NOT EXISTS idx_entry_tags_tag ON entry_tags(tag_id, entry_id);"
+    "CREATE TRIGGER IF NOT EXISTS tags_release AFTER DELETE ON entry_tags BEGIN"
+    "  DELETE FROM tags WHERE id = OLD.tag_id AND NOT EXISTS (SELECT 1 FROM entry_tags WHERE tag_id = OLD.tag_id);"
+    " END;",
+    // 9: group filters in searches and group views
+    "CREATE INDEX IF NOT EXISTS idx_entries_group_id ON entries(group_id);"
+    "CREATE INDEX IF NOT EXISTS idx_groups_parent_id ON groups(parent_id);",
+    // 10: how often and when each entry was last used, for ranking quick access
+    "CREATE TABLE IF NOT EXISTS entry_usage (entry_id INTEGER PRIMARY KEY, use_count INTEGER NOT NULL,"
+    " last_used INTEGER NOT NULL, FOREIGN KEY(entry_id) REFERENCES entries(id) ON DELETE CASCADE);",
+    // 11: closure of the group tree, one row per ancestor/descendant pair including each group
+    // itself. Kept by triggers, so merges and other connections maintain it as well.
+    "CREATE TABLE IF NOT EXISTS group_closure (ancestor INTEGER NOT NULL, descendant INTEGER NOT NULL,"
+    " depth INTEGER NOT NULL, PRIMARY KEY(ancestor, descendant)) WITHOUT ROWID;"
+    "CREATE INDEX IF NOT EXISTS idx_group_closure_descendant ON group_closure(descendant, ancestor);"
+    "INSERT INTO group_closure (ancestor, descendant, depth)"
+    " WITH RECURSIVE walk(ancestor, descendant, depth) AS (SELECT id, id, 0 FROM groups"
+    "  UNION ALL SELECT walk.ancestor, g.id, walk.depth + 1 FROM groups g JOIN walk ON g.parent_id = walk.descendant)"
+    " SELECT ancestor, descendant, depth FROM walk;"
+    "CREATE TRIGGER IF NOT EXISTS groups_closure_insert AFTER INSERT ON groups BEGIN"
+    "  INSERT INTO group_closure (ancestor, descendant, depth)"
+    "   SELECT ancestor, NEW.id, depth + 1 FROM group_closure WHERE descendant = NEW.parent_id"
+    "   UNION ALL SELECT NEW.id, NEW.id, 0;"
+    " END;"
+    "CREATE TRIGGER IF NOT EXISTS groups_closure_delete AFTER DELETE ON groups BEGIN"
+    "  DELETE FROM group_closure WHERE descendant = OLD.id;"
+    "  DELETE FROM group_closure WHERE ancestor = OLD.id;"
+    " END;"
+    "CREATE TRIGGER IF NOT EXISTS groups_closure_move AFTER UPDATE OF parent_id ON groups"
+    " WHEN OLD.parent_id IS NOT NEW.parent_id BEGIN"
+    "  DELETE FROM group_closure WHERE descendant IN (SELECT descendant FROM group_closure WHERE ancestor = NEW.id)"
+    "   AND ancestor NOT IN (SELECT descendant FROM group_closure WHERE ancestor = NEW.id);"
+    "  INSERT INTO group_closure (ancestor, descendant, depth)"
+    "   SELECT a.ancestor, d.descendant, a.depth + d.depth + 1 FROM group_closure a, group_closure d"
+    "   WHERE a.descendant = NEW.parent_id AND d.ancestor = NEW.id;"
+    " END;",
+    // 12: soft delete. Deleted items sit in the recycle-bin group until the retention period
+    // runs out, remembering where they came from.
+    "ALTER TABLE groups ADD COLUMN deleted_at DATETIME;"
+    "ALTER TABLE groups ADD COLUMN restore_parent_id INTEGER;"
+    "ALTER TABLE groups ADD COLUMN is_recycle_bin INTEGER NOT NULL DEFAULT 0;"
+    "CREATE UNIQUE INDEX IF NOT EXISTS idx_groups_recycle_bin ON groups(is_recycle_bin) WHERE is_recycle_bin = 1;"
+    "ALTER TABLE entries ADD COLUMN deleted_at DATETIME;"
+    "ALTER TABLE entries ADD COLUMN restore_group_id INTEGER;"
+    "CREATE INDEX IF NOT EXISTS idx_entries_deleted_at ON entries(deleted_at) WHERE deleted_at IS NOT NULL;",
+    // 13: the recycle bin becomes a top-level group, so deleting a user group never involves it
+    "UPDATE groups SET parent_id = NULL, modified_at = CURRENT_TIMESTAMP WHERE is_recycle_bin = 1;",
+};
+
+using Entry = DatabaseManager::Entry;
+using Group = DatabaseManager::Group;
+using OptionalText = std::optional<QString>;
+
+// Entry rows are read in the column order of Sql::Mapping<Entry>
+constexpr Sql::Query<Entry, int> EntriesInGroup{
+    "SELECT id, group_id, title, username, password, url, notes, otp FROM entries WHERE group_id = ?"};
+constexpr Sql::Query<Entry, int> EntryById{
+    "SELECT id, group_id, title, username, password, url, notes, otp FROM entries WHERE id = ?"};
+constexpr Sql::Query<Entry, QString> EntriesModifiedSince{
+    "SELECT id, group_id, title, username, password, url, notes, otp FROM entries WHERE modified_at >= ?"};
+constexpr Sql::Command<int, QString, QString, QString, QString, QString, OptionalText> InsertEntry{
+    "INSERT INTO entries (group_id, title, username, password, url, notes, otp) VALUES (?, ?, ?, ?, ?, ?, ?)"};
+constexpr Sql::Command<QString, QString, QString, QString, QString, OptionalText, int> UpdateEntry{
+    "UPDATE entries SET title = ?, username = ?, password = ?, url = ?, notes = ?, otp = ?,"
+    " modified_at = CURRENT_TIMESTAMP WHERE id = ?"};
+constexpr Sql::Command<QString, int> SetEntryOtp{
+    "UPDATE entries SET otp = ?, modified_at = CURRENT_TIMESTAMP WHERE id = ?"};
+
+constexpr Sql::Query<Group> TopLevelGroups{"SELECT id, name, parent_id FROM groups WHERE parent_id IS NULL"};
+constexpr Sql::Query<Group, int> GroupsIn{"SELECT id, name, parent_id FROM groups WHERE parent_id = ?"};
+constexpr Sql::Query<Group> AllGroups{"SELECT id, name, parent_id FROM groups ORDER BY id"};
+constexpr Sql::Command<QString, std::optional<int>> InsertGroup{"INSERT INTO groups (name, parent_id) VALUES (?, ?)"};
+constexpr Sql::Command<QString, int> RenameGroup{
+    "UPDATE groups SET name = ?, modified_at = CURRENT_TIMESTAMP WHERE id = ?"};
+
+constexpr Sql::Query<std::tuple<QByteArray>, QString> AutofillClientKey{"SELECT key FROM autofill_clients WHERE id = ?"};
+constexpr Sql::Command<QString, QByteArray> AddAutofillClient{
+    "INSERT OR REPLACE INTO autofill_clients (id, key) VALUES (?, ?)"};
+
+bool copyEntryTags(sqlite3* db, int fromEntryId, int toEntryId) {
+    sqlite3_stmt* stmt;
+    const char* query = "INSERT INTO entry_tags (entry_id, tag_id) SELECT ?, tag_id FROM entry_tags WHERE entry_id = ?";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+    sqlite3_bind_int(stmt, 1, toEntryId);
+    sqlite3_bind_int(stmt, 2, fromEntryId);
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+QList<DatabaseManager::Entry> selectEntries(sqlite3* db, const QString& where, const QStringList& params) {
+    QList<DatabaseManager::Entry> list;
+    // Searches never turn up what is in the recycle bin
+    const QByteArray sql = "SELECT id, group_id, title, username, password, url, notes, otp FROM entries WHERE ("
+                           + where.toUtf8() + ") AND " + RecycleBin::NotInBin;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql.constData(), -1, &stmt, nullptr) != SQLITE_OK) {
+        qWarning() << "Failed to prepare search:" << sqlite3_errmsg(db);
+        return list;
+    }
+    
+    SearchQuery::bind(stmt, params);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        list.append(Sql::read<DatabaseManager::Entry>(stmt));
+    }
+    
+    sqlite3_finalize(stmt);
+    return list;
+}
+
+// Whether an update would change nothing, in which case no history version is recorded
+bool sameFields(const Entry& a, const Entry& b) {
+    return a.title == b.title && a.username == b.username && a.password == b.password
+        && a.url == b.url && a.notes == b.notes && a.otp == b.otp;
+}
+
+// Tags as the index keeps them: normalized, without duplicates, sorted
+QStringList normalizedTags(const QStringList& tags) {
+    QStringList normalized;
+    for (const QString& tag : tags) {
+        QString name = TagIndex::normalize(tag);
+        if (!name.isEmpty() && !normalized.contains(name)) {
+            normalized.append(name);
+        }
+    }
+    normalized.sort();
+    return normalized;
 }
 
-DatabaseManager::DatabaseManager() {
+std::filesystem::path toFsPath(const QString& path) {
+#ifdef Q_OS_WIN
+    return std::filesystem::path(path.toStdWString());
+#else
+    return std::filesystem::path(QFile::encodeName(path).toStdString());
+#endif
+}
+
+}
+
+DatabaseManager::DatabaseManager(QObject* parent)
+    : QObject(parent) {
+    // Sync tools only see the vault file, so edits should not sit in the WAL for the whole session.
+    // PASSIVE never waits; pages a reader still needs are left for the next round.
+    m_checkpointTimer = new QTimer(this);
+    m_checkpointTimer->setSingleShot(true);
+    m_checkpointTimer->setInterval(CheckpointDelayMs);
+    connect(m_checkpointTimer, &QTimer::timeout, this, [this]() {
+        if (m_db && !isChangingPassword()) {
+            checkpointWal(false);
+        }
+    });
+    connect(this, &DatabaseManager::databaseModified, m_checkpointTimer, qOverload<>(&QTimer::start));
 }
 
 DatabaseManager::~DatabaseManager() {
+    if (m_rekeyThread) {
+        cancelPasswordChange();
+        m_rekeyThread->quit();
+        m_rekeyThread->wait();
+    }
     closeDatabase();
 }
 
@@ -37,202 +297,880 @@ void DatabaseManager::ensureRootGroup() {
 
 int DatabaseManager::createGroup(const QString& name, int parentId) {
     if (!m_db) return -1;
+    if (!InsertGroup.exec(m_db, name, Sql::nullIfZero(parentId))) return -1;
+    
+    int id = (int)sqlite3_last_insert_rowid(m_db);
+    emit databaseModified();
+    return id;
+}
+
+QList<DatabaseManager::Group> DatabaseManager::getGroups(int parentId) {
+    if (!m_db) return QList<Group>();
+    return parentId == 0 ? TopLevelGroups.all(m_db) : GroupsIn.all(m_db, parentId);
+}
+
+QList<DatabaseManager::Entry> DatabaseManager::getEntries(int groupId) {
+    if (!m_db) return QList<Entry>();
+    return EntriesInGroup.all(m_db, groupId);
+}
+
+QList<DatabaseManager::Entry> DatabaseManager::searchEntries(const QString& query) {
+    QList<Entry> list;
+    if (!m_db || query.trimmed().isEmpty()) return list;
+    
+    QSharedPointer<const SearchQuery::Plan> plan = SearchQuery::compile(query);
+    if (plan->tags.isEmpty()) return selectEntries(m_db, plan->where, plan->params);
+    
+    // Top-level tag terms are settled in memory; only the entries that pass are read
+    RoaringBitmap matches = m_tagIndex.match(plan->tags);
+    if (matches.isEmpty()) return list;
+    if (plan->residualWhere.isEmpty()) {
+        const QSet<int> bin = RecycleBin::groupIds(m_db);
+        list = getEntriesByIds(matches.toList());
+        list.erase(std::remove_if(list.begin(), list.end(), [&bin](const Entry& e) {
+            return bin.contains(e.groupId);
+        }), list.end());
+        return list;
+    }
+    
+    list = selectEntries(m_db, plan->residualWhere, plan->residualParams);
+    list.erase(std::remove_if(list.begin(), list.end(), [&matches](const Entry& e) {
+        return !matches.contains((quint32)e.id);
+    }), list.end());
+    return list;
+}
+
+QList<DatabaseManager::Entry> DatabaseManager::searchEntries(sqlite3* db, const QString& query) {
+    if (!db || query.trimmed().isEmpty()) return QList<Entry>();
+    
+    QSharedPointer<const SearchQuery::Plan> plan = SearchQuery::compile(query);
+    return selectEntries(db, plan->where, plan->params);
+}
+
+bool DatabaseManager::updateGroup(int id, const QString& name) {
+    if (!m_db) return false;
+    
+    bool success = RenameGroup.exec(m_db, name, id);
+    if (success) emit databaseModified();
+    return success;
+}
+
+DatabaseManager::GroupDeletion DatabaseManager::groupDeletion(int id) {
+    const int binId = m_db ? RecycleBin::groupId(m_db, false) : -1;
+    if (binId < 0) return GroupDeletion::ToRecycleBin;
+    if (isInSubtree(id, binId)) return GroupDeletion::Permanent;
+    if (isInSubtree(binId, id)) return GroupDeletion::NotAllowed;
+    return GroupDeletion::ToRecycleBin;
+}
+
+bool DatabaseManager::deleteGroup(int id) {
+    if (!m_db) return false;
+    
+    switch (groupDeletion(id)) {
+    case GroupDeletion::NotAllowed:
+        qWarning() << "Group" << id << "holds the recycle bin and cannot be deleted";
+        return false;
+    case GroupDeletion::Permanent:
+        // The cascade over the subtree runs in the purge, off this thread
+        if (!RecycleBin::expire(m_db, id)) {
+            qCritical() << "Failed to mark group" << id << "for removal:" << sqlite3_errmsg(m_db);
+            return false;
+        }
+        emit databaseModified();
+        return true;
+    case GroupDeletion::ToRecycleBin:
+        break;
+    }
+    
+    if (!beginTransaction()) return false;
+    const int binId = RecycleBin::groupId(m_db, true);
+    if (binId < 0 || !RecycleBin::trashGroup(m_db, id, binId) || !commitTransaction()) {
+        qCritical() << "Failed to move group" << id << "to the recycle bin:" << sqlite3_errmsg(m_db);
+        rollbackTransaction();
+        return false;
+    }
+    emit databaseModified();
+    return true;
+}
+
+bool DatabaseManager::moveGroup(int id, int parentId) {
+    if (!m_db || id == parentId) return false;
+    if (parentId > 0 && isInSubtree(parentId, id)) {
+        qWarning() << "Cannot move group" << id << "below its own subgroup" << parentId;
+        return false;
+    }
+    if (id == RecycleBin::groupId(m_db, false)) {
+        qWarning() << "The recycle bin stays at the top level";
+        return false;
+    }
+    
+    // Dropping a group into the bin is the same as deleting it
+    if (parentId > 0 && isInRecycleBin(parentId)) {
+        if (!RecycleBin::trashGroup(m_db, id, parentId)) return false;
+        emit databaseModified();
+        return true;
+    }
     
     sqlite3_stmt* stmt;
-    const char* query = "INSERT INTO groups (name, parent_id) VALUES (?, ?)";
-    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    const char* query = "UPDATE groups SET parent_id = ?, deleted_at = NULL, restore_parent_id = NULL,"
+                        " modified_at = CURRENT_TIMESTAMP WHERE id = ?";
+    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
     
-    sqlite3_bind_text(stmt, 1, name.toUtf8().constData(), -1, SQLITE_TRANSIENT);
     if (parentId > 0) {
-        sqlite3_bind_int(stmt, 2, parentId);
+        sqlite3_bind_int(stmt, 1, parentId);
     } else {
-        sqlite3_bind_null(stmt, 2);
+        sqlite3_bind_null(stmt, 1);
+    }
+    sqlite3_bind_int(stmt, 2, id);
+    
+    // The closure rows are rewritten by a trigger within the same statement
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    if (success) emit databaseModified();
+    return success;
+}
+
+bool DatabaseManager::isInSubtree(int groupId, int ancestorId) {
+    if (!m_db) return false;
+    
+    sqlite3_stmt* stmt;
+    const char* query = "SELECT 1 FROM group_closure WHERE ancestor = ? AND descendant = ?";
+    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+    
+    sqlite3_bind_int(stmt, 1, ancestorId);
+    sqlite3_bind_int(stmt, 2, groupId);
+    bool found = (sqlite3_step(stmt) == SQLITE_ROW);
+    sqlite3_finalize(stmt);
+    return found;
+}
+
+QHash<int, int> DatabaseManager::getSubtreeEntryCounts() {
+    QHash<int, int> counts;
+    if (!m_db) return counts;
+    
+    sqlite3_stmt* stmt;
+    const char* query = "SELECT c.ancestor, COUNT(*) FROM group_closure c "
+                        "JOIN entries e ON e.group_id = c.descendant GROUP BY c.ancestor";
+    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return counts;
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        counts.insert(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+    }
+    
+    sqlite3_finalize(stmt);
+    return counts;
+}
+
+QList<DatabaseManager::Group> DatabaseManager::getAllGroups() {
+    if (!m_db) return QList<Group>();
+    return AllGroups.all(m_db);
+}
+
+QSet<int> DatabaseManager::getEntryIds() {
+    QSet<int> ids;
+    if (!m_db) return ids;
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_db, "SELECT id FROM entries", -1, &stmt, nullptr) != SQLITE_OK) return ids;
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ids.insert(sqlite3_column_int(stmt, 0));
+    }
+    
+    sqlite3_finalize(stmt);
+    return ids;
+}
+
+QList<DatabaseManager::Entry> DatabaseManager::getEntriesByIds(const QList<int>& ids) {
+    QList<Entry> list;
+    if (!m_db || ids.isEmpty()) return list;
+    
+    // One statement, reset and rebound for every id
+    Sql::Prepared<Entry, int> byId(m_db, EntryById);
+    for (int id : ids) {
+        if (!byId.appendAll(&list, id)) break;
+    }
+    return list;
+}
+
+QList<DatabaseManager::Entry> DatabaseManager::getEntriesModifiedSince(const QString& timestamp) {
+    if (!m_db) return QList<Entry>();
+    
+    // Timestamps have one second resolution, so the boundary second is read again
+    return EntriesModifiedSince.all(m_db, timestamp);
+}
+
+QString DatabaseManager::latestModification() {
+    QString timestamp;
+    if (!m_db) return timestamp;
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_db, "SELECT max(modified_at) FROM entries", -1, &stmt, nullptr) != SQLITE_OK) return timestamp;
+    
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        timestamp = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0));
+    }
+    
+    sqlite3_finalize(stmt);
+    return timestamp;
+}
+
+int DatabaseManager::dataVersion() {
+    int version = -1;
+    if (!m_db) return version;
+    
+    // Changes whenever another connection commits, never for our own writes
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_db, "PRAGMA data_version", -1, &stmt, nullptr) != SQLITE_OK) return version;
+    
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        version = sqlite3_column_int(stmt, 0);
+    }
+    
+    sqlite3_finalize(stmt);
+    return version;
+}
+
+QList<QPair<int, QString>> DatabaseManager::getEntryUrls() {
+    return getEntryUrls(m_db);
+}
+
+QList<QPair<int, QString>> DatabaseManager::getEntryUrls(sqlite3* db) {
+    QList<QPair<int, QString>> urls;
+    if (!db) return urls;
+    
+    sqlite3_stmt* stmt;
+    const QByteArray query = QByteArray("SELECT id, url FROM entries WHERE url IS NOT NULL AND url != '' AND ")
+                             + RecycleBin::NotInBin;
+    if (sqlite3_prepare_v2(db, query.constData(), -1, &stmt, nullptr) != SQLITE_OK) return urls;
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        urls.append({sqlite3_column_int(stmt, 0), QString::fromUtf8((const char*)sqlite3_column_text(stmt, 1))});
+    }
+    
+    sqlite3_finalize(stmt);
+    return urls;
+}
+
+QByteArray DatabaseManager::autofillClientKey(const QString& clientId) {
+    std::tuple<QByteArray> key;
+    if (!m_db || !AutofillClientKey.first(m_db, &key, clientId)) return QByteArray();
+    return std::get<0>(key);
+}
+
+bool DatabaseManager::addAutofillClient(const QString& clientId, const QByteArray& key) {
+    if (!m_db || clientId.isEmpty() || key.isEmpty()) return false;
+    return AddAutofillClient.exec(m_db, clientId, key);
+}
+
+QMap<QString, QString> DatabaseManager::getEntryAttributes(int entryId) {
+    QMap<QString, QString> attributes;
+    if (!m_db) return attributes;
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_db, "SELECT name, value FROM entry_attributes WHERE entry_id = ?", -1, &stmt, nullptr) != SQLITE_OK) return attributes;
+    
+    sqlite3_bind_int(stmt, 1, entryId);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        attributes.insert(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0)),
+                          QString::fromUtf8((const char*)sqlite3_column_text(stmt, 1)));
+    }
+    
+    sqlite3_finalize(stmt);
+    return attributes;
+}
+
+bool DatabaseManager::setEntryAttributes(int entryId, const QMap<QString, QString>& attributes) {
+    if (!m_db) return false;
+    if (!beginTransaction()) return false;
+    
+    if (!writeEntryAttributes(entryId, attributes) || !commitTransaction()) {
+        rollbackTransaction();
+        return false;
+    }
+    
+    emit databaseModified();
+    return true;
+}
+
+bool DatabaseManager::writeEntryAttributes(int entryId, const QMap<QString, QString>& attributes) {
+    sqlite3_stmt* stmt = nullptr;
+    bool success = false;
+    if (sqlite3_prepare_v2(m_db, "DELETE FROM entry_attributes WHERE entry_id = ?", -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, entryId);
+        success = (sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_finalize(stmt);
+    }
+    
+    const char* query = "INSERT INTO entry_attributes (entry_id, name, value) VALUES (?, ?, ?)";
+    if (success && sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) == SQLITE_OK) {
+        for (auto it = attributes.constBegin(); it != attributes.constEnd() && success; ++it) {
+            sqlite3_bind_int(stmt, 1, entryId);
+            sqlite3_bind_text(stmt, 2, it.key().toUtf8().constData(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, it.value().toUtf8().constData(), -1, SQLITE_TRANSIENT);
+            success = (sqlite3_step(stmt) == SQLITE_DONE);
+            sqlite3_reset(stmt);
+        }
+        sqlite3_finalize(stmt);
+    } else {
+        success = false;
+    }
+    
+    if (!success) {
+        qCritical() << "Failed to store attributes of entry" << entryId << ":" << sqlite3_errmsg(m_db);
+    }
+    return success;
+}
+
+int DatabaseManager::saveEntryWithAttributes(const Entry& entry, const QMap<QString, QString>& attributes) {
+    if (!m_db) return -1;
+    if (!beginTransaction()) return -1;
+    
+    const bool created = entry.id < 0;
+    int id = entry.id;
+    bool success;
+    if (created) {
+        success = InsertEntry.exec(m_db, entry.groupId, entry.title, entry.username, entry.password, entry.url,
+                                   entry.notes, Sql::nullIfEmpty(entry.otp));
+        id = (int)sqlite3_last_insert_rowid(m_db);
+    } else {
+        QList<Entry> current = getEntriesByIds({id});
+        success = !current.isEmpty()
+            && (sameFields(current.first(), entry) || writeEntryUpdate(current.first(), entry));
+    }
+    
+    if (!success || !writeEntryAttributes(id, attributes) || !commitTransaction()) {
+        rollbackTransaction();
+        return -1;
+    }
+    
+    if (created) m_tagIndex.addEntry(id);
+    emit databaseModified();
+    return id;
+}
+
+QList<int> DatabaseManager::findEntriesByAttributes(const QMap<QString, QString>& attributes, int groupId) {
+    QList<int> ids;
+    if (!m_db) return ids;
+    
+    // One index range per attribute, intersected; no attributes matches the whole group
+    QByteArray query = "SELECT id FROM entries WHERE group_id = ?";
+    if (!attributes.isEmpty()) {
+        QByteArrayList terms;
+        for (int i = 0; i < attributes.size(); ++i) {
+            terms.append("SELECT entry_id FROM entry_attributes WHERE name = ? AND value = ?");
+        }
+        query += " AND id IN (" + terms.join(" INTERSECT ") + ")";
+    }
+    
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_db, query.constData(), -1, &stmt, nullptr) != SQLITE_OK) return ids;
+    
+    int index = 1;
+    sqlite3_bind_int(stmt, index++, groupId);
+    for (auto it = attributes.constBegin(); it != attributes.constEnd(); ++it) {
+        sqlite3_bind_text(stmt, index++, it.key().toUtf8().constData(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt, index++, it.value().toUtf8().constData(), -1, SQLITE_TRANSIENT);
+    }
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ids.append(sqlite3_column_int(stmt, 0));
+    }
+    
+    sqlite3_finalize(stmt);
+    return ids;
+}
+
+QList<DatabaseManager::HistoryVersion> DatabaseManager::getEntryHistory(int entryId) {
+    return EntryHistory::versions(m_db, entryId);
+}
+
+bool DatabaseManager::getEntryVersion(int entryId, int version, Entry* entry) {
+    QList<Entry> current = getEntriesByIds({entryId});
+    if (current.isEmpty()) return false;
+    
+    *entry = current.first();
+    return EntryHistory::load(m_db, entryId, version, entry);
+}
+
+bool DatabaseManager::restoreEntryVersion(int entryId, int version) {
+    Entry entry;
+    if (!getEntryVersion(entryId, version, &entry)) return false;
+    return updateEntry(entry);
+}
+
+QList<DatabaseManager::Attachment> DatabaseManager::getAttachments(int entryId) {
+    return Attachments::list(m_db, entryId);
+}
+
+int DatabaseManager::addAttachment(int entryId, const QString& name, QIODevice* source) {
+    if (!beginTransaction()) return -1;
+    
+    int id = Attachments::add(m_db, entryId, name, source);
+    if (id < 0 || !commitTransaction()) {
+        qCritical() << "Failed to add attachment" << name << ":" << sqlite3_errmsg(m_db);
+        rollbackTransaction();
+        return -1;
+    }
+    emit databaseModified();
+    return id;
+}
+
+bool DatabaseManager::saveAttachment(int attachmentId, QIODevice* target) {
+    return Attachments::write(m_db, attachmentId, target);
+}
+
+bool DatabaseManager::removeAttachment(int attachmentId) {
+    if (!Attachments::remove(m_db, attachmentId)) return false;
+    emit databaseModified();
+    return true;
+}
+
+QList<FrecencyIndex::Item> DatabaseManager::getEntryUsage() {
+    return getEntryUsage(m_db);
+}
+
+QList<FrecencyIndex::Item> DatabaseManager::getEntryUsage(sqlite3* db) {
+    QList<FrecencyIndex::Item> list;
+    if (!db) return list;
+    
+    sqlite3_stmt* stmt;
+    const QByteArray query = QByteArray("SELECT e.id, e.title, e.username, COALESCE(u.use_count, 0), COALESCE(u.last_used, 0) "
+                                        "FROM entries e LEFT JOIN entry_usage u ON u.entry_id = e.id WHERE ")
+                             + RecycleBin::NotInBin;
+    if (sqlite3_prepare_v2(db, query.constData(), -1, &stmt, nullptr) != SQLITE_OK) return list;
+    
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        FrecencyIndex::Item item;
+        item.id = sqlite3_column_int(stmt, 0);
+        item.title = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 1));
+        item.username = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 2));
+        item.useCount = sqlite3_column_int(stmt, 3);
+        item.lastUsed = sqlite3_column_int64(stmt, 4);
+        list.append(item);
+    }
+    
+    sqlite3_finalize(stmt);
+    return list;
+}
+
+bool DatabaseManager::recordEntryUse(int entryId, qint64 when) {
+    if (!m_db) return false;
+    
+    sqlite3_stmt* stmt;
+    const char* query = "INSERT INTO entry_usage (entry_id, use_count, last_used) VALUES (?, 1, ?) "
+                        "ON CONFLICT(entry_id) DO UPDATE SET use_count = use_count + 1, last_used = excluded.last_used";
+    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+    
+    sqlite3_bind_int(stmt, 1, entryId);
+    sqlite3_bind_int64(stmt, 2, when);
+    
+    // Bookkeeping only, so no databaseModified; copying passwords should not count toward backups
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+QStringList DatabaseManager::getTags() const {
+    return m_tagIndex.tags();
+}
+
+QStringList DatabaseManager::getEntryTags(int entryId) const {
+    return m_tagIndex.tagsOf(entryId);
+}
+
+bool DatabaseManager::setEntryTags(int entryId, const QStringList& tags) {
+    if (!m_db) return false;
+    
+    const QStringList normalized = normalizedTags(tags);
+    if (normalized == m_tagIndex.tagsOf(entryId)) return true;
+    
+    if (!beginTransaction()) return false;
+    if (!writeEntryTags(entryId, normalized) || !commitTransaction()) {
+        qCritical() << "Failed to set tags of entry" << entryId << ":" << sqlite3_errmsg(m_db);
+        rollbackTransaction();
+        return false;
+    }
+    m_tagIndex.setEntryTags(entryId, normalized);
+    emit databaseModified();
+    return true;
+}
+
+int DatabaseManager::saveEntryWithTags(const Entry& entry, const QStringList& tags) {
+    if (!m_db) return -1;
+    
+    const QStringList normalized = normalizedTags(tags);
+    if (!beginTransaction()) return -1;
+    
+    const bool created = entry.id < 0;
+    int id = entry.id;
+    bool success;
+    if (created) {
+        success = InsertEntry.exec(m_db, entry.groupId, entry.title, entry.username, entry.password, entry.url,
+                                   entry.notes, Sql::nullIfEmpty(entry.otp));
+        id = (int)sqlite3_last_insert_rowid(m_db);
+    } else {
+        QList<Entry> current = getEntriesByIds({id});
+        success = !current.isEmpty()
+            && (sameFields(current.first(), entry) || writeEntryUpdate(current.first(), entry));
+    }
+    // A new id is not in the index yet, so this also skips a new entry without tags
+    if (success && normalized != m_tagIndex.tagsOf(id)) {
+        success = writeEntryTags(id, normalized);
+    }
+    
+    if (!success || !commitTransaction()) {
+        qCritical() << "Failed to save entry" << id << ":" << sqlite3_errmsg(m_db);
+        rollbackTransaction();
+        return -1;
+    }
+    
+    if (created) {
+        m_tagIndex.addEntry(id, normalized);
+    } else {
+        m_tagIndex.setEntryTags(id, normalized);
+    }
+    emit databaseModified();
+    return id;
+}
+
+bool DatabaseManager::writeEntryTags(int entryId, const QStringList& tags) {
+    sqlite3_stmt* stmt;
+    bool success = sqlite3_prepare_v2(m_db, "DELETE FROM entry_tags WHERE entry_id = ?", -1, &stmt, nullptr) == SQLITE_OK;
+    if (success) {
+        sqlite3_bind_int(stmt, 1, entryId);
+        success = (sqlite3_step(stmt) == SQLITE_DONE);
+        sqlite3_finalize(stmt);
+    }
+    
+    sqlite3_stmt* insertTag = nullptr;
+    sqlite3_stmt* linkTag = nullptr;
+    success = success
+        && sqlite3_prepare_v2(m_db, "INSERT OR IGNORE INTO tags (name) VALUES (?)", -1, &insertTag, nullptr) == SQLITE_OK
+        && sqlite3_prepare_v2(m_db, "INSERT INTO entry_tags (entry_id, tag_id) SELECT ?, id FROM tags WHERE name = ?",
+                              -1, &linkTag, nullptr) == SQLITE_OK;
+    for (int i = 0; success && i < tags.size(); ++i) {
+        const QByteArray name = tags.at(i).toUtf8();
+        sqlite3_bind_text(insertTag, 1, name.constData(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(linkTag, 1, entryId);
+        sqlite3_bind_text(linkTag, 2, name.constData(), -1, SQLITE_TRANSIENT);
+        success = sqlite3_step(insertTag) == SQLITE_DONE && sqlite3_step(linkTag) == SQLITE_DONE;
+        sqlite3_reset(insertTag);
+        sqlite3_reset(linkTag);
+    }
+    sqlite3_finalize(insertTag);
+    sqlite3_finalize(linkTag);
+    return success;
+}
+
+void DatabaseManager::rebuildTagIndex() {
+    m_tagIndex.build(m_db);
+}
+
+QPair<qint64, qint64> DatabaseManager::entryTimes(int entryId) {
+    QPair<qint64, qint64> times(0, 0);
+    if (!m_db) return times;
+    
+    sqlite3_stmt* stmt;
+    const char* query = "SELECT strftime('%s', created_at), strftime('%s', modified_at) FROM entries WHERE id = ?";
+    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return times;
+    
+    sqlite3_bind_int(stmt, 1, entryId);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        times = {sqlite3_column_int64(stmt, 0), sqlite3_column_int64(stmt, 1)};
+    }
+    
+    sqlite3_finalize(stmt);
+    return times;
+}
+
+int DatabaseManager::createEntry(const Entry& entry) {
+    if (!m_db) return -1;
+    if (!InsertEntry.exec(m_db, entry.groupId, entry.title, entry.username, entry.password, entry.url, entry.notes,
+                          Sql::nullIfEmpty(entry.otp))) {
+        return -1;
+    }
+    
+    int id = (int)sqlite3_last_insert_rowid(m_db);
+    m_tagIndex.addEntry(id);
+    emit databaseModified();
+    return id;
+}
+
+bool DatabaseManager::updateEntry(const Entry& entry) {
+    if (!m_db) return false;
+    
+    QList<Entry> current = getEntriesByIds({entry.id});
+    if (current.isEmpty()) return false;
+    if (sameFields(current.first(), entry)) return true;
+    
+    if (!beginTransaction()) return false;
+    if (!writeEntryUpdate(current.first(), entry) || !commitTransaction()) {
+        rollbackTransaction();
+        return false;
+    }
+    emit databaseModified();
+    return true;
+}
+
+bool DatabaseManager::writeEntryUpdate(const Entry& previous, const Entry& entry) {
+    return EntryHistory::record(m_db, previous)
+        && UpdateEntry.exec(m_db, entry.title, entry.username, entry.password, entry.url, entry.notes,
+                            Sql::nullIfEmpty(entry.otp), entry.id);
+}
+
+QString DatabaseManager::advanceHotpCounter(int entryId) {
+    if (!m_db) return QString();
+    if (!beginTransaction()) return QString();
+    
+    // Read and written under the write lock, so two copies in a row never hand out the same code
+    const QList<Entry> current = EntryById.all(m_db, entryId);
+    const QString otp = current.isEmpty() ? QString() : current.first().otp;
+    const Totp::Settings settings = Totp::parse(otp);
+    if (settings.type != Totp::Type::Hotp) {
+        rollbackTransaction();
+        return QString();
+    }
+    
+    const QString advanced = Totp::withCounter(otp, settings.counter + 1);
+    if (!SetEntryOtp.exec(m_db, advanced, entryId) || !commitTransaction()) {
+        qCritical() << "Failed to advance the HOTP counter of entry" << entryId << ":" << sqlite3_errmsg(m_db);
+        rollbackTransaction();
+        return QString();
+    }
+    emit databaseModified();
+    return advanced;
+}
+
+bool DatabaseManager::deleteEntry(int id) {
+    return deleteEntries({id});
+}
+
+int DatabaseManager::recycleBinGroupId() {
+    return m_db ? RecycleBin::groupId(m_db, false) : -1;
+}
+
+QSet<int> DatabaseManager::recycleBinGroupIds() {
+    return m_db ? RecycleBin::groupIds(m_db) : QSet<int>();
+}
+
+bool DatabaseManager::isInRecycleBin(int groupId) {
+    const int binId = recycleBinGroupId();
+    return binId >= 0 && isInSubtree(groupId, binId);
+}
+
+bool DatabaseManager::restoreEntries(const QList<int>& ids) {
+    if (!m_db || ids.isEmpty()) return false;
+    if (!beginTransaction()) return false;
+    
+    for (int id : ids) {
+        if (!RecycleBin::restoreEntry(m_db, id)) {
+            qCritical() << "Failed to restore entry" << id << ":" << sqlite3_errmsg(m_db);
+            rollbackTransaction();
+            return false;
+        }
     }
+    if (!commitTransaction()) return false;
     
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
-        return -1;
+    emit databaseModified();
+    return true;
+}
+
+bool DatabaseManager::restoreGroup(int id) {
+    if (!m_db) return false;
+    if (!RecycleBin::restoreGroup(m_db, id)) {
+        qCritical() << "Failed to restore group" << id << ":" << sqlite3_errmsg(m_db);
+        return false;
     }
-    
-    sqlite3_finalize(stmt);
-    return (int)sqlite3_last_insert_rowid(m_db);
+    emit databaseModified();
+    return true;
 }
 
-QList<DatabaseManager::Group> DatabaseManager::getGroups(int parentId) {
-    QList<Group> list;
-    if (!m_db) return list;
-    
-    sqlite3_stmt* stmt;
-    QString sql;
-    if (parentId == 0) {
-        sql = "SELECT id, name, parent_id FROM groups WHERE parent_id IS NULL";
-    } else {
-        sql = "SELECT id, name, parent_id FROM groups WHERE parent_id = ?";
+bool DatabaseManager::moveEntries(const QList<int>& ids, int groupId) {
+    QList<QPair<int, int>> moves;
+    for (int id : ids) {
+        moves.append({id, groupId});
     }
+    return moveEntries(moves);
+}
+
+bool DatabaseManager::moveEntries(const QList<QPair<int, int>>& moves) {
+    if (!m_db || moves.isEmpty()) return false;
+    if (!beginTransaction()) return false;
     
-    if (sqlite3_prepare_v2(m_db, sql.toUtf8().constData(), -1, &stmt, nullptr) != SQLITE_OK) {
-        qCritical() << "Failed to prepare getGroups:" << sqlite3_errmsg(m_db);
-        return list;
+    // Moving into the bin counts as deleting, moving out of it as restoring
+    const QSet<int> bin = RecycleBin::groupIds(m_db);
+    sqlite3_stmt* toBin;
+    sqlite3_stmt* toGroup;
+    const char* toBinQuery = "UPDATE entries SET restore_group_id = CASE WHEN deleted_at IS NULL THEN group_id ELSE restore_group_id END,"
+                             " group_id = ?, deleted_at = COALESCE(deleted_at, CURRENT_TIMESTAMP), modified_at = CURRENT_TIMESTAMP WHERE id = ?";
+    const char* toGroupQuery = "UPDATE entries SET group_id = ?, deleted_at = NULL, restore_group_id = NULL,"
+                               " modified_at = CURRENT_TIMESTAMP WHERE id = ?";
+    if (sqlite3_prepare_v2(m_db, toBinQuery, -1, &toBin, nullptr) != SQLITE_OK) {
+        rollbackTransaction();
+        return false;
+    }
+    if (sqlite3_prepare_v2(m_db, toGroupQuery, -1, &toGroup, nullptr) != SQLITE_OK) {
+        sqlite3_finalize(toBin);
+        rollbackTransaction();
+        return false;
     }
     
-    if (parentId > 0) {
-        sqlite3_bind_int(stmt, 1, parentId);
+    bool success = true;
+    for (const auto& move : moves) {
+        sqlite3_stmt* stmt = bin.contains(move.second) ? toBin : toGroup;
+        sqlite3_bind_int(stmt, 1, move.second);
+        sqlite3_bind_int(stmt, 2, move.first);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            qCritical() << "Failed to move entry" << move.first << ":" << sqlite3_errmsg(m_db);
+            success = false;
+            break;
+        }
+        sqlite3_reset(stmt);
     }
     
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Group g;
-        g.id = sqlite3_column_int(stmt, 0);
-        g.name = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 1));
-        g.parentId = sqlite3_column_int(stmt, 2);
-        list.append(g);
+    sqlite3_finalize(toBin);
+    sqlite3_finalize(toGroup);
+    if (!success) {
+        rollbackTransaction();
+        return false;
     }
+    if (!commitTransaction()) return false;
     
-    sqlite3_finalize(stmt);
-    return list;
+    emit databaseModified();
+    return true;
 }
 
-QList<DatabaseManager::Entry> DatabaseManager::getEntries(int groupId) {
-    QList<Entry> list;
-    if (!m_db) return list;
-    
-    const char* query = "SELECT id, group_id, title, username, password, url, notes FROM entries WHERE group_id = ?";
-    sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return list;
+bool DatabaseManager::deleteEntries(const QList<int>& ids) {
+    if (!m_db || ids.isEmpty()) return false;
+    if (!beginTransaction()) return false;
     
-    sqlite3_bind_int(stmt, 1, groupId);
-    
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Entry e;
-        e.id = sqlite3_column_int(stmt, 0);
-        e.groupId = sqlite3_column_int(stmt, 1);
-        e.title = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 2));
-        e.username = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 3));
-        e.password = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 4));
-        e.url = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 5));
-        e.notes = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 6));
-        list.append(e);
+    const int binId = RecycleBin::groupId(m_db, true);
+    if (binId < 0) {
+        rollbackTransaction();
+        return false;
     }
     
-    sqlite3_finalize(stmt);
-    return list;
-}
-
-QList<DatabaseManager::Entry> DatabaseManager::searchEntries(const QString& query) {
-    QList<Entry> list;
-    if (!m_db || query.isEmpty()) return list;
-    
-    const char* sql = "SELECT id, group_id, title, username, password, url, notes FROM entries "
-                      "WHERE title LIKE ? OR username LIKE ? OR url LIKE ? OR notes LIKE ?";
+    // Entries already in the bin are dated back for the next purge to remove, off this thread
+    // and without cascading here; the rest are moved there
     sqlite3_stmt* stmt;
-    if (sqlite3_prepare_v2(m_db, sql, -1, &stmt, nullptr) != SQLITE_OK) return list;
-    
-    QString likeQuery = "%" + query + "%";
-    QByteArray queryBytes = likeQuery.toUtf8();
-    
-    sqlite3_bind_text(stmt, 1, queryBytes.constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, queryBytes.constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, queryBytes.constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, queryBytes.constData(), -1, SQLITE_TRANSIENT);
+    const QByteArray query = QByteArray("UPDATE entries SET deleted_at = '1970-01-01 00:00:00' WHERE id = ? AND NOT ")
+                             + RecycleBin::NotInBin;
+    if (sqlite3_prepare_v2(m_db, query.constData(), -1, &stmt, nullptr) != SQLITE_OK) {
+        rollbackTransaction();
+        return false;
+    }
     
-    while (sqlite3_step(stmt) == SQLITE_ROW) {
-        Entry e;
-        e.id = sqlite3_column_int(stmt, 0);
-        e.groupId = sqlite3_column_int(stmt, 1);
-        e.title = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 2));
-        e.username = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 3));
-        e.password = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 4));
-        e.url = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 5));
-        e.notes = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 6));
-        list.append(e);
+    bool success = true;
+    for (int id : ids) {
+        sqlite3_bind_int(stmt, 1, id);
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            success = false;
+        } else if (sqlite3_changes(m_db) == 0) {
+            success = RecycleBin::trashEntry(m_db, id, binId);
+        }
+        if (!success) {
+            qCritical() << "Failed to delete entry" << id << ":" << sqlite3_errmsg(m_db);
+            break;
+        }
+        sqlite3_reset(stmt);
     }
     
     sqlite3_finalize(stmt);
-    return list;
-}
-
-bool DatabaseManager::updateGroup(int id, const QString& name) {
-    if (!m_db) return false;
-    
-    sqlite3_stmt* stmt;
-    const char* query = "UPDATE groups SET name = ? WHERE id = ?";
-    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
-    
-    sqlite3_bind_text(stmt, 1, name.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 2, id);
+    if (!success) {
+        rollbackTransaction();
+        return false;
+    }
+    if (!commitTransaction()) return false;
     
-    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
-    return success;
+    emit databaseModified();
+    return true;
 }
 
-bool DatabaseManager::deleteGroup(int id) {
-    if (!m_db) return false;
+QList<int> DatabaseManager::duplicateEntries(const QList<int>& ids, int groupId) {
+    QList<int> newIds;
+    if (!m_db || ids.isEmpty()) return newIds;
+    if (!beginTransaction()) return newIds;
     
+    // groupId 0 duplicates in place, marking the copies so they can be told apart
     sqlite3_stmt* stmt;
-    const char* query = "DELETE FROM groups WHERE id = ?";
-    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+    const char* query = (groupId > 0)
+        ? "INSERT INTO entries (group_id, title, username, password, url, notes, otp) "
+          "SELECT ?, title, username, password, url, notes, otp FROM entries WHERE id = ?"
+        : "INSERT INTO entries (group_id, title, username, password, url, notes, otp) "
+          "SELECT group_id, title || ' - Copy', username, password, url, notes, otp FROM entries WHERE id = ?";
+    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+        rollbackTransaction();
+        return newIds;
+    }
     
-    sqlite3_bind_int(stmt, 1, id);
+    bool success = true;
+    for (int id : ids) {
+        if (groupId > 0) {
+            sqlite3_bind_int(stmt, 1, groupId);
+            sqlite3_bind_int(stmt, 2, id);
+        } else {
+            sqlite3_bind_int(stmt, 1, id);
+        }
+        if (sqlite3_step(stmt) != SQLITE_DONE) {
+            qCritical() << "Failed to duplicate entry" << id << ":" << sqlite3_errmsg(m_db);
+            success = false;
+            break;
+        }
+        newIds.append((int)sqlite3_last_insert_rowid(m_db));
+        sqlite3_reset(stmt);
+        
+        // Copies share the attachment contents, only the references are new
+        if (!Attachments::copy(m_db, id, newIds.last()) || !copyEntryTags(m_db, id, newIds.last())) {
+            qCritical() << "Failed to copy attachments or tags of entry" << id << ":" << sqlite3_errmsg(m_db);
+            success = false;
+            break;
+        }
+    }
     
-    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
     sqlite3_finalize(stmt);
-    return success;
+    if (!success || !commitTransaction()) {
+        rollbackTransaction();
+        newIds.clear();
+    } else {
+        for (int i = 0; i < newIds.size(); ++i) {
+            m_tagIndex.addEntry(newIds.at(i), m_tagIndex.tagsOf(ids.at(i)));
+        }
+        emit databaseModified();
+    }
+    return newIds;
 }
 
-int DatabaseManager::createEntry(const Entry& entry) {
-    if (!m_db) return -1;
+bool DatabaseManager::beginTransaction() {
+    if (!m_db || isChangingPassword()) return false;
     
-    sqlite3_stmt* stmt;
-    const char* query = "INSERT INTO entries (group_id, title, username, password, url, notes) VALUES (?, ?, ?, ?, ?, ?)";
-    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return -1;
-    
-    sqlite3_bind_int(stmt, 1, entry.groupId);
-    sqlite3_bind_text(stmt, 2, entry.title.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, entry.username.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, entry.password.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 5, entry.url.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 6, entry.notes.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    
-    if (sqlite3_step(stmt) != SQLITE_DONE) {
-        sqlite3_finalize(stmt);
-        return -1;
+    char* errMsg = nullptr;
+    if (sqlite3_exec(m_db, "BEGIN IMMEDIATE;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        qCritical() << "Failed to begin transaction:" << (errMsg ? errMsg : "Unknown error");
+        sqlite3_free(errMsg);
+        return false;
     }
-    
-    sqlite3_finalize(stmt);
-    return (int)sqlite3_last_insert_rowid(m_db);
+    return true;
 }
 
-bool DatabaseManager::updateEntry(const Entry& entry) {
-    if (!m_db) return false;
-    
-    sqlite3_stmt* stmt;
-    const char* query = "UPDATE entries SET title = ?, username = ?, password = ?, url = ?, notes = ?, modified_at = CURRENT_TIMESTAMP WHERE id = ?";
-    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+bool DatabaseManager::commitTransaction() {
+    if (!m_db || isChangingPassword()) return false;
     
-    sqlite3_bind_text(stmt, 1, entry.title.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 2, entry.username.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 3, entry.password.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 4, entry.url.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_text(stmt, 5, entry.notes.toUtf8().constData(), -1, SQLITE_TRANSIENT);
-    sqlite3_bind_int(stmt, 6, entry.id);
-    
-    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
-    return success;
+    char* errMsg = nullptr;
+    if (sqlite3_exec(m_db, "COMMIT;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        qCritical() << "Failed to commit transaction:" << (errMsg ? errMsg : "Unknown error");
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
 }
 
-bool DatabaseManager::deleteEntry(int id) {
-    if (!m_db) return false;
-    
-    sqlite3_stmt* stmt;
-    const char* query = "DELETE FROM entries WHERE id = ?";
-    if (sqlite3_prepare_v2(m_db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+void DatabaseManager::rollbackTransaction() {
+    if (!m_db || isChangingPassword()) return;
     
-    sqlite3_bind_int(stmt, 1, id);
-    
-    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
-    sqlite3_finalize(stmt);
-    return success;
+    // Harmless if the failed statement already rolled the transaction back
+    if (!sqlite3_get_autocommit(m_db)) {
+        sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
 }
 
 bool DatabaseManager::createDatabase(const QString& path, const QString& password) {
@@ -251,6 +1189,7 @@ bool DatabaseManager::createDatabase(const QString& path, const QString& passwor
             return false;
         }
     }
+    saveCipherProfile(path, CipherProfile());
 
     // Open/Create the database
     // SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE
@@ -329,50 +1268,80 @@ bool DatabaseManager::createDatabase(const QString& path, const QString& passwor
 }
 
 bool DatabaseManager::openDatabase(const QString& path, const QString& password) {
+    Trace::Span span("openDatabase", "db");
+    QByteArray keySpec = deriveKeySpec(path, password);
+    if (keySpec.isEmpty()) {
+        return false;
+    }
+
+    bool opened = openWithKey(path, keySpec);
+    CipherKey::wipe(keySpec);
+    return opened;
+}
+
+QByteArray DatabaseManager::deriveKeySpec(const QString& path, const QString& password) {
     if (!QFile::exists(path)) {
         qWarning() << "Database file does not exist:" << path;
-        return false;
+        return QByteArray();
     }
 
     // SECURITY CHECK: Reject plain text SQLite files
     {
+        Trace::Span headerSpan("headerCheck", "db");
         QFile file(path);
         if (file.open(QIODevice::ReadOnly)) {
             QByteArray header = file.read(16);
             file.close();
             if (header.startsWith("SQLite format 3")) {
                  qCritical() << "SECURITY ALERT: Attempted to open a PLAIN TEXT database. Access Denied.";
-                 return false;
+                 return QByteArray();
             }
         }
     }
 
+    // Run the KDF once; the main connection and every background one is keyed with the result
+    const CipherProfile profile = loadCipherProfile(path);
+    qint64 phaseBegin = Trace::now();
+    QByteArray keySpec = CipherKey::derive(path, password.toUtf8(), profile.kdfIterations);
+    Trace::complete("kdf", phaseBegin, "db");
+    return keySpec;
+}
+
+bool DatabaseManager::openWithKey(const QString& path, const QByteArray& keySpec) {
+    return openWithKeySpec(path, keySpec, loadCipherProfile(path));
+}
+
+bool DatabaseManager::openWithKeySpec(const QString& path, const QByteArray& keySpec, const CipherProfile& profile) {
     closeDatabase();
 
+    qint64 phaseBegin = Trace::now();
     int rc = sqlite3_open_v2(path.toUtf8().constData(), &m_db, SQLITE_OPEN_READWRITE, nullptr);
+    Trace::complete("sqlite3_open", phaseBegin, "db");
     if (rc != SQLITE_OK) {
         qCritical() << "Failed to open database:" << (m_db ? sqlite3_errmsg(m_db) : "Unknown error");
         closeDatabase();
         return false;
     }
 
-    QByteArray pwdBytes = password.toUtf8();
-    rc = sqlite3_key(m_db, pwdBytes.constData(), pwdBytes.length());
+    phaseBegin = Trace::now();
+    rc = sqlite3_key(m_db, keySpec.constData(), keySpec.length());
+    Trace::complete("sqlite3_key", phaseBegin, "db");
     if (rc != SQLITE_OK) {
         qCritical() << "Failed to set key:" << sqlite3_errmsg(m_db);
         closeDatabase();
         return false;
     }
 
-    char* errMsg = nullptr;
-    rc = sqlite3_exec(m_db, "PRAGMA cipher_compatibility = 4;", nullptr, nullptr, &errMsg);
-    if (rc != SQLITE_OK) {
-        qCritical() << "Failed to set compatibility:" << (errMsg ? errMsg : "Unknown error");
-        sqlite3_free(errMsg);
+    phaseBegin = Trace::now();
+    bool configured = configureCipher(m_db, profile);
+    Trace::complete("cipherPragmas", phaseBegin, "db");
+    if (!configured) {
+        qCritical() << "Failed to set cipher settings:" << sqlite3_errmsg(m_db);
         closeDatabase();
         return false;
     }
 
+    char* errMsg = nullptr;
     rc = sqlite3_exec(m_db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, &errMsg);
     if (rc != SQLITE_OK) {
         qWarning() << "Failed to enable foreign keys:" << (errMsg ? errMsg : "Unknown error");
@@ -380,7 +1349,10 @@ bool DatabaseManager::openDatabase(const QString& path, const QString& password)
     }
 
     // Verify correctness: Try to read sqlite_master
+    // The first page read is where SQLCipher checks the key
+    phaseBegin = Trace::now();
     rc = sqlite3_exec(m_db, "SELECT count(*) FROM sqlite_master;", nullptr, nullptr, &errMsg);
+    Trace::complete("verify", phaseBegin, "db");
     if (rc != SQLITE_OK) {
         qWarning() << "Verification failed (Wrong Password?):" << (errMsg ? errMsg : "Unknown error");
         sqlite3_free(errMsg);
@@ -388,18 +1360,359 @@ bool DatabaseManager::openDatabase(const QString& path, const QString& password)
         return false;
     }
     
+    // Background connections (backups) take short read locks on the file
+    sqlite3_busy_timeout(m_db, 2000);
+
+    // WAL lets the reader pool work on snapshots while this connection writes
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(m_db, "PRAGMA journal_mode = WAL;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) != SQLITE_ROW
+            || qstricmp((const char*)sqlite3_column_text(stmt, 0), "wal") != 0) {
+            qWarning() << "Failed to enable WAL journaling, readers will wait for writers";
+        }
+        sqlite3_finalize(stmt);
+    }
+    
+    m_path = path;
+    m_key = keySpec;
+    m_profile = profile;
+    m_profiler.attach(m_db);
+
+    // Vaults from before the profile file get one, so copies taken from now on carry it
+    if (!QFile::exists(cipherProfilePath(path))) {
+        saveCipherProfile(path, profile);
+    }
+
+    if (!migrate()) {
+        closeDatabase();
+        return false;
+    }
+    m_readers = QSharedPointer<ReaderPool>::create(connectionInfo());
+
+    phaseBegin = Trace::now();
     ensureRootGroup();
+    Trace::complete("ensureRootGroup", phaseBegin, "db");
+
+    m_tagIndex.build(m_db);
     
     return true;
 }
 
 void DatabaseManager::closeDatabase() {
+    // Readers must be gone before the writer closes, or the WAL outlives this session
+    if (m_readers) {
+        m_readers->shutdown();
+        m_readers.reset();
+    }
+    m_checkpointTimer->stop();
     if (m_db) {
+        // Leaves the vault file complete on its own, e.g. for a sync tool picking it up after the lock
+        checkpointWal(true);
+        m_profiler.detach();
         sqlite3_close(m_db);
         m_db = nullptr;
     }
+    m_tagIndex.clear();
+    CipherKey::wipe(m_key);
 }
 
 bool DatabaseManager::isOpen() const {
     return m_db != nullptr;
+}
+
+bool DatabaseManager::reopen() {
+    if (!m_db) return false;
+
+    // Keyed with the raw key, so no KDF; fails if the new file has another key or salt
+    const QString path = m_path;
+    QByteArray keySpec = m_key;
+    const CipherProfile profile = m_profile;
+    bool opened = openWithKeySpec(path, keySpec, profile);
+    CipherKey::wipe(keySpec);
+    return opened;
+}
+
+bool DatabaseManager::migrate() {
+    sqlite3_stmt* stmt;
+    int version = 0;
+    if (sqlite3_prepare_v2(m_db, "PRAGMA user_version;", -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            version = sqlite3_column_int(stmt, 0);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    const int latest = (int)(sizeof(Migrations) / sizeof(Migrations[0]));
+    for (int i = version; i < latest; ++i) {
+        if (!beginTransaction()) return false;
+
+        char* errMsg = nullptr;
+        QByteArray versionPragma = "PRAGMA user_version = " + QByteArray::number(i + 1) + ";";
+        if (sqlite3_exec(m_db, Migrations[i], nullptr, nullptr, &errMsg) != SQLITE_OK
+            || sqlite3_exec(m_db, versionPragma.constData(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+            qCritical() << "Schema migration" << i + 1 << "failed:" << (errMsg ? errMsg : "Unknown error");
+            sqlite3_free(errMsg);
+            rollbackTransaction();
+            return false;
+        }
+        if (!commitTransaction()) return false;
+    }
+    return true;
+}
+
+QueryProfiler& DatabaseManager::profiler() {
+    return m_profiler;
+}
+
+bool DatabaseManager::changePassword(const QString& newPassword, const CipherProfile& profile) {
+    if (!m_db || m_rekeyThread || newPassword.isEmpty()) return false;
+    if (!holdWriteLock()) return false;
+    
+    m_pendingProfile = profile;
+    
+    RekeyWorker::Job job{m_path, m_key, newPassword.toUtf8(), m_profile, profile};
+    m_rekeyThread = new QThread();
+    m_rekeyWorker = new RekeyWorker(job);
+    CipherKey::wipe(job.newKey);
+    m_rekeyWorker->moveToThread(m_rekeyThread);
+    
+    connect(m_rekeyThread, &QThread::started, m_rekeyWorker, &RekeyWorker::run);
+    connect(m_rekeyWorker, &RekeyWorker::progress, this, &DatabaseManager::passwordChangeProgress);
+    connect(m_rekeyWorker, &RekeyWorker::finished, this, &DatabaseManager::finishPasswordChange);
+    connect(m_rekeyWorker, &RekeyWorker::finished, m_rekeyThread, &QThread::quit);
+    connect(m_rekeyThread, &QThread::finished, m_rekeyWorker, &QObject::deleteLater);
+    connect(m_rekeyThread, &QThread::finished, m_rekeyThread, &QObject::deleteLater);
+    
+    m_rekeyThread->start();
+    return true;
+}
+
+void DatabaseManager::cancelPasswordChange() {
+    if (m_rekeyWorker) {
+        m_rekeyWorker->cancel();
+    }
+}
+
+bool DatabaseManager::isChangingPassword() const {
+    return m_rekeyThread != nullptr;
+}
+
+bool DatabaseManager::verifyPassword(const ConnectionInfo& info, const QString& password) {
+    if (info.keySpec.isEmpty()) return false;
+    
+    QByteArray candidate = CipherKey::derive(info.path, password.toUtf8(), info.profile.kdfIterations);
+    if (candidate.size() != info.keySpec.size()) {
+        CipherKey::wipe(candidate);
+        return false;
+    }
+    
+    // Constant time, so the comparison does not leak how much of the key matched
+    unsigned char diff = 0;
+    for (int i = 0; i < candidate.size(); ++i) {
+        diff |= (unsigned char)(candidate.at(i) ^ info.keySpec.at(i));
+    }
+    CipherKey::wipe(candidate);
+    return diff == 0;
+}
+
+bool DatabaseManager::holdWriteLock() {
+    char* errMsg = nullptr;
+    if (sqlite3_exec(m_db, "BEGIN IMMEDIATE;", nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        qWarning() << "Vault is busy, cannot hold off writers:" << (errMsg ? errMsg : "Unknown error");
+        sqlite3_free(errMsg);
+        return false;
+    }
+    // Other connections wait on the lock; this one fails its writes instead of queueing them in the open transaction
+    sqlite3_set_authorizer(m_db, &denyWrites, nullptr);
+    return true;
+}
+
+void DatabaseManager::releaseWriteLock() {
+    if (!m_db) return;
+    sqlite3_set_authorizer(m_db, nullptr, nullptr);
+    if (!sqlite3_get_autocommit(m_db)) {
+        sqlite3_exec(m_db, "ROLLBACK;", nullptr, nullptr, nullptr);
+    }
+}
+
+bool DatabaseManager::checkpointWal(bool truncate) {
+    if (!m_db) return false;
+    
+    const int mode = truncate ? SQLITE_CHECKPOINT_TRUNCATE : SQLITE_CHECKPOINT_PASSIVE;
+    if (sqlite3_wal_checkpoint_v2(m_db, nullptr, mode, nullptr, nullptr) != SQLITE_OK) {
+        qWarning() << "WAL checkpoint failed:" << sqlite3_errmsg(m_db);
+        return false;
+    }
+    return true;
+}
+
+DatabaseManager::CipherProfile DatabaseManager::cipherProfile() const {
+    return m_profile;
+}
+
+QString DatabaseManager::path() const {
+    return m_path;
+}
+
+QSharedPointer<ReaderPool> DatabaseManager::readerPool() const {
+    return m_readers;
+}
+
+DatabaseManager::ConnectionInfo DatabaseManager::connectionInfo() const {
+    return ConnectionInfo{m_path, m_key, m_profile};
+}
+
+sqlite3* DatabaseManager::openConnection(const ConnectionInfo& info, int flags, QString* error) {
+    sqlite3* db = nullptr;
+    if (sqlite3_open_v2(info.path.toUtf8().constData(), &db, flags, nullptr) != SQLITE_OK) {
+        *error = QString("Failed to open %1: %2").arg(info.path, db ? sqlite3_errmsg(db) : "Unknown error");
+        sqlite3_close(db);
+        return nullptr;
+    }
+    
+    if (sqlite3_key(db, info.keySpec.constData(), info.keySpec.length()) != SQLITE_OK
+        || !configureCipher(db, info.profile)) {
+        *error = QString("Failed to key %1: %2").arg(info.path, sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return nullptr;
+    }
+    
+    sqlite3_busy_timeout(db, 5000);
+    return db;
+}
+
+void DatabaseManager::finishPasswordChange(bool success, const QByteArray& keySpec, const QString& error) {
+    m_rekeyWorker = nullptr;
+    m_rekeyThread = nullptr;
+    releaseWriteLock();
+    
+    QByteArray newKey = keySpec;
+    QByteArray oldKey = m_key;
+    auto wipePending = [&newKey, &oldKey]() {
+        CipherKey::wipe(newKey);
+        CipherKey::wipe(oldKey);
+    };
+    
+    if (!success) {
+        wipePending();
+        emit passwordChangeFinished(false, error);
+        return;
+    }
+    
+    const QString path = m_path;
+    const QString copyPath = RekeyWorker::targetPathFor(path);
+    const QString originalPath = path + ".old";
+    const CipherProfile oldProfile = m_profile;
+    
+    // Whatever is left in the WAL must be in the original and the log empty before the rename,
+    // or it would be replayed onto the new file
+    if (m_readers) {
+        m_readers->shutdown();
+        m_readers.reset();
+    }
+    if (!checkpointWal(true)) {
+        QFile::remove(copyPath);
+        openWithKeySpec(path, oldKey, oldProfile);
+        wipePending();
+        emit passwordChangeFinished(false, tr("The vault is in use; the password was not changed."));
+        return;
+    }
+    closeDatabase();
+    
+    // Keep the original reachable until the new file has been opened successfully
+    std::error_code ec;
+    std::filesystem::remove(toFsPath(originalPath), ec);
+    ec.clear();
+    std::filesystem::create_hard_link(toFsPath(path), toFsPath(originalPath), ec);
+    if (ec) {
+        ec.clear();
+        std::filesystem::copy_file(toFsPath(path), toFsPath(originalPath), ec);
+    }
+    
+    // rename() replaces the vault atomically, so it is never missing or half written
+    if (!ec) {
+        std::filesystem::rename(toFsPath(copyPath), toFsPath(path), ec);
+    }
+    if (ec) {
+        qCritical() << "Failed to swap in the re-encrypted vault:" << QString::fromStdString(ec.message());
+        QFile::remove(copyPath);
+        QFile::remove(originalPath);
+        openWithKeySpec(path, oldKey, oldProfile);
+        wipePending();
+        emit passwordChangeFinished(false, tr("Failed to replace the vault file."));
+        return;
+    }
+    
+    saveCipherProfile(path, m_pendingProfile);
+    if (!openWithKeySpec(path, newKey, m_pendingProfile)) {
+        qCritical() << "Re-encrypted vault could not be opened, restoring the original";
+        std::filesystem::rename(toFsPath(originalPath), toFsPath(path), ec);
+        saveCipherProfile(path, oldProfile);
+        openWithKeySpec(path, oldKey, oldProfile);
+        wipePending();
+        emit passwordChangeFinished(false, tr("The re-encrypted vault could not be opened; the original was kept."));
+        return;
+    }
+    
+    QFile::remove(originalPath);
+    wipePending();
+    emit passwordChangeFinished(true, QString());
+}
+
+bool DatabaseManager::configureCipher(sqlite3* db, const CipherProfile& profile, const char* schema) {
+    // Must run after keying and before the first read
+    const QByteArray prefix = QByteArray("PRAGMA ") + schema + ".";
+    const QByteArray sql = prefix + "cipher_compatibility = 4; "
+                         + prefix + "kdf_iter = " + QByteArray::number(profile.kdfIterations) + "; "
+                         + prefix + "cipher_page_size = " + QByteArray::number(profile.pageSize) + ";";
+    
+    char* errMsg = nullptr;
+    if (sqlite3_exec(db, sql.constData(), nullptr, nullptr, &errMsg) != SQLITE_OK) {
+        qWarning() << "Failed to configure cipher:" << (errMsg ? errMsg : "Unknown error");
+        sqlite3_free(errMsg);
+        return false;
+    }
+    return true;
+}
+
+QString DatabaseManager::cipherProfilePath(const QString& path) {
+    return path + ".profile";
+}
+
+DatabaseManager::CipherProfile DatabaseManager::loadCipherProfile(const QString& path, const CipherProfile& fallback) {
+    // The profile cannot live inside the encrypted file, it is needed to open it
+    CipherProfile profile = fallback;
+    const QString profilePath = cipherProfilePath(path);
+    if (QFile::exists(profilePath)) {
+        QSettings file(profilePath, QSettings::IniFormat);
+        profile.kdfIterations = file.value("kdfIterations", fallback.kdfIterations).toInt();
+        profile.pageSize = file.value("pageSize", fallback.pageSize).toInt();
+        return profile;
+    }
+    
+    QSettings settings;
+    const QString legacyKey = legacyProfileKey(path);
+    if (!settings.contains(legacyKey + "/kdfIterations")) {
+        return profile;
+    }
+    settings.beginGroup(legacyKey);
+    profile.kdfIterations = settings.value("kdfIterations", profile.kdfIterations).toInt();
+    profile.pageSize = settings.value("pageSize", profile.pageSize).toInt();
+    settings.endGroup();
+    if (saveCipherProfile(path, profile)) {
+        settings.remove(legacyKey);
+    }
+    return profile;
+}
+
+bool DatabaseManager::saveCipherProfile(const QString& path, const CipherProfile& profile) {
+    QSettings file(cipherProfilePath(path), QSettings::IniFormat);
+    file.setValue("kdfIterations", profile.kdfIterations);
+    file.setValue("pageSize", profile.pageSize);
+    file.sync();
+    if (file.status() != QSettings::NoError) {
+        qWarning() << "Failed to write the cipher profile:" << cipherProfilePath(path);
+        return false;
+    }
+    return true;
 }
\ No newline at end of file
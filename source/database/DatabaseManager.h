@@ -4,12 +4,35 @@
 #include <sqlite3.h>
 #include <QString>
 #include <QList>
+#include <QMap>
+#include <QPair>
+#include <QByteArray>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QSet>
+#include <QHash>
 
+#include "QueryProfiler.h"
+#include "TagIndex.h"
+#include "../utils/FrecencyIndex.h"
+
+class QThread;
+class QTimer;
+class RekeyWorker;
+class ReaderPool;
+class QIODevice;
+
+// One open vault: its main connection, key and cipher settings.
+// Every open vault has its own instance, owned by the widget that shows it.
 class DatabaseManager : public QObject {
     Q_OBJECT
 
 public:
-    static DatabaseManager& instance();
+    // Committed pages are moved from the WAL into the vault file once writes have settled for this long
+    static const int CheckpointDelayMs = 2000;
+
+    explicit DatabaseManager(QObject* parent = nullptr);
+    ~DatabaseManager() override;
 
     struct Group {
         int id;
@@ -25,31 +48,213 @@ public:
         QString password;
         QString url;
         QString notes;
+        // otpauth:// URI, empty when the entry has no one-time password
+        QString otp;
+    };
+
+    // A file attached to an entry; the contents are read and written through streams
+    struct Attachment {
+        int id;
+        int entryId;
+        QString name;
+        qint64 size;
+        QString sha256;
+    };
+
+    // One past version of an entry, as listed in its history
+    struct HistoryVersion {
+        int version;
+        QString changedAt;
+    };
+
+    // SQLCipher settings a vault is keyed with; compatibility 4 defaults
+    struct CipherProfile {
+        int kdfIterations = 256000;
+        int pageSize = 4096;
+    };
+
+    // Everything another connection needs to open this vault without running the KDF again
+    struct ConnectionInfo {
+        QString path;
+        QByteArray keySpec;
+        CipherProfile profile;
     };
 
     // Database Logic
     void ensureRootGroup();
     QList<Group> getGroups(int parentId = 0);
     QList<Entry> getEntries(int groupId);
+    // Structured query, see SearchQuery; top-level tag terms go through the tag index
     QList<Entry> searchEntries(const QString& query);
+    // Same search on any connection to a vault, for callers on other threads; tags are looked up in SQL
+    static QList<Entry> searchEntries(sqlite3* db, const QString& query);
     int createGroup(const QString& name, int parentId = 0);
     bool updateGroup(int id, const QString& name);
+    // What deleteGroup would do with a group, for asking the user the right question
+    enum class GroupDeletion {
+        ToRecycleBin,
+        // The group is in the bin already, or is the bin; it goes with the next purge
+        Permanent,
+        // The group holds the bin, which only a vault edited elsewhere can get into
+        NotAllowed
+    };
+    GroupDeletion groupDeletion(int id);
+    // Moves the group with everything in it to the recycle bin. A group already in the bin is
+    // marked for the background purge instead; nothing is ever removed here on the GUI thread.
     bool deleteGroup(int id);
+    // parentId 0 makes it a top-level group; fails for a target inside the group itself
+    bool moveGroup(int id, int parentId);
+    bool isInSubtree(int groupId, int ancestorId);
+    // Entries in each group and everything below it, keyed by group id; empty subtrees are left out
+    QHash<int, int> getSubtreeEntryCounts();
+
+    // Used to pick up changes made by other processes or machines
+    QList<Group> getAllGroups();
+    QSet<int> getEntryIds();
+    QList<Entry> getEntriesByIds(const QList<int>& ids);
+    QList<Entry> getEntriesModifiedSince(const QString& timestamp);
+    QString latestModification();
+    int dataVersion();
+
+    // Browser autofill: URLs to index, and the clients allowed to ask for them
+    QList<QPair<int, QString>> getEntryUrls();
+    static QList<QPair<int, QString>> getEntryUrls(sqlite3* db);
+    QByteArray autofillClientKey(const QString& clientId);
+    bool addAutofillClient(const QString& clientId, const QByteArray& key);
+
+    // Lookup attributes, as used by Secret Service clients
+    QMap<QString, QString> getEntryAttributes(int entryId);
+    bool setEntryAttributes(int entryId, const QMap<QString, QString>& attributes);
+    // Writes the entry, as a new one when its id is -1, and replaces its attributes in one
+    // transaction, so a failure leaves neither behind. Returns the entry id, or -1.
+    int saveEntryWithAttributes(const Entry& entry, const QMap<QString, QString>& attributes);
+    QList<int> findEntriesByAttributes(const QMap<QString, QString>& attributes, int groupId);
+    // Creation and modification time in seconds since the epoch
+    QPair<qint64, qint64> entryTimes(int entryId);
 
     int createEntry(const Entry& entry);
+    // The replaced field values are kept as a new version in the entry's history
     bool updateEntry(const Entry& entry);
+    // Moves a HOTP entry's counter past the code just used, without a history version.
+    // Returns the stored otp URI, or an empty string if the entry has no HOTP settings.
+    QString advanceHotpCounter(int entryId);
+    // Moves the entry to the recycle bin, or marks it for the next purge if it is there already
     bool deleteEntry(int id);
 
+    // Past versions of an entry, newest first
+    QList<HistoryVersion> getEntryHistory(int entryId);
+    bool getEntryVersion(int entryId, int version, Entry* entry);
+    // Brings the fields of a past version back; what they replace becomes a version too
+    bool restoreEntryVersion(int entryId, int version);
+
+    // Attachments, streamed in fixed-size chunks; identical files are stored once
+    QList<Attachment> getAttachments(int entryId);
+    int addAttachment(int entryId, const QString& name, QIODevice* source);
+    bool saveAttachment(int attachmentId, QIODevice* target);
+    bool removeAttachment(int attachmentId);
+
+    // Titles with their use counts, for the quick access palette
+    QList<FrecencyIndex::Item> getEntryUsage();
+    static QList<FrecencyIndex::Item> getEntryUsage(sqlite3* db);
+    bool recordEntryUse(int entryId, qint64 when);
+
+    // Tags, kept in memory as a bitmap index while the vault is open
+    QStringList getTags() const;
+    QStringList getEntryTags(int entryId) const;
+    bool setEntryTags(int entryId, const QStringList& tags);
+    // Like saveEntryWithAttributes: the entry, new when its id is -1, and its tags in one transaction
+    int saveEntryWithTags(const Entry& entry, const QStringList& tags);
+    // For changes that bypassed this connection, e.g. a merge or a sync tool
+    void rebuildTagIndex();
+
+    // Recycle bin; items go back where they were deleted from, or to the top-level group
+    int recycleBinGroupId();
+    QSet<int> recycleBinGroupIds();
+    bool isInRecycleBin(int groupId);
+    bool restoreEntries(const QList<int>& ids);
+    bool restoreGroup(int id);
+
+    // Bulk operations, each run as a single transaction
+    bool moveEntries(const QList<int>& ids, int groupId);
+    // Entry id and target group pairs, e.g. to put entries back where they came from
+    bool moveEntries(const QList<QPair<int, int>>& moves);
+    // Same rules as deleteEntry
+    bool deleteEntries(const QList<int>& ids);
+    QList<int> duplicateEntries(const QList<int>& ids, int groupId = 0);
+
+    bool beginTransaction();
+    bool commitTransaction();
+    void rollbackTransaction();
+
     bool createDatabase(const QString& path, const QString& password);
     bool openDatabase(const QString& path, const QString& password);
+    // openDatabase in two steps, so the KDF can run off the GUI thread. deriveKeySpec is
+    // safe on any thread and returns an empty spec for a missing or plain-text file.
+    static QByteArray deriveKeySpec(const QString& path, const QString& password);
+    bool openWithKey(const QString& path, const QByteArray& keySpec);
     void closeDatabase();
     bool isOpen() const;
+    // Opens the file at the same path again with the current key, e.g. after a sync tool replaced it
+    bool reopen();
+
+    // Master password change; re-encrypts into a new file on a worker thread
+    bool changePassword(const QString& newPassword, const CipherProfile& profile);
+    void cancelPasswordChange();
+    bool isChangingPassword() const;
+    // Runs the KDF, so call it off the GUI thread with a copy of connectionInfo()
+    static bool verifyPassword(const ConnectionInfo& info, const QString& password);
+    CipherProfile cipherProfile() const;
+
+    QString path() const;
+    ConnectionInfo connectionInfo() const;
+    // Read-only connections for worker threads; hold the pointer while using a lease
+    QSharedPointer<ReaderPool> readerPool() const;
+    static sqlite3* openConnection(const ConnectionInfo& info, int flags, QString* error);
+
+    // Statement timings for the main connection; off unless KEEBOX_PROFILE_SQL is set
+    QueryProfiler& profiler();
+
+    static bool configureCipher(sqlite3* db, const CipherProfile& profile, const char* schema = "main");
+    // The profile is kept in a small file next to the vault, so it travels with moves, syncs and backups.
+    // A vault without one is assumed to use the fallback.
+    static QString cipherProfilePath(const QString& path);
+    static CipherProfile loadCipherProfile(const QString& path, const CipherProfile& fallback = CipherProfile());
+    static bool saveCipherProfile(const QString& path, const CipherProfile& profile);
+
+signals:
+    void databaseModified();
+    void passwordChangeProgress(int percent);
+    void passwordChangeFinished(bool success, const QString& error);
 
 private:
-    DatabaseManager();
-    ~DatabaseManager() override;
+    bool openWithKeySpec(const QString& path, const QByteArray& keySpec, const CipherProfile& profile);
+    // Statements of updateEntry and setEntryAttributes, run inside the caller's transaction
+    bool writeEntryUpdate(const Entry& previous, const Entry& entry);
+    bool writeEntryAttributes(int entryId, const QMap<QString, QString>& attributes);
+    // Replaces the entry's tags, given normalized
+    bool writeEntryTags(int entryId, const QStringList& tags);
+    bool migrate();
+
     DatabaseManager(const DatabaseManager&) = delete;
     DatabaseManager& operator=(const DatabaseManager&) = delete;
 
+    void finishPasswordChange(bool success, const QByteArray& keySpec, const QString& error);
+    // Held by the main connection while a password change copies the vault, so no commit misses the copy
+    bool holdWriteLock();
+    void releaseWriteLock();
+    bool checkpointWal(bool truncate);
+
     sqlite3* m_db = nullptr;
+    QString m_path;
+    QByteArray m_key;
+    CipherProfile m_profile;
+    QueryProfiler m_profiler;
+    QSharedPointer<ReaderPool> m_readers;
+    TagIndex m_tagIndex;
+
+    QTimer* m_checkpointTimer = nullptr;
+
+    QPointer<QThread> m_rekeyThread;
+    QPointer<RekeyWorker> m_rekeyWorker;
+    CipherProfile m_pendingProfile;
 };
\ No newline at end of file
@@ -0,0 +1,279 @@
+#include "EntryHistory.h"
+
+#include <QDataStream>
+#include <QDebug>
+#include <QHash>
+#include <QIODevice>
+#include <QSettings>
+#include <QThread>
+
+namespace {
+
+const quint8 FormatVersion = 1;
+const int FieldCount = 6;
+const int NotesField = 4;
+// Below this, zlib framing costs more than it saves
+const int CompressAbove = 96;
+
+QString* field(DatabaseManager::Entry& entry, int index) {
+    switch (index) {
+    case 0: return &entry.title;
+    case 1: return &entry.username;
+    case 2: return &entry.password;
+    case 3: return &entry.url;
+    case 4: return &entry.notes;
+    default: return &entry.otp;
+    }
+}
+
+const QString& valueOf(const DatabaseManager::Entry& entry, int index) {
+    return *field(const_cast<DatabaseManager::Entry&>(entry), index);
+}
+
+// One byte for the format, a mask of stored fields, a mask of compressed ones, then the fields in order
+QByteArray encode(const DatabaseManager::Entry& entry, quint8 fields) {
+    QByteArray data;
+    QDataStream stream(&data, QIODevice::WriteOnly);
+    quint8 compressed = 0;
+    QList<QByteArray> values;
+    for (int i = 0; i < FieldCount; ++i) {
+        if (!(fields & (1 << i))) continue;
+        QByteArray value = valueOf(entry, i).toUtf8();
+        if (i == NotesField && value.size() > CompressAbove) {
+            QByteArray packed = qCompress(value, 9);
+            if (packed.size() < value.size()) {
+                value = packed;
+                compressed |= quint8(1 << i);
+            }
+        }
+        values.append(value);
+    }
+
+    stream << FormatVersion << fields << compressed;
+    for (const QByteArray& value : values) {
+        stream << value;
+    }
+    return data;
+}
+
+bool apply(const QByteArray& data, DatabaseManager::Entry* entry) {
+    QDataStream stream(data);
+    quint8 format = 0, fields = 0, compressed = 0;
+    stream >> format >> fields >> compressed;
+    if (format != FormatVersion) return false;
+
+    for (int i = 0; i < FieldCount; ++i) {
+        if (!(fields & (1 << i))) continue;
+        QByteArray value;
+        stream >> value;
+        if (compressed & (1 << i)) {
+            value = qUncompress(value);
+        }
+        *field(*entry, i) = QString::fromUtf8(value);
+    }
+    return stream.status() == QDataStream::Ok;
+}
+
+int queryInt(sqlite3* db, const char* sql, int entryId) {
+    int value = 0;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    sqlite3_bind_int(stmt, 1, entryId);
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        value = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+}
+
+EntryHistory::Policy EntryHistory::loadPolicy() {
+    Policy policy;
+    QSettings settings;
+    settings.beginGroup("history");
+    policy.keepVersions = settings.value("keepVersions", policy.keepVersions).toInt();
+    policy.keepDays = settings.value("keepDays", policy.keepDays).toInt();
+    settings.endGroup();
+    return policy;
+}
+
+void EntryHistory::savePolicy(const Policy& policy) {
+    QSettings settings;
+    settings.beginGroup("history");
+    settings.setValue("keepVersions", policy.keepVersions);
+    settings.setValue("keepDays", policy.keepDays);
+    settings.endGroup();
+}
+
+bool EntryHistory::record(sqlite3* db, const DatabaseManager::Entry& previous) {
+    const int last = queryInt(db, "SELECT COALESCE(max(version), 0) FROM entry_history WHERE entry_id = ?", previous.id);
+    if (last < 0) return false;
+    const int version = last + 1;
+
+    // Deltas are taken against the version before; the row is a snapshot when there is none to rebuild
+    quint8 fields = (1 << FieldCount) - 1;
+    bool snapshot = true;
+    DatabaseManager::Entry base = previous;
+    if (last > 0 && version % SnapshotInterval != 1 && load(db, previous.id, last, &base)) {
+        snapshot = false;
+        fields = 0;
+        for (int i = 0; i < FieldCount; ++i) {
+            if (valueOf(base, i) != valueOf(previous, i)) fields |= quint8(1 << i);
+        }
+    }
+
+    sqlite3_stmt* stmt;
+    const char* query = "INSERT INTO entry_history (entry_id, version, snapshot, data) VALUES (?, ?, ?, ?)";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+
+    const QByteArray data = encode(previous, fields);
+    sqlite3_bind_int(stmt, 1, previous.id);
+    sqlite3_bind_int(stmt, 2, version);
+    sqlite3_bind_int(stmt, 3, snapshot ? 1 : 0);
+    sqlite3_bind_blob(stmt, 4, data.constData(), data.size(), SQLITE_TRANSIENT);
+
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    if (!success) {
+        qCritical() << "Failed to record entry history:" << sqlite3_errmsg(db);
+    }
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+QList<DatabaseManager::HistoryVersion> EntryHistory::versions(sqlite3* db, int entryId) {
+    QList<DatabaseManager::HistoryVersion> list;
+    if (!db) return list;
+
+    sqlite3_stmt* stmt;
+    const char* query = "SELECT version, changed_at FROM entry_history WHERE entry_id = ? ORDER BY version DESC";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return list;
+
+    sqlite3_bind_int(stmt, 1, entryId);
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        DatabaseManager::HistoryVersion v;
+        v.version = sqlite3_column_int(stmt, 0);
+        v.changedAt = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 1));
+        list.append(v);
+    }
+
+    sqlite3_finalize(stmt);
+    return list;
+}
+
+bool EntryHistory::load(sqlite3* db, int entryId, int version, DatabaseManager::Entry* entry) {
+    if (!db) return false;
+
+    // The nearest snapshot at or below the version, then the deltas up to it
+    sqlite3_stmt* stmt;
+    const char* query =
+        "SELECT version, data FROM entry_history WHERE entry_id = ?1 AND version <= ?2 AND version >= "
+        "(SELECT max(version) FROM entry_history WHERE entry_id = ?1 AND version <= ?2 AND snapshot = 1) "
+        "ORDER BY version";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+
+    sqlite3_bind_int(stmt, 1, entryId);
+    sqlite3_bind_int(stmt, 2, version);
+    int reached = 0;
+    bool ok = true;
+    while (ok && sqlite3_step(stmt) == SQLITE_ROW) {
+        reached = sqlite3_column_int(stmt, 0);
+        const QByteArray data = QByteArray::fromRawData((const char*)sqlite3_column_blob(stmt, 1),
+                                                        sqlite3_column_bytes(stmt, 1));
+        ok = apply(data, entry);
+    }
+
+    sqlite3_finalize(stmt);
+    return ok && reached == version;
+}
+
+int EntryHistory::prune(sqlite3* db, const Policy& policy, const std::atomic<bool>& cancelled) {
+    if (!db) return -1;
+    // A version is kept while either rule keeps it, and a rule set to 0 keeps everything
+    if (policy.keepVersions <= 0 || policy.keepDays <= 0) return 0;
+
+    // entry id -> newest version past the newest keepVersions
+    QHash<int, int> byCount;
+    sqlite3_stmt* stmt;
+    const char* countQuery = "SELECT entry_id, max(version) FROM entry_history GROUP BY entry_id HAVING count(*) > ?";
+    if (sqlite3_prepare_v2(db, countQuery, -1, &stmt, nullptr) == SQLITE_OK) {
+        sqlite3_bind_int(stmt, 1, policy.keepVersions);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            byCount.insert(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1) - policy.keepVersions);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    // entry id -> newest version that goes, which both rules have to give up. Versions are only
+    // ever added, so a cutoff read here still holds when its batch runs.
+    QList<QPair<int, int>> cutoffs;
+    const char* ageQuery = "SELECT entry_id, max(version) FROM entry_history WHERE changed_at < datetime('now', ?) GROUP BY entry_id";
+    if (!byCount.isEmpty() && sqlite3_prepare_v2(db, ageQuery, -1, &stmt, nullptr) == SQLITE_OK) {
+        const QByteArray modifier = QByteArray("-") + QByteArray::number(policy.keepDays) + " days";
+        sqlite3_bind_text(stmt, 1, modifier.constData(), -1, SQLITE_TRANSIENT);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto count = byCount.constFind(sqlite3_column_int(stmt, 0));
+            if (count != byCount.constEnd()) {
+                cutoffs.append({count.key(), qMin(count.value(), sqlite3_column_int(stmt, 1))});
+            }
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    sqlite3_stmt* rebase = nullptr;
+    sqlite3_stmt* remove = nullptr;
+    bool ok = sqlite3_prepare_v2(db, "UPDATE entry_history SET snapshot = 1, data = ?3 WHERE entry_id = ?1 AND version = ?2",
+                                 -1, &rebase, nullptr) == SQLITE_OK
+        && sqlite3_prepare_v2(db, "DELETE FROM entry_history WHERE entry_id = ?1 AND version <= ?2",
+                              -1, &remove, nullptr) == SQLITE_OK;
+
+    // PruneBatch entries per transaction with a pause in between, so GUI writes get the lock
+    int removed = 0;
+    for (int first = 0; ok && first < cutoffs.size() && !cancelled; first += PruneBatch) {
+        if (first > 0) QThread::msleep(PrunePauseMs);
+        if (sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            ok = false;
+            break;
+        }
+
+        int batchRemoved = 0;
+        for (int i = first; ok && i < qMin(first + PruneBatch, cutoffs.size()); ++i) {
+            const int entryId = cutoffs.at(i).first;
+            const int cutoff = cutoffs.at(i).second;
+
+            // The oldest version left has to stand on its own once the ones before it are gone;
+            // if it cannot be rebuilt, the entry keeps its whole chain
+            const int oldestKept = cutoff + 1;
+            DatabaseManager::Entry entry;
+            if (!load(db, entryId, oldestKept, &entry)) {
+                qWarning() << "Skipping history of entry" << entryId << ": version" << oldestKept << "cannot be rebuilt";
+                continue;
+            }
+            const QByteArray data = encode(entry, (1 << FieldCount) - 1);
+            sqlite3_bind_int(rebase, 1, entryId);
+            sqlite3_bind_int(rebase, 2, oldestKept);
+            sqlite3_bind_blob(rebase, 3, data.constData(), data.size(), SQLITE_TRANSIENT);
+            ok = sqlite3_step(rebase) == SQLITE_DONE;
+            sqlite3_reset(rebase);
+
+            sqlite3_bind_int(remove, 1, entryId);
+            sqlite3_bind_int(remove, 2, cutoff);
+            ok = ok && sqlite3_step(remove) == SQLITE_DONE;
+            batchRemoved += sqlite3_changes(db);
+            sqlite3_reset(remove);
+        }
+
+        if (ok && sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) == SQLITE_OK) {
+            removed += batchRemoved;
+        } else {
+            ok = false;
+            sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        }
+    }
+    sqlite3_finalize(rebase);
+    sqlite3_finalize(remove);
+
+    if (ok) return removed;
+    qWarning() << "Pruning entry history failed:" << sqlite3_errmsg(db);
+    return -1;
+}
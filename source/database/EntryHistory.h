@@ -0,0 +1,37 @@
+#pragma once
+
+#include <QList>
+#include <sqlite3.h>
+#include <atomic>
+
+#include "DatabaseManager.h"
+
+// Past versions of entries, one row per update in entry_history. A version
+// normally stores only the fields that differ from the version before it, with
+// long notes compressed; every SnapshotInterval-th version, and the oldest one
+// kept, is stored whole, so rebuilding any version replays only a few rows.
+class EntryHistory {
+public:
+    static const int SnapshotInterval = 8;
+    static const int PruneBatch = 100;
+    static const int PrunePauseMs = 50;
+
+    struct Policy {
+        int keepVersions = 20;  // per entry; 0 keeps every version
+        int keepDays = 365;     // 0 keeps versions of any age
+    };
+
+    static Policy loadPolicy();
+    static void savePolicy(const Policy& policy);
+
+    // Adds previous (the entry as it is before an update) as the entry's next version.
+    // Runs inside the caller's transaction.
+    static bool record(sqlite3* db, const DatabaseManager::Entry& previous);
+    // Newest first; served by the (entry_id, version) index
+    static QList<DatabaseManager::HistoryVersion> versions(sqlite3* db, int entryId);
+    // Fills in the stored fields of one version; id and group are left as they are
+    static bool load(sqlite3* db, int entryId, int version, DatabaseManager::Entry* entry);
+    // Drops versions the policy no longer keeps, PruneBatch entries per transaction.
+    // Returns how many, or -1; a cancelled run keeps what its finished batches removed.
+    static int prune(sqlite3* db, const Policy& policy, const std::atomic<bool>& cancelled);
+};
@@ -0,0 +1,143 @@
+#include "IntegrityChecker.h"
+#include "IntegrityWorker.h"
+
+#include <QDebug>
+#include <QThread>
+
+IntegrityChecker::IntegrityChecker(DatabaseManager& database, QObject* parent)
+    : QObject(parent), m_database(database) {
+    m_idleTimer = new QTimer(this);
+    m_idleTimer->setSingleShot(true);
+    m_idleTimer->setInterval(IdleDelayMs);
+    connect(m_idleTimer, &QTimer::timeout, this, &IntegrityChecker::onIdle);
+    m_idleTimer->start();
+}
+
+IntegrityChecker::~IntegrityChecker() {
+    if (m_thread) {
+        if (m_worker) {
+            m_worker->setPaused(true);
+        }
+        m_thread->quit();
+        m_thread->wait();
+    }
+}
+
+bool IntegrityChecker::isRunning() const {
+    return m_listed && !m_pending.isEmpty();
+}
+
+bool IntegrityChecker::ensureWorker() {
+    if (m_thread) return true;
+
+    QSharedPointer<ReaderPool> readers = m_database.readerPool();
+    if (!readers) return false;
+
+    // The worker reads through the vault's pool; a reopened vault gets a new worker
+    m_thread = new QThread();
+    m_worker = new IntegrityWorker(readers);
+    m_worker->moveToThread(m_thread);
+
+    connect(m_worker, &IntegrityWorker::chunksListed, this, &IntegrityChecker::onChunksListed);
+    connect(m_worker, &IntegrityWorker::chunkFinished, this, &IntegrityChecker::onChunkFinished);
+    connect(m_worker, &IntegrityWorker::readersClosed, this, &IntegrityChecker::discardWorker);
+    connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+    connect(m_thread, &QThread::finished, m_thread, &QObject::deleteLater);
+
+    m_thread->start(QThread::LowestPriority);
+    return true;
+}
+
+void IntegrityChecker::discardWorker() {
+    m_busy = false;
+    if (m_thread) {
+        m_thread->quit();
+    }
+    m_thread = nullptr;
+    m_worker = nullptr;
+}
+
+void IntegrityChecker::noteActivity() {
+    m_idle = false;
+    m_idleTimer->start();
+    if (m_busy && !m_forced && m_worker) {
+        m_worker->setPaused(true);
+    }
+}
+
+void IntegrityChecker::checkNow() {
+    if (!m_database.isOpen()) return;
+    m_forced = true;
+    if (!isRunning()) {
+        m_listed = false;
+        m_pending.clear();
+    }
+    if (m_worker) {
+        m_worker->setPaused(false);
+    }
+    runNextChunk();
+}
+
+void IntegrityChecker::onIdle() {
+    m_idle = true;
+    if (m_passDone && !m_forced) return;
+    runNextChunk();
+}
+
+void IntegrityChecker::runNextChunk() {
+    if (m_busy || !m_database.isOpen()) return;
+    if (!m_idle && !m_forced) return;
+
+    if (!ensureWorker()) return;
+    m_worker->setPaused(false);
+    m_busy = true;
+
+    if (!m_listed) {
+        QMetaObject::invokeMethod(m_worker, "listChunks", Qt::QueuedConnection);
+    } else {
+        QMetaObject::invokeMethod(m_worker, "runChunk", Qt::QueuedConnection, Q_ARG(QString, m_pending.first()));
+    }
+}
+
+void IntegrityChecker::onChunksListed(const QStringList& chunks) {
+    m_busy = false;
+    m_listed = true;
+    m_pending = chunks;
+    m_total = chunks.size();
+    m_problems.clear();
+
+    if (chunks.isEmpty()) {
+        m_forced = false;
+        m_passDone = true;
+        emit checkFinished(false, {tr("The vault could not be opened for checking")});
+        return;
+    }
+
+    emit checkProgress(0, m_total);
+    runNextChunk();
+}
+
+void IntegrityChecker::onChunkFinished(const QString& chunk, bool completed, const QStringList& problems) {
+    m_busy = false;
+
+    // An interrupted chunk stays at the head of the queue and is redone from scratch
+    if (completed && !m_pending.isEmpty() && m_pending.first() == chunk) {
+        m_pending.removeFirst();
+        m_problems.append(problems);
+        emit checkProgress(m_total - m_pending.size(), m_total);
+    }
+
+    if (m_pending.isEmpty()) {
+        m_forced = false;
+        m_passDone = true;
+        m_listed = false;
+        if (!m_problems.isEmpty()) {
+            qWarning() << "Integrity check found problems:" << m_problems;
+        }
+        emit checkFinished(m_problems.isEmpty(), m_problems);
+        return;
+    }
+
+    // Yield between chunks so queued UI work is never starved
+    QTimer::singleShot(50, this, &IntegrityChecker::runNextChunk);
+}
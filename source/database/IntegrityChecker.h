@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QString>
+#include <QStringList>
+#include <QTimer>
+
+#include "DatabaseManager.h"
+
+class QThread;
+class IntegrityWorker;
+
+// Verifies an open vault in the background while the user is idle.
+// The pass is split into chunks; user activity pauses the current chunk and
+// the pass resumes from it once the user is idle again.
+class IntegrityChecker : public QObject {
+    Q_OBJECT
+
+public:
+    static const int IdleDelayMs = 3000;
+
+    explicit IntegrityChecker(DatabaseManager& database, QObject* parent = nullptr);
+    ~IntegrityChecker() override;
+
+    // Called on every user input event
+    void noteActivity();
+    // Starts a pass right away that is not paused by activity
+    void checkNow();
+    bool isRunning() const;
+
+signals:
+    void checkProgress(int done, int total);
+    void checkFinished(bool ok, const QStringList& problems);
+
+private:
+    bool ensureWorker();
+    void discardWorker();
+    void onIdle();
+    void runNextChunk();
+    void onChunksListed(const QStringList& chunks);
+    void onChunkFinished(const QString& chunk, bool completed, const QStringList& problems);
+
+    DatabaseManager& m_database;
+    QTimer* m_idleTimer = nullptr;
+    QPointer<QThread> m_thread;
+    QPointer<IntegrityWorker> m_worker;
+
+    QStringList m_pending;
+    QStringList m_problems;
+    int m_total = 0;
+    bool m_idle = false;
+    bool m_forced = false;
+    bool m_busy = false;      // a request is queued on the worker
+    bool m_listed = false;    // the chunks of the current pass are known
+    bool m_passDone = false;  // one automatic pass per unlock is enough
+};
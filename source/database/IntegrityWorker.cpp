@@ -0,0 +1,157 @@
+#include "IntegrityWorker.h"
+
+#include <QDebug>
+#include <cstring>
+
+const char* IntegrityWorker::PagesPrefix = "pages:";
+const char* IntegrityWorker::CipherCheckChunk = "pages:all";
+
+IntegrityWorker::IntegrityWorker(const QSharedPointer<ReaderPool>& readers, QObject* parent)
+    : QObject(parent), m_readers(readers) {
+}
+
+void IntegrityWorker::setPaused(bool paused) {
+    m_paused = paused;
+}
+
+void IntegrityWorker::listChunks() {
+    QStringList chunks;
+    QString error;
+    ReaderPool::Lease lease = m_readers->acquire(&error);
+    if (!lease.isValid()) {
+        qWarning() << "Integrity check could not read the vault:" << error;
+        emit readersClosed();
+        return;
+    }
+    sqlite3* db = lease.db();
+
+    // Reading a page through sqlite_dbpage decrypts it, which checks its HMAC like cipher_integrity_check
+    // does, but in ranges that can be paused. Without that table the whole file goes in one chunk.
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT count(*) FROM sqlite_dbpage", -1, &stmt, nullptr) == SQLITE_OK) {
+        const int pageCount = sqlite3_step(stmt) == SQLITE_ROW ? sqlite3_column_int(stmt, 0) : 0;
+        sqlite3_finalize(stmt);
+        for (int first = 1; first <= pageCount; first += PagesPerChunk) {
+            const int last = qMin(first + PagesPerChunk - 1, pageCount);
+            chunks.append(QString("%1%2-%3").arg(PagesPrefix).arg(first).arg(last));
+        }
+    } else {
+        qInfo() << "sqlite_dbpage is not available; pages are verified by cipher_integrity_check in one go";
+        chunks.append(CipherCheckChunk);
+    }
+
+    const char* query = "SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%' ORDER BY name";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            chunks.append(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    emit chunksListed(chunks);
+}
+
+void IntegrityWorker::runChunk(const QString& chunk) {
+    QString error;
+    ReaderPool::Lease lease = m_readers->acquire(&error);
+    if (!lease.isValid()) {
+        emit readersClosed();
+        return;
+    }
+
+    int rc = SQLITE_DONE;
+    QStringList problems;
+    if (chunk == CipherCheckChunk) {
+        problems = checkCipher(lease.db(), &rc);
+    } else if (chunk.startsWith(PagesPrefix)) {
+        const QStringList range = chunk.mid(int(strlen(PagesPrefix))).split('-');
+        problems = checkPages(lease.db(), range.value(0).toInt(), range.value(1).toInt(), &rc);
+    } else {
+        problems = checkTable(lease.db(), chunk, &rc);
+    }
+
+    // Interrupted either by a pause or by the vault closing; the chunk is redone later
+    bool completed = (rc == SQLITE_DONE);
+    if (!completed && rc != SQLITE_INTERRUPT) {
+        problems.append(QString("%1: %2").arg(chunk, sqlite3_errstr(rc)));
+        completed = true;
+    }
+
+    emit chunkFinished(chunk, completed, problems);
+}
+
+QStringList IntegrityWorker::checkPages(sqlite3* db, int first, int last, int* rc) {
+    QStringList problems;
+    sqlite3_stmt* stmt;
+    *rc = sqlite3_prepare_v2(db, "SELECT pgno, length(data) FROM sqlite_dbpage WHERE pgno BETWEEN ? AND ? ORDER BY pgno",
+                             -1, &stmt, nullptr);
+    if (*rc != SQLITE_OK) return problems;
+
+    // Checked every few thousand VM steps so a pause takes effect almost at once
+    sqlite3_progress_handler(db, 4000, &IntegrityWorker::progressCallback, this);
+
+    // A page that fails its HMAC ends the statement, so the scan picks up again after it
+    int next = first;
+    while (next <= last) {
+        sqlite3_reset(stmt);
+        sqlite3_bind_int(stmt, 1, next);
+        sqlite3_bind_int(stmt, 2, last);
+        while ((*rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+            next = sqlite3_column_int(stmt, 0) + 1;
+        }
+        if (*rc == SQLITE_DONE || *rc == SQLITE_INTERRUPT) break;
+
+        problems.append(QString("page %1: %2").arg(next).arg(sqlite3_errmsg(db)));
+        ++next;
+        *rc = SQLITE_DONE;
+    }
+
+    sqlite3_progress_handler(db, 0, nullptr, nullptr);
+    sqlite3_finalize(stmt);
+    return problems;
+}
+
+QStringList IntegrityWorker::checkTable(sqlite3* db, const QString& table, int* rc) {
+    QStringList problems;
+
+    // quick_check of one table also covers its indexes
+    const QByteArray sql = "PRAGMA quick_check('" + QString(table).replace("'", "''").toUtf8() + "');";
+
+    sqlite3_stmt* stmt;
+    *rc = sqlite3_prepare_v2(db, sql.constData(), -1, &stmt, nullptr);
+    if (*rc != SQLITE_OK) {
+        problems.append(QString("%1: %2").arg(table, sqlite3_errmsg(db)));
+        *rc = SQLITE_DONE;
+        return problems;
+    }
+    while ((*rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        QString line = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0));
+        if (line != "ok") {
+            problems.append(QString("%1: %2").arg(table, line));
+        }
+    }
+    sqlite3_finalize(stmt);
+    return problems;
+}
+
+QStringList IntegrityWorker::checkCipher(sqlite3* db, int* rc) {
+    QStringList problems;
+
+    // Each row it returns is a page that failed its HMAC; a sound file returns none
+    sqlite3_stmt* stmt;
+    *rc = sqlite3_prepare_v2(db, "PRAGMA cipher_integrity_check;", -1, &stmt, nullptr);
+    if (*rc != SQLITE_OK) {
+        problems.append(QString("cipher_integrity_check: %1").arg(sqlite3_errmsg(db)));
+        *rc = SQLITE_DONE;
+        return problems;
+    }
+    while ((*rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+        problems.append(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0)));
+    }
+    sqlite3_finalize(stmt);
+    return problems;
+}
+
+int IntegrityWorker::progressCallback(void* context) {
+    return static_cast<IntegrityWorker*>(context)->m_paused ? 1 : 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <sqlite3.h>
+#include <atomic>
+
+#include "ReaderPool.h"
+
+// Runs integrity checks one chunk at a time, each on a pooled reader.
+// A chunk is either a range of pages whose HMAC is verified, or quick_check of
+// a single table. A page range can be paused mid-way and is run again later,
+// which costs at most PagesPerChunk pages. quick_check cannot resume, so a
+// table chunk that has started runs to the end; a pause applies after it.
+// Without sqlite_dbpage the pages are verified by one cipher_integrity_check
+// chunk instead, which likewise runs to the end.
+class IntegrityWorker : public QObject {
+    Q_OBJECT
+
+public:
+    static const char* PagesPrefix;
+    static const char* CipherCheckChunk;
+    static const int PagesPerChunk = 256;
+
+    explicit IntegrityWorker(const QSharedPointer<ReaderPool>& readers, QObject* parent = nullptr);
+
+    // Safe to call from any thread
+    void setPaused(bool paused);
+
+public slots:
+    void listChunks();
+    void runChunk(const QString& chunk);
+
+signals:
+    void chunksListed(const QStringList& chunks);
+    void chunkFinished(const QString& chunk, bool completed, const QStringList& problems);
+    // The vault was closed under us; this worker cannot be used any more
+    void readersClosed();
+
+private:
+    static int progressCallback(void* context);
+    QStringList checkPages(sqlite3* db, int first, int last, int* rc);
+    QStringList checkTable(sqlite3* db, const QString& table, int* rc);
+    QStringList checkCipher(sqlite3* db, int* rc);
+
+    QSharedPointer<ReaderPool> m_readers;
+    std::atomic<bool> m_paused{false};
+};
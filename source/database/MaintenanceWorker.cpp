@@ -0,0 +1,51 @@
+#include "MaintenanceWorker.h"
+#include "CipherKey.h"
+
+#include <QDebug>
+
+MaintenanceWorker::MaintenanceWorker(const Job& job, QObject* parent)
+    : QObject(parent), m_job(job) {
+}
+
+MaintenanceWorker::~MaintenanceWorker() {
+    CipherKey::wipe(m_job.vault.keySpec);
+}
+
+void MaintenanceWorker::cancel() {
+    m_cancelled = true;
+}
+
+void MaintenanceWorker::run() {
+    QString error;
+    sqlite3* db = DatabaseManager::openConnection(m_job.vault, SQLITE_OPEN_READWRITE, &error);
+    CipherKey::wipe(m_job.vault.keySpec);
+    if (!db) {
+        emit finished(false, 0, 0, error);
+        return;
+    }
+    // Purged entries take their history, tags and attachments with them through the cascades
+    sqlite3_exec(db, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr);
+
+    // Both steps commit in small batches, so neither holds the write lock for long
+    int removed = EntryHistory::prune(db, m_job.history, m_cancelled);
+    if (removed < 0 && !m_cancelled) {
+        error = QString("Failed to prune entry history: %1").arg(sqlite3_errmsg(db));
+    }
+
+    int purged = 0;
+    if (removed >= 0 && !m_cancelled) {
+        purged = RecycleBin::purge(db, m_job.recycleBin, m_cancelled);
+        if (purged < 0 && !m_cancelled) {
+            error = QString("Failed to purge the recycle bin: %1").arg(sqlite3_errmsg(db));
+        }
+    }
+    sqlite3_close(db);
+
+    if (removed > 0) {
+        qInfo() << "Pruned" << removed << "old entry versions";
+    }
+    if (purged > 0) {
+        qInfo() << "Purged" << purged << "items from the recycle bin";
+    }
+    emit finished(removed >= 0 && purged >= 0, qMax(removed, 0), qMax(purged, 0), error);
+}
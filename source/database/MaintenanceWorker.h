@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <atomic>
+
+#include "DatabaseManager.h"
+#include "EntryHistory.h"
+#include "RecycleBin.h"
+
+// Housekeeping that writes to the vault but needs no attention from the user,
+// run on its own connection on a worker thread: pruning entry history and
+// purging what has been in the recycle bin past its retention period.
+class MaintenanceWorker : public QObject {
+    Q_OBJECT
+
+public:
+    struct Job {
+        DatabaseManager::ConnectionInfo vault;
+        EntryHistory::Policy history;
+        RecycleBin::Policy recycleBin;
+    };
+
+    explicit MaintenanceWorker(const Job& job, QObject* parent = nullptr);
+    ~MaintenanceWorker() override;
+
+    void cancel();
+
+public slots:
+    void run();
+
+signals:
+    void finished(bool success, int versionsRemoved, int itemsPurged, const QString& error);
+
+private:
+    Job m_job;
+    std::atomic<bool> m_cancelled{false};
+};
@@ -0,0 +1,167 @@
+#include "./MergeDialog.h"
+#include "./ui_MergeDialog.h"
+#include "./BackupManager.h"
+#include "./DatabaseManager.h"
+#include "./MergeWorker.h"
+
+#include <QDir>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QLocale>
+#include <QPushButton>
+#include <QThread>
+
+MergeDialog::MergeDialog(DatabaseManager& database, QWidget *parent)
+  : QDialog(parent), ui(new Ui::MergeDialog), m_database(database) {
+  ui->setupUi(this);
+  setWindowTitle(tr("Merge From Another Copy"));
+
+  // A backup is only a valid base if it predates both copies' changes, which cannot be
+  // checked here; a later one turns local additions into remote deletions. So no base is
+  // the default and picking one is up to the user.
+  ui->baseComboBox->addItem(tr("None (never delete, every difference is a conflict)"), QString());
+  for (const QString& path : BackupManager::backups(m_database.path())) {
+    QString taken = QLocale().toString(QFileInfo(path).lastModified(), QLocale::ShortFormat);
+    ui->baseComboBox->addItem(tr("Backup from %1").arg(taken), path);
+  }
+  ui->baseComboBox->setCurrentIndex(0);
+  connect(ui->baseComboBox, QOverload<int>::of(&QComboBox::currentIndexChanged), this, [this]() {
+    ui->baseHintLabel->setVisible(!ui->baseComboBox->currentData().toString().isEmpty());
+  });
+
+  for (MergeWorker::ConflictPolicy policy : {MergeWorker::ConflictPolicy::PreferNewer,
+                                             MergeWorker::ConflictPolicy::PreferLocal,
+                                             MergeWorker::ConflictPolicy::PreferRemote,
+                                             MergeWorker::ConflictPolicy::KeepBoth}) {
+    ui->policyComboBox->addItem(MergeWorker::policyName(policy), (int)policy);
+  }
+
+  connect(ui->buttonBox, &QDialogButtonBox::accepted, this, &MergeDialog::accept);
+  connect(ui->buttonBox, &QDialogButtonBox::rejected, this, &MergeDialog::reject);
+  connect(ui->browseButton, &QPushButton::clicked, this, &MergeDialog::onBrowseClicked);
+  connect(ui->filePathLineEdit, &QLineEdit::textChanged, this, &MergeDialog::validateInputs);
+
+  validateInputs();
+}
+
+MergeDialog::~MergeDialog() {
+  if (m_thread) {
+    if (m_worker) {
+      m_worker->cancel();
+    }
+    m_thread->quit();
+    m_thread->wait();
+  }
+  delete ui;
+}
+
+QString MergeDialog::summary() const {
+  return m_summary;
+}
+
+void MergeDialog::accept() {
+  if (m_thread) return;
+
+  const QString path = QDir::fromNativeSeparators(ui->filePathLineEdit->text());
+  if (!QFileInfo::exists(path)) {
+    ui->errorLabel->setText(tr("File not found"));
+    return;
+  }
+  if (QFileInfo(path).canonicalFilePath() == QFileInfo(m_database.path()).canonicalFilePath()) {
+    ui->errorLabel->setText(tr("Choose a different copy of this vault"));
+    return;
+  }
+
+  // Copies of one vault share its salt and profile, so the current key usually opens the other one too.
+  // A copy that brought its own profile file is opened with that one.
+  MergeWorker::Job job;
+  job.local = m_database.connectionInfo();
+  job.remote = {path, QByteArray(), DatabaseManager::loadCipherProfile(path, job.local.profile)};
+  if (ui->passwordLineEdit->text().isEmpty()) {
+    job.remote.keySpec = job.local.keySpec;
+  } else {
+    job.remotePassword = ui->passwordLineEdit->text().toUtf8();
+  }
+  const QString basePath = ui->baseComboBox->currentData().toString();
+  if (!basePath.isEmpty()) {
+    job.base = {basePath, job.local.keySpec, DatabaseManager::loadCipherProfile(basePath, job.local.profile)};
+  }
+  job.policy = (MergeWorker::ConflictPolicy)ui->policyComboBox->currentData().toInt();
+
+  m_thread = new QThread();
+  m_worker = new MergeWorker(m_database.readerPool(), job);
+  m_worker->moveToThread(m_thread);
+
+  connect(m_thread, &QThread::started, m_worker, &MergeWorker::run);
+  connect(m_worker, &MergeWorker::progress, this, &MergeDialog::onProgress);
+  connect(m_worker, &MergeWorker::finished, this, &MergeDialog::onFinished);
+  connect(m_worker, &MergeWorker::finished, m_thread, &QThread::quit);
+  connect(m_thread, &QThread::finished, m_worker, &QObject::deleteLater);
+  connect(m_thread, &QThread::finished, m_thread, &QObject::deleteLater);
+
+  ui->errorLabel->clear();
+  setRunning(true);
+  m_thread->start();
+}
+
+void MergeDialog::reject() {
+  // Cancelling rolls the merge back; the dialog closes once the worker is done
+  if (m_thread) {
+    m_cancelRequested = true;
+    if (m_worker) {
+      m_worker->cancel();
+    }
+    return;
+  }
+  QDialog::reject();
+}
+
+void MergeDialog::onBrowseClicked() {
+  QFileDialog dialog(nullptr, tr("Merge From"));
+  dialog.setDirectory(QFileInfo(m_database.path()).absolutePath());
+  dialog.setNameFilter(tr("SQLite Database (*.db);;All Files (*)"));
+  dialog.setOption(QFileDialog::DontUseNativeDialog, true);
+  dialog.setFileMode(QFileDialog::ExistingFile);
+
+  if (dialog.exec() == QDialog::Accepted) {
+    QStringList files = dialog.selectedFiles();
+    if (!files.isEmpty()) {
+      ui->filePathLineEdit->setText(QDir::toNativeSeparators(files.first()));
+    }
+  }
+}
+
+void MergeDialog::validateInputs() {
+  ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!ui->filePathLineEdit->text().isEmpty());
+}
+
+void MergeDialog::onProgress(int percent) {
+  ui->progressBar->setValue(percent);
+}
+
+void MergeDialog::onFinished(bool success, int added, int updated, int deleted, int conflicts, const QString& error) {
+  m_thread = nullptr;
+  m_worker = nullptr;
+  setRunning(false);
+
+  if (success) {
+    m_summary = tr("Merged: %1 added, %2 updated, %3 deleted, %4 conflicts")
+                  .arg(added).arg(updated).arg(deleted).arg(conflicts);
+    QDialog::accept();
+    return;
+  }
+
+  if (m_cancelRequested) {
+    QDialog::reject();
+    return;
+  }
+  ui->errorLabel->setText(error);
+}
+
+void MergeDialog::setRunning(bool running) {
+  ui->sourceGroupBox->setEnabled(!running);
+  ui->optionsGroupBox->setEnabled(!running);
+  ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!running);
+  ui->progressBar->setVisible(running);
+  ui->progressBar->setValue(0);
+}
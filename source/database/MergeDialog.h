@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QDialog>
+#include <QPointer>
+#include <QString>
+
+class DatabaseManager;
+class MergeWorker;
+class QThread;
+
+namespace Ui {
+  class MergeDialog;
+}
+
+class MergeDialog : public QDialog {
+  Q_OBJECT
+
+  public:
+    explicit MergeDialog(DatabaseManager& database, QWidget *parent = nullptr);
+    ~MergeDialog();
+
+    QString summary() const;
+
+  public slots:
+    void accept() override;
+    void reject() override;
+
+  private slots:
+    void onBrowseClicked();
+    void validateInputs();
+    void onProgress(int percent);
+    void onFinished(bool success, int added, int updated, int deleted, int conflicts, const QString& error);
+
+  private:
+    void setRunning(bool running);
+
+    Ui::MergeDialog *ui;
+    DatabaseManager& m_database;
+    QPointer<QThread> m_thread;
+    QPointer<MergeWorker> m_worker;
+    QString m_summary;
+    bool m_cancelRequested = false;
+};
@@ -0,0 +1,536 @@
+#include "MergeWorker.h"
+#include "CipherKey.h"
+
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QList>
+#include <functional>
+
+namespace {
+
+// Every copy creates its own recycle bin with its own uuid, so the bins are matched by this key instead.
+// Real uuids are hex or "legacy-...", so it cannot collide with one.
+#define BIN_KEY "'recycle-bin'"
+#define GROUP_KEY(alias) "CASE WHEN " alias ".is_recycle_bin = 1 THEN " BIN_KEY " ELSE " alias ".uuid END"
+
+// Rows are keyed by uuid; the columns after it up to the timestamp are what is compared.
+// Bin membership is compared too, so trashing and restoring travel like any other edit.
+const char* const GroupStream =
+    "SELECT " GROUP_KEY("g") " AS merge_key, " GROUP_KEY("p") ", g.name, g.deleted_at, " GROUP_KEY("r") ", g.modified_at "
+    "FROM groups g LEFT JOIN groups p ON p.id = g.parent_id LEFT JOIN groups r ON r.id = g.restore_parent_id "
+    "ORDER BY merge_key";
+const int GroupColumns = 6;
+
+const char* const EntryStream =
+    "SELECT e.uuid, " GROUP_KEY("g") ", e.title, e.username, e.password, e.url, e.notes, e.otp, e.deleted_at, "
+    GROUP_KEY("r") ", e.modified_at FROM entries e JOIN groups g ON g.id = e.group_id "
+    "LEFT JOIN groups r ON r.id = e.restore_group_id ORDER BY e.uuid";
+const int EntryColumns = 11;
+
+// The local group for a merge key bound as ?n; NULL if there is none
+QByteArray groupIdOf(int param) {
+    const QByteArray p = "?" + QByteArray::number(param);
+    return "COALESCE((SELECT id FROM groups WHERE uuid = " + p + "),"
+           " (SELECT id FROM groups WHERE " + p + " = " BIN_KEY " AND is_recycle_bin = 1))";
+}
+
+// Entries whose group is gone here end up in the root group
+QByteArray groupIdFor(int param) {
+    return "COALESCE(" + groupIdOf(param) + ", (SELECT min(id) FROM groups WHERE parent_id IS NULL AND is_recycle_bin = 0))";
+}
+
+class Statement {
+public:
+    Statement(sqlite3* db, const QByteArray& sql) {
+        if (!db) return;
+        if (sqlite3_prepare_v2(db, sql.constData(), -1, &m_stmt, nullptr) != SQLITE_OK) {
+            sqlite3_finalize(m_stmt);
+            m_stmt = nullptr;
+        }
+    }
+    ~Statement() { sqlite3_finalize(m_stmt); }
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+
+    sqlite3_stmt* get() const { return m_stmt; }
+
+private:
+    sqlite3_stmt* m_stmt = nullptr;
+};
+
+// One side of the merge in uuid order. Only the current row is held.
+class RowStream {
+public:
+    // A missing database reads as an empty stream
+    RowStream(sqlite3* db, const char* sql, int columns)
+        : m_stmt(db, sql), m_columns(columns), m_empty(!db) {
+    }
+
+    bool isValid() const { return m_empty || m_stmt.get(); }
+    bool failed() const { return m_failed; }
+    bool atEnd() const { return m_atEnd; }
+    const QByteArray& uuid() const { return m_uuid; }
+    const QByteArray& hash() const { return m_hash; }
+    QByteArray modifiedAt() const {
+        return QByteArray((const char*)sqlite3_column_text(m_stmt.get(), m_columns - 1));
+    }
+    sqlite3_stmt* stmt() const { return m_stmt.get(); }
+
+    bool next() {
+        m_atEnd = true;
+        if (!m_stmt.get()) return false;
+
+        int rc = sqlite3_step(m_stmt.get());
+        if (rc != SQLITE_ROW) {
+            m_failed = (rc != SQLITE_DONE);
+            return false;
+        }
+
+        m_uuid = QByteArray((const char*)sqlite3_column_text(m_stmt.get(), 0));
+        // Length-prefixed so that moving text between columns changes the hash
+        m_hasher.reset();
+        for (int i = 1; i < m_columns - 1; ++i) {
+            if (sqlite3_column_type(m_stmt.get(), i) == SQLITE_NULL) {
+                m_hasher.addData(QByteArray::fromRawData("\0N", 2));
+                continue;
+            }
+            const char* text = (const char*)sqlite3_column_text(m_stmt.get(), i);
+            int length = sqlite3_column_bytes(m_stmt.get(), i);
+            m_hasher.addData(QByteArray::number(length) + ":");
+            m_hasher.addData(QByteArray::fromRawData(text, length));
+        }
+        m_hash = m_hasher.result();
+        m_atEnd = false;
+        return true;
+    }
+
+private:
+    Statement m_stmt;
+    int m_columns;
+    bool m_empty;
+    bool m_failed = false;
+    bool m_atEnd = true;
+    QByteArray m_uuid;
+    QByteArray m_hash;
+    QCryptographicHash m_hasher{QCryptographicHash::Sha256};
+};
+
+struct Side {
+    bool present = false;
+    QByteArray hash;
+    QByteArray modifiedAt;
+};
+
+Side sideFor(const RowStream& stream, const QByteArray& uuid) {
+    Side side;
+    if (!stream.atEnd() && stream.uuid() == uuid) {
+        side.present = true;
+        side.hash = stream.hash();
+        side.modifiedAt = stream.modifiedAt();
+    }
+    return side;
+}
+
+enum class Action { Keep, TakeRemote, Delete, AddCopy };
+
+Action resolve(const Side& local, const Side& remote, const Side& base,
+               MergeWorker::ConflictPolicy policy, bool* conflict) {
+    using Policy = MergeWorker::ConflictPolicy;
+    *conflict = false;
+
+    if (local.present && remote.present) {
+        if (local.hash == remote.hash) return Action::Keep;
+        if (base.present && base.hash == local.hash) return Action::TakeRemote;
+        if (base.present && base.hash == remote.hash) return Action::Keep;
+
+        *conflict = true;
+        switch (policy) {
+        case Policy::PreferLocal: return Action::Keep;
+        case Policy::PreferRemote: return Action::TakeRemote;
+        case Policy::KeepBoth: return Action::AddCopy;
+        case Policy::PreferNewer: break;
+        }
+        return remote.modifiedAt > local.modifiedAt ? Action::TakeRemote : Action::Keep;
+    }
+
+    if (remote.present) {
+        // New over there, or deleted here since the base
+        if (!base.present) return Action::TakeRemote;
+        if (base.hash == remote.hash) return Action::Keep;
+        *conflict = true;
+        return policy == Policy::PreferLocal ? Action::Keep : Action::TakeRemote;
+    }
+
+    if (local.present) {
+        // New here, or deleted over there since the base
+        if (!base.present) return Action::Keep;
+        if (base.hash == local.hash) return Action::Delete;
+        *conflict = true;
+        return policy == Policy::PreferRemote ? Action::Delete : Action::Keep;
+    }
+
+    return Action::Keep;
+}
+
+using ApplyFn = std::function<bool(Action action, bool localPresent, bool remotePresent, RowStream& local, RowStream& remote)>;
+
+// Walks the three sorted streams in step; rows only the base still has were deleted on both sides
+bool walk(RowStream& local, RowStream& remote, RowStream& base, MergeWorker::ConflictPolicy policy,
+          const std::atomic<bool>& cancelled, int* conflicts, const ApplyFn& apply, QString* error) {
+    local.next();
+    remote.next();
+    base.next();
+
+    while (!local.atEnd() || !remote.atEnd()) {
+        if (cancelled) {
+            *error = "Cancelled";
+            return false;
+        }
+
+        QByteArray uuid;
+        if (local.atEnd()) {
+            uuid = remote.uuid();
+        } else if (remote.atEnd()) {
+            uuid = local.uuid();
+        } else {
+            uuid = qMin(local.uuid(), remote.uuid());
+        }
+        while (!base.atEnd() && base.uuid() < uuid) {
+            base.next();
+        }
+
+        Side l = sideFor(local, uuid);
+        Side r = sideFor(remote, uuid);
+        bool conflict = false;
+        Action action = resolve(l, r, sideFor(base, uuid), policy, &conflict);
+        if (conflict) ++*conflicts;
+        if (!apply(action, l.present, r.present, local, remote)) return false;
+
+        if (l.present) local.next();
+        if (r.present) remote.next();
+    }
+
+    if (local.failed() || remote.failed() || base.failed()) {
+        *error = "Failed to read one of the copies";
+        return false;
+    }
+    return true;
+}
+
+// Binds the first columns of a stream row as ?1..?n
+bool execWith(sqlite3_stmt* stmt, sqlite3_stmt* row, int columns) {
+    sqlite3_reset(stmt);
+    sqlite3_clear_bindings(stmt);
+    for (int i = 0; i < columns; ++i) {
+        sqlite3_bind_value(stmt, i + 1, sqlite3_column_value(row, i));
+    }
+    return sqlite3_step(stmt) == SQLITE_DONE;
+}
+
+qint64 countRows(sqlite3* db) {
+    if (!db) return 0;
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT (SELECT count(*) FROM groups) + (SELECT count(*) FROM entries)",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        return -1;
+    }
+    qint64 count = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        count = sqlite3_column_int64(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return count;
+}
+
+// Uuids and the recycle bin columns the streams read
+bool hasMergeColumns(sqlite3* db) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT e.uuid, e.deleted_at, g.is_recycle_bin FROM entries e, groups g LIMIT 0",
+                           -1, &stmt, nullptr) != SQLITE_OK) {
+        return false;
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+}
+
+MergeWorker::MergeWorker(const QSharedPointer<ReaderPool>& readers, const Job& job, QObject* parent)
+    : QObject(parent), m_readers(readers), m_job(job) {
+}
+
+MergeWorker::~MergeWorker() {
+    CipherKey::wipe(m_job.local.keySpec);
+    CipherKey::wipe(m_job.remote.keySpec);
+    CipherKey::wipe(m_job.base.keySpec);
+    CipherKey::wipe(m_job.remotePassword);
+}
+
+QString MergeWorker::policyName(ConflictPolicy policy) {
+    switch (policy) {
+    case ConflictPolicy::PreferNewer: return tr("Keep the newer change");
+    case ConflictPolicy::PreferLocal: return tr("Keep this vault's version");
+    case ConflictPolicy::PreferRemote: return tr("Take the other copy's version");
+    case ConflictPolicy::KeepBoth: return tr("Keep both entries");
+    }
+    return QString();
+}
+
+void MergeWorker::cancel() {
+    m_cancelled = true;
+}
+
+void MergeWorker::run() {
+    QString error;
+    if (m_job.remote.keySpec.isEmpty()) {
+        m_job.remote.keySpec = CipherKey::derive(m_job.remote.path, m_job.remotePassword, m_job.remote.profile.kdfIterations);
+        CipherKey::wipe(m_job.remotePassword);
+        if (m_job.remote.keySpec.isEmpty()) {
+            emit finished(false, 0, 0, 0, 0, tr("The other copy is not a KeeBox vault"));
+            return;
+        }
+    }
+
+    sqlite3* remote = DatabaseManager::openConnection(m_job.remote, SQLITE_OPEN_READONLY, &error);
+    if (!remote) {
+        emit finished(false, 0, 0, 0, 0, error);
+        return;
+    }
+    if (countRows(remote) < 0) {
+        sqlite3_close(remote);
+        emit finished(false, 0, 0, 0, 0, tr("The other copy could not be read (wrong password?)"));
+        return;
+    }
+    if (!hasMergeColumns(remote)) {
+        sqlite3_close(remote);
+        emit finished(false, 0, 0, 0, 0, tr("The other copy has to be opened once with this version of KeeBox first"));
+        return;
+    }
+
+    // Without a usable base every difference is treated as a conflict and nothing is deleted
+    sqlite3* base = nullptr;
+    if (!m_job.base.path.isEmpty()) {
+        QString baseError;
+        base = DatabaseManager::openConnection(m_job.base, SQLITE_OPEN_READONLY, &baseError);
+        if (base && (countRows(base) < 0 || !hasMergeColumns(base))) {
+            sqlite3_close(base);
+            base = nullptr;
+            baseError = "unreadable or too old";
+        }
+        if (!base) {
+            qWarning() << "Merge base" << m_job.base.path << "not used:" << baseError;
+        }
+    }
+
+    sqlite3* writer = DatabaseManager::openConnection(m_job.local, SQLITE_OPEN_READWRITE, &error);
+    bool success = false;
+    if (writer) {
+        sqlite3_exec(writer, "PRAGMA foreign_keys = ON;", nullptr, nullptr, nullptr);
+
+        // Holding the write lock first means the reader's snapshot is exactly what the writer starts from.
+        // Edits made in the window meanwhile wait on the busy timeout.
+        if (sqlite3_exec(writer, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+            error = QString("Failed to lock the vault: %1").arg(sqlite3_errmsg(writer));
+        } else {
+            ReaderPool::Lease lease = m_readers ? m_readers->acquire(&error) : ReaderPool::Lease();
+            if (lease.isValid()) {
+                m_rowsTotal = qMax<qint64>(1, countRows(lease.db()) + countRows(remote));
+                success = merge(writer, lease.db(), remote, base, &error);
+            }
+            lease.release();
+
+            if (success && sqlite3_exec(writer, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+                error = QString("Failed to commit the merge: %1").arg(sqlite3_errmsg(writer));
+                success = false;
+            }
+            if (!success) {
+                sqlite3_exec(writer, "ROLLBACK;", nullptr, nullptr, nullptr);
+            }
+        }
+        sqlite3_close(writer);
+    }
+
+    sqlite3_close(base);
+    sqlite3_close(remote);
+
+    if (success) {
+        emit progress(100);
+        qInfo() << "Merged" << m_job.remote.path << "with policy" << (int)m_job.policy << "-"
+                << m_stats.added << "added," << m_stats.updated << "updated," << m_stats.deleted << "deleted,"
+                << m_stats.conflicts << "conflicts";
+    } else {
+        qWarning() << "Merge failed:" << error;
+        m_stats = Stats();
+    }
+    emit finished(success, m_stats.added, m_stats.updated, m_stats.deleted, m_stats.conflicts, error);
+}
+
+bool MergeWorker::merge(sqlite3* writer, sqlite3* local, sqlite3* remote, sqlite3* base, QString* error) {
+    // Groups first, so entries can find their group by uuid
+    return mergeGroups(writer, local, remote, base, error) && mergeEntries(writer, local, remote, base, error);
+}
+
+bool MergeWorker::mergeGroups(sqlite3* writer, sqlite3* local, sqlite3* remote, sqlite3* base, QString* error) {
+    RowStream localRows(local, GroupStream, GroupColumns);
+    RowStream remoteRows(remote, GroupStream, GroupColumns);
+    RowStream baseRows(base, GroupStream, GroupColumns);
+    // A bin taken over from the other copy gets a uuid of its own, like any bin
+    Statement insert(writer, "INSERT INTO groups (uuid, name, parent_id, is_recycle_bin, deleted_at, modified_at)"
+                             " VALUES (CASE WHEN ?1 = " BIN_KEY " THEN NULL ELSE ?1 END, ?3, NULL, ?1 = " BIN_KEY ", ?4, ?6)");
+    Statement update(writer, "UPDATE groups SET name = ?3, deleted_at = ?4, modified_at = ?6 WHERE id = " + groupIdOf(1));
+    if (!localRows.isValid() || !remoteRows.isValid() || !baseRows.isValid() || !insert.get() || !update.get()) {
+        *error = QString("Failed to prepare the group merge: %1").arg(sqlite3_errmsg(writer));
+        return false;
+    }
+
+    // Parents can only be linked once every group exists; there are few groups, so these are kept
+    struct Link {
+        QByteArray key;
+        QByteArray parent;
+        QByteArray restoreParent;
+    };
+    QList<Link> parents;
+    const ConflictPolicy policy = m_job.policy == ConflictPolicy::KeepBoth ? ConflictPolicy::PreferNewer : m_job.policy;
+
+    bool ok = walk(localRows, remoteRows, baseRows, policy, m_cancelled, &m_stats.conflicts,
+                   [&](Action action, bool localPresent, bool remotePresent, RowStream& localRow, RowStream& remoteRow) {
+        if (action == Action::Delete) {
+            m_pendingGroupDeletes.append(localRow.uuid());
+        } else if (action == Action::TakeRemote) {
+            if (!execWith(localPresent ? update.get() : insert.get(), remoteRow.stmt(), GroupColumns)) {
+                return false;
+            }
+            ++(localPresent ? m_stats.updated : m_stats.added);
+            const char* parent = (const char*)sqlite3_column_text(remoteRow.stmt(), 1);
+            const char* restoreParent = (const char*)sqlite3_column_text(remoteRow.stmt(), 4);
+            parents.append({remoteRow.uuid(), parent ? QByteArray(parent) : QByteArray(),
+                            restoreParent ? QByteArray(restoreParent) : QByteArray()});
+        }
+        m_rowsDone += (localPresent ? 1 : 0) + (remotePresent ? 1 : 0);
+        reportProgress();
+        return true;
+    }, error);
+    if (!ok) {
+        if (error->isEmpty()) *error = QString("Failed to merge groups: %1").arg(sqlite3_errmsg(writer));
+        return false;
+    }
+
+    // Never link a group below one of its own descendants
+    Statement link(writer,
+        "UPDATE groups SET parent_id = " + groupIdOf(2) + " WHERE id = " + groupIdOf(1) + " AND NOT EXISTS ("
+        " WITH RECURSIVE up(id) AS (SELECT " + groupIdOf(2)
+        + "  UNION SELECT g.parent_id FROM groups g JOIN up ON g.id = up.id WHERE g.parent_id IS NOT NULL)"
+        " SELECT 1 FROM up WHERE up.id = " + groupIdOf(1) + ")");
+    Statement linkRestore(writer, "UPDATE groups SET restore_parent_id = " + groupIdOf(2) + " WHERE id = " + groupIdOf(1));
+    if (!link.get() || !linkRestore.get()) {
+        *error = QString("Failed to prepare the group merge: %1").arg(sqlite3_errmsg(writer));
+        return false;
+    }
+    auto bindKey = [](sqlite3_stmt* stmt, int index, const QByteArray& key) {
+        if (key.isEmpty()) {
+            sqlite3_bind_null(stmt, index);
+        } else {
+            sqlite3_bind_text(stmt, index, key.constData(), key.size(), SQLITE_TRANSIENT);
+        }
+    };
+    for (const Link& parent : std::as_const(parents)) {
+        for (sqlite3_stmt* stmt : {link.get(), linkRestore.get()}) {
+            sqlite3_reset(stmt);
+            bindKey(stmt, 1, parent.key);
+            bindKey(stmt, 2, stmt == link.get() ? parent.parent : parent.restoreParent);
+            if (sqlite3_step(stmt) != SQLITE_DONE) {
+                *error = QString("Failed to link groups: %1").arg(sqlite3_errmsg(writer));
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool MergeWorker::mergeEntries(sqlite3* writer, sqlite3* local, sqlite3* remote, sqlite3* base, QString* error) {
+    RowStream localRows(local, EntryStream, EntryColumns);
+    RowStream remoteRows(remote, EntryStream, EntryColumns);
+    RowStream baseRows(base, EntryStream, EntryColumns);
+    // deleted_at comes along with the row, so an entry restored over there is live here too
+    Statement insert(writer, "INSERT INTO entries (uuid, group_id, title, username, password, url, notes, otp,"
+                             " deleted_at, restore_group_id, modified_at) VALUES (?1, " + groupIdFor(2)
+                             + ", ?3, ?4, ?5, ?6, ?7, ?8, ?9, " + groupIdOf(10) + ", ?11)");
+    Statement copy(writer, "INSERT INTO entries (group_id, title, username, password, url, notes, otp,"
+                           " deleted_at, restore_group_id, modified_at) VALUES (" + groupIdFor(2)
+                           + ", ?3 || ' (conflict)', ?4, ?5, ?6, ?7, ?8, ?9, " + groupIdOf(10) + ", ?11)");
+    Statement update(writer, "UPDATE entries SET group_id = " + groupIdFor(2)
+                             + ", title = ?3, username = ?4, password = ?5, url = ?6, notes = ?7, otp = ?8,"
+                             " deleted_at = ?9, restore_group_id = " + groupIdOf(10) + ", modified_at = ?11 WHERE uuid = ?1");
+    Statement remove(writer, "DELETE FROM entries WHERE uuid = ?1");
+    if (!localRows.isValid() || !remoteRows.isValid() || !baseRows.isValid()
+        || !insert.get() || !copy.get() || !update.get() || !remove.get()) {
+        *error = QString("Failed to prepare the entry merge: %1").arg(sqlite3_errmsg(writer));
+        return false;
+    }
+
+    bool ok = walk(localRows, remoteRows, baseRows, m_job.policy, m_cancelled, &m_stats.conflicts,
+                   [&](Action action, bool localPresent, bool remotePresent, RowStream& localRow, RowStream& remoteRow) {
+        bool done = true;
+        switch (action) {
+        case Action::Keep:
+            break;
+        case Action::TakeRemote:
+            done = execWith(localPresent ? update.get() : insert.get(), remoteRow.stmt(), EntryColumns);
+            ++(localPresent ? m_stats.updated : m_stats.added);
+            break;
+        case Action::AddCopy:
+            done = execWith(copy.get(), remoteRow.stmt(), EntryColumns);
+            ++m_stats.added;
+            break;
+        case Action::Delete:
+            done = execWith(remove.get(), localRow.stmt(), 1);
+            ++m_stats.deleted;
+            break;
+        }
+        m_rowsDone += (localPresent ? 1 : 0) + (remotePresent ? 1 : 0);
+        reportProgress();
+        return done;
+    }, error);
+    if (!ok) {
+        if (error->isEmpty()) *error = QString("Failed to merge entries: %1").arg(sqlite3_errmsg(writer));
+        return false;
+    }
+
+    // Groups deleted over there go only once nothing is left in them here
+    Statement removeGroup(writer,
+        "DELETE FROM groups WHERE uuid = ?1"
+        " AND NOT EXISTS (SELECT 1 FROM entries WHERE group_id = groups.id)"
+        " AND NOT EXISTS (SELECT 1 FROM groups c WHERE c.parent_id = groups.id)");
+    if (!removeGroup.get()) {
+        *error = QString("Failed to prepare the group cleanup: %1").arg(sqlite3_errmsg(writer));
+        return false;
+    }
+    // Children first; repeat while a pass still removes something
+    int removed;
+    do {
+        removed = 0;
+        for (int i = m_pendingGroupDeletes.size() - 1; i >= 0; --i) {
+            const QByteArray& uuid = m_pendingGroupDeletes.at(i);
+            sqlite3_reset(removeGroup.get());
+            sqlite3_bind_text(removeGroup.get(), 1, uuid.constData(), uuid.size(), SQLITE_TRANSIENT);
+            if (sqlite3_step(removeGroup.get()) != SQLITE_DONE) {
+                *error = QString("Failed to remove groups: %1").arg(sqlite3_errmsg(writer));
+                return false;
+            }
+            if (sqlite3_changes(writer) > 0) {
+                m_pendingGroupDeletes.removeAt(i);
+                ++m_stats.deleted;
+                ++removed;
+            }
+        }
+    } while (removed > 0);
+    return true;
+}
+
+void MergeWorker::reportProgress() {
+    int percent = (int)qMin<qint64>(99, m_rowsDone * 100 / m_rowsTotal);
+    if (percent != m_lastPercent) {
+        m_lastPercent = percent;
+        emit progress(percent);
+    }
+}
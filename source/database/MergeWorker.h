@@ -0,0 +1,72 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+#include <sqlite3.h>
+#include <atomic>
+
+#include "DatabaseManager.h"
+#include "ReaderPool.h"
+
+// Merges another copy of a vault into this one, three-way against a common
+// base (usually a backup generation). Each side is streamed in uuid order and
+// compared by row hash, so memory stays flat however large the vault is.
+// Everything is applied in a single transaction on its own connection.
+class MergeWorker : public QObject {
+    Q_OBJECT
+
+public:
+    enum class ConflictPolicy {
+        PreferNewer,   // the side with the later modified_at wins; edits win over deletes
+        PreferLocal,
+        PreferRemote,
+        KeepBoth       // the remote entry is added as a copy; groups fall back to PreferNewer
+    };
+
+    struct Job {
+        DatabaseManager::ConnectionInfo local;
+        DatabaseManager::ConnectionInfo remote;  // keyed from remotePassword when keySpec is empty
+        QByteArray remotePassword;
+        DatabaseManager::ConnectionInfo base;  // empty path for a two-way merge
+        ConflictPolicy policy = ConflictPolicy::PreferNewer;
+    };
+
+    struct Stats {
+        int added = 0;
+        int updated = 0;
+        int deleted = 0;
+        int conflicts = 0;
+    };
+
+    MergeWorker(const QSharedPointer<ReaderPool>& readers, const Job& job, QObject* parent = nullptr);
+    ~MergeWorker() override;
+
+    static QString policyName(ConflictPolicy policy);
+    void cancel();
+
+public slots:
+    void run();
+
+signals:
+    void progress(int percent);
+    void finished(bool success, int added, int updated, int deleted, int conflicts, const QString& error);
+
+private:
+    bool merge(sqlite3* writer, sqlite3* local, sqlite3* remote, sqlite3* base, QString* error);
+    bool mergeGroups(sqlite3* writer, sqlite3* local, sqlite3* remote, sqlite3* base, QString* error);
+    bool mergeEntries(sqlite3* writer, sqlite3* local, sqlite3* remote, sqlite3* base, QString* error);
+    void reportProgress();
+
+    QSharedPointer<ReaderPool> m_readers;
+    Job m_job;
+    Stats m_stats;
+    QList<QByteArray> m_pendingGroupDeletes;
+    std::atomic<bool> m_cancelled{false};
+
+    qint64 m_rowsTotal = 0;
+    qint64 m_rowsDone = 0;
+    int m_lastPercent = -1;
+};
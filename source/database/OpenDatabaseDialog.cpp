@@ -1,13 +1,20 @@
 #include "OpenDatabaseDialog.h"
 #include "ui_OpenDatabaseDialog.h"
+#include "DatabaseManager.h"
+#include "CipherKey.h"
+#include "../utils/Trace.h"
 
 #include <QFileDialog>
+#include <QFileInfo>
+#include <QFutureWatcher>
 #include <QSettings>
 #include <QMessageBox>
 #include <QPushButton>
+#include <QtConcurrent>
 
 OpenDatabaseDialog::OpenDatabaseDialog(QWidget *parent) :
   QDialog(parent), ui(new Ui::OpenDatabaseDialog) {
+  Trace::Span span("OpenDatabaseDialog::OpenDatabaseDialog");
   ui->setupUi(this);
 
   // Set window icon and title
@@ -25,12 +32,18 @@ OpenDatabaseDialog::OpenDatabaseDialog(QWidget *parent) :
 
   // Disable OK button by default
   ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(false);
+  ui->statusLabel->hide();
+  ui->unlockProgressBar->hide();
+
+  m_keyWatcher = new QFutureWatcher<QByteArray>(this);
+  connect(m_keyWatcher, &QFutureWatcher<QByteArray>::finished, this, &OpenDatabaseDialog::onKeyDerived);
 
   // Set focus to file path line edit
   ui->filePathLineEdit->setFocus();
 }
 
 OpenDatabaseDialog::~OpenDatabaseDialog() {
+  delete m_database;
   delete ui;
 }
 
@@ -42,6 +55,80 @@ QString OpenDatabaseDialog::getPassword() const {
   return ui->passwordLineEdit->text();
 }
 
+void OpenDatabaseDialog::setOpenVaults(const QStringList& paths) {
+  m_openVaults.clear();
+  for (const QString& path : paths) {
+    m_openVaults.append(QFileInfo(path).absoluteFilePath());
+  }
+}
+
+DatabaseManager* OpenDatabaseDialog::takeDatabase() {
+  DatabaseManager* database = m_database;
+  m_database = nullptr;
+  return database;
+}
+
+void OpenDatabaseDialog::accept() {
+  if (m_keyWatcher->isRunning()) return;
+
+  // Already unlocked in another tab; no need to pay for the KDF again
+  const QString path = getFilePath();
+  if (m_openVaults.contains(QFileInfo(path).absoluteFilePath())) {
+    QDialog::accept();
+    return;
+  }
+
+  m_unlockBegin = Trace::now();
+  setUnlocking(true, tr("Deriving key..."));
+  const QString password = getPassword();
+  m_keyWatcher->setFuture(QtConcurrent::run([path, password]() {
+    return DatabaseManager::deriveKeySpec(path, password);
+  }));
+}
+
+void OpenDatabaseDialog::reject() {
+  // The KDF cannot be interrupted; its result is dropped when it finishes
+  m_keyWatcher->disconnect(this);
+  QDialog::reject();
+}
+
+void OpenDatabaseDialog::onKeyDerived() {
+  QByteArray keySpec = m_keyWatcher->result();
+  const QString path = getFilePath();
+
+  // Keying and migrating stay on this thread, which owns the connection from here on
+  bool opened = false;
+  if (!keySpec.isEmpty()) {
+    setUnlocking(true, tr("Opening vault..."));
+    ui->statusLabel->repaint();
+    m_database = new DatabaseManager();
+    opened = m_database->openWithKey(path, keySpec);
+  }
+  CipherKey::wipe(keySpec);
+  Trace::complete("unlock", m_unlockBegin);
+
+  if (opened) {
+    QDialog::accept();
+    return;
+  }
+
+  delete m_database;
+  m_database = nullptr;
+  setUnlocking(false, QString());
+  ui->passwordLineEdit->selectAll();
+  ui->passwordLineEdit->setFocus();
+  QMessageBox::critical(this, tr("Authentication Failed"), tr("Invalid password or corrupted database."));
+}
+
+void OpenDatabaseDialog::setUnlocking(bool unlocking, const QString& status) {
+  ui->groupBox->setEnabled(!unlocking);
+  ui->groupBox_2->setEnabled(!unlocking);
+  ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(!unlocking);
+  ui->statusLabel->setText(status);
+  ui->statusLabel->setVisible(unlocking);
+  ui->unlockProgressBar->setVisible(unlocking);
+}
+
 void OpenDatabaseDialog::onBrowseClicked() {
   QFileDialog dialog(nullptr, tr("Open Database"));
   dialog.setDirectory(QDir::homePath());
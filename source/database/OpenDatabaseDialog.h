@@ -2,6 +2,10 @@
 
 #include <QDialog>
 #include <QString>
+#include <QStringList>
+
+class DatabaseManager;
+template <typename T> class QFutureWatcher;
 
 namespace Ui {
   class OpenDatabaseDialog;
@@ -17,10 +21,27 @@ class OpenDatabaseDialog : public QDialog {
     QString getFilePath() const;
     QString getPassword() const;
 
+    // Vaults unlocked already; accepting one of them closes the dialog without a KDF run
+    void setOpenVaults(const QStringList& paths);
+    // The vault unlocked on accept, owned by the caller from here on; null if it was open already
+    DatabaseManager* takeDatabase();
+
+  public slots:
+    // Unlocks before closing: the KDF runs on a worker thread while the dialog shows progress
+    void accept() override;
+    void reject() override;
+
     private slots:
       void onBrowseClicked();
     void validateInput();
+    void onKeyDerived();
 
   private:
+    void setUnlocking(bool unlocking, const QString& status);
+
     Ui::OpenDatabaseDialog *ui;
+    QStringList m_openVaults;
+    DatabaseManager* m_database = nullptr;
+    QFutureWatcher<QByteArray>* m_keyWatcher = nullptr;
+    qint64 m_unlockBegin = 0;
 };
\ No newline at end of file
@@ -0,0 +1,211 @@
+#include "QueryProfiler.h"
+
+#include <QDebug>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <algorithm>
+
+namespace {
+
+const int MaxSlowQueries = 200;
+
+double percentile(QVector<qint64> samples, double fraction) {
+    if (samples.isEmpty()) return 0.0;
+    int index = qBound(0, (int)(fraction * (samples.size() - 1) + 0.5), samples.size() - 1);
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples.at(index) / 1e6;
+}
+
+}
+
+QueryProfiler::QueryProfiler() {
+    m_enabled = qEnvironmentVariableIntValue("KEEBOX_PROFILE_SQL") != 0;
+    bool ok = false;
+    int threshold = qEnvironmentVariableIntValue("KEEBOX_SLOW_QUERY_MS", &ok);
+    if (ok && threshold > 0) {
+        m_slowThresholdMs = threshold;
+    }
+}
+
+QueryProfiler::~QueryProfiler() {
+    detach();
+}
+
+void QueryProfiler::attach(sqlite3* db) {
+    m_db = db;
+    install();
+}
+
+void QueryProfiler::detach() {
+    if (m_db) {
+        sqlite3_trace_v2(m_db, 0, nullptr, nullptr);
+        m_db = nullptr;
+    }
+    QMutexLocker locker(&m_mutex);
+    m_pendingRows.clear();
+}
+
+void QueryProfiler::install() {
+    if (!m_db) return;
+    if (m_enabled) {
+        sqlite3_trace_v2(m_db, SQLITE_TRACE_PROFILE | SQLITE_TRACE_ROW, &QueryProfiler::traceCallback, this);
+    } else {
+        sqlite3_trace_v2(m_db, 0, nullptr, nullptr);
+    }
+}
+
+void QueryProfiler::setEnabled(bool enabled) {
+    m_enabled = enabled;
+    install();
+}
+
+bool QueryProfiler::isEnabled() const {
+    return m_enabled;
+}
+
+void QueryProfiler::setSlowThresholdMs(int ms) {
+    m_slowThresholdMs = ms;
+}
+
+int QueryProfiler::slowThresholdMs() const {
+    return m_slowThresholdMs;
+}
+
+void QueryProfiler::reset() {
+    QMutexLocker locker(&m_mutex);
+    m_stats.clear();
+    m_pendingRows.clear();
+    m_slowQueries.clear();
+    if (m_db) {
+        int current = 0;
+        int highwater = 0;
+        sqlite3_db_status(m_db, SQLITE_DBSTATUS_CACHE_HIT, &current, &highwater, 1);
+        sqlite3_db_status(m_db, SQLITE_DBSTATUS_CACHE_MISS, &current, &highwater, 1);
+    }
+}
+
+QString QueryProfiler::scrub(const char* sql) {
+    // Keys are normally set through sqlite3_key(), but never let a literal one through
+    static const QRegularExpression keyPragma("(PRAGMA\\s+(\\w+\\.)?(re)?key\\s*=?\\s*\\(?).*",
+                                              QRegularExpression::CaseInsensitiveOption);
+    static const QRegularExpression attachKey("(\\bKEY\\s+)'(?:[^']|'')*'",
+                                              QRegularExpression::CaseInsensitiveOption);
+    QString text = QString::fromUtf8(sql).simplified();
+    text.replace(keyPragma, "\\1<redacted>");
+    text.replace(attachKey, "\\1<redacted>");
+    return text;
+}
+
+int QueryProfiler::traceCallback(unsigned type, void* context, void* p, void* x) {
+    QueryProfiler* self = static_cast<QueryProfiler*>(context);
+    sqlite3_stmt* stmt = static_cast<sqlite3_stmt*>(p);
+
+    QMutexLocker locker(&self->m_mutex);
+    if (type == SQLITE_TRACE_ROW) {
+        ++self->m_pendingRows[stmt];
+        return 0;
+    }
+    if (type != SQLITE_TRACE_PROFILE) return 0;
+
+    qint64 ns = (qint64)*static_cast<sqlite3_uint64*>(x);
+    qint64 rows = self->m_pendingRows.take(stmt);
+
+    // sqlite3_sql() is the text as prepared, with ? placeholders rather than values
+    const char* sql = sqlite3_sql(stmt);
+    QString key = scrub(sql ? sql : "");
+
+    Accumulator& stats = self->m_stats[key];
+    ++stats.calls;
+    stats.rows += rows;
+    stats.totalNs += ns;
+    stats.maxNs = qMax(stats.maxNs, ns);
+    if (stats.samples.size() < SampleCount) {
+        stats.samples.append(ns);
+    } else {
+        stats.samples[stats.nextSample] = ns;
+        stats.nextSample = (stats.nextSample + 1) % SampleCount;
+    }
+
+    double ms = ns / 1e6;
+    if (self->m_slowThresholdMs > 0 && ms >= self->m_slowThresholdMs) {
+        qWarning().noquote() << QString("Slow query (%1 ms, %2 rows): %3").arg(ms, 0, 'f', 2).arg(rows).arg(key);
+        if (self->m_slowQueries.size() >= MaxSlowQueries) {
+            self->m_slowQueries.removeFirst();
+        }
+        self->m_slowQueries.append({QDateTime::currentDateTime(), key, ms});
+    }
+    return 0;
+}
+
+QList<QueryProfiler::StatementStats> QueryProfiler::statements() const {
+    QMutexLocker locker(&m_mutex);
+    QList<StatementStats> result;
+    for (auto it = m_stats.constBegin(); it != m_stats.constEnd(); ++it) {
+        StatementStats stats;
+        stats.sql = it.key();
+        stats.calls = it->calls;
+        stats.rows = it->rows;
+        stats.totalMs = it->totalNs / 1e6;
+        stats.maxMs = it->maxNs / 1e6;
+        stats.p50Ms = percentile(it->samples, 0.50);
+        stats.p99Ms = percentile(it->samples, 0.99);
+        result.append(stats);
+    }
+
+    // Most expensive first
+    std::sort(result.begin(), result.end(), [](const StatementStats& a, const StatementStats& b) {
+        return a.totalMs > b.totalMs;
+    });
+    return result;
+}
+
+QList<QueryProfiler::SlowQuery> QueryProfiler::slowQueries() const {
+    QMutexLocker locker(&m_mutex);
+    return m_slowQueries;
+}
+
+double QueryProfiler::cacheHitRatio() const {
+    if (!m_db) return -1.0;
+    int hits = 0;
+    int misses = 0;
+    int highwater = 0;
+    sqlite3_db_status(m_db, SQLITE_DBSTATUS_CACHE_HIT, &hits, &highwater, 0);
+    sqlite3_db_status(m_db, SQLITE_DBSTATUS_CACHE_MISS, &misses, &highwater, 0);
+    if (hits + misses == 0) return -1.0;
+    return (double)hits / (hits + misses);
+}
+
+QByteArray QueryProfiler::toJson() const {
+    QJsonArray statementsArray;
+    for (const StatementStats& stats : statements()) {
+        QJsonObject object;
+        object["sql"] = stats.sql;
+        object["calls"] = stats.calls;
+        object["rows"] = stats.rows;
+        object["totalMs"] = stats.totalMs;
+        object["maxMs"] = stats.maxMs;
+        object["p50Ms"] = stats.p50Ms;
+        object["p99Ms"] = stats.p99Ms;
+        statementsArray.append(object);
+    }
+
+    QJsonArray slowArray;
+    for (const SlowQuery& query : slowQueries()) {
+        QJsonObject object;
+        object["when"] = query.when.toString(Qt::ISODateWithMs);
+        object["sql"] = query.sql;
+        object["ms"] = query.ms;
+        slowArray.append(object);
+    }
+
+    QJsonObject root;
+    root["enabled"] = m_enabled;
+    root["slowThresholdMs"] = m_slowThresholdMs;
+    root["cacheHitRatio"] = cacheHitRatio();
+    root["statements"] = statementsArray;
+    root["slowQueries"] = slowArray;
+    return QJsonDocument(root).toJson(QJsonDocument::Indented);
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QVector>
+#include <sqlite3.h>
+
+// Optional per-statement instrumentation for SQLite connections, built on sqlite3_trace_v2.
+// Statements are keyed by their SQL text as prepared; bound parameter values are never
+// expanded, so secrets passed through bindings cannot reach the stats or the logs.
+class QueryProfiler {
+public:
+    static const int SampleCount = 512;
+
+    struct StatementStats {
+        QString sql;
+        qint64 calls = 0;
+        qint64 rows = 0;
+        double totalMs = 0.0;
+        double maxMs = 0.0;
+        double p50Ms = 0.0;
+        double p99Ms = 0.0;
+    };
+
+    struct SlowQuery {
+        QDateTime when;
+        QString sql;
+        double ms = 0.0;
+    };
+
+    // Reads KEEBOX_PROFILE_SQL and KEEBOX_SLOW_QUERY_MS from the environment
+    QueryProfiler();
+    ~QueryProfiler();
+
+    void attach(sqlite3* db);
+    void detach();
+
+    void setEnabled(bool enabled);
+    bool isEnabled() const;
+    void setSlowThresholdMs(int ms);
+    int slowThresholdMs() const;
+
+    void reset();
+    QList<StatementStats> statements() const;
+    QList<SlowQuery> slowQueries() const;
+    // -1 when nothing has been read through the page cache yet
+    double cacheHitRatio() const;
+
+    QByteArray toJson() const;
+
+private:
+    struct Accumulator {
+        qint64 calls = 0;
+        qint64 rows = 0;
+        qint64 totalNs = 0;
+        qint64 maxNs = 0;
+        QVector<qint64> samples;  // ring buffer of the latest latencies
+        int nextSample = 0;
+    };
+
+    static int traceCallback(unsigned type, void* context, void* p, void* x);
+    static QString scrub(const char* sql);
+    void install();
+
+    sqlite3* m_db = nullptr;
+    bool m_enabled = false;
+    int m_slowThresholdMs = 50;
+
+    mutable QMutex m_mutex;
+    QHash<QString, Accumulator> m_stats;
+    QHash<sqlite3_stmt*, qint64> m_pendingRows;
+    QList<SlowQuery> m_slowQueries;
+};
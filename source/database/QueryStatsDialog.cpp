@@ -0,0 +1,90 @@
+#include "./QueryStatsDialog.h"
+#include "./ui_QueryStatsDialog.h"
+
+#include <QFile>
+#include <QFileDialog>
+#include <QHeaderView>
+#include <QMessageBox>
+
+namespace {
+
+QTableWidgetItem* numberItem(double value, int precision) {
+  // Sort by value rather than by the formatted text
+  QTableWidgetItem* item = new QTableWidgetItem();
+  item->setData(Qt::DisplayRole, precision > 0 ? QVariant(QString::number(value, 'f', precision).toDouble()) : QVariant((qlonglong)value));
+  item->setTextAlignment(Qt::AlignRight | Qt::AlignVCenter);
+  return item;
+}
+
+}
+
+QueryStatsDialog::QueryStatsDialog(QueryProfiler& profiler, QWidget *parent)
+  : QDialog(parent), ui(new Ui::QueryStatsDialog), m_profiler(profiler) {
+  ui->setupUi(this);
+  setWindowTitle(tr("Query Statistics"));
+
+  ui->statementsTable->horizontalHeader()->setSectionResizeMode(0, QHeaderView::Stretch);
+  ui->enabledCheckBox->setChecked(m_profiler.isEnabled());
+  ui->thresholdSpinBox->setValue(m_profiler.slowThresholdMs());
+
+  connect(ui->enabledCheckBox, &QCheckBox::toggled, this, [this](bool enabled) {
+    m_profiler.setEnabled(enabled);
+  });
+  connect(ui->thresholdSpinBox, QOverload<int>::of(&QSpinBox::valueChanged), this, [this](int ms) {
+    m_profiler.setSlowThresholdMs(ms);
+  });
+  connect(ui->refreshButton, &QPushButton::clicked, this, &QueryStatsDialog::refresh);
+  connect(ui->resetButton, &QPushButton::clicked, this, &QueryStatsDialog::onReset);
+  connect(ui->saveButton, &QPushButton::clicked, this, &QueryStatsDialog::onSave);
+
+  refresh();
+}
+
+QueryStatsDialog::~QueryStatsDialog() {
+  delete ui;
+}
+
+void QueryStatsDialog::refresh() {
+  const QList<QueryProfiler::StatementStats> statements = m_profiler.statements();
+
+  ui->statementsTable->setSortingEnabled(false);
+  ui->statementsTable->setRowCount(0);
+  for (const QueryProfiler::StatementStats& stats : statements) {
+    int row = ui->statementsTable->rowCount();
+    ui->statementsTable->insertRow(row);
+    QTableWidgetItem* sqlItem = new QTableWidgetItem(stats.sql);
+    sqlItem->setToolTip(stats.sql);
+    ui->statementsTable->setItem(row, 0, sqlItem);
+    ui->statementsTable->setItem(row, 1, numberItem(stats.calls, 0));
+    ui->statementsTable->setItem(row, 2, numberItem(stats.totalMs, 2));
+    ui->statementsTable->setItem(row, 3, numberItem(stats.p50Ms, 3));
+    ui->statementsTable->setItem(row, 4, numberItem(stats.p99Ms, 3));
+    ui->statementsTable->setItem(row, 5, numberItem(stats.rows, 0));
+  }
+  ui->statementsTable->setSortingEnabled(true);
+
+  QStringList lines;
+  for (const QueryProfiler::SlowQuery& query : m_profiler.slowQueries()) {
+    lines.append(QString("%1  %2 ms  %3").arg(query.when.toString("HH:mm:ss.zzz")).arg(query.ms, 0, 'f', 2).arg(query.sql));
+  }
+  ui->slowTextEdit->setPlainText(lines.join("\n"));
+
+  double ratio = m_profiler.cacheHitRatio();
+  ui->cacheLabel->setText(ratio < 0 ? tr("Page cache hit ratio: n/a")
+                                    : tr("Page cache hit ratio: %1%").arg(ratio * 100.0, 0, 'f', 1));
+}
+
+void QueryStatsDialog::onReset() {
+  m_profiler.reset();
+  refresh();
+}
+
+void QueryStatsDialog::onSave() {
+  QString fileName = QFileDialog::getSaveFileName(this, tr("Save Query Statistics"), "query-stats.json", tr("JSON Files (*.json)"));
+  if (fileName.isEmpty()) return;
+
+  QFile file(fileName);
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate) || file.write(m_profiler.toJson()) < 0) {
+    QMessageBox::warning(this, tr("Save Query Statistics"), tr("Could not write %1").arg(fileName));
+  }
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <QDialog>
+
+#include "./QueryProfiler.h"
+
+namespace Ui {
+  class QueryStatsDialog;
+}
+
+// Debug view of the statement timings collected by a QueryProfiler
+class QueryStatsDialog : public QDialog {
+  Q_OBJECT
+
+  public:
+    explicit QueryStatsDialog(QueryProfiler& profiler, QWidget *parent = nullptr);
+    ~QueryStatsDialog();
+
+  private slots:
+    void refresh();
+    void onReset();
+    void onSave();
+
+  private:
+    Ui::QueryStatsDialog *ui;
+    QueryProfiler& m_profiler;
+};
@@ -0,0 +1,139 @@
+#include "ReaderPool.h"
+#include "CipherKey.h"
+
+#include <QDebug>
+#include <QMutexLocker>
+#include <utility>
+
+ReaderPool::Lease::Lease(ReaderPool* pool, sqlite3* db)
+    : m_pool(pool), m_db(db) {
+}
+
+ReaderPool::Lease::Lease(Lease&& other) noexcept
+    : m_pool(other.m_pool), m_db(other.m_db) {
+    other.m_pool = nullptr;
+    other.m_db = nullptr;
+}
+
+ReaderPool::Lease& ReaderPool::Lease::operator=(Lease&& other) noexcept {
+    if (this != &other) {
+        release();
+        m_pool = other.m_pool;
+        m_db = other.m_db;
+        other.m_pool = nullptr;
+        other.m_db = nullptr;
+    }
+    return *this;
+}
+
+ReaderPool::Lease::~Lease() {
+    release();
+}
+
+void ReaderPool::Lease::release() {
+    if (m_pool && m_db) {
+        m_pool->giveBack(m_db);
+    }
+    m_pool = nullptr;
+    m_db = nullptr;
+}
+
+ReaderPool::ReaderPool(const DatabaseManager::ConnectionInfo& info, int size)
+    : m_info(info), m_size(qMax(1, size)) {
+}
+
+ReaderPool::~ReaderPool() {
+    shutdown();
+    CipherKey::wipe(m_info.keySpec);
+}
+
+sqlite3* ReaderPool::open(QString* error) {
+    QString openError;
+    sqlite3* db = DatabaseManager::openConnection(m_info, SQLITE_OPEN_READONLY, &openError);
+    if (!db) {
+        if (error) *error = openError;
+        return nullptr;
+    }
+    sqlite3_exec(db, "PRAGMA query_only = ON;", nullptr, nullptr, nullptr);
+    return db;
+}
+
+ReaderPool::Lease ReaderPool::acquire(QString* error) {
+    QMutexLocker locker(&m_mutex);
+    while (!m_shutDown && m_idle.isEmpty() && m_leased.size() + m_opening >= m_size) {
+        m_available.wait(&m_mutex);
+    }
+    if (m_shutDown) {
+        if (error) *error = QString("The vault has been closed");
+        return Lease();
+    }
+
+    sqlite3* db = nullptr;
+    if (!m_idle.isEmpty()) {
+        db = m_idle.takeLast();
+    } else {
+        // Opening is cheap with a raw key, but still done outside the lock
+        ++m_opening;
+        locker.unlock();
+        db = open(error);
+        locker.relock();
+        --m_opening;
+        if (!db || m_shutDown) {
+            if (db) {
+                sqlite3_close(db);
+                if (error) *error = QString("The vault has been closed");
+            }
+            m_available.wakeAll();
+            return Lease();
+        }
+    }
+
+    // The snapshot is taken by the first read and held until the lease ends
+    if (sqlite3_exec(db, "BEGIN;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        if (error) *error = QString::fromUtf8(sqlite3_errmsg(db));
+        m_idle.append(db);
+        m_available.wakeOne();
+        return Lease();
+    }
+    m_leased.insert(db);
+    return Lease(this, db);
+}
+
+void ReaderPool::giveBack(sqlite3* db) {
+    if (!sqlite3_get_autocommit(db)) {
+        sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr);
+    }
+
+    QMutexLocker locker(&m_mutex);
+    m_leased.remove(db);
+    if (m_shutDown) {
+        sqlite3_close(db);
+    } else {
+        m_idle.append(db);
+    }
+    m_available.wakeAll();
+}
+
+void ReaderPool::shutdown() {
+    QMutexLocker locker(&m_mutex);
+    m_shutDown = true;
+
+    // Safe while the lease holder keeps the connection open, which it does until giveBack()
+    for (sqlite3* db : std::as_const(m_leased)) {
+        sqlite3_interrupt(db);
+    }
+    while (!m_leased.isEmpty() || m_opening > 0) {
+        m_available.wait(&m_mutex);
+    }
+
+    for (sqlite3* db : std::as_const(m_idle)) {
+        sqlite3_close(db);
+    }
+    m_idle.clear();
+    m_available.wakeAll();
+}
+
+bool ReaderPool::isShutDown() const {
+    QMutexLocker locker(&m_mutex);
+    return m_shutDown;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <QList>
+#include <QMutex>
+#include <QSet>
+#include <QWaitCondition>
+#include <sqlite3.h>
+
+#include "DatabaseManager.h"
+
+// A small pool of keyed read-only connections to a vault in WAL mode.
+// Every lease runs inside its own read transaction, so all statements on it see
+// one snapshot while the writer keeps committing. Meant for worker threads only:
+// acquire() blocks while every connection is leased.
+class ReaderPool {
+public:
+    static const int DefaultSize = 4;
+
+    class Lease {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+
+        sqlite3* db() const { return m_db; }
+        bool isValid() const { return m_db != nullptr; }
+        // Ends the snapshot early and hands the connection back
+        void release();
+
+    private:
+        friend class ReaderPool;
+        Lease(ReaderPool* pool, sqlite3* db);
+
+        ReaderPool* m_pool = nullptr;
+        sqlite3* m_db = nullptr;
+    };
+
+    explicit ReaderPool(const DatabaseManager::ConnectionInfo& info, int size = DefaultSize);
+    ~ReaderPool();
+
+    // Invalid lease with *error set once the pool is shut down or a connection fails to open
+    Lease acquire(QString* error = nullptr);
+
+    // Interrupts every leased connection, waits for them to come back and closes all of them.
+    // After this returns no reader holds the vault file, so its WAL can be checkpointed away.
+    void shutdown();
+    bool isShutDown() const;
+
+private:
+    void giveBack(sqlite3* db);
+    sqlite3* open(QString* error);
+
+    DatabaseManager::ConnectionInfo m_info;
+    const int m_size;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_available;
+    QList<sqlite3*> m_idle;
+    QSet<sqlite3*> m_leased;
+    int m_opening = 0;
+    bool m_shutDown = false;
+};
@@ -0,0 +1,209 @@
+#include "RecycleBin.h"
+
+#include <QByteArray>
+#include <QDebug>
+#include <QList>
+#include <QSettings>
+#include <QThread>
+
+namespace {
+
+int queryInt(sqlite3* db, const char* query, int arg = 0) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+    if (sqlite3_bind_parameter_count(stmt) > 0) {
+        sqlite3_bind_int(stmt, 1, arg);
+    }
+    int value = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW && sqlite3_column_type(stmt, 0) != SQLITE_NULL) {
+        value = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+bool execInt(sqlite3* db, const char* query, int first, int second = 0) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return false;
+    sqlite3_bind_int(stmt, 1, first);
+    if (sqlite3_bind_parameter_count(stmt) > 1) {
+        sqlite3_bind_int(stmt, 2, second);
+    }
+    bool success = (sqlite3_step(stmt) == SQLITE_DONE);
+    sqlite3_finalize(stmt);
+    return success;
+}
+
+// Where restored items go when their old place no longer exists or is itself in the bin
+int fallbackGroup(sqlite3* db) {
+    return queryInt(db, "SELECT id FROM groups WHERE parent_id IS NULL AND is_recycle_bin = 0 ORDER BY id LIMIT 1");
+}
+
+bool isUsableTarget(sqlite3* db, int groupId) {
+    return groupId > 0
+        && queryInt(db, "SELECT 1 FROM groups WHERE id = ?", groupId) == 1
+        && !RecycleBin::groupIds(db).contains(groupId);
+}
+
+// Runs one batch delete, with the retention modifier bound, in its own transaction
+int purgeBatch(sqlite3* db, const char* deleteQuery, const QByteArray& modifier) {
+    if (sqlite3_exec(db, "BEGIN IMMEDIATE;", nullptr, nullptr, nullptr) != SQLITE_OK) return -1;
+
+    sqlite3_stmt* stmt;
+    int removed = -1;
+    if (sqlite3_prepare_v2(db, deleteQuery, -1, &stmt, nullptr) == SQLITE_OK) {
+        if (sqlite3_bind_parameter_count(stmt) >= 1) {
+            sqlite3_bind_text(stmt, 1, modifier.constData(), -1, SQLITE_TRANSIENT);
+        }
+        if (sqlite3_step(stmt) == SQLITE_DONE) {
+            removed = sqlite3_changes(db);
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (removed < 0 || sqlite3_exec(db, "COMMIT;", nullptr, nullptr, nullptr) != SQLITE_OK) {
+        sqlite3_exec(db, "ROLLBACK;", nullptr, nullptr, nullptr);
+        return -1;
+    }
+    return removed;
+}
+
+}
+
+const char* const RecycleBin::NotInBin =
+    "group_id NOT IN (SELECT c.descendant FROM group_closure c JOIN groups b ON b.id = c.ancestor WHERE b.is_recycle_bin = 1)";
+
+RecycleBin::Policy RecycleBin::loadPolicy() {
+    Policy policy;
+    QSettings settings;
+    settings.beginGroup("recycleBin");
+    policy.retentionDays = settings.value("retentionDays", policy.retentionDays).toInt();
+    settings.endGroup();
+    return policy;
+}
+
+void RecycleBin::savePolicy(const Policy& policy) {
+    QSettings settings;
+    settings.beginGroup("recycleBin");
+    settings.setValue("retentionDays", policy.retentionDays);
+    settings.endGroup();
+}
+
+int RecycleBin::groupId(sqlite3* db, bool create) {
+    int id = queryInt(db, "SELECT id FROM groups WHERE is_recycle_bin = 1");
+    if (id >= 0 || !create) return id;
+
+    if (sqlite3_exec(db, "INSERT INTO groups (name, parent_id, is_recycle_bin) VALUES ('Recycle Bin', NULL, 1)",
+                     nullptr, nullptr, nullptr) != SQLITE_OK) {
+        qCritical() << "Failed to create the recycle bin:" << sqlite3_errmsg(db);
+        return -1;
+    }
+    return (int)sqlite3_last_insert_rowid(db);
+}
+
+QSet<int> RecycleBin::groupIds(sqlite3* db) {
+    QSet<int> ids;
+    sqlite3_stmt* stmt;
+    const char* query = "SELECT c.descendant FROM group_closure c JOIN groups b ON b.id = c.ancestor WHERE b.is_recycle_bin = 1";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) return ids;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        ids.insert(sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+    return ids;
+}
+
+bool RecycleBin::trashEntry(sqlite3* db, int entryId, int binId) {
+    // Moving something around inside the bin keeps its deletion time and original place
+    return execInt(db, "UPDATE entries SET restore_group_id = CASE WHEN deleted_at IS NULL THEN group_id ELSE restore_group_id END,"
+                       " group_id = ?2, deleted_at = COALESCE(deleted_at, CURRENT_TIMESTAMP),"
+                       " modified_at = CURRENT_TIMESTAMP WHERE id = ?1", entryId, binId);
+}
+
+bool RecycleBin::trashGroup(sqlite3* db, int groupId, int binId) {
+    // The closure trigger moves the subtree along; its entries are not touched
+    return execInt(db, "UPDATE groups SET restore_parent_id = CASE WHEN deleted_at IS NULL THEN parent_id ELSE restore_parent_id END,"
+                       " parent_id = ?2, deleted_at = COALESCE(deleted_at, CURRENT_TIMESTAMP),"
+                       " modified_at = CURRENT_TIMESTAMP WHERE id = ?1", groupId, binId);
+}
+
+bool RecycleBin::restoreEntry(sqlite3* db, int entryId) {
+    // Anything not in the bin stays where it is
+    if (queryInt(db, "SELECT 1 FROM entries WHERE id = ? AND deleted_at IS NOT NULL", entryId) != 1) return true;
+
+    int target = queryInt(db, "SELECT restore_group_id FROM entries WHERE id = ?", entryId);
+    if (!isUsableTarget(db, target)) target = fallbackGroup(db);
+    if (target < 0) return false;
+    return execInt(db, "UPDATE entries SET group_id = ?2, restore_group_id = NULL, deleted_at = NULL,"
+                       " modified_at = CURRENT_TIMESTAMP WHERE id = ?1", entryId, target);
+}
+
+bool RecycleBin::restoreGroup(sqlite3* db, int groupId) {
+    if (queryInt(db, "SELECT 1 FROM groups WHERE id = ? AND deleted_at IS NOT NULL", groupId) != 1) return true;
+
+    // Deleted from the top level, or its parent is gone: it becomes a top-level group again
+    const int target = queryInt(db, "SELECT restore_parent_id FROM groups WHERE id = ?", groupId);
+    if (!isUsableTarget(db, target)) {
+        return execInt(db, "UPDATE groups SET parent_id = NULL, restore_parent_id = NULL, deleted_at = NULL,"
+                           " modified_at = CURRENT_TIMESTAMP WHERE id = ?", groupId);
+    }
+    return execInt(db, "UPDATE groups SET parent_id = ?2, restore_parent_id = NULL, deleted_at = NULL,"
+                       " modified_at = CURRENT_TIMESTAMP WHERE id = ?1", groupId, target);
+}
+
+bool RecycleBin::expire(sqlite3* db, int groupId) {
+    const int binId = RecycleBin::groupId(db, false);
+    if (binId < 0 || !groupIds(db).contains(groupId)) return false;
+
+    if (groupId != binId) {
+        return execInt(db, "UPDATE groups SET deleted_at = '1970-01-01 00:00:00' WHERE id = ?", groupId);
+    }
+    return execInt(db, "UPDATE groups SET deleted_at = '1970-01-01 00:00:00' WHERE parent_id = ?", binId)
+        && execInt(db, "UPDATE entries SET deleted_at = '1970-01-01 00:00:00' WHERE group_id = ?", binId);
+}
+
+int RecycleBin::purge(sqlite3* db, const Policy& policy, const std::atomic<bool>& cancelled) {
+    if (!db || groupId(db, false) < 0) return 0;
+
+    // Entries first, in batches, so removing the emptied groups afterwards cascades over nothing large.
+    // deleted_at alone does not prove an item is in the bin; a merge can move a group out without clearing it.
+    const char* const expiredEntries[] = {
+        "DELETE FROM entries WHERE id IN (SELECT id FROM entries WHERE deleted_at <= datetime('now', ?1)"
+        " AND group_id IN (SELECT c.descendant FROM group_closure c JOIN groups b ON b.id = c.ancestor"
+        "  WHERE b.is_recycle_bin = 1) LIMIT 200)",
+        "DELETE FROM entries WHERE id IN (SELECT e.id FROM entries e JOIN group_closure c ON c.descendant = e.group_id"
+        " JOIN groups g ON g.id = c.ancestor WHERE g.deleted_at <= datetime('now', ?1)"
+        " AND g.id IN (SELECT bc.descendant FROM group_closure bc JOIN groups b ON b.id = bc.ancestor"
+        "  WHERE b.is_recycle_bin = 1) LIMIT 200)",
+        "DELETE FROM groups WHERE id IN (SELECT id FROM groups WHERE deleted_at <= datetime('now', ?1)"
+        " AND id IN (SELECT c.descendant FROM group_closure c JOIN groups b ON b.id = c.ancestor"
+        "  WHERE b.is_recycle_bin = 1) LIMIT 200)",
+    };
+    const char* const everything[] = {
+        "DELETE FROM entries WHERE id IN (SELECT e.id FROM entries e JOIN group_closure c ON c.descendant = e.group_id"
+        " JOIN groups b ON b.id = c.ancestor WHERE b.is_recycle_bin = 1 LIMIT 200)",
+        "DELETE FROM groups WHERE id IN (SELECT id FROM groups WHERE parent_id IN"
+        " (SELECT id FROM groups WHERE is_recycle_bin = 1) LIMIT 200)",
+    };
+    static_assert(PurgeBatch == 200, "the purge statements inline the batch size");
+
+    QList<const char*> steps;
+    if (policy.retentionDays > 0) {
+        for (const char* query : expiredEntries) steps.append(query);
+    } else {
+        for (const char* query : everything) steps.append(query);
+    }
+    const QByteArray modifier = QByteArray("-") + QByteArray::number(qMax(policy.retentionDays, 0)) + " days";
+
+    int total = 0;
+    for (const char* query : steps) {
+        while (!cancelled) {
+            const int removed = purgeBatch(db, query, modifier);
+            if (removed < 0) return -1;
+            total += removed;
+            if (removed < PurgeBatch) break;
+            QThread::msleep(PurgePauseMs);
+        }
+    }
+    return total;
+}
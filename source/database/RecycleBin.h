@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QSet>
+#include <sqlite3.h>
+#include <atomic>
+
+// Soft delete. A deleted entry or group is moved into the recycle-bin group and
+// stamped with deleted_at and where it came from, which is a single-row update
+// however large the group is. Nothing cascades until purge() drops what has
+// been in the bin past the retention period, PurgeBatch entries per
+// transaction with a pause in between so the vault stays writable meanwhile.
+class RecycleBin {
+public:
+    static const int PurgeBatch = 200;
+    static const int PurgePauseMs = 50;
+
+    struct Policy {
+        int retentionDays = 30;  // 0 purges everything in the bin
+    };
+
+    static Policy loadPolicy();
+    static void savePolicy(const Policy& policy);
+
+    // The bin group, or -1; with create set it is added as a top-level group of its own,
+    // so no user group can contain it
+    static int groupId(sqlite3* db, bool create);
+    // The bin and every group inside it
+    static QSet<int> groupIds(sqlite3* db);
+    // SQL condition on entries that leaves out the ones in the bin
+    static const char* const NotInBin;
+
+    // These run inside the caller's transaction
+    static bool trashEntry(sqlite3* db, int entryId, int binId);
+    static bool trashGroup(sqlite3* db, int groupId, int binId);
+    // Back to where they were deleted from. If that is gone too, an entry goes to the first top-level
+    // group and a group to the top level. Items that are not in the bin are left alone.
+    static bool restoreEntry(sqlite3* db, int entryId);
+    static bool restoreGroup(sqlite3* db, int groupId);
+
+    // Dates a group in the bin back so the next purge removes it, whatever the retention;
+    // given the bin itself, does that to everything in it. Nothing is deleted here.
+    static bool expire(sqlite3* db, int groupId);
+
+    // Removes expired bin contents; returns how many entries and groups went, or -1
+    static int purge(sqlite3* db, const Policy& policy, const std::atomic<bool>& cancelled);
+};
@@ -0,0 +1,198 @@
+#include "RekeyWorker.h"
+#include "CipherKey.h"
+
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+
+namespace {
+
+int queryInt(sqlite3* db, const char* sql) {
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, sql, -1, &stmt, nullptr) != SQLITE_OK) return -1;
+
+    int value = -1;
+    if (sqlite3_step(stmt) == SQLITE_ROW) {
+        value = sqlite3_column_int(stmt, 0);
+    }
+    sqlite3_finalize(stmt);
+    return value;
+}
+
+}
+
+RekeyWorker::RekeyWorker(const Job& job, QObject* parent)
+    : QObject(parent), m_job(job), m_targetPath(targetPathFor(job.path)) {
+}
+
+RekeyWorker::~RekeyWorker() {
+    CipherKey::wipe(m_job.oldKey);
+    CipherKey::wipe(m_job.newKey);
+    CipherKey::wipe(m_keySpec);
+}
+
+QString RekeyWorker::targetPathFor(const QString& path) {
+    return path + ".rekey";
+}
+
+void RekeyWorker::cancel() {
+    m_cancelled = true;
+}
+
+void RekeyWorker::run() {
+    m_sourceSize = QFileInfo(m_job.path).size();
+    m_reportTimer.start();
+
+    if (QFile::exists(m_targetPath)) {
+        QFile::remove(m_targetPath);
+    }
+
+    QString error;
+    bool success = exportCopy(&error) && deriveKeySpec(&error) && verifyCopy(&error);
+    if (success) {
+        emit progress(100);
+    } else {
+        qWarning() << "Master password change failed:" << error;
+        QFile::remove(m_targetPath);
+        CipherKey::wipe(m_keySpec);
+    }
+
+    emit finished(success, m_keySpec, error);
+}
+
+bool RekeyWorker::exportCopy(QString* error) {
+    // ATTACH inherits the connection flags, so the source must be opened with CREATE for the copy to be made
+    sqlite3* db = DatabaseManager::openConnection({m_job.path, m_job.oldKey, m_job.oldProfile},
+                                                  SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, error);
+    if (!db) {
+        return false;
+    }
+
+    m_groupCount = queryInt(db, "SELECT count(*) FROM groups");
+    m_entryCount = queryInt(db, "SELECT count(*) FROM entries");
+    int userVersion = queryInt(db, "PRAGMA user_version");
+    if (m_groupCount < 0 || m_entryCount < 0) {
+        *error = "Failed to read the vault (wrong password?)";
+        sqlite3_close(db);
+        return false;
+    }
+
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "ATTACH DATABASE ? AS rekeyed KEY ?", -1, &stmt, nullptr) != SQLITE_OK) {
+        *error = QString("Failed to prepare attach: %1").arg(sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    QByteArray targetBytes = m_targetPath.toUtf8();
+    sqlite3_bind_text(stmt, 1, targetBytes.constData(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, m_job.newKey.constData(), m_job.newKey.length(), SQLITE_TRANSIENT);
+    int rc = sqlite3_step(stmt);
+    sqlite3_finalize(stmt);
+    if (rc != SQLITE_DONE) {
+        *error = QString("Failed to create the re-encrypted copy: %1").arg(sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    if (!DatabaseManager::configureCipher(db, m_job.newProfile, "rekeyed")) {
+        *error = QString("Failed to apply the new cipher profile: %1").arg(sqlite3_errmsg(db));
+        sqlite3_close(db);
+        return false;
+    }
+
+    // A small cache makes pages reach the file steadily, which is what progress is read from
+    sqlite3_exec(db, "PRAGMA rekeyed.cache_size = 256;", nullptr, nullptr, nullptr);
+
+    sqlite3_progress_handler(db, 10000, &RekeyWorker::progressCallback, this);
+    char* errMsg = nullptr;
+    rc = sqlite3_exec(db, "SELECT sqlcipher_export('rekeyed');", nullptr, nullptr, &errMsg);
+    sqlite3_progress_handler(db, 0, nullptr, nullptr);
+    if (rc != SQLITE_OK) {
+        *error = m_cancelled ? QString("Cancelled") : QString("Export failed: %1").arg(errMsg ? errMsg : "Unknown error");
+        sqlite3_free(errMsg);
+        sqlite3_close(db);
+        return false;
+    }
+
+    QByteArray versionPragma = QByteArray("PRAGMA rekeyed.user_version = ") + QByteArray::number(userVersion) + ";";
+    sqlite3_exec(db, versionPragma.constData(), nullptr, nullptr, nullptr);
+    sqlite3_exec(db, "DETACH DATABASE rekeyed;", nullptr, nullptr, nullptr);
+    sqlite3_close(db);
+
+    emit progress(90);
+    return true;
+}
+
+bool RekeyWorker::deriveKeySpec(QString* error) {
+    // The copy has a fresh salt, so the spec can only be derived once it exists
+    m_keySpec = CipherKey::derive(m_targetPath, m_job.newKey, m_job.newProfile.kdfIterations);
+    if (m_keySpec.isEmpty()) {
+        *error = "Failed to derive the new key";
+        return false;
+    }
+    emit progress(95);
+    return true;
+}
+
+bool RekeyWorker::verifyCopy(QString* error) {
+    // Opened with the derived spec, which also proves the spec the vault is reopened with
+    sqlite3* db = DatabaseManager::openConnection({m_targetPath, m_keySpec, m_job.newProfile},
+                                                  SQLITE_OPEN_READONLY, error);
+    if (!db) {
+        return false;
+    }
+
+    // cipher_integrity_check reports one row per damaged page and nothing when the file is sound
+    sqlite3_stmt* stmt;
+    bool sound = false;
+    if (sqlite3_prepare_v2(db, "PRAGMA cipher_integrity_check;", -1, &stmt, nullptr) == SQLITE_OK) {
+        int rc = sqlite3_step(stmt);
+        sound = (rc == SQLITE_DONE);
+        if (rc == SQLITE_ROW) {
+            *error = QString("Copy failed the cipher integrity check: %1")
+                         .arg(QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0)));
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (sound && sqlite3_prepare_v2(db, "PRAGMA quick_check;", -1, &stmt, nullptr) == SQLITE_OK) {
+        sound = (sqlite3_step(stmt) == SQLITE_ROW)
+                && qstrcmp((const char*)sqlite3_column_text(stmt, 0), "ok") == 0;
+        if (!sound) {
+            *error = "Copy failed the quick check";
+        }
+        sqlite3_finalize(stmt);
+    }
+
+    if (sound && (queryInt(db, "SELECT count(*) FROM groups") != m_groupCount
+                  || queryInt(db, "SELECT count(*) FROM entries") != m_entryCount)) {
+        *error = "Copy does not contain the same number of groups and entries";
+        sound = false;
+    }
+
+    if (!sound && error->isEmpty()) {
+        *error = QString("Failed to verify the copy: %1").arg(sqlite3_errmsg(db));
+    }
+
+    sqlite3_close(db);
+    return sound;
+}
+
+int RekeyWorker::progressCallback(void* context) {
+    auto* self = static_cast<RekeyWorker*>(context);
+    if (self->m_cancelled) return 1;
+    if (self->m_reportTimer.elapsed() < 100) return 0;
+    self->m_reportTimer.restart();
+
+    if (self->m_sourceSize > 0) {
+        // Approximate: bytes in the copy so far against the size of the original
+        qint64 written = QFileInfo(self->m_targetPath).size();
+        int percent = (int)qBound<qint64>(0, written * 90 / self->m_sourceSize, 89);
+        if (percent != self->m_lastPercent) {
+            self->m_lastPercent = percent;
+            emit self->progress(percent);
+        }
+    }
+    return 0;
+}
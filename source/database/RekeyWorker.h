@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QElapsedTimer>
+#include <sqlite3.h>
+#include <atomic>
+
+#include "DatabaseManager.h"
+
+// Re-encrypts a vault into a sibling file with a new key and cipher profile.
+// Meant to run on a worker thread; the caller swaps the file in once it succeeds,
+// keying it with the spec derived here so the KDF does not run again.
+class RekeyWorker : public QObject {
+    Q_OBJECT
+
+public:
+    struct Job {
+        QString path;
+        QByteArray oldKey;
+        QByteArray newKey;
+        DatabaseManager::CipherProfile oldProfile;
+        DatabaseManager::CipherProfile newProfile;
+    };
+
+    explicit RekeyWorker(const Job& job, QObject* parent = nullptr);
+    ~RekeyWorker() override;
+
+    static QString targetPathFor(const QString& path);
+    void cancel();
+
+public slots:
+    void run();
+
+signals:
+    void progress(int percent);
+    void finished(bool success, const QByteArray& keySpec, const QString& error);
+
+private:
+    bool exportCopy(QString* error);
+    bool deriveKeySpec(QString* error);
+    bool verifyCopy(QString* error);
+    static int progressCallback(void* context);
+
+    Job m_job;
+    QString m_targetPath;
+    QByteArray m_keySpec;
+    std::atomic<bool> m_cancelled{false};
+
+    qint64 m_sourceSize = 0;
+    QElapsedTimer m_reportTimer;
+    int m_lastPercent = -1;
+
+    int m_groupCount = 0;
+    int m_entryCount = 0;
+};
@@ -0,0 +1,383 @@
+#include "SearchQuery.h"
+
+#include <QCache>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QRegularExpression>
+#include <QVector>
+
+namespace {
+
+const char* const TextColumns[] = {"title", "username", "url", "notes"};
+
+struct Token {
+    enum Kind { Word, Open, Close, Or, And, Not, End };
+    Kind kind = End;
+    QString field;
+    QString value;
+};
+
+// Nodes refer to their operands by index into the parser's node list
+struct Node {
+    enum Kind { And, Or, Not, Term };
+    Kind kind = Term;
+    int left = -1;
+    int right = -1;
+    QString field;
+    QString value;
+};
+
+bool isField(const QString& name) {
+    static const QStringList fields = {"title", "user", "username", "url", "notes", "group", "tag", "modified", "created"};
+    return fields.contains(name);
+}
+
+QList<Token> tokenize(const QString& query, bool* ok) {
+    QList<Token> tokens;
+    int i = 0;
+    const int n = query.size();
+    while (i < n) {
+        const QChar c = query.at(i);
+        if (c.isSpace()) {
+            ++i;
+        } else if (c == '(' || c == ')' || c == '|') {
+            Token token;
+            token.kind = c == '(' ? Token::Open : (c == ')' ? Token::Close : Token::Or);
+            tokens.append(token);
+            ++i;
+        } else if (c == '-' && i + 1 < n && !query.at(i + 1).isSpace()) {
+            Token token;
+            token.kind = Token::Not;
+            tokens.append(token);
+            ++i;
+        } else {
+            Token token;
+            token.kind = Token::Word;
+            bool quoted = false;
+            while (i < n) {
+                const QChar ch = query.at(i);
+                if (ch == '"') {
+                    const int close = query.indexOf('"', i + 1);
+                    if (close < 0) {
+                        *ok = false;
+                        return tokens;
+                    }
+                    token.value += query.mid(i + 1, close - i - 1);
+                    quoted = true;
+                    i = close + 1;
+                } else if (ch.isSpace() || ch == '(' || ch == ')') {
+                    break;
+                } else {
+                    // The first colon splits off a known field; "https://..." stays a word
+                    if (ch == ':' && token.field.isEmpty() && !quoted && isField(token.value.toLower())) {
+                        token.field = token.value.toLower();
+                        token.value.clear();
+                    } else {
+                        token.value += ch;
+                    }
+                    ++i;
+                }
+            }
+            if (!quoted && token.field.isEmpty()) {
+                if (token.value == "OR") token.kind = Token::Or;
+                else if (token.value == "AND") token.kind = Token::And;
+                else if (token.value == "NOT") token.kind = Token::Not;
+            }
+            tokens.append(token);
+        }
+    }
+    tokens.append(Token());
+    return tokens;
+}
+
+class Parser {
+public:
+    explicit Parser(const QList<Token>& tokens) : m_tokens(tokens) {}
+
+    int parse() {
+        int root = parseOr();
+        return (root >= 0 && peek().kind == Token::End) ? root : -1;
+    }
+
+    QVector<Node> nodes;
+
+private:
+    const Token& peek() const { return m_tokens.at(m_pos); }
+
+    int make(Node::Kind kind, int left, int right = -1) {
+        Node node;
+        node.kind = kind;
+        node.left = left;
+        node.right = right;
+        nodes.append(node);
+        return nodes.size() - 1;
+    }
+
+    int parseOr() {
+        int left = parseAnd();
+        while (left >= 0 && peek().kind == Token::Or) {
+            ++m_pos;
+            const int right = parseAnd();
+            left = right < 0 ? -1 : make(Node::Or, left, right);
+        }
+        return left;
+    }
+
+    int parseAnd() {
+        int left = parseUnary();
+        while (left >= 0 && peek().kind != Token::Or && peek().kind != Token::Close && peek().kind != Token::End) {
+            if (peek().kind == Token::And) ++m_pos;
+            const int right = parseUnary();
+            left = right < 0 ? -1 : make(Node::And, left, right);
+        }
+        return left;
+    }
+
+    int parseUnary() {
+        const Token& token = peek();
+        if (token.kind == Token::Not) {
+            ++m_pos;
+            const int operand = parseUnary();
+            return operand < 0 ? -1 : make(Node::Not, operand);
+        }
+        if (token.kind == Token::Open) {
+            ++m_pos;
+            const int inner = parseOr();
+            if (inner < 0 || peek().kind != Token::Close) return -1;
+            ++m_pos;
+            return inner;
+        }
+        if (token.kind == Token::Word) {
+            ++m_pos;
+            Node node;
+            node.field = token.field;
+            node.value = token.value;
+            nodes.append(node);
+            return nodes.size() - 1;
+        }
+        return -1;
+    }
+
+    const QList<Token>& m_tokens;
+    int m_pos = 0;
+};
+
+QString escapeLike(const QString& text) {
+    QString escaped;
+    for (const QChar c : text) {
+        if (c == '\\' || c == '%' || c == '_') escaped += '\\';
+        escaped += c;
+    }
+    return escaped;
+}
+
+// * is a wildcard; without one the value matches anywhere in the field
+QString likePattern(const QString& value) {
+    if (!value.contains('*')) return '%' + escapeLike(value) + '%';
+    return escapeLike(value).replace('*', '%');
+}
+
+class Compiler {
+public:
+    explicit Compiler(const QVector<Node>& nodes) : m_nodes(nodes) {}
+
+    QString compile(int index, QStringList* params) {
+        const Node& node = m_nodes.at(index);
+        switch (node.kind) {
+        case Node::And:
+            return '(' + compile(node.left, params) + " AND " + compile(node.right, params) + ')';
+        case Node::Or:
+            return '(' + compile(node.left, params) + " OR " + compile(node.right, params) + ')';
+        case Node::Not:
+            // IS NOT 1 also keeps rows where the term is NULL
+            return '(' + compile(node.left, params) + ") IS NOT 1";
+        case Node::Term:
+            return term(node, params);
+        }
+        return QString();
+    }
+
+    bool ok = true;
+
+private:
+    QString term(const Node& node, QStringList* params) {
+        if (node.field.isEmpty()) {
+            QStringList any;
+            for (const char* column : TextColumns) {
+                any.append(QString("COALESCE(%1, '') LIKE ? ESCAPE '\\'").arg(column));
+                params->append(likePattern(node.value));
+            }
+            return '(' + any.join(" OR ") + ')';
+        }
+        if (node.field == "group") return group(node.value, params);
+        if (node.field == "tag") return tag(node.value, params);
+        if (node.field == "modified" || node.field == "created") return date(node.field + "_at", node.value, params);
+
+        const QString column = node.field == "user" ? QString("username") : node.field;
+        if (node.value.isEmpty()) return QString("COALESCE(%1, '') = ''").arg(column);
+        params->append(likePattern(node.value));
+        return QString("COALESCE(%1, '') LIKE ? ESCAPE '\\'").arg(column);
+    }
+
+    // Paths are built below the root group, so /Infra is a child of the root
+    QString group(const QString& value, QStringList* params) {
+        QString path = value;
+        while (path.endsWith('/')) path.chop(1);
+        if (value.startsWith('/') && path.isEmpty()) return "1";
+        if (path.isEmpty()) {
+            ok = false;
+            return QString();
+        }
+        // A bare name matches that group wherever it sits
+        const QString pattern = (value.startsWith('/') ? QString() : QString("%/")) + escapeLike(path);
+        params->append(pattern);
+        // Only the named groups come from walking the paths; their subtrees are read from the closure
+        return "group_id IN (SELECT c.descendant FROM group_closure c WHERE c.ancestor IN ("
+               "WITH RECURSIVE tree(id, path) AS ("
+               "SELECT id, '' FROM groups WHERE parent_id IS NULL UNION ALL "
+               "SELECT g.id, tree.path || '/' || g.name FROM groups g JOIN tree ON g.parent_id = tree.id) "
+               "SELECT id FROM tree WHERE path LIKE ? ESCAPE '\\'))";
+    }
+
+    QString tag(const QString& value, QStringList* params) {
+        QStringList placeholders;
+        for (const QString& name : value.split(',', Qt::SkipEmptyParts)) {
+            const QString normalized = TagIndex::normalize(name);
+            if (normalized.isEmpty()) continue;
+            params->append(normalized);
+            placeholders.append("?");
+        }
+        if (placeholders.isEmpty()) {
+            ok = false;
+            return QString();
+        }
+        return "EXISTS (SELECT 1 FROM entry_tags et JOIN tags t ON t.id = et.tag_id "
+               "WHERE et.entry_id = entries.id AND t.name IN (" + placeholders.join(", ") + "))";
+    }
+
+    // <90d is newer than 90 days, >1y older than a year; a date compares by calendar day
+    QString date(const QString& column, const QString& value, QStringList* params) {
+        static const QRegularExpression agePattern("^([<>]?)(\\d+)([hdwmy])$");
+        static const QRegularExpression datePattern("^([<>=]?)(\\d{4}-\\d{2}-\\d{2})$");
+
+        QRegularExpressionMatch match = agePattern.match(value);
+        if (match.hasMatch()) {
+            static const QHash<QString, qint64> unitSeconds = {
+                {"h", 3600}, {"d", 86400}, {"w", 7 * 86400}, {"m", 30 * 86400}, {"y", 365 * 86400}};
+            const qint64 seconds = match.captured(2).toLongLong() * unitSeconds.value(match.captured(3));
+            params->append(QString("-%1 seconds").arg(seconds));
+            return match.captured(1) == ">"
+                ? QString("%1 <= datetime('now', ?)").arg(column)
+                : QString("%1 > datetime('now', ?)").arg(column);
+        }
+
+        match = datePattern.match(value);
+        if (match.hasMatch()) {
+            const QString day = match.captured(2);
+            params->append(day);
+            if (match.captured(1) == "<") return QString("%1 < ?").arg(column);
+            if (match.captured(1) == ">") return QString("%1 >= date(?, '+1 day')").arg(column);
+            params->append(day);
+            return QString("(%1 >= ? AND %1 < date(?, '+1 day'))").arg(column);
+        }
+
+        ok = false;
+        return QString();
+    }
+
+    const QVector<Node>& m_nodes;
+};
+
+void collectConjuncts(const QVector<Node>& nodes, int index, QList<int>* conjuncts) {
+    if (nodes.at(index).kind == Node::And) {
+        collectConjuncts(nodes, nodes.at(index).left, conjuncts);
+        collectConjuncts(nodes, nodes.at(index).right, conjuncts);
+    } else {
+        conjuncts->append(index);
+    }
+}
+
+bool isTagTerm(const Node& node) {
+    return node.kind == Node::Term && node.field == "tag";
+}
+
+QStringList tagNames(const QString& value) {
+    QStringList names;
+    for (const QString& name : value.split(',', Qt::SkipEmptyParts)) {
+        if (!TagIndex::normalize(name).isEmpty()) names.append(TagIndex::normalize(name));
+    }
+    return names;
+}
+
+bool build(const QString& query, SearchQuery::Plan* plan) {
+    bool ok = true;
+    const QList<Token> tokens = tokenize(query, &ok);
+    if (!ok) return false;
+
+    Parser parser(tokens);
+    const int root = parser.parse();
+    if (root < 0) return false;
+    const QVector<Node>& nodes = parser.nodes;
+
+    Compiler compiler(nodes);
+    plan->where = compiler.compile(root, &plan->params);
+
+    // Tags ANDed in at the top are answered by the bitmap index instead
+    QList<int> conjuncts;
+    collectConjuncts(nodes, root, &conjuncts);
+    QStringList residual;
+    for (int index : conjuncts) {
+        const Node& node = nodes.at(index);
+        if (isTagTerm(node)) {
+            plan->tags.allOf.append(tagNames(node.value));
+        } else if (node.kind == Node::Not && isTagTerm(nodes.at(node.left))) {
+            plan->tags.noneOf.append(tagNames(nodes.at(node.left).value));
+        } else {
+            residual.append(compiler.compile(index, &plan->residualParams));
+        }
+    }
+    plan->residualWhere = residual.join(" AND ");
+
+    QStringList words;
+    for (const Node& node : nodes) {
+        if (node.kind == Node::Term && node.field.isEmpty()) words.append(node.value);
+    }
+    plan->text = words.join(' ');
+    return compiler.ok;
+}
+
+}
+
+QSharedPointer<const SearchQuery::Plan> SearchQuery::compile(const QString& query) {
+    static QMutex mutex;
+    static QCache<QString, QSharedPointer<const Plan>> cache(CacheSize);
+
+    QMutexLocker locker(&mutex);
+    if (QSharedPointer<const Plan>* cached = cache.object(query)) {
+        return *cached;
+    }
+
+    QSharedPointer<Plan> plan = QSharedPointer<Plan>::create();
+    if (!build(query, plan.data())) {
+        *plan = Plan();
+        Node phrase;
+        phrase.value = query.trimmed();
+        QVector<Node> nodes = {phrase};
+        Compiler compiler(nodes);
+        plan->where = compiler.compile(0, &plan->params);
+        plan->residualWhere = plan->where;
+        plan->residualParams = plan->params;
+        plan->text = phrase.value;
+    }
+
+    cache.insert(query, new QSharedPointer<const Plan>(plan));
+    return plan;
+}
+
+void SearchQuery::bind(sqlite3_stmt* stmt, const QStringList& params) {
+    for (int i = 0; i < params.size(); ++i) {
+        const QByteArray value = params.at(i).toUtf8();
+        sqlite3_bind_text(stmt, i + 1, value.constData(), value.size(), SQLITE_TRANSIENT);
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QSharedPointer>
+#include <QString>
+#include <QStringList>
+#include <sqlite3.h>
+
+#include "TagIndex.h"
+
+// Structured entry search, e.g.
+//   user:admin url:*.corp group:/Infra -tag:old modified:<90d
+// Bare words match any text field; title:, user:, url: and notes: match one
+// field, * is a wildcard. group: takes a path below the root group (or a
+// name anywhere) and covers its subgroups, tag:a,b matches either tag, and
+// modified: / created: take <age or >age (90d, 12w, 6m, 1y) or a date.
+// Terms are ANDed unless joined by OR, and - or NOT negates a term or a
+// parenthesized group.
+//
+// A query is parsed into an AST and compiled once into a parameterized WHERE
+// clause over entries; compiled plans are cached per query string.
+class SearchQuery {
+public:
+    static const int CacheSize = 64;
+
+    struct Plan {
+        // Full clause; tag terms become lookups in entry_tags
+        QString where;
+        QStringList params;
+        // The same query with its top-level tag terms left to a TagIndex.
+        // residualWhere is empty when nothing else is left to check.
+        TagIndex::Filter tags;
+        QString residualWhere;
+        QStringList residualParams;
+        // The bare words, for ranking results
+        QString text;
+    };
+
+    // Thread-safe; a query that does not parse is searched as one plain phrase
+    static QSharedPointer<const Plan> compile(const QString& query);
+    static void bind(sqlite3_stmt* stmt, const QStringList& params);
+};
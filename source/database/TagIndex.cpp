@@ -0,0 +1,120 @@
+#include "TagIndex.h"
+#include "../utils/Trace.h"
+
+#include <QDebug>
+#include <algorithm>
+#include <iterator>
+
+QString TagIndex::normalize(const QString& tag) {
+    return tag.simplified().toLower().replace(' ', '-');
+}
+
+bool TagIndex::build(sqlite3* db) {
+    Trace::Span span("TagIndex::build", "db");
+    clear();
+    if (!db) return false;
+
+    // Both scans come back in id order, so every add lands at the end of its container
+    sqlite3_stmt* stmt;
+    if (sqlite3_prepare_v2(db, "SELECT id FROM entries ORDER BY id", -1, &stmt, nullptr) != SQLITE_OK) return false;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        m_entries.add((quint32)sqlite3_column_int(stmt, 0));
+    }
+    sqlite3_finalize(stmt);
+
+    const char* query = "SELECT t.name, et.entry_id FROM entry_tags et JOIN tags t ON t.id = et.tag_id "
+                        "ORDER BY et.tag_id, et.entry_id";
+    if (sqlite3_prepare_v2(db, query, -1, &stmt, nullptr) != SQLITE_OK) {
+        qCritical() << "Failed to load tags:" << sqlite3_errmsg(db);
+        return false;
+    }
+    QString name;
+    RoaringBitmap* bitmap = nullptr;
+    while (sqlite3_step(stmt) == SQLITE_ROW) {
+        const QString rowName = QString::fromUtf8((const char*)sqlite3_column_text(stmt, 0));
+        if (!bitmap || rowName != name) {
+            name = rowName;
+            bitmap = &m_byTag[name];
+        }
+        bitmap->add((quint32)sqlite3_column_int(stmt, 1));
+    }
+    sqlite3_finalize(stmt);
+    return true;
+}
+
+void TagIndex::clear() {
+    m_byTag.clear();
+    m_entries.clear();
+}
+
+QStringList TagIndex::tags() const {
+    QStringList list = m_byTag.keys();
+    list.sort();
+    return list;
+}
+
+QStringList TagIndex::tagsOf(int entryId) const {
+    QStringList list;
+    for (auto it = m_byTag.constBegin(); it != m_byTag.constEnd(); ++it) {
+        if (it.value().contains((quint32)entryId)) {
+            list.append(it.key());
+        }
+    }
+    list.sort();
+    return list;
+}
+
+RoaringBitmap TagIndex::match(const Filter& filter) const {
+    static const RoaringBitmap none;
+
+    // Narrowest group first keeps the intermediate results small
+    QList<RoaringBitmap> groups;
+    for (const QStringList& anyOf : filter.allOf) {
+        RoaringBitmap group;
+        for (const QString& tag : anyOf) {
+            group |= m_byTag.value(tag, none);
+        }
+        groups.append(group);
+    }
+    std::sort(groups.begin(), groups.end(), [](const RoaringBitmap& a, const RoaringBitmap& b) {
+        return a.cardinality() < b.cardinality();
+    });
+
+    RoaringBitmap result = groups.isEmpty() ? m_entries : groups.first();
+    for (int i = 1; i < groups.size() && !result.isEmpty(); ++i) {
+        result &= groups.at(i);
+    }
+    for (const QString& tag : filter.noneOf) {
+        if (result.isEmpty()) break;
+        auto it = m_byTag.constFind(tag);
+        if (it != m_byTag.constEnd()) {
+            result -= it.value();
+        }
+    }
+    return result;
+}
+
+void TagIndex::addEntry(int entryId, const QStringList& tags) {
+    m_entries.add((quint32)entryId);
+    for (const QString& tag : tags) {
+        m_byTag[tag].add((quint32)entryId);
+    }
+}
+
+void TagIndex::removeEntry(int entryId) {
+    m_entries.remove((quint32)entryId);
+    setEntryTags(entryId, QStringList());
+}
+
+void TagIndex::setEntryTags(int entryId, const QStringList& tags) {
+    for (auto it = m_byTag.begin(); it != m_byTag.end();) {
+        if (!tags.contains(it.key())) {
+            it.value().remove((quint32)entryId);
+        }
+        // Unused tags disappear, as their rows do
+        it = it.value().isEmpty() ? m_byTag.erase(it) : std::next(it);
+    }
+    for (const QString& tag : tags) {
+        m_byTag[tag].add((quint32)entryId);
+    }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <sqlite3.h>
+
+#include "../utils/RoaringBitmap.h"
+
+// Tags of an open vault held in memory: one bitmap of entry ids per tag and
+// one of every entry, built in a single pass when the vault is unlocked and
+// kept current by DatabaseManager. Tag filters are evaluated as bitmap
+// operations and never touch the database.
+class TagIndex {
+public:
+    // Every group in allOf needs one of its tags, and no tag in noneOf may be present
+    struct Filter {
+        QList<QStringList> allOf;
+        QStringList noneOf;
+
+        bool isEmpty() const { return allOf.isEmpty() && noneOf.isEmpty(); }
+    };
+
+    // Tags are compared lower-cased, with inner whitespace turned into dashes
+    static QString normalize(const QString& tag);
+
+    bool build(sqlite3* db);
+    void clear();
+
+    // Tags in use, sorted
+    QStringList tags() const;
+    QStringList tagsOf(int entryId) const;
+    RoaringBitmap match(const Filter& filter) const;
+
+    void addEntry(int entryId, const QStringList& tags = QStringList());
+    void removeEntry(int entryId);
+    void setEntryTags(int entryId, const QStringList& tags);
+
+private:
+    QHash<QString, RoaringBitmap> m_byTag;
+    RoaringBitmap m_entries;
+};
@@ -0,0 +1,266 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDebug>
+#include <QList>
+#include <QString>
+#include <sqlite3.h>
+
+#include <array>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+// Statements whose parameter and row types are fixed at compile time.
+//
+//     static constexpr Sql::Query<Group, int> GroupsIn{"SELECT id, name, parent_id FROM groups WHERE parent_id = ?"};
+//     QList<Group> groups = GroupsIn.all(db, parentId);
+//
+// Rows are either std::tuple or a struct with a Sql::Mapping listing its
+// members in column order. Text is encoded once into a buffer owned by the
+// running statement and bound SQLITE_STATIC; byte arrays are bound straight
+// from the caller's argument. Columns are read with their stored length, so
+// nothing is scanned for a terminator.
+namespace Sql {
+
+// Specialize with `static constexpr auto columns = std::make_tuple(&Row::member, ...);`
+template <typename Row>
+struct Mapping;
+
+template <typename T>
+struct Column;
+
+template <>
+struct Column<int> {
+    static int read(sqlite3_stmt* stmt, int index) { return sqlite3_column_int(stmt, index); }
+};
+
+template <>
+struct Column<qint64> {
+    static qint64 read(sqlite3_stmt* stmt, int index) { return sqlite3_column_int64(stmt, index); }
+};
+
+template <>
+struct Column<double> {
+    static double read(sqlite3_stmt* stmt, int index) { return sqlite3_column_double(stmt, index); }
+};
+
+template <>
+struct Column<QString> {
+    static QString read(sqlite3_stmt* stmt, int index) {
+        // The pointer comes first so the length is that of the UTF-8 form
+        const char* text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, index));
+        return QString::fromUtf8(text, sqlite3_column_bytes(stmt, index));
+    }
+};
+
+template <>
+struct Column<QByteArray> {
+    static QByteArray read(sqlite3_stmt* stmt, int index) {
+        const char* data = static_cast<const char*>(sqlite3_column_blob(stmt, index));
+        return QByteArray(data, sqlite3_column_bytes(stmt, index));
+    }
+};
+
+// storage is this parameter's slot in the running statement, for values that need converting
+template <typename T>
+struct Param;
+
+template <>
+struct Param<int> {
+    static int bind(sqlite3_stmt* stmt, int index, int value, QByteArray&) {
+        return sqlite3_bind_int(stmt, index, value);
+    }
+};
+
+template <>
+struct Param<qint64> {
+    static int bind(sqlite3_stmt* stmt, int index, qint64 value, QByteArray&) {
+        return sqlite3_bind_int64(stmt, index, value);
+    }
+};
+
+template <>
+struct Param<QString> {
+    static int bind(sqlite3_stmt* stmt, int index, const QString& value, QByteArray& storage) {
+        storage = value.toUtf8();
+        return sqlite3_bind_text(stmt, index, storage.constData(), storage.size(), SQLITE_STATIC);
+    }
+};
+
+template <>
+struct Param<QByteArray> {
+    static int bind(sqlite3_stmt* stmt, int index, const QByteArray& value, QByteArray&) {
+        return sqlite3_bind_blob(stmt, index, value.constData(), value.size(), SQLITE_STATIC);
+    }
+};
+
+template <typename T>
+struct Param<std::optional<T>> {
+    static int bind(sqlite3_stmt* stmt, int index, const std::optional<T>& value, QByteArray& storage) {
+        return value ? Param<T>::bind(stmt, index, *value, storage) : sqlite3_bind_null(stmt, index);
+    }
+};
+
+// Empty text and zero ids are stored as NULL
+inline std::optional<QString> nullIfEmpty(const QString& value) {
+    return value.isEmpty() ? std::nullopt : std::optional<QString>(value);
+}
+
+inline std::optional<int> nullIfZero(int value) {
+    return value > 0 ? std::optional<int>(value) : std::nullopt;
+}
+
+namespace detail {
+
+template <typename T>
+struct MemberType;
+
+template <typename Owner, typename T>
+struct MemberType<T Owner::*> {
+    using type = T;
+};
+
+template <typename Row>
+struct Reader {
+    template <std::size_t... I>
+    static Row read(sqlite3_stmt* stmt, std::index_sequence<I...>) {
+        constexpr auto columns = Mapping<Row>::columns;
+        Row row{};
+        ((row.*std::get<I>(columns) =
+              Column<typename MemberType<std::decay_t<decltype(std::get<I>(columns))>>::type>::read(stmt, (int)I)), ...);
+        return row;
+    }
+
+    static Row read(sqlite3_stmt* stmt) {
+        return read(stmt, std::make_index_sequence<std::tuple_size<std::decay_t<decltype(Mapping<Row>::columns)>>::value>());
+    }
+};
+
+template <typename... Ts>
+struct Reader<std::tuple<Ts...>> {
+    template <std::size_t... I>
+    static std::tuple<Ts...> read(sqlite3_stmt* stmt, std::index_sequence<I...>) {
+        return std::tuple<Ts...>(Column<Ts>::read(stmt, (int)I)...);
+    }
+
+    static std::tuple<Ts...> read(sqlite3_stmt* stmt) {
+        return read(stmt, std::index_sequence_for<Ts...>());
+    }
+};
+
+// A prepared statement with room for the parameters it has bound. The buffers are
+// declared first so they outlive the statement that points into them.
+template <typename... Params>
+class Statement {
+public:
+    Statement(sqlite3* db, const char* sql) {
+        if (db && sqlite3_prepare_v2(db, sql, -1, &m_stmt, nullptr) != SQLITE_OK) {
+            qWarning() << "Failed to prepare" << sql << ":" << sqlite3_errmsg(db);
+            sqlite3_finalize(m_stmt);
+            m_stmt = nullptr;
+        }
+    }
+    ~Statement() { sqlite3_finalize(m_stmt); }
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+
+    sqlite3_stmt* get() const { return m_stmt; }
+
+    bool bind(const Params&... params) {
+        if (!m_stmt) return false;
+        sqlite3_reset(m_stmt);
+        return bindAll(std::index_sequence_for<Params...>(), params...);
+    }
+
+private:
+    template <std::size_t... I>
+    bool bindAll(std::index_sequence<I...>, const Params&... params) {
+        return ((Param<Params>::bind(m_stmt, (int)I + 1, params, m_storage[I]) == SQLITE_OK) && ... && true);
+    }
+
+    std::array<QByteArray, sizeof...(Params)> m_storage;
+    sqlite3_stmt* m_stmt = nullptr;
+};
+
+}
+
+template <typename Row>
+Row read(sqlite3_stmt* stmt) {
+    return detail::Reader<Row>::read(stmt);
+}
+
+template <typename Row, typename... Params>
+class Query;
+
+// Keeps a query prepared for running it many times, e.g. once per id
+template <typename Row, typename... Params>
+class Prepared {
+public:
+    Prepared(sqlite3* db, const Query<Row, Params...>& query) : m_statement(db, query.sql()) {}
+
+    bool isValid() const { return m_statement.get() != nullptr; }
+
+    // Adds the rows for one set of parameters to rows
+    bool appendAll(QList<Row>* rows, const Params&... params) {
+        if (!m_statement.bind(params...)) return false;
+        int rc;
+        while ((rc = sqlite3_step(m_statement.get())) == SQLITE_ROW) {
+            rows->append(read<Row>(m_statement.get()));
+        }
+        return rc == SQLITE_DONE;
+    }
+
+    bool first(Row* row, const Params&... params) {
+        if (!m_statement.bind(params...) || sqlite3_step(m_statement.get()) != SQLITE_ROW) return false;
+        *row = read<Row>(m_statement.get());
+        return true;
+    }
+
+private:
+    detail::Statement<Params...> m_statement;
+};
+
+template <typename Row, typename... Params>
+class Query {
+public:
+    constexpr explicit Query(const char* sql) : m_sql(sql) {}
+
+    constexpr const char* sql() const { return m_sql; }
+
+    QList<Row> all(sqlite3* db, const Params&... params) const {
+        QList<Row> rows;
+        Prepared<Row, Params...> prepared(db, *this);
+        prepared.appendAll(&rows, params...);
+        return rows;
+    }
+
+    // False when there is no row, or on error
+    bool first(sqlite3* db, Row* row, const Params&... params) const {
+        Prepared<Row, Params...> prepared(db, *this);
+        return prepared.first(row, params...);
+    }
+
+private:
+    const char* m_sql;
+};
+
+// A statement that returns no rows
+template <typename... Params>
+class Command {
+public:
+    constexpr explicit Command(const char* sql) : m_sql(sql) {}
+
+    constexpr const char* sql() const { return m_sql; }
+
+    bool exec(sqlite3* db, const Params&... params) const {
+        detail::Statement<Params...> statement(db, m_sql);
+        return statement.bind(params...) && sqlite3_step(statement.get()) == SQLITE_DONE;
+    }
+
+private:
+    const char* m_sql;
+};
+
+}
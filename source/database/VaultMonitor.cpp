@@ -0,0 +1,153 @@
+#include "VaultMonitor.h"
+
+#include <QDateTime>
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <utility>
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+namespace {
+
+bool sameGroups(const QList<DatabaseManager::Group>& a, const QList<DatabaseManager::Group>& b) {
+    if (a.size() != b.size()) return false;
+    for (int i = 0; i < a.size(); ++i) {
+        if (a.at(i).id != b.at(i).id || a.at(i).name != b.at(i).name || a.at(i).parentId != b.at(i).parentId) {
+            return false;
+        }
+    }
+    return true;
+}
+
+}
+
+VaultMonitor::VaultMonitor(DatabaseManager& database, QObject* parent)
+    : QObject(parent), m_database(database) {
+    m_watcher = new QFileSystemWatcher(this);
+
+    // Sync tools write in bursts; look once things have settled
+    m_settleTimer = new QTimer(this);
+    m_settleTimer->setSingleShot(true);
+    m_settleTimer->setInterval(SettleDelayMs);
+    connect(m_settleTimer, &QTimer::timeout, this, &VaultMonitor::check);
+    connect(m_watcher, &QFileSystemWatcher::fileChanged, m_settleTimer, QOverload<>::of(&QTimer::start));
+    connect(m_watcher, &QFileSystemWatcher::directoryChanged, m_settleTimer, QOverload<>::of(&QTimer::start));
+
+    // Our own writes only move the watermark; anything another process slipped in before is reported first
+    connect(&m_database, &DatabaseManager::databaseModified, this, &VaultMonitor::check);
+    // A password change swaps the file itself; that is not an external change
+    connect(&m_database, &DatabaseManager::passwordChangeFinished, this, [this]() {
+        snapshot();
+        watch();
+    });
+
+    snapshot();
+    watch();
+}
+
+QByteArray VaultMonitor::fileIdentity(const QString& path) {
+#ifdef Q_OS_UNIX
+    struct stat info;
+    if (::stat(QFile::encodeName(path).constData(), &info) != 0) return QByteArray();
+    return QByteArray::number((qulonglong)info.st_dev) + ":" + QByteArray::number((qulonglong)info.st_ino);
+#else
+    // A replaced file is a new file, with its own creation time
+    QFileInfo info(path);
+    if (!info.exists()) return QByteArray();
+    return QByteArray::number(info.birthTime().toMSecsSinceEpoch());
+#endif
+}
+
+void VaultMonitor::watch() {
+    const QString path = m_database.path();
+    if (path.isEmpty()) return;
+
+    // Files replaced by rename drop out of the watch list, so add them back every time.
+    // Another process on this machine writes to the WAL rather than to the vault itself.
+    QStringList paths{path, QFileInfo(path).absolutePath()};
+    if (QFile::exists(path + "-wal")) {
+        paths.append(path + "-wal");
+    }
+    for (const QString& watched : paths) {
+        if (!m_watcher->files().contains(watched) && !m_watcher->directories().contains(watched)) {
+            m_watcher->addPath(watched);
+        }
+    }
+}
+
+void VaultMonitor::snapshot() {
+    m_identity = fileIdentity(m_database.path());
+    m_dataVersion = m_database.dataVersion();
+    m_lastModified = m_database.latestModification();
+    m_entryIds = m_database.getEntryIds();
+    m_groups = m_database.getAllGroups();
+}
+
+void VaultMonitor::check() {
+    if (!m_database.isOpen() || m_database.isChangingPassword()) return;
+
+    Changes changes;
+    QByteArray identity = fileIdentity(m_database.path());
+    if (identity.isEmpty()) {
+        // Mid-replace; the new file shows up with the next notification
+        watch();
+        return;
+    }
+
+    if (identity != m_identity) {
+        qInfo() << "Vault file was replaced on disk, reopening:" << m_database.path();
+        if (!m_database.reopen()) {
+            emit reopenFailed();
+            return;
+        }
+        changes.reopened = true;
+    } else if (m_database.dataVersion() == m_dataVersion) {
+        // Only our own writes since the last look. The id and group lists are left as they are:
+        // the next external change may list our rows again, which the view applies as a no-op.
+        m_lastModified = m_database.latestModification();
+        watch();
+        return;
+    }
+
+    const QSet<int> ids = m_database.getEntryIds();
+    for (int id : std::as_const(m_entryIds)) {
+        if (!ids.contains(id)) {
+            changes.removedEntryIds.append(id);
+        }
+    }
+
+    // Only rows touched since the newest change we had seen, plus rows that are new to us
+    changes.changedEntries = m_lastModified.isEmpty()
+        ? QList<DatabaseManager::Entry>()
+        : m_database.getEntriesModifiedSince(m_lastModified);
+    QSet<int> seen;
+    for (const DatabaseManager::Entry& entry : std::as_const(changes.changedEntries)) {
+        seen.insert(entry.id);
+    }
+    QList<int> added;
+    for (int id : ids) {
+        if (!m_entryIds.contains(id) && !seen.contains(id)) {
+            added.append(id);
+        }
+    }
+    changes.changedEntries.append(m_database.getEntriesByIds(added));
+
+    QList<DatabaseManager::Group> groups = m_database.getAllGroups();
+    changes.groupsChanged = !sameGroups(groups, m_groups);
+
+    // The lists just read are the new baseline
+    m_identity = identity;
+    m_dataVersion = m_database.dataVersion();
+    m_lastModified = m_database.latestModification();
+    m_entryIds = ids;
+    m_groups = groups;
+    watch();
+
+    if (changes.reopened || changes.groupsChanged || !changes.changedEntries.isEmpty() || !changes.removedEntryIds.isEmpty()) {
+        emit externalChange(changes);
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <QByteArray>
+#include <QList>
+#include <QObject>
+#include <QSet>
+#include <QString>
+#include <QTimer>
+
+#include "DatabaseManager.h"
+
+class QFileSystemWatcher;
+
+// Notices when a vault file is changed by another process or a sync tool and
+// works out what changed since it last looked, without reading the whole vault.
+class VaultMonitor : public QObject {
+    Q_OBJECT
+
+public:
+    static const int SettleDelayMs = 500;
+
+    // May repeat changes this process made since the last external one
+    struct Changes {
+        QList<DatabaseManager::Entry> changedEntries;  // added or modified
+        QList<int> removedEntryIds;
+        bool groupsChanged = false;
+        bool reopened = false;  // the file was replaced and opened again
+    };
+
+    explicit VaultMonitor(DatabaseManager& database, QObject* parent = nullptr);
+
+signals:
+    void externalChange(const VaultMonitor::Changes& changes);
+    // The replaced file could not be opened with the current key
+    void reopenFailed();
+
+private:
+    static QByteArray fileIdentity(const QString& path);
+    void watch();
+    void check();
+    void snapshot();
+
+    DatabaseManager& m_database;
+    QFileSystemWatcher* m_watcher = nullptr;
+    QTimer* m_settleTimer = nullptr;
+
+    QByteArray m_identity;
+    int m_dataVersion = -1;
+    QString m_lastModified;
+    QSet<int> m_entryIds;
+    QList<DatabaseManager::Group> m_groups;
+};
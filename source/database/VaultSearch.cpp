@@ -0,0 +1,103 @@
+#include "VaultSearch.h"
+#include "SearchQuery.h"
+
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QPair>
+#include <QSharedPointer>
+#include <QtConcurrent>
+#include <algorithm>
+
+VaultSearch::VaultSearch(QObject* parent)
+    : QObject(parent) {
+}
+
+void VaultSearch::cancel() {
+    ++m_generation;
+}
+
+int VaultSearch::score(const DatabaseManager::Entry& entry, const QString& query) {
+    if (entry.title.compare(query, Qt::CaseInsensitive) == 0) return 100;
+    if (entry.title.startsWith(query, Qt::CaseInsensitive)) return 80;
+    if (entry.title.contains(query, Qt::CaseInsensitive)) return 60;
+    if (entry.username.contains(query, Qt::CaseInsensitive)) return 40;
+    if (entry.url.contains(query, Qt::CaseInsensitive)) return 30;
+    return 10;
+}
+
+bool VaultSearch::ranksBefore(const Hit& a, const Hit& b) {
+    if (a.score != b.score) return a.score > b.score;
+    return a.entry.title.compare(b.entry.title, Qt::CaseInsensitive) < 0;
+}
+
+QList<VaultSearch::Hit> VaultSearch::searchVault(QSharedPointer<ReaderPool> readers, const QString& path, const QString& query) {
+    QList<Hit> hits;
+
+    // The main connection belongs to the GUI thread, and would wait for any writes
+    QString error;
+    ReaderPool::Lease lease = readers->acquire(&error);
+    if (!lease.isValid()) {
+        qWarning() << "Search could not read" << path << ":" << error;
+        return hits;
+    }
+
+    const QList<DatabaseManager::Entry> entries = DatabaseManager::searchEntries(lease.db(), query);
+    lease.release();
+
+    // Field filters only narrow the results; the bare words decide the ranking
+    const QString text = SearchQuery::compile(query)->text;
+    hits.reserve(entries.size());
+    for (const DatabaseManager::Entry& entry : entries) {
+        hits.append({path, entry, score(entry, text)});
+    }
+    std::stable_sort(hits.begin(), hits.end(), &VaultSearch::ranksBefore);
+    if (hits.size() > MaxHits) {
+        hits.erase(hits.begin() + MaxHits, hits.end());
+    }
+    return hits;
+}
+
+QList<VaultSearch::Hit> VaultSearch::merge(const QList<QList<Hit>>& rankings) {
+    // Each ranking is already sorted, so pairwise merging keeps the overall order
+    QList<Hit> merged;
+    for (const QList<Hit>& ranking : rankings) {
+        QList<Hit> next;
+        next.reserve(merged.size() + ranking.size());
+        std::merge(merged.begin(), merged.end(), ranking.begin(), ranking.end(),
+                   std::back_inserter(next), &VaultSearch::ranksBefore);
+        merged = next;
+        if (merged.size() > MaxHits) {
+            merged.erase(merged.begin() + MaxHits, merged.end());
+        }
+    }
+    return merged;
+}
+
+void VaultSearch::start(const QList<DatabaseManager*>& vaults, const QString& query) {
+    const int generation = ++m_generation;
+
+    QList<QPair<QString, QSharedPointer<ReaderPool>>> sources;
+    for (DatabaseManager* vault : vaults) {
+        if (vault && vault->readerPool()) {
+            sources.append({vault->path(), vault->readerPool()});
+        }
+    }
+    if (sources.isEmpty() || query.isEmpty()) {
+        emit finished(query, {});
+        return;
+    }
+
+    // Fan out one task per vault and merge once the last one reports back
+    auto rankings = QSharedPointer<QList<QList<Hit>>>::create();
+    auto remaining = QSharedPointer<int>::create(sources.size());
+    for (const auto& source : sources) {
+        auto* watcher = new QFutureWatcher<QList<Hit>>(this);
+        connect(watcher, &QFutureWatcher<QList<Hit>>::finished, this, [this, watcher, rankings, remaining, generation, query]() {
+            rankings->append(watcher->result());
+            watcher->deleteLater();
+            if (--*remaining > 0 || generation != m_generation) return;
+            emit finished(query, merge(*rankings));
+        });
+        watcher->setFuture(QtConcurrent::run(&VaultSearch::searchVault, source.second, source.first, query));
+    }
+}
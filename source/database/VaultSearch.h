@@ -0,0 +1,43 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QSharedPointer>
+#include <QString>
+
+#include "DatabaseManager.h"
+#include "ReaderPool.h"
+
+// Searches every open vault at once, each on a pooled reader and a pool thread,
+// and merges the per-vault rankings into one list.
+class VaultSearch : public QObject {
+    Q_OBJECT
+
+public:
+    static const int MaxHits = 200;
+
+    struct Hit {
+        QString vaultPath;
+        DatabaseManager::Entry entry;
+        int score = 0;
+    };
+
+    explicit VaultSearch(QObject* parent = nullptr);
+
+    // Supersedes any search still running; its results are dropped
+    void start(const QList<DatabaseManager*>& vaults, const QString& query);
+    void cancel();
+
+    static int score(const DatabaseManager::Entry& entry, const QString& query);
+    // Best first; ties keep title order so the merge is stable
+    static bool ranksBefore(const Hit& a, const Hit& b);
+
+signals:
+    void finished(const QString& query, const QList<VaultSearch::Hit>& hits);
+
+private:
+    static QList<Hit> searchVault(QSharedPointer<ReaderPool> readers, const QString& path, const QString& query);
+    static QList<Hit> merge(const QList<QList<Hit>>& rankings);
+
+    int m_generation = 0;
+};
@@ -0,0 +1,115 @@
+#include "AttachmentsDialog.h"
+#include "ui_AttachmentsDialog.h"
+#include <QFile>
+#include <QFileDialog>
+#include <QFileInfo>
+#include <QLocale>
+#include <QMessageBox>
+
+AttachmentsDialog::AttachmentsDialog(DatabaseManager& database, int entryId, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::AttachmentsDialog),
+    m_database(database),
+    m_entryId(entryId)
+{
+    ui->setupUi(this);
+
+    connect(ui->addButton, &QPushButton::clicked, this, &AttachmentsDialog::onAddClicked);
+    connect(ui->saveButton, &QPushButton::clicked, this, &AttachmentsDialog::onSaveClicked);
+    connect(ui->removeButton, &QPushButton::clicked, this, &AttachmentsDialog::onRemoveClicked);
+    connect(ui->attachmentsList, &QListWidget::currentRowChanged, this, &AttachmentsDialog::updateButtons);
+    connect(ui->attachmentsList, &QListWidget::itemDoubleClicked, this, &AttachmentsDialog::onSaveClicked);
+
+    reload();
+}
+
+AttachmentsDialog::~AttachmentsDialog()
+{
+    delete ui;
+}
+
+void AttachmentsDialog::reload()
+{
+    ui->attachmentsList->clear();
+    m_attachments = m_database.getAttachments(m_entryId);
+    for (const auto& attachment : m_attachments) {
+        ui->attachmentsList->addItem(tr("%1 (%2)").arg(attachment.name, QLocale().formattedDataSize(attachment.size)));
+    }
+    if (!m_attachments.isEmpty()) {
+        ui->attachmentsList->setCurrentRow(0);
+    }
+    updateButtons();
+}
+
+void AttachmentsDialog::updateButtons()
+{
+    int row = ui->attachmentsList->currentRow();
+    bool selected = row >= 0 && row < m_attachments.size();
+    ui->saveButton->setEnabled(selected);
+    ui->removeButton->setEnabled(selected);
+}
+
+void AttachmentsDialog::onAddClicked()
+{
+    QString path = QFileDialog::getOpenFileName(this, tr("Attach File"));
+    if (path.isEmpty()) return;
+
+    const QString name = QFileInfo(path).fileName();
+    for (const auto& attachment : m_attachments) {
+        if (attachment.name == name
+            && QMessageBox::question(this, tr("Attach File"),
+                                     tr("Replace the existing attachment \"%1\"?").arg(name)) != QMessageBox::Yes) {
+            return;
+        }
+    }
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to open %1.").arg(path));
+        return;
+    }
+
+    if (m_database.addAttachment(m_entryId, name, &file) < 0) {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to attach %1.").arg(name));
+    }
+    reload();
+}
+
+void AttachmentsDialog::onSaveClicked()
+{
+    int row = ui->attachmentsList->currentRow();
+    if (row < 0 || row >= m_attachments.size()) return;
+
+    const DatabaseManager::Attachment& attachment = m_attachments.at(row);
+    QString path = QFileDialog::getSaveFileName(this, tr("Save Attachment"), attachment.name);
+    if (path.isEmpty()) return;
+
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to open %1 for writing.").arg(path));
+        return;
+    }
+
+    if (!m_database.saveAttachment(attachment.id, &file)) {
+        // Leave no half-written copy behind
+        file.remove();
+        QMessageBox::critical(this, tr("Error"), tr("Failed to save %1.").arg(attachment.name));
+    }
+}
+
+void AttachmentsDialog::onRemoveClicked()
+{
+    int row = ui->attachmentsList->currentRow();
+    if (row < 0 || row >= m_attachments.size()) return;
+
+    const DatabaseManager::Attachment attachment = m_attachments.at(row);
+    if (QMessageBox::question(this, tr("Remove Attachment"),
+                              tr("Remove \"%1\" from this entry?").arg(attachment.name)) != QMessageBox::Yes) {
+        return;
+    }
+
+    if (!m_database.removeAttachment(attachment.id)) {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to remove %1.").arg(attachment.name));
+    }
+    reload();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <QDialog>
+#include "../database/DatabaseManager.h"
+
+namespace Ui {
+class AttachmentsDialog;
+}
+
+// Adds, saves and removes the files attached to one entry.
+// Contents are streamed between the file and the vault, never loaded whole.
+class AttachmentsDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    AttachmentsDialog(DatabaseManager& database, int entryId, QWidget *parent = nullptr);
+    ~AttachmentsDialog();
+
+private slots:
+    void onAddClicked();
+    void onSaveClicked();
+    void onRemoveClicked();
+    void updateButtons();
+
+private:
+    void reload();
+
+    Ui::AttachmentsDialog *ui;
+    DatabaseManager& m_database;
+    int m_entryId;
+    QList<DatabaseManager::Attachment> m_attachments;
+};
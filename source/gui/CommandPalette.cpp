@@ -0,0 +1,70 @@
+#include "CommandPalette.h"
+#include "ui_CommandPalette.h"
+#include <QDateTime>
+#include <QKeyEvent>
+
+CommandPalette::CommandPalette(const FrecencyIndex& index, QWidget *parent) :
+    QDialog(parent, Qt::Popup),
+    ui(new Ui::CommandPalette),
+    m_index(index)
+{
+    ui->setupUi(this);
+
+    connect(ui->queryEdit, &QLineEdit::textChanged, this, &CommandPalette::onQueryChanged);
+    connect(ui->queryEdit, &QLineEdit::returnPressed, this, &CommandPalette::onActivated);
+    connect(ui->resultsList, &QListWidget::itemActivated, this, &CommandPalette::onActivated);
+    ui->queryEdit->installEventFilter(this);
+
+    onQueryChanged(QString());
+}
+
+CommandPalette::~CommandPalette()
+{
+    delete ui;
+}
+
+int CommandPalette::selectedEntryId() const
+{
+    return m_selectedEntryId;
+}
+
+bool CommandPalette::eventFilter(QObject* watched, QEvent* event)
+{
+    // The arrow keys move through the results while typing goes on in the query
+    if (watched == ui->queryEdit && event->type() == QEvent::KeyPress) {
+        auto* keyEvent = static_cast<QKeyEvent*>(event);
+        int row = ui->resultsList->currentRow();
+        if (keyEvent->key() == Qt::Key_Down && row + 1 < ui->resultsList->count()) {
+            ui->resultsList->setCurrentRow(row + 1);
+            return true;
+        }
+        if (keyEvent->key() == Qt::Key_Up && row > 0) {
+            ui->resultsList->setCurrentRow(row - 1);
+            return true;
+        }
+    }
+    return QDialog::eventFilter(watched, event);
+}
+
+void CommandPalette::onQueryChanged(const QString& query)
+{
+    m_results = m_index.rank(query, MaxResults, QDateTime::currentSecsSinceEpoch());
+
+    ui->resultsList->clear();
+    for (const auto& item : m_results) {
+        ui->resultsList->addItem(item.username.isEmpty() ? item.title
+                                                         : tr("%1 - %2").arg(item.title, item.username));
+    }
+    if (!m_results.isEmpty()) {
+        ui->resultsList->setCurrentRow(0);
+    }
+}
+
+void CommandPalette::onActivated()
+{
+    int row = ui->resultsList->currentRow();
+    if (row < 0 || row >= m_results.size()) return;
+
+    m_selectedEntryId = m_results.at(row).id;
+    accept();
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <QDialog>
+#include "../utils/FrecencyIndex.h"
+
+namespace Ui {
+class CommandPalette;
+}
+
+// Quick access to entries by title: results are re-ranked on every keystroke
+// from an in-memory index. Accepted with the chosen entry in selectedEntryId().
+class CommandPalette : public QDialog {
+    Q_OBJECT
+
+public:
+    static const int MaxResults = 30;
+
+    CommandPalette(const FrecencyIndex& index, QWidget *parent = nullptr);
+    ~CommandPalette();
+
+    int selectedEntryId() const;
+
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
+private slots:
+    void onQueryChanged(const QString& query);
+    void onActivated();
+
+private:
+    Ui::CommandPalette *ui;
+    const FrecencyIndex& m_index;
+    QList<FrecencyIndex::Item> m_results;
+    int m_selectedEntryId = -1;
+};
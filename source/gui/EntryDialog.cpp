@@ -1,6 +1,8 @@
 #include "EntryDialog.h"
 #include "ui_EntryDialog.h"
 #include "PasswordGeneratorDialog.h"
+#include "../utils/Totp.h"
+#include <QCompleter>
 #include <QPushButton>
 
 EntryDialog::EntryDialog(QWidget *parent) :
@@ -11,6 +13,7 @@ EntryDialog::EntryDialog(QWidget *parent) :
 
     connect(ui->showPasswordCheck, &QCheckBox::toggled, this, &EntryDialog::onShowPasswordToggled);
     connect(ui->titleEdit, &QLineEdit::textChanged, this, &EntryDialog::validateInput);
+    connect(ui->otpEdit, &QLineEdit::textChanged, this, &EntryDialog::validateInput);
     connect(ui->generatePasswordButton, &QToolButton::clicked, this, &EntryDialog::onGeneratePasswordClicked);
 
     validateInput();
@@ -30,6 +33,7 @@ void EntryDialog::setEntry(const DatabaseManager::Entry& entry)
     ui->passwordEdit->setText(entry.password);
     ui->urlEdit->setText(entry.url);
     ui->notesEdit->setPlainText(entry.notes);
+    ui->otpEdit->setText(entry.otp);
 }
 
 DatabaseManager::Entry EntryDialog::getEntry() const
@@ -42,9 +46,35 @@ DatabaseManager::Entry EntryDialog::getEntry() const
     entry.password = ui->passwordEdit->text();
     entry.url = ui->urlEdit->text();
     entry.notes = ui->notesEdit->toPlainText();
+
+    // Bare secrets are stored as a URI so every entry keeps its OTP settings the same way
+    QString otp = ui->otpEdit->text().trimmed();
+    if (!otp.isEmpty() && !otp.startsWith("otpauth://", Qt::CaseInsensitive)) {
+        otp = Totp::toUri(Totp::parse(otp), entry.title);
+    }
+    entry.otp = otp;
     return entry;
 }
 
+void EntryDialog::setTags(const QStringList& tags, const QStringList& knownTags)
+{
+    ui->tagsEdit->setText(tags.join(", "));
+    QCompleter* completer = new QCompleter(knownTags, ui->tagsEdit);
+    completer->setCaseSensitivity(Qt::CaseInsensitive);
+    ui->tagsEdit->setCompleter(completer);
+}
+
+QStringList EntryDialog::getTags() const
+{
+    QStringList tags;
+    for (const QString& tag : ui->tagsEdit->text().split(',', Qt::SkipEmptyParts)) {
+        if (!tag.trimmed().isEmpty()) {
+            tags.append(tag.trimmed());
+        }
+    }
+    return tags;
+}
+
 void EntryDialog::onShowPasswordToggled(bool checked)
 {
     ui->passwordEdit->setEchoMode(checked ? QLineEdit::Normal : QLineEdit::Password);
@@ -60,6 +90,8 @@ void EntryDialog::onGeneratePasswordClicked()
 
 void EntryDialog::validateInput()
 {
-    bool isValid = !ui->titleEdit->text().trimmed().isEmpty();
+    QString otp = ui->otpEdit->text().trimmed();
+    bool isValid = !ui->titleEdit->text().trimmed().isEmpty()
+        && (otp.isEmpty() || Totp::parse(otp).isValid());
     ui->buttonBox->button(QDialogButtonBox::Ok)->setEnabled(isValid);
 }
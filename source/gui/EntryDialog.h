@@ -16,6 +16,9 @@ public:
 
     void setEntry(const DatabaseManager::Entry& entry);
     DatabaseManager::Entry getEntry() const;
+    // Tags are saved apart from the entry; knownTags feeds the completer
+    void setTags(const QStringList& tags, const QStringList& knownTags);
+    QStringList getTags() const;
 
 private slots:
     void onShowPasswordToggled(bool checked);
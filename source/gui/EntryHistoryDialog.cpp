@@ -0,0 +1,66 @@
+#include "EntryHistoryDialog.h"
+#include "ui_EntryHistoryDialog.h"
+#include <QMessageBox>
+#include <QPushButton>
+
+EntryHistoryDialog::EntryHistoryDialog(DatabaseManager& database, int entryId, QWidget *parent) :
+    QDialog(parent),
+    ui(new Ui::EntryHistoryDialog),
+    m_database(database),
+    m_entryId(entryId)
+{
+    ui->setupUi(this);
+
+    m_restoreButton = ui->buttonBox->addButton(tr("Restore This Version"), QDialogButtonBox::ActionRole);
+    connect(m_restoreButton, &QPushButton::clicked, this, &EntryHistoryDialog::onRestoreClicked);
+    connect(ui->versionsList, &QListWidget::currentRowChanged, this, &EntryHistoryDialog::onVersionSelected);
+    connect(ui->showPasswordCheck, &QCheckBox::toggled, this, [this](bool checked) {
+        ui->passwordEdit->setEchoMode(checked ? QLineEdit::Normal : QLineEdit::Password);
+    });
+
+    // Only the list comes from the index; a version is rebuilt when it is selected
+    m_versions = m_database.getEntryHistory(m_entryId);
+    for (const auto& version : m_versions) {
+        ui->versionsList->addItem(tr("Version %1 - %2").arg(version.version).arg(version.changedAt));
+    }
+
+    m_restoreButton->setEnabled(false);
+    if (m_versions.isEmpty()) {
+        ui->versionsList->addItem(tr("No earlier versions"));
+        ui->versionsList->setEnabled(false);
+    } else {
+        ui->versionsList->setCurrentRow(0);
+    }
+}
+
+EntryHistoryDialog::~EntryHistoryDialog()
+{
+    delete ui;
+}
+
+void EntryHistoryDialog::onVersionSelected(int row)
+{
+    DatabaseManager::Entry entry;
+    bool loaded = row >= 0 && row < m_versions.size()
+        && m_database.getEntryVersion(m_entryId, m_versions.at(row).version, &entry);
+    m_restoreButton->setEnabled(loaded);
+    if (!loaded) return;
+
+    ui->titleEdit->setText(entry.title);
+    ui->usernameEdit->setText(entry.username);
+    ui->passwordEdit->setText(entry.password);
+    ui->urlEdit->setText(entry.url);
+    ui->notesEdit->setPlainText(entry.notes);
+}
+
+void EntryHistoryDialog::onRestoreClicked()
+{
+    int row = ui->versionsList->currentRow();
+    if (row < 0 || row >= m_versions.size()) return;
+
+    if (m_database.restoreEntryVersion(m_entryId, m_versions.at(row).version)) {
+        accept();
+    } else {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to restore this version."));
+    }
+}
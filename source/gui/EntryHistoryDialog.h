@@ -0,0 +1,31 @@
+#pragma once
+
+#include <QDialog>
+#include "../database/DatabaseManager.h"
+
+class QPushButton;
+
+namespace Ui {
+class EntryHistoryDialog;
+}
+
+// Lists the past versions of one entry and restores the selected one.
+// Accepted only when a version was restored.
+class EntryHistoryDialog : public QDialog {
+    Q_OBJECT
+
+public:
+    EntryHistoryDialog(DatabaseManager& database, int entryId, QWidget *parent = nullptr);
+    ~EntryHistoryDialog();
+
+private slots:
+    void onVersionSelected(int row);
+    void onRestoreClicked();
+
+private:
+    Ui::EntryHistoryDialog *ui;
+    DatabaseManager& m_database;
+    int m_entryId;
+    QList<DatabaseManager::HistoryVersion> m_versions;
+    QPushButton* m_restoreButton = nullptr;
+};
@@ -6,17 +6,30 @@
 #include "../database/DatabaseManager.h"
 #include "../database/CreateDatabaseDialog.h"
 #include "../database/OpenDatabaseDialog.h"
+#include "../autofill/AutofillServer.h"
+#ifdef KEEBOX_SECRET_SERVICE
+#include "../secretservice/SecretServiceProvider.h"
+#endif
+#include "../utils/Trace.h"
 
+#include <QFileInfo>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QMenu>
 #include <QMessageBox>
+#include <QPointer>
+#include <QToolButton>
+#include <QVBoxLayout>
 
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent), ui(new Ui::MainWindow) {
+    Trace::Span span("MainWindow::MainWindow");
     ui->setupUi(this);
 
     // Use the existing stacked widget from UI
     m_stackedWidget = ui->stackedWidget;
-    
+
     // Clean up any existing pages (just in case, though usually empty or has placeholders)
     while (m_stackedWidget->count() > 0) {
         QWidget* w = m_stackedWidget->widget(0);
@@ -26,12 +39,28 @@ MainWindow::MainWindow(QWidget *parent)
 
     // Create Page 1: Welcome
     WelcomeWidget* welcomePage = new WelcomeWidget(this);
+    m_welcomePage = welcomePage;
     m_stackedWidget->addWidget(welcomePage);
 
+    // Create Page 2: open vaults, one tab each
+    m_vaultPage = createVaultPage();
+    m_stackedWidget->addWidget(m_vaultPage);
+
     // Connect signals
     connect(welcomePage, &WelcomeWidget::createDatabaseRequested, this, &MainWindow::onCreateDatabaseRequested);
     connect(welcomePage, &WelcomeWidget::openDatabaseRequested, this, &MainWindow::onOpenDatabaseRequested);
 
+    // Browser extensions look logins up in whichever vaults are unlocked
+    m_autofillServer = new AutofillServer(this);
+    connect(m_autofillServer, &AutofillServer::associationRequested, this, &MainWindow::onAutofillAssociationRequested);
+    m_autofillServer->listen();
+
+#ifdef KEEBOX_SECRET_SERVICE
+    // Desktop apps (libsecret, secret-tool) read the vaults' "Secret Service" groups
+    m_secretService = new SecretServiceProvider(this);
+    m_secretService->registerOnSessionBus();
+#endif
+
     // Initial state
     m_stackedWidget->setCurrentWidget(welcomePage);
 }
@@ -40,24 +69,163 @@ MainWindow::~MainWindow() {
     delete ui;
 }
 
+QWidget* MainWindow::createVaultPage() {
+    QWidget* page = new QWidget(this);
+    QVBoxLayout* layout = new QVBoxLayout(page);
+    layout->setContentsMargins(0, 0, 0, 0);
+
+    // Search across every open vault
+    QHBoxLayout* searchLayout = new QHBoxLayout();
+    m_globalSearchEdit = new QLineEdit(page);
+    m_globalSearchEdit->setPlaceholderText(tr("Search all open vaults..."));
+    m_globalSearchEdit->setClearButtonEnabled(true);
+    searchLayout->addWidget(m_globalSearchEdit);
+
+    QToolButton* addVaultButton = new QToolButton(page);
+    addVaultButton->setText(tr("Add Vault"));
+    addVaultButton->setPopupMode(QToolButton::InstantPopup);
+    QMenu* addVaultMenu = new QMenu(addVaultButton);
+    addVaultMenu->addAction(tr("Open Database..."), this, &MainWindow::onOpenDatabaseRequested);
+    addVaultMenu->addAction(tr("New Database..."), this, &MainWindow::onCreateDatabaseRequested);
+    addVaultButton->setMenu(addVaultMenu);
+    searchLayout->addWidget(addVaultButton);
+    layout->addLayout(searchLayout);
+
+    m_searchResults = new QTreeWidget(page);
+    m_searchResults->setHeaderLabels({tr("Title"), tr("Username"), tr("URL"), tr("Vault")});
+    m_searchResults->setRootIsDecorated(false);
+    m_searchResults->header()->setSectionResizeMode(0, QHeaderView::Stretch);
+    m_searchResults->setMaximumHeight(220);
+    m_searchResults->hide();
+    layout->addWidget(m_searchResults);
+
+    m_vaultTabs = new QTabWidget(page);
+    m_vaultTabs->setTabsClosable(true);
+    m_vaultTabs->setMovable(true);
+    m_vaultTabs->setDocumentMode(true);
+    layout->addWidget(m_vaultTabs);
+
+    // Closing a tab locks that vault
+    connect(m_vaultTabs, &QTabWidget::tabCloseRequested, this, [this](int index) {
+        if (VaultWidget* vault = vaultAt(index)) {
+            vault->onLockDatabase();
+        }
+    });
+
+    // Debounced so fast typing does not start a search per keystroke
+    m_searchTimer = new QTimer(this);
+    m_searchTimer->setSingleShot(true);
+    m_searchTimer->setInterval(150);
+    connect(m_globalSearchEdit, &QLineEdit::textChanged, m_searchTimer, QOverload<>::of(&QTimer::start));
+    connect(m_searchTimer, &QTimer::timeout, this, &MainWindow::onGlobalSearchChanged);
+
+    m_vaultSearch = new VaultSearch(this);
+    connect(m_vaultSearch, &VaultSearch::finished, this, &MainWindow::onGlobalSearchFinished);
+    connect(m_searchResults, &QTreeWidget::itemActivated, this, &MainWindow::onSearchResultActivated);
+
+    return page;
+}
+
+VaultWidget* MainWindow::vaultAt(int index) const {
+    return qobject_cast<VaultWidget*>(m_vaultTabs->widget(index));
+}
+
+int MainWindow::indexOfVault(const QString& path) const {
+    const QString absolutePath = QFileInfo(path).absoluteFilePath();
+    for (int i = 0; i < m_vaultTabs->count(); ++i) {
+        VaultWidget* vault = vaultAt(i);
+        if (vault && QFileInfo(vault->database()->path()).absoluteFilePath() == absolutePath) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void MainWindow::addVault(DatabaseManager* database) {
+    const qint64 vaultBegin = Trace::now();
+    VaultWidget* vaultPage = new VaultWidget(database, m_vaultTabs);
+    connect(vaultPage, &VaultWidget::lockRequested, this, [this, vaultPage]() {
+        removeVault(vaultPage);
+    });
+
+    QFileInfo info(database->path());
+    auto state = m_viewStates.constFind(info.absoluteFilePath());
+    if (state != m_viewStates.constEnd()) {
+        vaultPage->restoreViewState(*state);
+        m_viewStates.erase(state);
+    }
+    int index = m_vaultTabs->addTab(vaultPage, info.completeBaseName());
+    m_vaultTabs->setTabToolTip(index, info.absoluteFilePath());
+    m_autofillServer->addVault(database);
+#ifdef KEEBOX_SECRET_SERVICE
+    m_secretService->addVault(database);
+#endif
+    m_vaultTabs->setCurrentIndex(index);
+    m_stackedWidget->setCurrentWidget(m_vaultPage);
+    Trace::complete("VaultWidget", vaultBegin);
+    Trace::flush();
+}
+
+void MainWindow::removeVault(VaultWidget* vault) {
+    // Only the view is kept; everything read from the vault goes with the widget
+    m_viewStates.insert(QFileInfo(vault->database()->path()).absoluteFilePath(), vault->viewState());
+
+    int index = m_vaultTabs->indexOf(vault);
+    if (index >= 0) {
+        m_vaultTabs->removeTab(index);
+    }
+    vault->deleteLater();
+
+    // Results from a locked vault must not stay on screen
+    m_vaultSearch->cancel();
+    m_globalSearchEdit->clear();
+    m_searchResults->clear();
+    m_searchResults->hide();
+
+    if (m_vaultTabs->count() == 0) {
+        m_stackedWidget->setCurrentWidget(m_welcomePage); // Switch to Welcome
+    }
+}
+
+void MainWindow::onAutofillAssociationRequested(quint64 request, const QString& clientId) {
+    // The client gets access to the vault in front, and only that one
+    QPointer<VaultWidget> vault = m_vaultTabs->count() > 0 ? vaultAt(m_vaultTabs->currentIndex()) : nullptr;
+    if (!vault) {
+        m_autofillServer->completeAssociation(request, nullptr);
+        return;
+    }
+
+    const QString vaultName = QFileInfo(vault->database()->path()).completeBaseName();
+    QMessageBox::StandardButton answer = QMessageBox::question(
+        this, tr("Browser Access"),
+        tr("\"%1\" wants to fill in logins from the vault \"%2\".\n\nAllow it?").arg(clientId, vaultName),
+        QMessageBox::Yes | QMessageBox::No, QMessageBox::No);
+    // The vault may have been locked while the question was up
+    m_autofillServer->completeAssociation(request, answer == QMessageBox::Yes && vault ? vault->database() : nullptr);
+}
+
 void MainWindow::onCreateDatabaseRequested() {
     CreateDatabaseDialog dialog(this);
     if (dialog.exec() == QDialog::Accepted) {
         QString path = dialog.getFilePath();
         QString password = dialog.getPassword();
 
+        if (indexOfVault(path) >= 0) {
+            QMessageBox::critical(this, "Error", "This database is open. Lock it before overwriting it.");
+            return;
+        }
+        m_viewStates.remove(QFileInfo(path).absoluteFilePath());
+
         // Strict Requirement: Apply SQLCipher key BEFORE tables created (handled by Manager)
-        if (DatabaseManager::instance().createDatabase(path, password)) {
+        DatabaseManager* database = new DatabaseManager(this);
+        const qint64 createBegin = Trace::now();
+        bool created = database->createDatabase(path, password);
+        Trace::complete("createDatabase", createBegin);
+        if (created) {
             // Success -> Go to Vault
-            VaultWidget* vaultPage = new VaultWidget(this);
-            connect(vaultPage, &VaultWidget::lockRequested, this, [this, vaultPage]() {
-                m_stackedWidget->setCurrentIndex(0); // Switch to Welcome
-                m_stackedWidget->removeWidget(vaultPage);
-                vaultPage->deleteLater();
-            });
-            m_stackedWidget->addWidget(vaultPage);
-            m_stackedWidget->setCurrentWidget(vaultPage);
+            addVault(database);
         } else {
+            delete database;
             QMessageBox::critical(this, "Error", "Failed to create database. check logs.");
         }
     }
@@ -65,24 +233,74 @@ void MainWindow::onCreateDatabaseRequested() {
 
 void MainWindow::onOpenDatabaseRequested() {
     OpenDatabaseDialog dialog(this);
+    QStringList openVaults;
+    for (int i = 0; i < m_vaultTabs->count(); ++i) {
+        if (VaultWidget* vault = vaultAt(i)) {
+            openVaults.append(vault->database()->path());
+        }
+    }
+    dialog.setOpenVaults(openVaults);
+
+    // The dialog stays up through the KDF and only closes on a successful unlock
     if (dialog.exec() == QDialog::Accepted) {
-        QString path = dialog.getFilePath();
-        QString password = dialog.getPassword();
+        DatabaseManager* database = dialog.takeDatabase();
+        if (!database) {
+            int existing = indexOfVault(dialog.getFilePath());
+            if (existing >= 0) {
+                m_vaultTabs->setCurrentIndex(existing);
+                m_stackedWidget->setCurrentWidget(m_vaultPage);
+            }
+            return;
+        }
 
-        // Attempt unlock
-        if (DatabaseManager::instance().openDatabase(path, password)) {
-            // Success -> Go to Vault
-            VaultWidget* vaultPage = new VaultWidget(this);
-            connect(vaultPage, &VaultWidget::lockRequested, this, [this, vaultPage]() {
-                m_stackedWidget->setCurrentIndex(0); // Switch to Welcome
-                m_stackedWidget->removeWidget(vaultPage);
-                vaultPage->deleteLater();
-            });
-            m_stackedWidget->addWidget(vaultPage);
-            m_stackedWidget->setCurrentWidget(vaultPage);
-        } else {
-            // Failure -> Stay on Welcome, Show Error
-            QMessageBox::critical(this, "Authentication Failed", "Invalid password or corrupted database.");
+        database->setParent(this);
+        addVault(database);
+    }
+}
+
+void MainWindow::onGlobalSearchChanged() {
+    const QString query = m_globalSearchEdit->text();
+    if (query.isEmpty()) {
+        m_vaultSearch->cancel();
+        m_searchResults->clear();
+        m_searchResults->hide();
+        return;
+    }
+
+    QList<DatabaseManager*> vaults;
+    for (int i = 0; i < m_vaultTabs->count(); ++i) {
+        if (VaultWidget* vault = vaultAt(i)) {
+            vaults.append(vault->database());
         }
     }
-}
\ No newline at end of file
+    m_vaultSearch->start(vaults, query);
+}
+
+void MainWindow::onGlobalSearchFinished(const QString& query, const QList<VaultSearch::Hit>& hits) {
+    if (query != m_globalSearchEdit->text()) return;
+
+    m_searchResults->clear();
+    for (const VaultSearch::Hit& hit : hits) {
+        QTreeWidgetItem* item = new QTreeWidgetItem(m_searchResults);
+        item->setText(0, hit.entry.title);
+        item->setText(1, hit.entry.username);
+        item->setText(2, hit.entry.url);
+        item->setText(3, QFileInfo(hit.vaultPath).completeBaseName());
+        item->setToolTip(3, hit.vaultPath);
+        item->setData(0, Qt::UserRole, hit.vaultPath);
+        item->setData(1, Qt::UserRole, hit.entry.groupId);
+        item->setData(2, Qt::UserRole, hit.entry.id);
+    }
+    m_searchResults->setVisible(!query.isEmpty());
+}
+
+void MainWindow::onSearchResultActivated(QTreeWidgetItem* item, int column) {
+    Q_UNUSED(column);
+    if (!item) return;
+
+    int index = indexOfVault(item->data(0, Qt::UserRole).toString());
+    if (index < 0) return;
+
+    m_vaultTabs->setCurrentIndex(index);
+    vaultAt(index)->showEntry(item->data(1, Qt::UserRole).toInt(), item->data(2, Qt::UserRole).toInt());
+}
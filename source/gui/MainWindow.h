@@ -1,7 +1,20 @@
 #pragma once
 
+#include <QHash>
 #include <QMainWindow>
 #include <QStackedWidget>
+#include <QTabWidget>
+#include <QLineEdit>
+#include <QTimer>
+#include <QTreeWidget>
+
+#include "../database/VaultSearch.h"
+#include "VaultViewState.h"
+
+class AutofillServer;
+class DatabaseManager;
+class SecretServiceProvider;
+class VaultWidget;
 
 QT_BEGIN_NAMESPACE
 namespace Ui {
@@ -19,8 +32,29 @@ public:
 private slots:
     void onCreateDatabaseRequested();
     void onOpenDatabaseRequested();
+    void onGlobalSearchChanged();
+    void onGlobalSearchFinished(const QString& query, const QList<VaultSearch::Hit>& hits);
+    void onSearchResultActivated(QTreeWidgetItem* item, int column);
+    void onAutofillAssociationRequested(quint64 request, const QString& clientId);
 
 private:
+    QWidget* createVaultPage();
+    void addVault(DatabaseManager* database);
+    void removeVault(VaultWidget* vault);
+    VaultWidget* vaultAt(int index) const;
+    int indexOfVault(const QString& path) const;
+
     Ui::MainWindow *ui;
     QStackedWidget *m_stackedWidget;
-};
\ No newline at end of file
+    QWidget *m_welcomePage = nullptr;
+    QWidget *m_vaultPage = nullptr;
+    QTabWidget *m_vaultTabs = nullptr;
+    QLineEdit *m_globalSearchEdit = nullptr;
+    QTreeWidget *m_searchResults = nullptr;
+    QTimer *m_searchTimer = nullptr;
+    VaultSearch *m_vaultSearch = nullptr;
+    AutofillServer *m_autofillServer = nullptr;
+    SecretServiceProvider *m_secretService = nullptr;
+    // Last view of each locked vault by absolute path, restored when it is unlocked again
+    QHash<QString, VaultViewState> m_viewStates;
+};
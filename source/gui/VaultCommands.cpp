@@ -0,0 +1,334 @@
+#include "VaultCommands.h"
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QDebug>
+#include "../utils/Totp.h"
+
+VaultCommand::VaultCommand(DatabaseManager& database, VaultView& view, const QString& text) :
+    m_database(database),
+    m_view(view),
+    m_lastEdit(QDateTime::currentMSecsSinceEpoch()) {
+    setText(text);
+}
+
+bool VaultCommand::withinBurst(const VaultCommand* other) const {
+    return other->m_lastEdit - m_lastEdit < CoalesceMs;
+}
+
+void VaultCommand::fail() {
+    qWarning() << "Could not apply" << text();
+    setObsolete(true);
+    m_view.commandFailed(text());
+}
+
+CreateEntriesCommand::CreateEntriesCommand(DatabaseManager& database, VaultView& view,
+                                           const QList<int>& ids, const QString& text) :
+    VaultCommand(database, view, text),
+    m_ids(ids) {
+}
+
+void CreateEntriesCommand::undo() {
+    if (!m_database.deleteEntries(m_ids)) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged(m_ids);
+}
+
+void CreateEntriesCommand::redo() {
+    if (m_done) {
+        m_done = false;
+        return;
+    }
+    if (!m_database.restoreEntries(m_ids)) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged(m_ids);
+}
+
+DeleteEntriesCommand::DeleteEntriesCommand(DatabaseManager& database, VaultView& view, const QList<int>& ids) :
+    VaultCommand(database, view, ids.size() == 1
+        ? QCoreApplication::translate("VaultCommand", "Delete Entry")
+        : QCoreApplication::translate("VaultCommand", "Delete %1 Entries").arg(ids.size())),
+    m_ids(ids) {
+}
+
+void DeleteEntriesCommand::undo() {
+    if (!m_database.restoreEntries(m_ids)) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged(m_ids);
+}
+
+void DeleteEntriesCommand::redo() {
+    if (!m_database.deleteEntries(m_ids)) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged(m_ids);
+}
+
+RestoreEntriesCommand::RestoreEntriesCommand(DatabaseManager& database, VaultView& view, const QList<int>& ids) :
+    VaultCommand(database, view, ids.size() == 1
+        ? QCoreApplication::translate("VaultCommand", "Restore Entry")
+        : QCoreApplication::translate("VaultCommand", "Restore %1 Entries").arg(ids.size())),
+    m_ids(ids) {
+}
+
+void RestoreEntriesCommand::undo() {
+    if (!m_database.deleteEntries(m_ids)) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged(m_ids);
+}
+
+void RestoreEntriesCommand::redo() {
+    if (!m_database.restoreEntries(m_ids)) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged(m_ids);
+}
+
+EditEntryCommand::EditEntryCommand(DatabaseManager& database, VaultView& view,
+                                   const DatabaseManager::Entry& before, const QStringList& tagsBefore,
+                                   const DatabaseManager::Entry& after, const QStringList& tagsAfter) :
+    VaultCommand(database, view, QCoreApplication::translate("VaultCommand", "Edit '%1'").arg(after.title)),
+    m_before(before),
+    m_after(after),
+    m_tagsBefore(tagsBefore),
+    m_tagsAfter(tagsAfter) {
+}
+
+void EditEntryCommand::undo() {
+    apply(m_before, m_tagsBefore);
+}
+
+void EditEntryCommand::redo() {
+    apply(m_after, m_tagsAfter);
+}
+
+int EditEntryCommand::id() const {
+    return EditEntryId;
+}
+
+bool EditEntryCommand::mergeWith(const QUndoCommand* other) {
+    // Both edits are already written; merging keeps the oldest state to go back to
+    auto* edit = static_cast<const EditEntryCommand*>(other);
+    if (edit->m_after.id != m_after.id || !withinBurst(edit)) return false;
+
+    m_after = edit->m_after;
+    m_tagsAfter = edit->m_tagsAfter;
+    m_lastEdit = edit->m_lastEdit;
+    setText(edit->text());
+    return true;
+}
+
+void EditEntryCommand::apply(const DatabaseManager::Entry& entry, const QStringList& tags) {
+    // A HOTP counter only moves forward; going back to a snapshot must not hand out spent codes again
+    DatabaseManager::Entry target = entry;
+    const QList<DatabaseManager::Entry> current = m_database.getEntriesByIds({entry.id});
+    if (!current.isEmpty()) {
+        const Totp::Settings stored = Totp::parse(current.first().otp);
+        const Totp::Settings wanted = Totp::parse(entry.otp);
+        if (stored.type == Totp::Type::Hotp && wanted.type == Totp::Type::Hotp && wanted.counter < stored.counter) {
+            target.otp = Totp::withCounter(entry.otp, stored.counter);
+        }
+    }
+
+    // Fields and tags in one transaction, so a failure cannot leave half an edit behind
+    if (m_database.saveEntryWithTags(target, tags) < 0) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged({entry.id});
+}
+
+MoveEntriesCommand::MoveEntriesCommand(DatabaseManager& database, VaultView& view,
+                                       const QList<QPair<int, int>>& moves, int groupId) :
+    VaultCommand(database, view, moves.size() == 1
+        ? QCoreApplication::translate("VaultCommand", "Move Entry")
+        : QCoreApplication::translate("VaultCommand", "Move %1 Entries").arg(moves.size())) {
+    for (const auto& move : moves) {
+        m_ids.append(move.first);
+        m_moves.insert(move.first, {move.second, groupId});
+    }
+}
+
+void MoveEntriesCommand::undo() {
+    apply(false);
+}
+
+void MoveEntriesCommand::redo() {
+    apply(true);
+}
+
+int MoveEntriesCommand::id() const {
+    return MoveEntriesId;
+}
+
+bool MoveEntriesCommand::mergeWith(const QUndoCommand* other) {
+    // An entry moved twice in one burst keeps the group it started in
+    auto* move = static_cast<const MoveEntriesCommand*>(other);
+    if (!withinBurst(move)) return false;
+
+    for (int id : move->m_ids) {
+        const QPair<int, int>& next = move->m_moves.value(id);
+        if (m_moves.contains(id)) {
+            m_moves[id].second = next.second;
+        } else {
+            m_ids.append(id);
+            m_moves.insert(id, next);
+        }
+    }
+    m_lastEdit = move->m_lastEdit;
+    setText(m_ids.size() == 1
+        ? QCoreApplication::translate("VaultCommand", "Move Entry")
+        : QCoreApplication::translate("VaultCommand", "Move %1 Entries").arg(m_ids.size()));
+    return true;
+}
+
+void MoveEntriesCommand::apply(bool forward) {
+    // However many moves were merged, replaying them is one transaction
+    QList<QPair<int, int>> moves;
+    for (int id : m_ids) {
+        const QPair<int, int>& move = m_moves.value(id);
+        moves.append({id, forward ? move.second : move.first});
+    }
+    if (!m_database.moveEntries(moves)) {
+        fail();
+        return;
+    }
+    m_view.entriesChanged(m_ids);
+}
+
+CreateGroupCommand::CreateGroupCommand(DatabaseManager& database, VaultView& view, int groupId, const QString& name) :
+    VaultCommand(database, view, QCoreApplication::translate("VaultCommand", "Add Group '%1'").arg(name)),
+    m_groupId(groupId) {
+}
+
+void CreateGroupCommand::undo() {
+    if (!m_database.deleteGroup(m_groupId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+void CreateGroupCommand::redo() {
+    if (m_done) {
+        m_done = false;
+        return;
+    }
+    if (!m_database.restoreGroup(m_groupId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+DeleteGroupCommand::DeleteGroupCommand(DatabaseManager& database, VaultView& view, int groupId, const QString& name) :
+    VaultCommand(database, view, QCoreApplication::translate("VaultCommand", "Delete Group '%1'").arg(name)),
+    m_groupId(groupId) {
+}
+
+void DeleteGroupCommand::undo() {
+    if (!m_database.restoreGroup(m_groupId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+void DeleteGroupCommand::redo() {
+    if (!m_database.deleteGroup(m_groupId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+RestoreGroupCommand::RestoreGroupCommand(DatabaseManager& database, VaultView& view, int groupId, const QString& name) :
+    VaultCommand(database, view, QCoreApplication::translate("VaultCommand", "Restore Group '%1'").arg(name)),
+    m_groupId(groupId) {
+}
+
+void RestoreGroupCommand::undo() {
+    if (!m_database.deleteGroup(m_groupId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+void RestoreGroupCommand::redo() {
+    if (!m_database.restoreGroup(m_groupId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+RenameGroupCommand::RenameGroupCommand(DatabaseManager& database, VaultView& view, int groupId,
+                                       const QString& before, const QString& after) :
+    VaultCommand(database, view, QCoreApplication::translate("VaultCommand", "Rename Group '%1'").arg(before)),
+    m_groupId(groupId),
+    m_before(before),
+    m_after(after) {
+}
+
+void RenameGroupCommand::undo() {
+    if (!m_database.updateGroup(m_groupId, m_before)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+void RenameGroupCommand::redo() {
+    if (!m_database.updateGroup(m_groupId, m_after)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+int RenameGroupCommand::id() const {
+    return RenameGroupId;
+}
+
+bool RenameGroupCommand::mergeWith(const QUndoCommand* other) {
+    auto* rename = static_cast<const RenameGroupCommand*>(other);
+    if (rename->m_groupId != m_groupId || !withinBurst(rename)) return false;
+
+    m_after = rename->m_after;
+    m_lastEdit = rename->m_lastEdit;
+    return true;
+}
+
+MoveGroupCommand::MoveGroupCommand(DatabaseManager& database, VaultView& view,
+                                   int groupId, int fromParentId, int toParentId) :
+    VaultCommand(database, view, QCoreApplication::translate("VaultCommand", "Move Group")),
+    m_groupId(groupId),
+    m_fromParentId(fromParentId),
+    m_toParentId(toParentId) {
+}
+
+void MoveGroupCommand::undo() {
+    if (!m_database.moveGroup(m_groupId, m_fromParentId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
+
+void MoveGroupCommand::redo() {
+    if (!m_database.moveGroup(m_groupId, m_toParentId)) {
+        fail();
+        return;
+    }
+    m_view.groupsChanged();
+}
@@ -0,0 +1,184 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QPair>
+#include <QStringList>
+#include <QUndoCommand>
+#include "../database/DatabaseManager.h"
+
+// What a command needs from the view to show its effect without a full reload
+class VaultView {
+public:
+    virtual ~VaultView() = default;
+    // Rows for these entries are updated, added or dropped from what is shown
+    virtual void entriesChanged(const QList<int>& ids) = 0;
+    virtual void groupsChanged() = 0;
+    virtual void commandFailed(const QString& text) = 0;
+};
+
+// Undoable edits to an open vault. Deleting goes through the recycle bin, so
+// undoing a delete is a restore and undoing an add is a delete; entry and
+// group ids stay the same either way. Edits of the same kind made within
+// CoalesceMs of each other merge into one command, which then undoes and
+// redoes as a single write.
+class VaultCommand : public QUndoCommand {
+public:
+    static const int CoalesceMs = 1000;
+
+    enum Id {
+        EditEntryId = 1,
+        MoveEntriesId,
+        RenameGroupId
+    };
+
+protected:
+    VaultCommand(DatabaseManager& database, VaultView& view, const QString& text);
+
+    bool withinBurst(const VaultCommand* other) const;
+    // Drops the command from the stack and tells the user
+    void fail();
+
+    DatabaseManager& m_database;
+    VaultView& m_view;
+    qint64 m_lastEdit;
+};
+
+// Entries that were just written, by adding or duplicating; the first redo is a no-op
+class CreateEntriesCommand : public VaultCommand {
+public:
+    CreateEntriesCommand(DatabaseManager& database, VaultView& view, const QList<int>& ids, const QString& text);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    QList<int> m_ids;
+    bool m_done = true;
+};
+
+class DeleteEntriesCommand : public VaultCommand {
+public:
+    DeleteEntriesCommand(DatabaseManager& database, VaultView& view, const QList<int>& ids);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    QList<int> m_ids;
+};
+
+// The inverse of DeleteEntriesCommand, for entries restored from the bin
+class RestoreEntriesCommand : public VaultCommand {
+public:
+    RestoreEntriesCommand(DatabaseManager& database, VaultView& view, const QList<int>& ids);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    QList<int> m_ids;
+};
+
+class EditEntryCommand : public VaultCommand {
+public:
+    EditEntryCommand(DatabaseManager& database, VaultView& view,
+                     const DatabaseManager::Entry& before, const QStringList& tagsBefore,
+                     const DatabaseManager::Entry& after, const QStringList& tagsAfter);
+
+    void undo() override;
+    void redo() override;
+    int id() const override;
+    bool mergeWith(const QUndoCommand* other) override;
+
+private:
+    void apply(const DatabaseManager::Entry& entry, const QStringList& tags);
+
+    DatabaseManager::Entry m_before;
+    DatabaseManager::Entry m_after;
+    QStringList m_tagsBefore;
+    QStringList m_tagsAfter;
+};
+
+class MoveEntriesCommand : public VaultCommand {
+public:
+    // moves pairs each entry id with the group it is in now
+    MoveEntriesCommand(DatabaseManager& database, VaultView& view, const QList<QPair<int, int>>& moves, int groupId);
+
+    void undo() override;
+    void redo() override;
+    int id() const override;
+    bool mergeWith(const QUndoCommand* other) override;
+
+private:
+    void apply(bool forward);
+
+    // Entry id to where it came from and where it went, in the order first moved
+    QList<int> m_ids;
+    QHash<int, QPair<int, int>> m_moves;
+};
+
+// A group that was just added; the first redo is a no-op
+class CreateGroupCommand : public VaultCommand {
+public:
+    CreateGroupCommand(DatabaseManager& database, VaultView& view, int groupId, const QString& name);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    int m_groupId;
+    bool m_done = true;
+};
+
+class DeleteGroupCommand : public VaultCommand {
+public:
+    DeleteGroupCommand(DatabaseManager& database, VaultView& view, int groupId, const QString& name);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    int m_groupId;
+};
+
+class RestoreGroupCommand : public VaultCommand {
+public:
+    RestoreGroupCommand(DatabaseManager& database, VaultView& view, int groupId, const QString& name);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    int m_groupId;
+};
+
+class RenameGroupCommand : public VaultCommand {
+public:
+    RenameGroupCommand(DatabaseManager& database, VaultView& view, int groupId,
+                       const QString& before, const QString& after);
+
+    void undo() override;
+    void redo() override;
+    int id() const override;
+    bool mergeWith(const QUndoCommand* other) override;
+
+private:
+    int m_groupId;
+    QString m_before;
+    QString m_after;
+};
+
+class MoveGroupCommand : public VaultCommand {
+public:
+    // Parent ids of 0 stand for the top level
+    MoveGroupCommand(DatabaseManager& database, VaultView& view, int groupId, int fromParentId, int toParentId);
+
+    void undo() override;
+    void redo() override;
+
+private:
+    int m_groupId;
+    int m_fromParentId;
+    int m_toParentId;
+};
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <QList>
+#include <QSet>
+#include <QString>
+
+// Where the user was in a vault view, kept across a lock so the next unlock
+// picks up there. Ids and offsets only: no names, titles or other contents,
+// since it outlives the vault being open. Held in memory, never written out.
+struct VaultViewState {
+    // Groups start expanded, so only the ones the user folded are listed
+    QSet<int> collapsedGroupIds;
+    int groupId = 0;
+    QList<int> selectedEntryIds;
+    int groupsScroll = 0;
+    int entriesScroll = 0;
+    QString searchText;
+};
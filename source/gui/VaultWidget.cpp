@@ -1,7 +1,17 @@
 #include "VaultWidget.h"
 #include "ui_VaultWidget.h"
 #include "EntryDialog.h"
+#include "EntryHistoryDialog.h"
+#include "AttachmentsDialog.h"
+#include "CommandPalette.h"
+#include "../database/ChangePasswordDialog.h"
+#include "../database/BackupSettingsDialog.h"
+#include "../database/QueryStatsDialog.h"
+#include "../database/MergeDialog.h"
 #include "../database/DatabaseManager.h"
+#include "../database/MaintenanceWorker.h"
+#include "../database/ReaderPool.h"
+#include "../utils/Trace.h"
 
 #include <QHeaderView>
 #include <QMenu>
@@ -9,9 +19,24 @@
 #include <QMessageBox>
 #include <QClipboard>
 #include <QApplication>
+#include <QTreeWidgetItemIterator>
+#include <QShortcut>
+#include <QUndoStack>
+#include <QAction>
+#include <QScrollBar>
+#include <QHash>
+#include <QThread>
+#include <QDateTime>
+#include <QDebug>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <algorithm>
 
-VaultWidget::VaultWidget(QWidget *parent)
-    : QWidget(parent), ui(new Ui::VaultWidget) {
+VaultWidget::VaultWidget(DatabaseManager* database, QWidget *parent)
+    : QWidget(parent), ui(new Ui::VaultWidget), m_database(database) {
+    Trace::Span span("VaultWidget::VaultWidget");
+    // The vault lives exactly as long as its tab
+    m_database->setParent(this);
     ui->setupUi(this);
     
     // UI Layout tweaks
@@ -19,6 +44,7 @@ VaultWidget::VaultWidget(QWidget *parent)
     ui->splitter->setStretchFactor(1, 4);
     
     ui->entriesTable->horizontalHeader()->setSectionResizeMode(QHeaderView::Stretch);
+    ui->entriesTable->horizontalHeader()->setSectionResizeMode(3, QHeaderView::ResizeToContents);
     
     // Context Menu
     ui->groupsTree->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -33,6 +59,73 @@ VaultWidget::VaultWidget(QWidget *parent)
     connect(ui->editEntryButton, &QToolButton::clicked, this, &VaultWidget::onEditEntry);
     connect(ui->deleteEntryButton, &QToolButton::clicked, this, &VaultWidget::onDeleteEntry);
     
+    // Undo and redo cover edits made in this view; the actions track the stack
+    m_undoStack = new QUndoStack(this);
+    QAction* undoAction = m_undoStack->createUndoAction(this, tr("Undo"));
+    undoAction->setShortcut(QKeySequence::Undo);
+    undoAction->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+    addAction(undoAction);
+    QAction* redoAction = m_undoStack->createRedoAction(this, tr("Redo"));
+    redoAction->setShortcut(QKeySequence::Redo);
+    redoAction->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+    addAction(redoAction);
+    
+    // Database menu
+    QMenu* databaseMenu = new QMenu(this);
+    databaseMenu->addAction(undoAction);
+    databaseMenu->addAction(redoAction);
+    databaseMenu->addSeparator();
+    databaseMenu->addAction(tr("Change Master Password..."), this, &VaultWidget::onChangeMasterPassword);
+    databaseMenu->addSeparator();
+    databaseMenu->addAction(tr("Back Up Now"), this, &VaultWidget::onBackupNow);
+    databaseMenu->addAction(tr("Backup Settings..."), this, &VaultWidget::onBackupSettings);
+    databaseMenu->addAction(tr("Merge From..."), this, &VaultWidget::onMergeFrom);
+    databaseMenu->addSeparator();
+    databaseMenu->addAction(tr("Check Integrity Now"), this, &VaultWidget::onCheckIntegrity);
+    databaseMenu->addAction(tr("Query Statistics..."), this, &VaultWidget::onQueryStats);
+    ui->databaseButton->setMenu(databaseMenu);
+    
+    // Online backups run on their own connections, the status bar only reports on them
+    m_backupManager = new BackupManager(*m_database, this);
+    connect(m_backupManager, &BackupManager::backupProgress, this, [this](int percent) {
+        ui->backupStatusLabel->setText(tr("Backing up... %1%").arg(percent));
+    });
+    connect(m_backupManager, &BackupManager::backupFinished, this, &VaultWidget::onBackupFinished);
+
+    // Quick access palette; its title index goes stale with every change to the vault
+    QShortcut* quickAccessShortcut = new QShortcut(QKeySequence(tr("Ctrl+K")), this);
+    connect(quickAccessShortcut, &QShortcut::activated, this, &VaultWidget::onQuickAccess);
+    connect(m_database, &DatabaseManager::databaseModified, this, &VaultWidget::invalidateQuickIndex);
+
+    // Subtree counts are refreshed once per burst of writes
+    m_groupCountsTimer = new QTimer(this);
+    m_groupCountsTimer->setSingleShot(true);
+    m_groupCountsTimer->setInterval(0);
+    connect(m_groupCountsTimer, &QTimer::timeout, this, &VaultWidget::updateGroupCounts);
+    connect(m_database, &DatabaseManager::databaseModified, m_groupCountsTimer, qOverload<>(&QTimer::start));
+
+    // Debug view of statement timings
+    QShortcut* statsShortcut = new QShortcut(QKeySequence(tr("Ctrl+Shift+D")), this);
+    connect(statsShortcut, &QShortcut::activated, this, &VaultWidget::onQueryStats);
+
+    // Integrity checks only run while the user is idle, see eventFilter()
+    m_integrityChecker = new IntegrityChecker(*m_database, this);
+    connect(m_integrityChecker, &IntegrityChecker::checkProgress, this, [this](int done, int total) {
+        ui->integrityStatusLabel->setText(tr("Checking integrity... %1/%2").arg(done).arg(total));
+    });
+    connect(m_integrityChecker, &IntegrityChecker::checkFinished, this, &VaultWidget::onIntegrityFinished);
+
+    // Edits made elsewhere (sync tools, another instance) are merged into the view as they land
+    m_vaultMonitor = new VaultMonitor(*m_database, this);
+    connect(m_vaultMonitor, &VaultMonitor::externalChange, this, &VaultWidget::onExternalChange);
+    connect(m_vaultMonitor, &VaultMonitor::reopenFailed, this, [this]() {
+        QMessageBox::warning(this, tr("Vault Replaced"),
+                             tr("The vault file was replaced by a copy that cannot be opened with the current password. "
+                                "The vault will be locked; unlock it again to continue."));
+        m_database->closeDatabase();
+        emit lockRequested();
+    });
+    
     // Search Connection
     connect(ui->searchLineEdit, &QLineEdit::textChanged, this, &VaultWidget::onSearchTextChanged);
     
@@ -46,6 +139,11 @@ VaultWidget::VaultWidget(QWidget *parent)
     m_clipboardTimer->setInterval(100);
     connect(m_clipboardTimer, &QTimer::timeout, this, &VaultWidget::updateClipboardProgress);
 
+    // One timer for every OTP countdown; codes are recomputed in a batch when their step rolls over
+    m_totpCache = new TotpCache(this);
+    connect(m_totpCache, &TotpCache::tick, this, &VaultWidget::updateOtpColumn);
+    connect(ui->entriesTable->verticalScrollBar(), &QScrollBar::valueChanged, this, &VaultWidget::updateOtpColumn);
+
     // Inactivity Timer (20 seconds)
     m_inactivityTimer = new QTimer(this);
     m_inactivityTimer->setInterval(20000); // 20s
@@ -56,18 +154,117 @@ VaultWidget::VaultWidget(QWidget *parent)
     qApp->installEventFilter(this);
     m_inactivityTimer->start();
 
-    // Initial Load
-    refreshGroups();
+    // History pruning waits until the unlock and first screens are done
+    QTimer::singleShot(30000, this, &VaultWidget::runMaintenance);
+
+    // Staged load: the tree is built before the tab first paints, the selected
+    // group's entries right after, and the subtree counts and caches last
+    loadGroupTree(0, nullptr);
+    ui->groupsTree->expandAll();
+    if (ui->groupsTree->topLevelItemCount() > 0) {
+        ui->groupsTree->setCurrentItem(ui->groupsTree->topLevelItem(0));
+    }
+    QTimer::singleShot(0, this, &VaultWidget::finishLoading);
 }
 
 VaultWidget::~VaultWidget() {
     if (qApp) {
         qApp->removeEventFilter(this);
     }
+    if (m_maintenanceThread) {
+        if (m_maintenanceWorker) {
+            m_maintenanceWorker->cancel();
+        }
+        m_maintenanceThread->quit();
+        m_maintenanceThread->wait();
+    }
     delete ui;
 }
 
+DatabaseManager* VaultWidget::database() const {
+    return m_database;
+}
+
+void VaultWidget::showEntry(int groupId, int entryId) {
+    ui->searchLineEdit->clear();
+    for (auto it = m_groupMap.begin(); it != m_groupMap.end(); ++it) {
+        if (it.value() == groupId) {
+            ui->groupsTree->setCurrentItem(it.key());
+            loadEntries(groupId);
+            break;
+        }
+    }
+    
+    for (int row = 0; row < m_currentEntries.size(); ++row) {
+        if (m_currentEntries.at(row).id == entryId) {
+            ui->entriesTable->selectRow(row);
+            ui->entriesTable->scrollToItem(ui->entriesTable->item(row, 0));
+            break;
+        }
+    }
+}
+
+VaultViewState VaultWidget::viewState() const {
+    VaultViewState state;
+    for (auto it = m_groupMap.constBegin(); it != m_groupMap.constEnd(); ++it) {
+        if (it.key()->childCount() > 0 && !it.key()->isExpanded()) {
+            state.collapsedGroupIds.insert(it.value());
+        }
+    }
+    if (QTreeWidgetItem* current = ui->groupsTree->currentItem()) {
+        state.groupId = m_groupMap.value(current, 0);
+    }
+    for (int row : selectedRows()) {
+        state.selectedEntryIds.append(m_currentEntries.at(row).id);
+    }
+    state.groupsScroll = ui->groupsTree->verticalScrollBar()->value();
+    state.entriesScroll = ui->entriesTable->verticalScrollBar()->value();
+    state.searchText = ui->searchLineEdit->text();
+    return state;
+}
+
+void VaultWidget::restoreViewState(const VaultViewState& state) {
+    // The tree is already built; folding and selecting it now shows it right on the first paint
+    for (auto it = m_groupMap.constBegin(); it != m_groupMap.constEnd(); ++it) {
+        if (state.collapsedGroupIds.contains(it.value())) {
+            it.key()->setExpanded(false);
+        }
+        if (it.value() == state.groupId) {
+            ui->groupsTree->setCurrentItem(it.key());
+        }
+    }
+    m_pendingViewState = state;
+}
+
+void VaultWidget::applyPendingViewState() {
+    const VaultViewState state = *m_pendingViewState;
+    m_pendingViewState.reset();
+
+    // Setting the text runs the search in place of loading the group
+    if (state.searchText.isEmpty()) {
+        onGroupSelected(ui->groupsTree->currentItem(), 0);
+    } else {
+        ui->searchLineEdit->setText(state.searchText);
+    }
+
+    // Entries that were deleted since are skipped
+    for (int row = 0; row < m_currentEntries.size(); ++row) {
+        if (state.selectedEntryIds.contains(m_currentEntries.at(row).id)) {
+            ui->entriesTable->selectionModel()->select(
+                ui->entriesTable->model()->index(row, 0),
+                QItemSelectionModel::Select | QItemSelectionModel::Rows);
+        }
+    }
+
+    // Scroll ranges are only known once the views have laid out their new rows
+    QTimer::singleShot(0, this, [this, state]() {
+        ui->groupsTree->verticalScrollBar()->setValue(state.groupsScroll);
+        ui->entriesTable->verticalScrollBar()->setValue(state.entriesScroll);
+    });
+}
+
 void VaultWidget::refreshGroups() {
+    Trace::Span span("VaultWidget::refreshGroups");
     // Remember current selection ID if possible
     int selectedId = -1;
     if (QTreeWidgetItem* current = ui->groupsTree->currentItem()) {
@@ -79,6 +276,7 @@ void VaultWidget::refreshGroups() {
     
     // Load recursively starting from root (parentId 0 in our logic means NULL in SQL)
     loadGroupTree(0, nullptr);
+    updateGroupCounts();
     
     ui->groupsTree->expandAll();
 
@@ -98,8 +296,51 @@ void VaultWidget::refreshGroups() {
     }
 }
 
+void VaultWidget::finishLoading() {
+    Trace::Span span("VaultWidget::finishLoading");
+    if (m_pendingViewState) {
+        applyPendingViewState();
+    } else {
+        onGroupSelected(ui->groupsTree->currentItem(), 0);
+    }
+    m_groupCountsTimer->start();
+    warmCaches();
+}
+
+void VaultWidget::warmCaches() {
+    // Builds the quick access index on a reader, which also leaves a connection open for the first search
+    QSharedPointer<ReaderPool> readers = m_database->readerPool();
+    if (!readers) return;
+
+    const int generation = m_quickIndexGeneration;
+    auto* watcher = new QFutureWatcher<QSharedPointer<FrecencyIndex>>(this);
+    connect(watcher, &QFutureWatcher<QSharedPointer<FrecencyIndex>>::finished, this, [this, watcher, generation]() {
+        watcher->deleteLater();
+        QSharedPointer<FrecencyIndex> index = watcher->result();
+        if (index && generation == m_quickIndexGeneration) {
+            m_quickIndex = *index;
+            m_quickIndexStale = false;
+        }
+    });
+    watcher->setFuture(QtConcurrent::run([readers]() {
+        Trace::Span span("warmQuickIndex");
+        QSharedPointer<FrecencyIndex> index;
+        ReaderPool::Lease lease = readers->acquire();
+        if (lease.isValid()) {
+            index = QSharedPointer<FrecencyIndex>::create();
+            index->setItems(DatabaseManager::getEntryUsage(lease.db()));
+        }
+        return index;
+    }));
+}
+
+void VaultWidget::invalidateQuickIndex() {
+    m_quickIndexStale = true;
+    ++m_quickIndexGeneration;
+}
+
 void VaultWidget::loadGroupTree(int parentId, QTreeWidgetItem* parentItem) {
-    QList<DatabaseManager::Group> groups = DatabaseManager::instance().getGroups(parentId);
+    QList<DatabaseManager::Group> groups = m_database->getGroups(parentId);
     
     for (const auto& group : groups) {
         QTreeWidgetItem* item;
@@ -109,7 +350,9 @@ void VaultWidget::loadGroupTree(int parentId, QTreeWidgetItem* parentItem) {
             item = new QTreeWidgetItem(ui->groupsTree);
         }
         
+        // The label gains the subtree count; the bare name stays in the item data
         item->setText(0, group.name);
+        item->setData(0, Qt::UserRole, group.name);
         m_groupMap[item] = group.id;
         
         // Recurse for children
@@ -117,6 +360,25 @@ void VaultWidget::loadGroupTree(int parentId, QTreeWidgetItem* parentItem) {
     }
 }
 
+void VaultWidget::updateGroupCounts() {
+    // One grouped query over the closure table covers every subtree
+    QHash<int, int> counts = m_database->getSubtreeEntryCounts();
+    for (auto it = m_groupMap.constBegin(); it != m_groupMap.constEnd(); ++it) {
+        const QString name = it.key()->data(0, Qt::UserRole).toString();
+        const int count = counts.value(it.value());
+        it.key()->setText(0, count > 0 ? tr("%1 (%2)").arg(name).arg(count) : name);
+    }
+}
+
+QString VaultWidget::groupPath(QTreeWidgetItem* item) const {
+    // Search paths start below the top-level group
+    QStringList names;
+    for (; item && item->parent(); item = item->parent()) {
+        names.prepend(item->data(0, Qt::UserRole).toString());
+    }
+    return '/' + names.join('/');
+}
+
 void VaultWidget::onGroupSelected(QTreeWidgetItem* item, int column) {
     Q_UNUSED(column);
     if (!item) return;
@@ -133,9 +395,48 @@ void VaultWidget::showGroupsContextMenu(const QPoint& pos) {
     QMenu menu(this);
     
     if (item) {
+        const int groupId = m_groupMap.value(item, -1);
         menu.addAction(tr("Add Subgroup"), this, &VaultWidget::onAddGroup);
         menu.addAction(tr("Edit Group"), this, &VaultWidget::onEditGroup);
+        menu.addAction(tr("Search in This Group"), this, [this, item]() {
+            QString path = groupPath(item);
+            if (path.contains(' ')) path = '"' + path + '"';
+            ui->searchLineEdit->setText(QString("group:%1 ").arg(path));
+            ui->searchLineEdit->setFocus();
+        });
+        
+        // Targets inside the group itself are left out
+        const int parentId = item->parent() ? m_groupMap.value(item->parent(), 0) : 0;
+        QMenu* moveMenu = menu.addMenu(tr("Move Group To"));
+        moveMenu->addAction(tr("(Top Level)"), this, [this, groupId, parentId]() {
+            m_undoStack->push(new MoveGroupCommand(*m_database, *this, groupId, parentId, 0));
+        })->setEnabled(item->parent() != nullptr);
+        for (QTreeWidgetItemIterator it(ui->groupsTree); *it; ++it) {
+            int targetId = m_groupMap.value(*it, -1);
+            bool inside = false;
+            for (QTreeWidgetItem* walk = *it; walk; walk = walk->parent()) {
+                inside = inside || walk == item;
+            }
+            if (inside || *it == item->parent()) continue;
+            int depth = 0;
+            for (QTreeWidgetItem* parent = (*it)->parent(); parent; parent = parent->parent()) {
+                ++depth;
+            }
+            QString label = QString(depth * 4, ' ') + (*it)->data(0, Qt::UserRole).toString();
+            moveMenu->addAction(label, this, [this, groupId, parentId, targetId]() {
+                m_undoStack->push(new MoveGroupCommand(*m_database, *this, groupId, parentId, targetId));
+            });
+        }
+        
         menu.addSeparator();
+        if (groupId == m_database->recycleBinGroupId()) {
+            menu.addAction(tr("Empty Recycle Bin"), this, &VaultWidget::onEmptyRecycleBin);
+        } else if (item->parent() && m_groupMap.value(item->parent(), -1) == m_database->recycleBinGroupId()) {
+            const QString name = item->data(0, Qt::UserRole).toString();
+            menu.addAction(tr("Restore Group"), this, [this, groupId, name]() {
+                m_undoStack->push(new RestoreGroupCommand(*m_database, *this, groupId, name));
+            });
+        }
         menu.addAction(tr("Delete Group"), this, &VaultWidget::onDeleteGroup);
     } else {
         menu.addAction(tr("Add Group"), this, &VaultWidget::onAddGroup);
@@ -153,7 +454,10 @@ void VaultWidget::onAddGroup() {
                                          tr("Group name:"), QLineEdit::Normal,
                                          "", &ok);
     if (ok && !name.isEmpty()) {
-        DatabaseManager::instance().createGroup(name, parentId);
+        int id = m_database->createGroup(name, parentId);
+        if (id > 0) {
+            m_undoStack->push(new CreateGroupCommand(*m_database, *this, id, name));
+        }
         refreshGroups();
     }
 }
@@ -166,12 +470,12 @@ void VaultWidget::onEditGroup() {
     if (groupId == -1) return;
     
     bool ok;
+    const QString oldName = item->data(0, Qt::UserRole).toString();
     QString name = QInputDialog::getText(this, tr("Edit Group"),
                                          tr("Group name:"), QLineEdit::Normal,
-                                         item->text(0), &ok);
-    if (ok && !name.isEmpty()) {
-        DatabaseManager::instance().updateGroup(groupId, name);
-        refreshGroups();
+                                         oldName, &ok);
+    if (ok && !name.isEmpty() && name != oldName) {
+        m_undoStack->push(new RenameGroupCommand(*m_database, *this, groupId, oldName, name));
     }
 }
 
@@ -182,16 +486,30 @@ void VaultWidget::onDeleteGroup() {
     int groupId = m_groupMap.value(item, -1);
     if (groupId == -1) return;
     
-    // Don't delete Root if you want to protect it, but let's assume user knows what they are doing.
-    // If it's the last group, maybe warn more?
+    // Groups in the bin go for good; everything else can be restored
+    const DatabaseManager::GroupDeletion deletion = m_database->groupDeletion(groupId);
+    const QString name = item->data(0, Qt::UserRole).toString();
+    if (deletion == DatabaseManager::GroupDeletion::NotAllowed) {
+        QMessageBox::warning(this, tr("Delete Group"),
+                             tr("Group '%1' holds the recycle bin and cannot be deleted.").arg(name));
+        return;
+    }
+    const bool permanent = deletion == DatabaseManager::GroupDeletion::Permanent;
+    QString question = permanent
+        ? tr("Permanently delete group '%1' and all its entries? This cannot be undone.").arg(name)
+        : tr("Move group '%1' and all its entries to the recycle bin?").arg(name);
     
-    auto result = QMessageBox::question(this, tr("Delete Group"),
-                                         tr("Are you sure you want to delete group '%1' and all its entries?").arg(item->text(0)),
+    auto result = QMessageBox::question(this, tr("Delete Group"), question,
                                          QMessageBox::Yes | QMessageBox::No);
     
-    if (result == QMessageBox::Yes) {
-        DatabaseManager::instance().deleteGroup(groupId);
-        refreshGroups();
+    if (result != QMessageBox::Yes) return;
+    if (permanent) {
+        // Marked here and removed by a background purge; the tree catches up when it is done
+        if (!m_database->deleteGroup(groupId)) return;
+        m_undoStack->clear();
+        requestPurge();
+    } else {
+        m_undoStack->push(new DeleteGroupCommand(*m_database, *this, groupId, name));
     }
 }
 
@@ -205,10 +523,18 @@ void VaultWidget::onAddEntry() {
     int groupId = m_groupMap.value(groupItem, -1);
     
     EntryDialog dialog(this);
+    dialog.setTags(QStringList(), m_database->getTags());
     if (dialog.exec() == QDialog::Accepted) {
         DatabaseManager::Entry entry = dialog.getEntry();
+        entry.id = -1;
         entry.groupId = groupId;
-        DatabaseManager::instance().createEntry(entry);
+        // The entry and its tags are written together, so a failure leaves no untagged entry behind
+        int id = m_database->saveEntryWithTags(entry, dialog.getTags());
+        if (id > 0) {
+            m_undoStack->push(new CreateEntriesCommand(*m_database, *this, {id}, tr("Add '%1'").arg(entry.title)));
+        } else {
+            QMessageBox::critical(this, tr("Error"), tr("Failed to add the entry."));
+        }
         loadEntries(groupId);
     }
 }
@@ -222,37 +548,389 @@ void VaultWidget::onEditEntry() {
     DatabaseManager::Entry entry = m_currentEntries.at(row);
     EntryDialog dialog(this);
     dialog.setEntry(entry);
+    dialog.setTags(m_database->getEntryTags(entry.id), m_database->getTags());
     
     if (dialog.exec() == QDialog::Accepted) {
-        DatabaseManager::Entry updatedEntry = dialog.getEntry();
-        DatabaseManager::instance().updateEntry(updatedEntry);
-        loadEntries(entry.groupId);
+        m_undoStack->push(new EditEntryCommand(*m_database, *this, entry, m_database->getEntryTags(entry.id),
+                                               dialog.getEntry(), dialog.getTags()));
     }
 }
 
 void VaultWidget::onDeleteEntry() {
-    int row = ui->entriesTable->currentRow();
-    if (row < 0 || row >= m_currentEntries.size()) {
+    QList<int> rows = selectedRows();
+    if (rows.isEmpty()) {
         return;
     }
     
-    DatabaseManager::Entry entry = m_currentEntries.at(row);
+    // Searches leave the bin out, so a selection is either all in it or all outside
+    const bool permanent = m_database->isInRecycleBin(m_currentEntries.at(rows.first()).groupId);
+    QString question;
+    if (permanent) {
+        question = (rows.size() == 1)
+            ? tr("Permanently delete entry '%1'? This cannot be undone.").arg(m_currentEntries.at(rows.first()).title)
+            : tr("Permanently delete %1 entries? This cannot be undone.").arg(rows.size());
+    } else {
+        question = (rows.size() == 1)
+            ? tr("Move entry '%1' to the recycle bin?").arg(m_currentEntries.at(rows.first()).title)
+            : tr("Move %1 entries to the recycle bin?").arg(rows.size());
+    }
     
-    auto result = QMessageBox::question(this, tr("Delete Entry"),
-                                         tr("Are you sure you want to delete entry '%1'?").arg(entry.title),
+    auto result = QMessageBox::question(this, tr("Delete Entry"), question,
                                          QMessageBox::Yes | QMessageBox::No);
     
     if (result == QMessageBox::Yes) {
-        DatabaseManager::instance().deleteEntry(entry.id);
-        loadEntries(entry.groupId);
+        QList<int> ids;
+        for (int row : rows) {
+            ids.append(m_currentEntries.at(row).id);
+        }
+        
+        if (!permanent) {
+            m_undoStack->push(new DeleteEntriesCommand(*m_database, *this, ids));
+        } else if (m_database->deleteEntries(ids)) {
+            // Like a permanently deleted group, they are gone once the background purge has run
+            m_undoStack->clear();
+            removeEntryRows(rows);
+            requestPurge();
+        } else {
+            QMessageBox::critical(this, tr("Error"), tr("Failed to delete the selected entries."));
+        }
+    }
+}
+
+void VaultWidget::onRestoreEntries() {
+    QList<int> rows = selectedRows();
+    if (rows.isEmpty()) return;
+    
+    QList<int> ids;
+    for (int row : rows) {
+        ids.append(m_currentEntries.at(row).id);
+    }
+    
+    m_undoStack->push(new RestoreEntriesCommand(*m_database, *this, ids));
+}
+
+void VaultWidget::onDuplicateEntries() {
+    copySelectedEntries(0);
+}
+
+void VaultWidget::onEntryAttachments() {
+    int row = ui->entriesTable->currentRow();
+    if (row < 0 || row >= m_currentEntries.size()) return;
+    
+    AttachmentsDialog dialog(*m_database, m_currentEntries.at(row).id, this);
+    dialog.exec();
+}
+
+void VaultWidget::onEntryHistory() {
+    int row = ui->entriesTable->currentRow();
+    if (row < 0 || row >= m_currentEntries.size()) return;
+    
+    const int entryId = m_currentEntries.at(row).id;
+    EntryHistoryDialog dialog(*m_database, entryId, this);
+    if (dialog.exec() == QDialog::Accepted) {
+        QList<DatabaseManager::Entry> restored = m_database->getEntriesByIds({entryId});
+        if (!restored.isEmpty() && row < m_currentEntries.size() && m_currentEntries.at(row).id == entryId) {
+            updateEntryRow(row, restored.first());
+        }
+    }
+}
+
+QList<int> VaultWidget::selectedRows() const {
+    QList<int> rows;
+    const QModelIndexList indexes = ui->entriesTable->selectionModel()->selectedRows();
+    for (const QModelIndex& index : indexes) {
+        if (index.row() < m_currentEntries.size()) {
+            rows.append(index.row());
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    return rows;
+}
+
+void VaultWidget::moveSelectedEntries(int groupId) {
+    QList<int> rows = selectedRows();
+    if (rows.isEmpty() || groupId == -1) return;
+    
+    // Each entry remembers its own group, search results can come from several
+    QList<QPair<int, int>> moves;
+    for (int row : rows) {
+        const DatabaseManager::Entry& entry = m_currentEntries.at(row);
+        if (entry.groupId != groupId) {
+            moves.append({entry.id, entry.groupId});
+        }
+    }
+    if (!moves.isEmpty()) {
+        m_undoStack->push(new MoveEntriesCommand(*m_database, *this, moves, groupId));
     }
 }
 
+void VaultWidget::copySelectedEntries(int groupId) {
+    QList<int> rows = selectedRows();
+    if (rows.isEmpty() || groupId == -1) return;
+    
+    QList<int> ids;
+    for (int row : rows) {
+        ids.append(m_currentEntries.at(row).id);
+    }
+    
+    QList<int> newIds = m_database->duplicateEntries(ids, groupId);
+    if (newIds.size() != ids.size()) {
+        QMessageBox::critical(this, tr("Error"), tr("Failed to copy the selected entries."));
+        return;
+    }
+    m_undoStack->push(new CreateEntriesCommand(*m_database, *this, newIds,
+                                               newIds.size() == 1 ? tr("Duplicate Entry") : tr("Duplicate %1 Entries").arg(newIds.size())));
+    
+    if (!ui->searchLineEdit->text().isEmpty()) return;
+    
+    // Only copies landing in the group being viewed need a new row
+    for (int i = 0; i < rows.size(); ++i) {
+        DatabaseManager::Entry copy = m_currentEntries.at(rows.at(i));
+        if (groupId > 0 && groupId != copy.groupId) continue;
+        
+        copy.id = newIds.at(i);
+        if (groupId <= 0) {
+            copy.title += " - Copy";
+        }
+        m_currentEntries.append(copy);
+        insertEntryRow(copy);
+    }
+    syncOtpEntries();
+}
+
 void VaultWidget::onLockDatabase() {
-    DatabaseManager::instance().closeDatabase();
+    // The vault is swapped and reopened when the re-encryption finishes; lock after that
+    if (m_database->isChangingPassword()) {
+        resetInactivityTimer();
+        return;
+    }
+    
+    m_database->closeDatabase();
     emit lockRequested();
 }
 
+void VaultWidget::onChangeMasterPassword() {
+    ChangePasswordDialog dialog(*m_database, this);
+    if (dialog.exec() == QDialog::Accepted) {
+        QMessageBox::information(this, tr("Change Master Password"),
+                                 tr("The master password has been changed."));
+    }
+}
+
+void VaultWidget::onBackupNow() {
+    if (!m_backupManager->backupNow()) {
+        ui->backupStatusLabel->setText(tr("A backup is already running"));
+    }
+}
+
+void VaultWidget::onBackupSettings() {
+    BackupSettingsDialog dialog(m_backupManager->policy(),
+                                BackupManager::backupDirectory(m_database->path()), this);
+    if (dialog.exec() == QDialog::Accepted) {
+        BackupManager::Policy policy = dialog.getPolicy();
+        BackupManager::savePolicy(policy);
+        m_backupManager->setPolicy(policy);
+    }
+}
+
+void VaultWidget::onBackupFinished(bool success, const QString& path, double megabytesPerSecond) {
+    Q_UNUSED(path);
+    if (success) {
+        ui->backupStatusLabel->setText(tr("Backup saved (%1 MB/s)").arg(megabytesPerSecond, 0, 'f', 1));
+    } else {
+        ui->backupStatusLabel->setText(tr("Backup failed"));
+    }
+}
+
+void VaultWidget::onMergeFrom() {
+    MergeDialog dialog(*m_database, this);
+    if (dialog.exec() != QDialog::Accepted) return;
+    
+    // Merged rows keep the other copy's timestamps, so reload rather than wait for the monitor
+    refreshGroups();
+    if (QTreeWidgetItem* current = ui->groupsTree->currentItem()) {
+        onGroupSelected(current, 0);
+    }
+    ui->backupStatusLabel->setText(dialog.summary());
+}
+
+void VaultWidget::onCheckIntegrity() {
+    m_integrityChecker->checkNow();
+}
+
+void VaultWidget::onIntegrityFinished(bool ok, const QStringList& problems) {
+    if (ok) {
+        ui->integrityStatusLabel->setText(tr("Integrity verified"));
+        return;
+    }
+
+    ui->integrityStatusLabel->setText(tr("Integrity problems found"));
+    QStringList shown = problems.mid(0, 10);
+    if (problems.size() > shown.size()) {
+        shown.append(tr("... and %1 more").arg(problems.size() - shown.size()));
+    }
+    QMessageBox::warning(this, tr("Integrity Check"),
+                         tr("The vault file appears to be damaged. Restore it from a backup as soon as possible.\n\n%1")
+                             .arg(shown.join("\n")));
+}
+
+void VaultWidget::onQueryStats() {
+    QueryStatsDialog dialog(m_database->profiler(), this);
+    dialog.exec();
+}
+
+void VaultWidget::runMaintenance() {
+    startMaintenance(RecycleBin::loadPolicy());
+}
+
+void VaultWidget::onEmptyRecycleBin() {
+    auto result = QMessageBox::question(this, tr("Empty Recycle Bin"),
+                                         tr("Permanently delete everything in the recycle bin? This cannot be undone."),
+                                         QMessageBox::Yes | QMessageBox::No);
+    if (result != QMessageBox::Yes) return;
+    
+    // Emptying is a purge with no retention; the tree catches up through the change monitor
+    RecycleBin::Policy policy;
+    policy.retentionDays = 0;
+    if (!startMaintenance(policy)) {
+        QMessageBox::information(this, tr("Empty Recycle Bin"),
+                                 tr("Vault maintenance is already running. Please try again in a moment."));
+    }
+}
+
+void VaultWidget::requestPurge() {
+    // A run already going may be past the purge; if so another one follows it
+    if (!startMaintenance(RecycleBin::loadPolicy())) {
+        m_purgePending = true;
+    }
+}
+
+bool VaultWidget::startMaintenance(const RecycleBin::Policy& recycleBin) {
+    if (m_maintenanceThread || !m_database->isOpen() || m_database->isChangingPassword()) return false;
+    
+    MaintenanceWorker::Job job;
+    job.vault = m_database->connectionInfo();
+    job.history = EntryHistory::loadPolicy();
+    job.recycleBin = recycleBin;
+    
+    m_maintenanceThread = new QThread();
+    m_maintenanceWorker = new MaintenanceWorker(job);
+    connect(m_maintenanceThread, &QObject::destroyed, this, [this]() {
+        if (m_purgePending) {
+            m_purgePending = false;
+            requestPurge();
+        }
+    });
+    m_maintenanceWorker->moveToThread(m_maintenanceThread);
+    
+    connect(m_maintenanceThread, &QThread::started, m_maintenanceWorker, &MaintenanceWorker::run);
+    connect(m_maintenanceWorker, &MaintenanceWorker::finished, this, [this](bool success, int, int itemsPurged, const QString& error) {
+        if (!success && !error.isEmpty()) {
+            qWarning() << "Vault maintenance failed:" << error;
+        }
+        // Undoing a delete cannot bring back what the purge removed
+        if (itemsPurged > 0) {
+            m_undoStack->clear();
+        }
+    });
+    connect(m_maintenanceWorker, &MaintenanceWorker::finished, m_maintenanceThread, &QThread::quit);
+    connect(m_maintenanceThread, &QThread::finished, m_maintenanceWorker, &QObject::deleteLater);
+    connect(m_maintenanceThread, &QThread::finished, m_maintenanceThread, &QObject::deleteLater);
+    
+    m_maintenanceThread->start(QThread::LowestPriority);
+    return true;
+}
+
+void VaultWidget::onExternalChange(const VaultMonitor::Changes& changes) {
+    // Rebuilding the tree keeps the selected group
+    if (changes.groupsChanged || changes.reopened) {
+        refreshGroups();
+    }
+    // Tags can change without touching an entry row, so the index is read again either way
+    if (!changes.reopened) {
+        m_database->rebuildTagIndex();
+    }
+    invalidateQuickIndex();
+    m_groupCountsTimer->start();
+    // A replaced file may not have the rows the commands refer to
+    if (changes.reopened) {
+        m_undoStack->clear();
+    }
+    
+    mergeEntryChanges(changes.removedEntryIds, changes.changedEntries);
+    
+    ui->backupStatusLabel->setText(tr("Reloaded changes made outside KeeBox"));
+}
+
+void VaultWidget::mergeEntryChanges(const QList<int>& removedIds, const QList<DatabaseManager::Entry>& changed) {
+    QTreeWidgetItem* groupItem = ui->groupsTree->currentItem();
+    int groupId = groupItem ? m_groupMap.value(groupItem, -1) : -1;
+    bool searching = !ui->searchLineEdit->text().isEmpty();
+    
+    QHash<int, int> rowOf;
+    for (int row = 0; row < m_currentEntries.size(); ++row) {
+        rowOf.insert(m_currentEntries.at(row).id, row);
+    }
+    
+    // Rows are updated in place so the selection and scroll position survive
+    QList<int> staleRows;
+    for (int id : removedIds) {
+        if (rowOf.contains(id)) {
+            staleRows.append(rowOf.value(id));
+        }
+    }
+    for (const DatabaseManager::Entry& entry : changed) {
+        if (rowOf.contains(entry.id)) {
+            int row = rowOf.value(entry.id);
+            if (searching || entry.groupId == groupId) {
+                updateEntryRow(row, entry);
+            } else {
+                staleRows.append(row);
+            }
+        } else if (!searching && entry.groupId == groupId) {
+            m_currentEntries.append(entry);
+            insertEntryRow(entry);
+        }
+    }
+    
+    std::sort(staleRows.begin(), staleRows.end());
+    staleRows.erase(std::unique(staleRows.begin(), staleRows.end()), staleRows.end());
+    removeEntryRows(staleRows);
+}
+
+void VaultWidget::entriesChanged(const QList<int>& ids) {
+    // Entries that no longer exist are not returned, and searches leave out the bin; their rows go
+    QList<DatabaseManager::Entry> changed = m_database->getEntriesByIds(ids);
+    const QSet<int> bin = ui->searchLineEdit->text().isEmpty() ? QSet<int>() : m_database->recycleBinGroupIds();
+    QSet<int> found;
+    for (auto it = changed.begin(); it != changed.end();) {
+        if (bin.contains(it->groupId)) {
+            it = changed.erase(it);
+        } else {
+            found.insert(it->id);
+            ++it;
+        }
+    }
+    QList<int> removed;
+    for (int id : ids) {
+        if (!found.contains(id)) removed.append(id);
+    }
+    mergeEntryChanges(removed, changed);
+}
+
+void VaultWidget::groupsChanged() {
+    refreshGroups();
+    if (QTreeWidgetItem* current = ui->groupsTree->currentItem()) {
+        if (ui->searchLineEdit->text().isEmpty()) {
+            onGroupSelected(current, 0);
+        }
+    }
+}
+
+void VaultWidget::commandFailed(const QString& text) {
+    QMessageBox::critical(this, tr("Error"), tr("Failed to apply \"%1\" to the vault.").arg(text));
+}
+
 void VaultWidget::onSearchTextChanged(const QString& text) {
     if (text.isEmpty()) {
         // Return to group view
@@ -266,16 +944,12 @@ void VaultWidget::onSearchTextChanged(const QString& text) {
     }
     
     ui->entriesTable->setRowCount(0);
-    m_currentEntries = DatabaseManager::instance().searchEntries(text);
+    m_currentEntries = m_database->searchEntries(text);
     
     for (const auto& entry : m_currentEntries) {
-        int row = ui->entriesTable->rowCount();
-        ui->entriesTable->insertRow(row);
-        
-        ui->entriesTable->setItem(row, 0, new QTableWidgetItem(entry.title));
-        ui->entriesTable->setItem(row, 1, new QTableWidgetItem(entry.username));
-        ui->entriesTable->setItem(row, 2, new QTableWidgetItem(entry.url));
+        insertEntryRow(entry);
     }
+    syncOtpEntries();
 }
 
 bool VaultWidget::eventFilter(QObject* watched, QEvent* event) {
@@ -284,10 +958,63 @@ bool VaultWidget::eventFilter(QObject* watched, QEvent* event) {
         event->type() == QEvent::KeyPress ||
         event->type() == QEvent::Wheel) {
         resetInactivityTimer();
+        m_integrityChecker->noteActivity();
+    }
+    if (watched == ui->groupsTree->viewport() && handleGroupsTreeDrag(event)) {
+        return true;
     }
     return QWidget::eventFilter(watched, event);
 }
 
+bool VaultWidget::handleGroupsTreeDrag(QEvent* event) {
+    switch (event->type()) {
+    case QEvent::DragEnter:
+    case QEvent::DragMove: {
+        auto* dragEvent = static_cast<QDragMoveEvent*>(event);
+        if (dragEvent->source() == ui->entriesTable && groupIdAt(dragEvent) != -1) {
+            dragEvent->acceptProposedAction();
+        } else if (event->type() == QEvent::DragEnter && dragEvent->source() == ui->entriesTable) {
+            // Keep receiving move events until the cursor reaches a group
+            dragEvent->accept();
+        } else {
+            dragEvent->ignore();
+        }
+        return true;
+    }
+    case QEvent::Drop: {
+        auto* dropEvent = static_cast<QDropEvent*>(event);
+        int groupId = groupIdAt(dropEvent);
+        if (dropEvent->source() != ui->entriesTable || groupId == -1) {
+            dropEvent->ignore();
+            return true;
+        }
+        
+        if (dropEvent->proposedAction() == Qt::CopyAction) {
+            copySelectedEntries(groupId);
+        } else {
+            moveSelectedEntries(groupId);
+        }
+        
+        // The table was already updated above, so report a copy to keep it from clearing the dragged rows
+        dropEvent->setDropAction(Qt::CopyAction);
+        dropEvent->accept();
+        return true;
+    }
+    default:
+        return false;
+    }
+}
+
+int VaultWidget::groupIdAt(const QDropEvent* event) const {
+#if QT_VERSION >= QT_VERSION_CHECK(6, 0, 0)
+    QPoint pos = event->position().toPoint();
+#else
+    QPoint pos = event->pos();
+#endif
+    QTreeWidgetItem* item = ui->groupsTree->itemAt(pos);
+    return item ? m_groupMap.value(item, -1) : -1;
+}
+
 void VaultWidget::resetInactivityTimer() {
     if (m_inactivityTimer) {
         m_inactivityTimer->start(); // Resets the 15s countdown
@@ -298,13 +1025,37 @@ void VaultWidget::showEntriesContextMenu(const QPoint& pos) {
     QTableWidgetItem* item = ui->entriesTable->itemAt(pos);
     if (!item) return;
 
-    ui->entriesTable->setCurrentItem(item); // Ensure the right-clicked row is selected
+    // Right-clicking outside the selection selects the clicked row, otherwise the selection is kept
+    if (!ui->entriesTable->selectionModel()->isRowSelected(item->row(), QModelIndex())) {
+        ui->entriesTable->setCurrentItem(item);
+    }
+    bool single = selectedRows().size() == 1;
     
     QMenu menu(this);
-    menu.addAction(tr("Copy Password"), this, &VaultWidget::onCopyPassword);
+    menu.addAction(tr("Copy Password"), this, &VaultWidget::onCopyPassword)->setEnabled(single);
+    menu.addAction(tr("Copy OTP"), this, &VaultWidget::onCopyOtp)
+        ->setEnabled(single && m_totpCache->hasOtp(m_currentEntries.at(item->row()).id));
     menu.addSeparator();
-    menu.addAction(tr("Edit Entry"), this, &VaultWidget::onEditEntry);
-    menu.addAction(tr("Delete Entry"), this, &VaultWidget::onDeleteEntry);
+    menu.addAction(tr("Edit Entry"), this, &VaultWidget::onEditEntry)->setEnabled(single);
+    menu.addAction(tr("Duplicate"), this, &VaultWidget::onDuplicateEntries);
+    menu.addAction(tr("Attachments..."), this, &VaultWidget::onEntryAttachments)->setEnabled(single);
+    menu.addAction(tr("History..."), this, &VaultWidget::onEntryHistory)->setEnabled(single);
+    
+    QMenu* moveMenu = menu.addMenu(tr("Move to Group"));
+    for (QTreeWidgetItemIterator it(ui->groupsTree); *it; ++it) {
+        int groupId = m_groupMap.value(*it, -1);
+        int depth = 0;
+        for (QTreeWidgetItem* parent = (*it)->parent(); parent; parent = parent->parent()) {
+            ++depth;
+        }
+        QString label = QString(depth * 4, ' ') + (*it)->data(0, Qt::UserRole).toString();
+        moveMenu->addAction(label, this, [this, groupId]() { moveSelectedEntries(groupId); });
+    }
+    
+    if (m_database->isInRecycleBin(m_currentEntries.at(item->row()).groupId)) {
+        menu.addAction(tr("Restore"), this, &VaultWidget::onRestoreEntries);
+    }
+    menu.addAction(single ? tr("Delete Entry") : tr("Delete Entries"), this, &VaultWidget::onDeleteEntry);
 
     menu.exec(ui->entriesTable->viewport()->mapToGlobal(pos));
 }
@@ -313,9 +1064,56 @@ void VaultWidget::onCopyPassword() {
     int row = ui->entriesTable->currentRow();
     if (row < 0 || row >= m_currentEntries.size()) return;
 
-    const auto& entry = m_currentEntries.at(row);
-    m_lastCopiedPassword = entry.password;
+    copySecret(m_currentEntries.at(row).password);
+    noteEntryUse(m_currentEntries.at(row).id);
+}
+
+void VaultWidget::onQuickAccess() {
+    if (m_quickIndexStale) {
+        m_quickIndex.setItems(m_database->getEntryUsage());
+        m_quickIndexStale = false;
+    }
+    
+    CommandPalette palette(m_quickIndex, this);
+    palette.move(mapToGlobal(QPoint((width() - palette.width()) / 2, height() / 6)));
+    if (palette.exec() != QDialog::Accepted) return;
+    
+    // Only titles are held in the index; the password is read when it is needed
+    QList<DatabaseManager::Entry> chosen = m_database->getEntriesByIds({palette.selectedEntryId()});
+    if (chosen.isEmpty()) return;
+    copySecret(chosen.first().password);
+    noteEntryUse(chosen.first().id);
+}
+
+void VaultWidget::noteEntryUse(int entryId) {
+    const qint64 now = QDateTime::currentSecsSinceEpoch();
+    if (m_database->recordEntryUse(entryId, now)) {
+        m_quickIndex.noteUse(entryId, now);
+    }
+}
+
+void VaultWidget::onCopyOtp() {
+    int row = ui->entriesTable->currentRow();
+    if (row < 0 || row >= m_currentEntries.size()) return;
+
+    DatabaseManager::Entry entry = m_currentEntries.at(row);
+    QString code = m_totpCache->code(entry.id);
+    if (code.isEmpty()) return;
+    copySecret(code);
 
+    // A HOTP code is spent once it is used, so the stored counter moves on. That is not an
+    // edit: it adds no history version, and undo leaves it alone (see EditEntryCommand).
+    if (Totp::parse(entry.otp).type == Totp::Type::Hotp) {
+        const QString otp = m_database->advanceHotpCounter(entry.id);
+        if (!otp.isEmpty()) {
+            entry.otp = otp;
+            updateEntryRow(row, entry);
+        }
+    }
+}
+
+void VaultWidget::copySecret(const QString& text) {
+    m_lastCopiedPassword = text;
     QApplication::clipboard()->setText(m_lastCopiedPassword);
 
     // Start 10s timer (10000ms)
@@ -351,15 +1149,80 @@ void VaultWidget::clearClipboard() {
 }
 
 void VaultWidget::loadEntries(int groupId) {
+    Trace::Span span("VaultWidget::loadEntries");
     ui->entriesTable->setRowCount(0);
-    m_currentEntries = DatabaseManager::instance().getEntries(groupId);
+    m_currentEntries = m_database->getEntries(groupId);
     
     for (const auto& entry : m_currentEntries) {
-        int row = ui->entriesTable->rowCount();
-        ui->entriesTable->insertRow(row);
+        insertEntryRow(entry);
+    }
+    syncOtpEntries();
+}
+
+void VaultWidget::insertEntryRow(const DatabaseManager::Entry& entry) {
+    int row = ui->entriesTable->rowCount();
+    ui->entriesTable->insertRow(row);
+    
+    ui->entriesTable->setItem(row, 0, new QTableWidgetItem(entry.title));
+    ui->entriesTable->setItem(row, 1, new QTableWidgetItem(entry.username));
+    ui->entriesTable->setItem(row, 2, new QTableWidgetItem(entry.url));
+    ui->entriesTable->setItem(row, 3, new QTableWidgetItem());
+}
+
+void VaultWidget::updateEntryRow(int row, const DatabaseManager::Entry& entry) {
+    m_currentEntries[row] = entry;
+    ui->entriesTable->item(row, 0)->setText(entry.title);
+    ui->entriesTable->item(row, 1)->setText(entry.username);
+    ui->entriesTable->item(row, 2)->setText(entry.url);
+    syncOtpEntries();
+}
+
+void VaultWidget::removeEntryRows(const QList<int>& rows) {
+    // Walk backwards so the remaining row numbers stay valid
+    for (auto it = rows.crbegin(); it != rows.crend(); ++it) {
+        ui->entriesTable->removeRow(*it);
+        m_currentEntries.removeAt(*it);
+    }
+    syncOtpEntries();
+}
+
+void VaultWidget::syncOtpEntries() {
+    QHash<int, QString> otpByEntry;
+    for (const auto& entry : m_currentEntries) {
+        if (!entry.otp.isEmpty()) {
+            otpByEntry.insert(entry.id, entry.otp);
+        }
+    }
+    m_totpCache->setEntries(otpByEntry);
+    updateOtpColumn();
+}
+
+void VaultWidget::updateOtpColumn() {
+    // Only rows in the viewport are redrawn; the rest pick their code up when scrolled in
+    QTableWidget* table = ui->entriesTable;
+    int first = table->rowAt(0);
+    int last = table->rowAt(table->viewport()->height() - 1);
+    if (first < 0) first = 0;
+    if (last < 0) last = table->rowCount() - 1;
+    
+    for (int row = first; row <= last && row < m_currentEntries.size(); ++row) {
+        QTableWidgetItem* item = table->item(row, 3);
+        if (!item) continue;
         
-        ui->entriesTable->setItem(row, 0, new QTableWidgetItem(entry.title));
-        ui->entriesTable->setItem(row, 1, new QTableWidgetItem(entry.username));
-        ui->entriesTable->setItem(row, 2, new QTableWidgetItem(entry.url));
+        const int entryId = m_currentEntries.at(row).id;
+        QString text;
+        if (m_totpCache->hasOtp(entryId)) {
+            QString code = m_totpCache->code(entryId);
+            if (code.isEmpty()) {
+                text = tr("invalid");
+            } else {
+                code.insert(code.size() / 2, ' ');
+                int seconds = m_totpCache->secondsRemaining(entryId);
+                text = seconds > 0 ? tr("%1  (%2s)").arg(code).arg(seconds) : code;
+            }
+        }
+        if (item->text() != text) {
+            item->setText(text);
+        }
     }
 }
\ No newline at end of file
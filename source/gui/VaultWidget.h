@@ -5,24 +5,51 @@
 #include <QTreeWidgetItem>
 #include <QTimer>
 #include <QEvent>
+#include <QDropEvent>
+#include <QPointer>
 #include "../database/DatabaseManager.h"
+#include "../database/BackupManager.h"
+#include "../database/IntegrityChecker.h"
+#include "../database/VaultMonitor.h"
+#include "../database/RecycleBin.h"
+#include "../utils/TotpCache.h"
+#include "../utils/FrecencyIndex.h"
+#include "VaultCommands.h"
+#include "VaultViewState.h"
+
+#include <optional>
 
 namespace Ui {
 class VaultWidget;
 }
 
-class VaultWidget : public QWidget {
+class MaintenanceWorker;
+class QThread;
+class QUndoStack;
+
+class VaultWidget : public QWidget, public VaultView {
     Q_OBJECT
 
 public:
-    explicit VaultWidget(QWidget *parent = nullptr);
+    // Takes ownership of an open vault
+    explicit VaultWidget(DatabaseManager* database, QWidget *parent = nullptr);
     ~VaultWidget();
 
+    DatabaseManager* database() const;
+    // Selects the group and then the entry, e.g. for a global search hit
+    void showEntry(int groupId, int entryId);
+    // Taken when the vault locks; restoring is staged like the first load
+    VaultViewState viewState() const;
+    void restoreViewState(const VaultViewState& state);
+
     bool eventFilter(QObject* watched, QEvent* event) override;
 
 signals:
     void lockRequested();
 
+public slots:
+    void onLockDatabase();
+
 private slots:
     void onGroupSelected(QTreeWidgetItem* item, int column);
     void showGroupsContextMenu(const QPoint& pos);
@@ -32,26 +59,92 @@ private slots:
     void onAddEntry();
     void onEditEntry();
     void onDeleteEntry();
-    void onLockDatabase();
+    void onRestoreEntries();
+    void onDuplicateEntries();
+    void onEntryAttachments();
+    void onEntryHistory();
+    void onChangeMasterPassword();
+    void onBackupNow();
+    void onBackupSettings();
+    void onBackupFinished(bool success, const QString& path, double megabytesPerSecond);
+    void onMergeFrom();
+    void onCheckIntegrity();
+    void onIntegrityFinished(bool ok, const QStringList& problems);
+    void onQueryStats();
+    void runMaintenance();
+    void onEmptyRecycleBin();
+    void onExternalChange(const VaultMonitor::Changes& changes);
     void onSearchTextChanged(const QString& text);
     void showEntriesContextMenu(const QPoint& pos);
     void onCopyPassword();
+    void onCopyOtp();
+    void onQuickAccess();
+    void updateOtpColumn();
     void updateClipboardProgress();
     void clearClipboard();
 
+protected:
+    void entriesChanged(const QList<int>& ids) override;
+    void groupsChanged() override;
+    void commandFailed(const QString& text) override;
+
 private:
     void refreshGroups();
+    void finishLoading();
+    void applyPendingViewState();
+    void warmCaches();
+    void invalidateQuickIndex();
     void loadGroupTree(int parentId, QTreeWidgetItem* parentItem);
+    void updateGroupCounts();
+    QString groupPath(QTreeWidgetItem* item) const;
     void loadEntries(int groupId);
+    void insertEntryRow(const DatabaseManager::Entry& entry);
+    void updateEntryRow(int row, const DatabaseManager::Entry& entry);
+    void removeEntryRows(const QList<int>& rows);
+    void mergeEntryChanges(const QList<int>& removedIds, const QList<DatabaseManager::Entry>& changed);
+    void syncOtpEntries();
+    void copySecret(const QString& text);
+    void noteEntryUse(int entryId);
+    QList<int> selectedRows() const;
+    void moveSelectedEntries(int groupId);
+    void copySelectedEntries(int groupId);
+    bool handleGroupsTreeDrag(QEvent* event);
+    int groupIdAt(const QDropEvent* event) const;
     void resetInactivityTimer();
+    bool startMaintenance(const RecycleBin::Policy& recycleBin);
+    // Runs the purge now, or after the maintenance run in progress
+    void requestPurge();
 
     Ui::VaultWidget *ui;
+    DatabaseManager* m_database = nullptr;
     QMap<QTreeWidgetItem*, int> m_groupMap;
     QList<DatabaseManager::Entry> m_currentEntries;
+    // What is left to restore once the entries are loaded
+    std::optional<VaultViewState> m_pendingViewState;
     
     QTimer* m_clipboardTimer = nullptr;
     int m_clipboardTimerValue = 0;
     QString m_lastCopiedPassword;
 
+    TotpCache* m_totpCache = nullptr;
+
+    // Rebuilt on the next Ctrl+K after the vault changed
+    FrecencyIndex m_quickIndex;
+    bool m_quickIndexStale = true;
+    // Bumped with every change, so an index warmed in the background is not installed stale
+    int m_quickIndexGeneration = 0;
+
+    // Edits made here; cleared when something outside the stack rewrites the vault
+    QUndoStack* m_undoStack = nullptr;
+
     QTimer* m_inactivityTimer = nullptr;
+    QTimer* m_groupCountsTimer = nullptr;
+
+    BackupManager* m_backupManager = nullptr;
+    IntegrityChecker* m_integrityChecker = nullptr;
+    VaultMonitor* m_vaultMonitor = nullptr;
+
+    QPointer<QThread> m_maintenanceThread;
+    QPointer<MaintenanceWorker> m_maintenanceWorker;
+    bool m_purgePending = false;
 };
\ No newline at end of file
@@ -1,8 +1,10 @@
 #include "WelcomeWidget.h"
 #include "ui_WelcomeWidget.h"
+#include "../utils/Trace.h"
 
 WelcomeWidget::WelcomeWidget(QWidget *parent)
     : QWidget(parent), ui(new Ui::WelcomeWidget) {
+    Trace::Span span("WelcomeWidget::WelcomeWidget");
     ui->setupUi(this);
 
     // Correct IDs from WelcomeWidget.ui
@@ -1,10 +1,14 @@
 #include <QApplication>
 #include <QFile>
 #include <QStyleFactory>
+#include <QTimer>
 
 #include "./gui/MainWindow.h"
+#include "./utils/Trace.h"
 
 void setDarkTheme(QApplication& app) {
+    Trace::Span span("setDarkTheme");
+
     // Set the application style to a dark palette
     app.setStyle(QStyleFactory::create("Fusion"));
     
@@ -45,8 +49,14 @@ void setDarkTheme(QApplication& app) {
 }
 
 int main(int argc, char *argv[]) {
+    // Startup tracing, enabled with KEEBOX_TRACE=<file.json>
+    Trace::initialize();
+    const qint64 startupBegin = Trace::now();
+
     // Create Qt application instance
+    qint64 phaseBegin = Trace::now();
     QApplication app(argc, argv);
+    Trace::complete("QApplication", phaseBegin);
     
     // Set application information
     app.setApplicationName("KeeBox");
@@ -57,9 +67,22 @@ int main(int argc, char *argv[]) {
     setDarkTheme(app);
     
     // Create and show main window
+    phaseBegin = Trace::now();
     MainWindow window;
+    Trace::complete("MainWindow", phaseBegin);
+
+    phaseBegin = Trace::now();
     window.show();
+    Trace::complete("MainWindow::show", phaseBegin);
+
+    // Startup ends once the event loop gets to run
+    QTimer::singleShot(0, &app, [startupBegin]() {
+        Trace::complete("startup", startupBegin);
+        Trace::flush();
+    });
     
     // Start Qt event loop
-    return app.exec();
+    int result = app.exec();
+    Trace::flush();
+    return result;
 }
@@ -0,0 +1,644 @@
+#include "SecretServiceProvider.h"
+#include "SecretSession.h"
+#include "../database/CipherKey.h"
+#include "../database/DatabaseManager.h"
+
+#include <QDBusMetaType>
+#include <QDBusServiceWatcher>
+#include <QDBusVariant>
+#include <QDebug>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <algorithm>
+
+namespace {
+
+const char* const ServiceInterface = "org.freedesktop.Secret.Service";
+const char* const CollectionInterface = "org.freedesktop.Secret.Collection";
+const char* const ItemInterface = "org.freedesktop.Secret.Item";
+const char* const SessionInterface = "org.freedesktop.Secret.Session";
+const char* const PropertiesInterface = "org.freedesktop.DBus.Properties";
+
+const char* const NoSessionError = "org.freedesktop.Secret.Error.NoSession";
+const char* const NoSuchObjectError = "org.freedesktop.Secret.Error.NoSuchObject";
+const char* const NotSupportedError = "org.freedesktop.DBus.Error.NotSupported";
+const char* const InvalidArgsError = "org.freedesktop.DBus.Error.InvalidArgs";
+const char* const UnknownMethodError = "org.freedesktop.DBus.Error.UnknownMethod";
+const char* const FailedError = "org.freedesktop.DBus.Error.Failed";
+
+const char* const ContentType = "text/plain";
+const char* const NoPrompt = "/";
+
+const char* const ServiceIntrospection =
+    "<interface name=\"org.freedesktop.Secret.Service\">"
+    "<method name=\"OpenSession\"><arg name=\"algorithm\" type=\"s\" direction=\"in\"/><arg name=\"input\" type=\"v\" direction=\"in\"/>"
+    "<arg name=\"output\" type=\"v\" direction=\"out\"/><arg name=\"result\" type=\"o\" direction=\"out\"/></method>"
+    "<method name=\"SearchItems\"><arg name=\"attributes\" type=\"a{ss}\" direction=\"in\"/>"
+    "<arg name=\"unlocked\" type=\"ao\" direction=\"out\"/><arg name=\"locked\" type=\"ao\" direction=\"out\"/></method>"
+    "<method name=\"Unlock\"><arg name=\"objects\" type=\"ao\" direction=\"in\"/>"
+    "<arg name=\"unlocked\" type=\"ao\" direction=\"out\"/><arg name=\"prompt\" type=\"o\" direction=\"out\"/></method>"
+    "<method name=\"Lock\"><arg name=\"objects\" type=\"ao\" direction=\"in\"/>"
+    "<arg name=\"locked\" type=\"ao\" direction=\"out\"/><arg name=\"Prompt\" type=\"o\" direction=\"out\"/></method>"
+    "<method name=\"GetSecrets\"><arg name=\"items\" type=\"ao\" direction=\"in\"/><arg name=\"session\" type=\"o\" direction=\"in\"/>"
+    "<arg name=\"secrets\" type=\"a{o(oayays)}\" direction=\"out\"/></method>"
+    "<method name=\"ReadAlias\"><arg name=\"name\" type=\"s\" direction=\"in\"/><arg name=\"collection\" type=\"o\" direction=\"out\"/></method>"
+    "<property name=\"Collections\" type=\"ao\" access=\"read\"/>"
+    "</interface>";
+
+const char* const CollectionIntrospection =
+    "<interface name=\"org.freedesktop.Secret.Collection\">"
+    "<method name=\"SearchItems\"><arg name=\"attributes\" type=\"a{ss}\" direction=\"in\"/>"
+    "<arg name=\"results\" type=\"ao\" direction=\"out\"/></method>"
+    "<method name=\"CreateItem\"><arg name=\"properties\" type=\"a{sv}\" direction=\"in\"/>"
+    "<arg name=\"secret\" type=\"(oayays)\" direction=\"in\"/><arg name=\"replace\" type=\"b\" direction=\"in\"/>"
+    "<arg name=\"item\" type=\"o\" direction=\"out\"/><arg name=\"prompt\" type=\"o\" direction=\"out\"/></method>"
+    "<signal name=\"ItemCreated\"><arg name=\"item\" type=\"o\"/></signal>"
+    "<signal name=\"ItemDeleted\"><arg name=\"item\" type=\"o\"/></signal>"
+    "<signal name=\"ItemChanged\"><arg name=\"item\" type=\"o\"/></signal>"
+    "<property name=\"Items\" type=\"ao\" access=\"read\"/>"
+    "<property name=\"Label\" type=\"s\" access=\"read\"/>"
+    "<property name=\"Locked\" type=\"b\" access=\"read\"/>"
+    "<property name=\"Created\" type=\"t\" access=\"read\"/>"
+    "<property name=\"Modified\" type=\"t\" access=\"read\"/>"
+    "</interface>";
+
+const char* const ItemIntrospection =
+    "<interface name=\"org.freedesktop.Secret.Item\">"
+    "<method name=\"Delete\"><arg name=\"Prompt\" type=\"o\" direction=\"out\"/></method>"
+    "<method name=\"GetSecret\"><arg name=\"session\" type=\"o\" direction=\"in\"/>"
+    "<arg name=\"secret\" type=\"(oayays)\" direction=\"out\"/></method>"
+    "<method name=\"SetSecret\"><arg name=\"secret\" type=\"(oayays)\" direction=\"in\"/></method>"
+    "<property name=\"Locked\" type=\"b\" access=\"read\"/>"
+    "<property name=\"Attributes\" type=\"a{ss}\" access=\"readwrite\"/>"
+    "<property name=\"Label\" type=\"s\" access=\"readwrite\"/>"
+    "<property name=\"Created\" type=\"t\" access=\"read\"/>"
+    "<property name=\"Modified\" type=\"t\" access=\"read\"/>"
+    "</interface>";
+
+const char* const SessionIntrospection =
+    "<interface name=\"org.freedesktop.Secret.Session\"><method name=\"Close\"/></interface>";
+
+const char* const PropertiesIntrospection =
+    "<interface name=\"org.freedesktop.DBus.Properties\">"
+    "<method name=\"Get\"><arg name=\"interface\" type=\"s\" direction=\"in\"/><arg name=\"name\" type=\"s\" direction=\"in\"/>"
+    "<arg name=\"value\" type=\"v\" direction=\"out\"/></method>"
+    "<method name=\"GetAll\"><arg name=\"interface\" type=\"s\" direction=\"in\"/>"
+    "<arg name=\"properties\" type=\"a{sv}\" direction=\"out\"/></method>"
+    "<method name=\"Set\"><arg name=\"interface\" type=\"s\" direction=\"in\"/><arg name=\"name\" type=\"s\" direction=\"in\"/>"
+    "<arg name=\"value\" type=\"v\" direction=\"in\"/></method>"
+    "</interface>";
+
+QDBusObjectPath noPrompt() {
+    return QDBusObjectPath(NoPrompt);
+}
+
+QString itemProperty(const char* name) {
+    return QString(ItemInterface) + "." + name;
+}
+
+}
+
+QDBusArgument& operator<<(QDBusArgument& argument, const SecretStruct& secret) {
+    argument.beginStructure();
+    argument << secret.session << secret.parameters << secret.value << secret.contentType;
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument& operator>>(const QDBusArgument& argument, SecretStruct& secret) {
+    argument.beginStructure();
+    argument >> secret.session >> secret.parameters >> secret.value >> secret.contentType;
+    argument.endStructure();
+    return argument;
+}
+
+const char* const SecretServiceProvider::ServiceName = "org.freedesktop.secrets";
+const char* const SecretServiceProvider::ServicePath = "/org/freedesktop/secrets";
+const char* const SecretServiceProvider::GroupName = "Secret Service";
+
+SecretServiceProvider::SecretServiceProvider(QObject* parent)
+    : QDBusVirtualObject(parent) {
+    qDBusRegisterMetaType<SecretStruct>();
+    qDBusRegisterMetaType<StringMap>();
+    qDBusRegisterMetaType<ObjectSecretMap>();
+}
+
+SecretServiceProvider::~SecretServiceProvider() {
+    if (m_registered) {
+        QDBusConnection bus = QDBusConnection::sessionBus();
+        bus.unregisterService(ServiceName);
+        bus.unregisterObject(ServicePath, QDBusConnection::UnregisterTree);
+    }
+}
+
+bool SecretServiceProvider::registerOnSessionBus() {
+    QDBusConnection bus = QDBusConnection::sessionBus();
+    if (!bus.isConnected()) {
+        qInfo() << "No session bus, Secret Service not provided";
+        return false;
+    }
+
+    if (!bus.registerVirtualObject(ServicePath, this, QDBusConnection::SubPath)) {
+        qWarning() << "Failed to register the Secret Service objects:" << bus.lastError().message();
+        return false;
+    }
+    // Another keyring (gnome-keyring, KWallet) may own the name already; it is not taken over
+    if (!bus.registerService(ServiceName)) {
+        qInfo() << "Secret Service is provided by another application:" << bus.lastError().message();
+        bus.unregisterObject(ServicePath, QDBusConnection::UnregisterTree);
+        return false;
+    }
+
+    m_clientWatcher = new QDBusServiceWatcher(this);
+    m_clientWatcher->setConnection(bus);
+    m_clientWatcher->setWatchMode(QDBusServiceWatcher::WatchForUnregistration);
+    connect(m_clientWatcher, &QDBusServiceWatcher::serviceUnregistered, this, &SecretServiceProvider::onClientGone);
+
+    m_registered = true;
+    qInfo() << "Providing the Secret Service on the session bus";
+    return true;
+}
+
+void SecretServiceProvider::addVault(DatabaseManager* database) {
+    // Object path elements only allow [A-Za-z0-9_]
+    QString base = QFileInfo(database->path()).completeBaseName();
+    base.replace(QRegularExpression("[^A-Za-z0-9_]"), "_");
+    if (base.isEmpty()) {
+        base = "vault";
+    }
+    QString id = base;
+    for (int n = 2; collectionFor(id); ++n) {
+        id = base + "_" + QString::number(n);
+    }
+
+    m_collections.append({database, id});
+    connect(database, &QObject::destroyed, this, [this]() {
+        m_collections.erase(std::remove_if(m_collections.begin(), m_collections.end(),
+                                           [](const Collection& collection) { return collection.database.isNull(); }),
+                            m_collections.end());
+    });
+}
+
+void SecretServiceProvider::onClientGone(const QString& service) {
+    for (auto it = m_sessions.begin(); it != m_sessions.end();) {
+        if (it.value()->owner() == service) {
+            it = m_sessions.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    m_clientWatcher->removeWatchedService(service);
+}
+
+QString SecretServiceProvider::collectionPath(const QString& id) {
+    return QString(ServicePath) + "/collection/" + id;
+}
+
+QString SecretServiceProvider::itemPath(const QString& collectionId, int entryId) {
+    return collectionPath(collectionId) + "/" + QString::number(entryId);
+}
+
+const SecretServiceProvider::Collection* SecretServiceProvider::collectionFor(const QString& id) const {
+    for (const Collection& collection : m_collections) {
+        if (collection.id == id && collection.database && collection.database->isOpen()) {
+            return &collection;
+        }
+    }
+    return nullptr;
+}
+
+int SecretServiceProvider::serviceGroup(DatabaseManager* database, bool create) {
+    // The first top-level group that is not the recycle bin, as restores fall back to
+    const int binId = database->recycleBinGroupId();
+    int rootId = -1;
+    for (const DatabaseManager::Group& root : database->getGroups(0)) {
+        if (root.id != binId) {
+            rootId = root.id;
+            break;
+        }
+    }
+    if (rootId < 0) return -1;
+
+    for (const DatabaseManager::Group& group : database->getGroups(rootId)) {
+        if (group.name == GroupName) return group.id;
+    }
+    return create ? database->createGroup(GroupName, rootId) : -1;
+}
+
+bool SecretServiceProvider::isServiceItem(DatabaseManager* database, int entryId) {
+    const int groupId = serviceGroup(database, false);
+    if (groupId < 0) return false;
+    const QList<DatabaseManager::Entry> entries = database->getEntriesByIds({entryId});
+    return !entries.isEmpty() && entries.first().groupId == groupId;
+}
+
+SecretServiceProvider::Target SecretServiceProvider::resolve(const QString& path) const {
+    Target target;
+    if (path == ServicePath) {
+        target.kind = Target::Service;
+        return target;
+    }
+
+    const QStringList parts = path.mid(QString(ServicePath).size() + 1).split('/');
+    if (parts.size() == 2 && parts.at(0) == "session") {
+        target.session = m_sessions.value(path);
+        if (target.session) {
+            target.kind = Target::Session;
+        }
+        return target;
+    }
+
+    // aliases/default is the same collection as ReadAlias("default")
+    QString collectionId;
+    if (parts.size() >= 2 && parts.at(0) == "collection") {
+        collectionId = parts.at(1);
+    } else if (parts.size() >= 2 && parts.at(0) == "aliases" && parts.at(1) == "default" && !m_collections.isEmpty()) {
+        collectionId = m_collections.first().id;
+    }
+    const Collection* collection = collectionFor(collectionId);
+    if (!collection) return target;
+
+    target.database = collection->database;
+    target.collectionId = collection->id;
+    if (parts.size() == 2) {
+        target.kind = Target::CollectionObject;
+    } else if (parts.size() == 3) {
+        bool ok = false;
+        target.entryId = parts.at(2).toInt(&ok);
+        if (ok && isServiceItem(target.database, target.entryId)) {
+            target.kind = Target::Item;
+        }
+    }
+    return target;
+}
+
+QString SecretServiceProvider::introspect(const QString& path) const {
+    const Target target = resolve(path);
+    QString xml;
+    switch (target.kind) {
+    case Target::Service:
+        xml = QString(ServiceIntrospection) + PropertiesIntrospection + "<node name=\"collection\"/>";
+        break;
+    case Target::CollectionObject: {
+        xml = QString(CollectionIntrospection) + PropertiesIntrospection;
+        const int groupId = serviceGroup(target.database, false);
+        if (groupId >= 0) {
+            for (const DatabaseManager::Entry& entry : target.database->getEntries(groupId)) {
+                xml += QString("<node name=\"%1\"/>").arg(entry.id);
+            }
+        }
+        break;
+    }
+    case Target::Item:
+        xml = QString(ItemIntrospection) + PropertiesIntrospection;
+        break;
+    case Target::Session:
+        xml = SessionIntrospection;
+        break;
+    case Target::None:
+        if (path == QString(ServicePath) + "/collection") {
+            for (const Collection& collection : m_collections) {
+                if (collection.database) {
+                    xml += QString("<node name=\"%1\"/>").arg(collection.id);
+                }
+            }
+        }
+        break;
+    }
+    return xml;
+}
+
+bool SecretServiceProvider::handleMessage(const QDBusMessage& message, const QDBusConnection& connection) {
+    if (message.type() != QDBusMessage::MethodCallMessage) return false;
+
+    const Target target = resolve(message.path());
+    QDBusMessage reply;
+    if (message.interface() == PropertiesInterface) {
+        if (target.kind == Target::None) return false;
+        reply = callProperties(target, message);
+    } else {
+        switch (target.kind) {
+        case Target::Service: reply = callService(message); break;
+        case Target::CollectionObject: reply = callCollection(target, message, connection); break;
+        case Target::Item: reply = callItem(target, message, connection); break;
+        case Target::Session: reply = callSession(target, message); break;
+        case Target::None: return false;
+        }
+    }
+
+    connection.send(reply);
+    return true;
+}
+
+QSharedPointer<SecretSession> SecretServiceProvider::sessionFor(const QDBusObjectPath& path, const QDBusMessage& message) const {
+    // A session only serves the client that opened it
+    QSharedPointer<SecretSession> session = m_sessions.value(path.path());
+    if (session && session->owner() != message.service()) {
+        return QSharedPointer<SecretSession>();
+    }
+    return session;
+}
+
+bool SecretServiceProvider::secretFor(DatabaseManager* database, int entryId, const SecretSession& session, SecretStruct* secret) const {
+    const QList<DatabaseManager::Entry> entries = database->getEntriesByIds({entryId});
+    if (entries.isEmpty()) return false;
+
+    QByteArray plain = entries.first().password.toUtf8();
+    secret->session = QDBusObjectPath(session.path());
+    secret->contentType = ContentType;
+    const bool ok = session.encrypt(plain, &secret->parameters, &secret->value);
+    CipherKey::wipe(plain);
+    return ok;
+}
+
+QList<QDBusObjectPath> SecretServiceProvider::searchItems(const Collection& collection, const StringMap& attributes) const {
+    QList<QDBusObjectPath> paths;
+    const int groupId = serviceGroup(collection.database, false);
+    if (groupId < 0) return paths;
+
+    for (int id : collection.database->findEntriesByAttributes(attributes, groupId)) {
+        paths.append(QDBusObjectPath(itemPath(collection.id, id)));
+    }
+    return paths;
+}
+
+QDBusMessage SecretServiceProvider::callService(const QDBusMessage& message) {
+    const QString member = message.member();
+    const QVariantList args = message.arguments();
+
+    if (member == "OpenSession" && message.signature() == "sv") {
+        const QString path = QString(ServicePath) + "/session/s" + QString::number(m_nextSession++);
+        QSharedPointer<SecretSession> session(new SecretSession(path, message.service()));
+        QVariant output;
+        if (!session->negotiate(args.at(0).toString(), args.at(1).value<QDBusVariant>().variant(), &output)) {
+            return message.createErrorReply(NotSupportedError, QString("Algorithm %1 is not supported").arg(args.at(0).toString()));
+        }
+        m_sessions.insert(path, session);
+        m_clientWatcher->addWatchedService(message.service());
+        return message.createReply(QVariantList{QVariant::fromValue(QDBusVariant(output)),
+                                                QVariant::fromValue(QDBusObjectPath(path))});
+    }
+
+    if (member == "SearchItems" && message.signature() == "a{ss}") {
+        const StringMap attributes = qdbus_cast<StringMap>(args.at(0));
+        QList<QDBusObjectPath> unlocked;
+        for (const Collection& collection : std::as_const(m_collections)) {
+            if (collection.database && collection.database->isOpen()) {
+                unlocked.append(searchItems(collection, attributes));
+            }
+        }
+        return message.createReply(QVariantList{QVariant::fromValue(unlocked),
+                                                QVariant::fromValue(QList<QDBusObjectPath>())});
+    }
+
+    // Every collection this service knows about is an unlocked vault; locking happens in KeeBox
+    if (member == "Unlock" && message.signature() == "ao") {
+        return message.createReply(QVariantList{QVariant::fromValue(qdbus_cast<QList<QDBusObjectPath>>(args.at(0))),
+                                                QVariant::fromValue(noPrompt())});
+    }
+    if (member == "Lock" && message.signature() == "ao") {
+        return message.createReply(QVariantList{QVariant::fromValue(QList<QDBusObjectPath>()),
+                                                QVariant::fromValue(noPrompt())});
+    }
+
+    if (member == "GetSecrets" && message.signature() == "aoo") {
+        QSharedPointer<SecretSession> session = sessionFor(qdbus_cast<QDBusObjectPath>(args.at(1)), message);
+        if (!session) {
+            return message.createErrorReply(NoSessionError, "No such session");
+        }
+
+        ObjectSecretMap secrets;
+        for (const QDBusObjectPath& item : qdbus_cast<QList<QDBusObjectPath>>(args.at(0))) {
+            const Target target = resolve(item.path());
+            SecretStruct secret;
+            if (target.kind == Target::Item && secretFor(target.database, target.entryId, *session, &secret)) {
+                secrets.insert(item, secret);
+            }
+        }
+        return message.createReply(QVariant::fromValue(secrets));
+    }
+
+    if (member == "ReadAlias" && message.signature() == "s") {
+        QDBusObjectPath path(NoPrompt);
+        if (args.at(0).toString() == "default") {
+            for (const Collection& collection : std::as_const(m_collections)) {
+                if (collection.database && collection.database->isOpen()) {
+                    path = QDBusObjectPath(collectionPath(collection.id));
+                    break;
+                }
+            }
+        }
+        return message.createReply(QVariant::fromValue(path));
+    }
+
+    if (member == "CreateCollection" || member == "SetAlias") {
+        return message.createErrorReply(NotSupportedError, "Collections are KeeBox vaults and are managed in KeeBox");
+    }
+    return message.createErrorReply(UnknownMethodError, QString("No method %1(%2)").arg(member, message.signature()));
+}
+
+QDBusMessage SecretServiceProvider::callCollection(const Target& target, const QDBusMessage& message, const QDBusConnection& connection) {
+    const QString member = message.member();
+    const QVariantList args = message.arguments();
+
+    if (member == "SearchItems" && message.signature() == "a{ss}") {
+        return message.createReply(QVariant::fromValue(searchItems(*collectionFor(target.collectionId),
+                                                                   qdbus_cast<StringMap>(args.at(0)))));
+    }
+
+    if (member == "CreateItem" && message.signature() == "a{sv}(oayays)b") {
+        const QVariantMap itemProperties = qdbus_cast<QVariantMap>(args.at(0));
+        const SecretStruct secret = qdbus_cast<SecretStruct>(args.at(1));
+        const bool replace = args.at(2).toBool();
+
+        QSharedPointer<SecretSession> session = sessionFor(secret.session, message);
+        if (!session) {
+            return message.createErrorReply(NoSessionError, "No such session");
+        }
+        QByteArray plain;
+        if (!session->decrypt(secret.parameters, secret.value, &plain)) {
+            return message.createErrorReply(InvalidArgsError, "The secret could not be decrypted");
+        }
+
+        const StringMap attributes = qdbus_cast<StringMap>(itemProperties.value(itemProperty("Attributes")));
+        const int groupId = serviceGroup(target.database, true);
+        if (groupId < 0) {
+            CipherKey::wipe(plain);
+            return message.createErrorReply(FailedError, "The vault has no root group");
+        }
+
+        // With replace, an item with exactly these attributes is overwritten in place. The lookup
+        // matches supersets, and without attributes it would match every item, so neither counts.
+        int existing = -1;
+        if (replace && !attributes.isEmpty()) {
+            for (int id : target.database->findEntriesByAttributes(attributes, groupId)) {
+                if (target.database->getEntryAttributes(id) == attributes) {
+                    existing = id;
+                    break;
+                }
+            }
+        }
+        QList<DatabaseManager::Entry> current = existing < 0 ? QList<DatabaseManager::Entry>()
+                                                             : target.database->getEntriesByIds({existing});
+        const bool created = current.isEmpty();
+
+        DatabaseManager::Entry entry = created ? DatabaseManager::Entry{-1, groupId, {}, {}, {}, {}, {}, {}} : current.first();
+        entry.title = itemProperties.value(itemProperty("Label")).toString();
+        entry.username = attributes.value("username", attributes.value("user"));
+        entry.password = QString::fromUtf8(plain);
+        CipherKey::wipe(plain);
+
+        // The entry and its attributes go in together, so a failure leaves no item without them
+        entry.id = target.database->saveEntryWithAttributes(entry, attributes);
+        if (entry.id < 0) {
+            return message.createErrorReply(FailedError, "The item could not be stored");
+        }
+
+        const QString path = itemPath(target.collectionId, entry.id);
+        QDBusMessage signal = QDBusMessage::createSignal(collectionPath(target.collectionId), CollectionInterface,
+                                                         created ? "ItemCreated" : "ItemChanged");
+        signal << QVariant::fromValue(QDBusObjectPath(path));
+        connection.send(signal);
+
+        return message.createReply(QVariantList{QVariant::fromValue(QDBusObjectPath(path)),
+                                                QVariant::fromValue(noPrompt())});
+    }
+
+    if (member == "Delete") {
+        return message.createErrorReply(NotSupportedError, "Collections are KeeBox vaults and are managed in KeeBox");
+    }
+    return message.createErrorReply(UnknownMethodError, QString("No method %1(%2)").arg(member, message.signature()));
+}
+
+QDBusMessage SecretServiceProvider::callItem(const Target& target, const QDBusMessage& message, const QDBusConnection& connection) {
+    const QString member = message.member();
+    const QVariantList args = message.arguments();
+
+    if (member == "GetSecret" && message.signature() == "o") {
+        QSharedPointer<SecretSession> session = sessionFor(qdbus_cast<QDBusObjectPath>(args.at(0)), message);
+        if (!session) {
+            return message.createErrorReply(NoSessionError, "No such session");
+        }
+        SecretStruct secret;
+        if (!secretFor(target.database, target.entryId, *session, &secret)) {
+            return message.createErrorReply(NoSuchObjectError, "No such item");
+        }
+        return message.createReply(QVariant::fromValue(secret));
+    }
+
+    if (member == "SetSecret" && message.signature() == "(oayays)") {
+        const SecretStruct secret = qdbus_cast<SecretStruct>(args.at(0));
+        QSharedPointer<SecretSession> session = sessionFor(secret.session, message);
+        if (!session) {
+            return message.createErrorReply(NoSessionError, "No such session");
+        }
+        QByteArray plain;
+        if (!session->decrypt(secret.parameters, secret.value, &plain)) {
+            return message.createErrorReply(InvalidArgsError, "The secret could not be decrypted");
+        }
+
+        QList<DatabaseManager::Entry> entries = target.database->getEntriesByIds({target.entryId});
+        bool stored = false;
+        if (!entries.isEmpty()) {
+            entries.first().password = QString::fromUtf8(plain);
+            stored = target.database->updateEntry(entries.first());
+        }
+        CipherKey::wipe(plain);
+        if (!stored) {
+            return message.createErrorReply(FailedError, "The secret could not be stored");
+        }
+        return message.createReply();
+    }
+
+    if (member == "Delete" && message.signature().isEmpty()) {
+        if (!target.database->deleteEntry(target.entryId)) {
+            return message.createErrorReply(FailedError, "The item could not be deleted");
+        }
+        QDBusMessage signal = QDBusMessage::createSignal(collectionPath(target.collectionId), CollectionInterface, "ItemDeleted");
+        signal << QVariant::fromValue(QDBusObjectPath(message.path()));
+        connection.send(signal);
+        return message.createReply(QVariant::fromValue(noPrompt()));
+    }
+
+    return message.createErrorReply(UnknownMethodError, QString("No method %1(%2)").arg(member, message.signature()));
+}
+
+QDBusMessage SecretServiceProvider::callSession(const Target& target, const QDBusMessage& message) {
+    if (message.member() == "Close") {
+        if (target.session->owner() == message.service()) {
+            m_sessions.remove(target.session->path());
+        }
+        return message.createReply();
+    }
+    return message.createErrorReply(UnknownMethodError, QString("No method %1").arg(message.member()));
+}
+
+QVariantMap SecretServiceProvider::properties(const Target& target, const QString& interface) const {
+    QVariantMap values;
+    if (target.kind == Target::Service && interface == ServiceInterface) {
+        QList<QDBusObjectPath> collections;
+        for (const Collection& collection : m_collections) {
+            if (collection.database && collection.database->isOpen()) {
+                collections.append(QDBusObjectPath(collectionPath(collection.id)));
+            }
+        }
+        values["Collections"] = QVariant::fromValue(collections);
+    } else if (target.kind == Target::CollectionObject && interface == CollectionInterface) {
+        values["Items"] = QVariant::fromValue(searchItems(*collectionFor(target.collectionId), StringMap()));
+        values["Label"] = QFileInfo(target.database->path()).completeBaseName();
+        values["Locked"] = false;
+        values["Created"] = (quint64)QFileInfo(target.database->path()).birthTime().toSecsSinceEpoch();
+        values["Modified"] = (quint64)QFileInfo(target.database->path()).lastModified().toSecsSinceEpoch();
+    } else if (target.kind == Target::Item && interface == ItemInterface) {
+        const QList<DatabaseManager::Entry> entries = target.database->getEntriesByIds({target.entryId});
+        const QPair<qint64, qint64> times = target.database->entryTimes(target.entryId);
+        values["Locked"] = false;
+        values["Attributes"] = QVariant::fromValue(target.database->getEntryAttributes(target.entryId));
+        values["Label"] = entries.isEmpty() ? QString() : entries.first().title;
+        values["Created"] = (quint64)times.first;
+        values["Modified"] = (quint64)times.second;
+    }
+    return values;
+}
+
+QDBusMessage SecretServiceProvider::callProperties(const Target& target, const QDBusMessage& message) {
+    const QString member = message.member();
+    const QVariantList args = message.arguments();
+
+    if (member == "GetAll" && message.signature() == "s") {
+        return message.createReply(QVariant::fromValue(properties(target, args.at(0).toString())));
+    }
+
+    if (member == "Get" && message.signature() == "ss") {
+        const QVariantMap values = properties(target, args.at(0).toString());
+        if (!values.contains(args.at(1).toString())) {
+            return message.createErrorReply(InvalidArgsError, QString("No property %1").arg(args.at(1).toString()));
+        }
+        return message.createReply(QVariant::fromValue(QDBusVariant(values.value(args.at(1).toString()))));
+    }
+
+    if (member == "Set" && message.signature() == "ssv" && target.kind == Target::Item
+        && args.at(0).toString() == ItemInterface) {
+        const QString name = args.at(1).toString();
+        const QVariant value = args.at(2).value<QDBusVariant>().variant();
+        bool stored = false;
+        if (name == "Label") {
+            QList<DatabaseManager::Entry> entries = target.database->getEntriesByIds({target.entryId});
+            if (!entries.isEmpty()) {
+                entries.first().title = value.toString();
+                stored = target.database->updateEntry(entries.first());
+            }
+        } else if (name == "Attributes") {
+            stored = target.database->setEntryAttributes(target.entryId, qdbus_cast<StringMap>(value));
+        } else {
+            return message.createErrorReply(InvalidArgsError, QString("Property %1 is read-only").arg(name));
+        }
+        return stored ? message.createReply()
+                      : message.createErrorReply(FailedError, QString("Property %1 could not be stored").arg(name));
+    }
+
+    if (member == "Set") {
+        return message.createErrorReply(InvalidArgsError, "Property is read-only");
+    }
+    return message.createErrorReply(UnknownMethodError, QString("No method %1(%2)").arg(member, message.signature()));
+}
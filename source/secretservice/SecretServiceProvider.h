@@ -0,0 +1,99 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDBusArgument>
+#include <QDBusConnection>
+#include <QDBusObjectPath>
+#include <QDBusVirtualObject>
+#include <QHash>
+#include <QList>
+#include <QMap>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QString>
+#include <QVariantMap>
+
+class DatabaseManager;
+class QDBusServiceWatcher;
+class SecretSession;
+
+// The (oayays) struct secrets travel in: session, parameters, value, content type
+struct SecretStruct {
+    QDBusObjectPath session;
+    QByteArray parameters;
+    QByteArray value;
+    QString contentType;
+};
+
+typedef QMap<QString, QString> StringMap;
+typedef QMap<QDBusObjectPath, SecretStruct> ObjectSecretMap;
+
+QDBusArgument& operator<<(QDBusArgument& argument, const SecretStruct& secret);
+const QDBusArgument& operator>>(const QDBusArgument& argument, SecretStruct& secret);
+
+Q_DECLARE_METATYPE(SecretStruct)
+Q_DECLARE_METATYPE(StringMap)
+Q_DECLARE_METATYPE(ObjectSecretMap)
+
+// Implements the freedesktop Secret Service API (org.freedesktop.secrets) on top
+// of the unlocked vaults, one collection each. Only entries in a vault's
+// "Secret Service" group are visible over the bus; desktop apps never see the rest.
+// All objects below /org/freedesktop/secrets are served by this one virtual object.
+class SecretServiceProvider : public QDBusVirtualObject {
+    Q_OBJECT
+
+public:
+    static const char* const ServiceName;
+    static const char* const ServicePath;
+    static const char* const GroupName;
+
+    explicit SecretServiceProvider(QObject* parent = nullptr);
+    ~SecretServiceProvider() override;
+
+    // Claims the service name on the session bus given by DBUS_SESSION_BUS_ADDRESS
+    bool registerOnSessionBus();
+    void addVault(DatabaseManager* database);
+
+    QString introspect(const QString& path) const override;
+    bool handleMessage(const QDBusMessage& message, const QDBusConnection& connection) override;
+
+private:
+    struct Collection {
+        QPointer<DatabaseManager> database;
+        QString id;
+    };
+
+    struct Target {
+        enum Kind { None, Service, CollectionObject, Item, Session };
+        Kind kind = None;
+        DatabaseManager* database = nullptr;
+        QString collectionId;
+        int entryId = 0;
+        QSharedPointer<SecretSession> session;
+    };
+
+    Target resolve(const QString& path) const;
+    const Collection* collectionFor(const QString& id) const;
+    static QString collectionPath(const QString& id);
+    static QString itemPath(const QString& collectionId, int entryId);
+    static int serviceGroup(DatabaseManager* database, bool create);
+    static bool isServiceItem(DatabaseManager* database, int entryId);
+
+    QDBusMessage callService(const QDBusMessage& message);
+    QDBusMessage callCollection(const Target& target, const QDBusMessage& message, const QDBusConnection& connection);
+    QDBusMessage callItem(const Target& target, const QDBusMessage& message, const QDBusConnection& connection);
+    QDBusMessage callSession(const Target& target, const QDBusMessage& message);
+    QDBusMessage callProperties(const Target& target, const QDBusMessage& message);
+
+    QVariantMap properties(const Target& target, const QString& interface) const;
+    QList<QDBusObjectPath> searchItems(const Collection& collection, const StringMap& attributes) const;
+    QSharedPointer<SecretSession> sessionFor(const QDBusObjectPath& path, const QDBusMessage& message) const;
+    bool secretFor(DatabaseManager* database, int entryId, const SecretSession& session, SecretStruct* secret) const;
+    void onClientGone(const QString& service);
+
+    QList<Collection> m_collections;
+    QHash<QString, QSharedPointer<SecretSession>> m_sessions;
+    quint64 m_nextSession = 1;
+    QDBusServiceWatcher* m_clientWatcher = nullptr;
+    bool m_registered = false;
+};
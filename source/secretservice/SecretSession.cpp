@@ -0,0 +1,150 @@
+#include "SecretSession.h"
+#include "../database/CipherKey.h"
+
+#include <QDebug>
+#include <QMessageAuthenticationCode>
+#include <openssl/bn.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+namespace {
+
+const int PrimeBytes = 128;
+const int AesKeyBytes = 16;
+const int AesBlockBytes = 16;
+
+// HKDF-SHA256 with no salt and no info, as the specification asks for
+QByteArray hkdfSha256(const QByteArray& secret, int length) {
+    const QByteArray prk = QMessageAuthenticationCode::hash(secret, QByteArray(32, '\0'), QCryptographicHash::Sha256);
+    QByteArray okm;
+    QByteArray block;
+    for (char counter = 1; okm.size() < length; ++counter) {
+        block = QMessageAuthenticationCode::hash(block + counter, prk, QCryptographicHash::Sha256);
+        okm.append(block);
+    }
+    return okm.left(length);
+}
+
+bool aesCbc(bool encrypt, const QByteArray& key, const QByteArray& iv, const QByteArray& in, QByteArray* out) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    if (!ctx) return false;
+
+    QByteArray buffer(in.size() + AesBlockBytes, '\0');
+    int written = 0;
+    int finalWritten = 0;
+    bool ok = EVP_CipherInit_ex(ctx, EVP_aes_128_cbc(), nullptr,
+                                reinterpret_cast<const unsigned char*>(key.constData()),
+                                reinterpret_cast<const unsigned char*>(iv.constData()), encrypt ? 1 : 0) == 1
+        && EVP_CipherUpdate(ctx, reinterpret_cast<unsigned char*>(buffer.data()), &written,
+                            reinterpret_cast<const unsigned char*>(in.constData()), in.size()) == 1
+        && EVP_CipherFinal_ex(ctx, reinterpret_cast<unsigned char*>(buffer.data()) + written, &finalWritten) == 1;
+    EVP_CIPHER_CTX_free(ctx);
+
+    if (ok) {
+        buffer.resize(written + finalWritten);
+        *out = buffer;
+    }
+    CipherKey::wipe(buffer);
+    return ok;
+}
+
+}
+
+const char* const SecretSession::PlainAlgorithm = "plain";
+const char* const SecretSession::DhAlgorithm = "dh-ietf1024-sha256-aes128-cbc-pkcs7";
+
+SecretSession::SecretSession(const QString& path, const QString& owner)
+    : m_path(path), m_owner(owner) {
+}
+
+SecretSession::~SecretSession() {
+    CipherKey::wipe(m_key);
+}
+
+QString SecretSession::path() const {
+    return m_path;
+}
+
+QString SecretSession::owner() const {
+    return m_owner;
+}
+
+bool SecretSession::negotiate(const QString& algorithm, const QVariant& input, QVariant* output) {
+    if (algorithm == QLatin1String(PlainAlgorithm)) {
+        m_encrypted = false;
+        *output = QString();
+        return true;
+    }
+    if (algorithm != QLatin1String(DhAlgorithm)) {
+        return false;
+    }
+
+    const QByteArray clientPublic = input.toByteArray();
+    if (clientPublic.isEmpty() || clientPublic.size() > PrimeBytes) {
+        return false;
+    }
+
+    BN_CTX* ctx = BN_CTX_new();
+    BIGNUM* prime = BN_get_rfc2409_prime_1024(nullptr);
+    BIGNUM* generator = BN_new();
+    BIGNUM* privateKey = BN_new();
+    BIGNUM* publicKey = BN_new();
+    BIGNUM* peer = BN_bin2bn(reinterpret_cast<const unsigned char*>(clientPublic.constData()), clientPublic.size(), nullptr);
+    BIGNUM* shared = BN_new();
+    BIGNUM* upperBound = BN_new();
+
+    QByteArray ourPublic(PrimeBytes, '\0');
+    QByteArray sharedBytes(PrimeBytes, '\0');
+    bool ok = ctx && prime && generator && privateKey && publicKey && peer && shared && upperBound
+        && BN_set_word(generator, 2)
+        && BN_priv_rand(privateKey, PrimeBytes * 8 - 1, BN_RAND_TOP_ANY, BN_RAND_BOTTOM_ANY)
+        && BN_mod_exp(publicKey, generator, privateKey, prime, ctx)
+        // Reject 0, 1 and p-1, which would force a known shared secret
+        && BN_sub(upperBound, prime, BN_value_one())
+        && BN_cmp(peer, BN_value_one()) > 0 && BN_cmp(peer, upperBound) < 0
+        && BN_mod_exp(shared, peer, privateKey, prime, ctx)
+        && BN_bn2binpad(publicKey, reinterpret_cast<unsigned char*>(ourPublic.data()), PrimeBytes) == PrimeBytes
+        && BN_bn2binpad(shared, reinterpret_cast<unsigned char*>(sharedBytes.data()), PrimeBytes) == PrimeBytes;
+
+    BN_clear_free(privateKey);
+    BN_clear_free(shared);
+    BN_free(upperBound);
+    BN_free(peer);
+    BN_free(publicKey);
+    BN_free(generator);
+    BN_free(prime);
+    BN_CTX_free(ctx);
+
+    if (ok) {
+        m_key = hkdfSha256(sharedBytes, AesKeyBytes);
+        m_encrypted = true;
+        *output = ourPublic;
+    } else {
+        qWarning() << "Secret Service key exchange failed for" << m_owner;
+    }
+    CipherKey::wipe(sharedBytes);
+    return ok;
+}
+
+bool SecretSession::encrypt(const QByteArray& secret, QByteArray* parameters, QByteArray* value) const {
+    if (!m_encrypted) {
+        *parameters = QByteArray();
+        *value = secret;
+        return true;
+    }
+
+    QByteArray iv(AesBlockBytes, '\0');
+    if (RAND_bytes(reinterpret_cast<unsigned char*>(iv.data()), iv.size()) != 1) return false;
+    if (!aesCbc(true, m_key, iv, secret, value)) return false;
+    *parameters = iv;
+    return true;
+}
+
+bool SecretSession::decrypt(const QByteArray& parameters, const QByteArray& value, QByteArray* secret) const {
+    if (!m_encrypted) {
+        *secret = value;
+        return true;
+    }
+    if (parameters.size() != AesBlockBytes || value.isEmpty() || value.size() % AesBlockBytes != 0) return false;
+    return aesCbc(false, m_key, parameters, value, secret);
+}
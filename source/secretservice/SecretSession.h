@@ -0,0 +1,36 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+#include <QVariant>
+
+// One Secret Service session: how secrets are protected on their way over the bus.
+// "plain" sends them as they are; "dh-ietf1024-sha256-aes128-cbc-pkcs7" agrees on
+// an AES key with the client through Diffie-Hellman in the 1024-bit IETF group.
+class SecretSession {
+public:
+    static const char* const PlainAlgorithm;
+    static const char* const DhAlgorithm;
+
+    SecretSession(const QString& path, const QString& owner);
+    ~SecretSession();
+
+    // Runs the exchange for OpenSession; output is what goes back to the client
+    bool negotiate(const QString& algorithm, const QVariant& input, QVariant* output);
+
+    bool encrypt(const QByteArray& secret, QByteArray* parameters, QByteArray* value) const;
+    bool decrypt(const QByteArray& parameters, const QByteArray& value, QByteArray* secret) const;
+
+    QString path() const;
+    // Unique bus name of the client that opened the session
+    QString owner() const;
+
+private:
+    SecretSession(const SecretSession&) = delete;
+    SecretSession& operator=(const SecretSession&) = delete;
+
+    QString m_path;
+    QString m_owner;
+    bool m_encrypted = false;
+    QByteArray m_key;
+};
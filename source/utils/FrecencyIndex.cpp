@@ -0,0 +1,94 @@
+#include "FrecencyIndex.h"
+
+#include <QtMath>
+#include <algorithm>
+#include <cmath>
+
+void FrecencyIndex::setItems(const QList<Item>& items) {
+    m_slots.clear();
+    m_slots.reserve(items.size());
+    for (const Item& item : items) {
+        m_slots.append({item, item.title.toLower(), item.username.toLower()});
+    }
+}
+
+void FrecencyIndex::clear() {
+    m_slots.clear();
+}
+
+bool FrecencyIndex::isEmpty() const {
+    return m_slots.isEmpty();
+}
+
+void FrecencyIndex::noteUse(int id, qint64 now) {
+    for (Slot& slot : m_slots) {
+        if (slot.item.id == id) {
+            slot.item.useCount += 1;
+            slot.item.lastUsed = now;
+            return;
+        }
+    }
+}
+
+double FrecencyIndex::frecency(const Item& item, qint64 now) const {
+    if (item.useCount <= 0) return 0.0;
+    const double ageDays = qMax<qint64>(0, now - item.lastUsed) / 86400.0;
+    return item.useCount * qPow(0.5, ageDays / HalfLifeDays);
+}
+
+int FrecencyIndex::fuzzyScore(const QString& query, const QString& text) {
+    // Every query character must appear in order; runs, word starts and a prefix score higher
+    int score = 0;
+    int run = 0;
+    int pos = 0;
+    for (const QChar c : query) {
+        const int found = text.indexOf(c, pos);
+        if (found < 0) return 0;
+
+        const bool wordStart = found == 0 || !text.at(found - 1).isLetterOrNumber();
+        run = (found == pos && pos > 0) ? run + 1 : 0;
+        score += 1 + run * 4 + (wordStart ? 6 : 0) - qMin(found - pos, 4);
+        pos = found + 1;
+    }
+    if (text.startsWith(query)) score += 10;
+    if (text.size() == query.size()) score += 10;
+    return qMax(score, 1);
+}
+
+QList<FrecencyIndex::Item> FrecencyIndex::rank(const QString& query, int limit, qint64 now) const {
+    struct Candidate {
+        double score;
+        const Slot* slot;
+    };
+
+    const QString key = query.toLower().simplified();
+    QVector<Candidate> candidates;
+    candidates.reserve(key.isEmpty() ? 0 : m_slots.size());
+    for (const Slot& slot : m_slots) {
+        const double usage = frecency(slot.item, now);
+        if (key.isEmpty()) {
+            if (usage > 0.0) candidates.append({usage, &slot});
+            continue;
+        }
+
+        // A username hit counts for less than the same hit in the title
+        const double match = qMax(double(fuzzyScore(key, slot.titleKey)), fuzzyScore(key, slot.usernameKey) / 2.0);
+        if (match > 0) {
+            candidates.append({match + 8.0 * std::log2(1.0 + usage), &slot});
+        }
+    }
+
+    const int count = qMin(limit, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                      [](const Candidate& a, const Candidate& b) {
+        if (a.score != b.score) return a.score > b.score;
+        return a.slot->titleKey < b.slot->titleKey;
+    });
+
+    QList<Item> items;
+    items.reserve(count);
+    for (int i = 0; i < count; ++i) {
+        items.append(candidates.at(i).slot->item);
+    }
+    return items;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QVector>
+
+// Titles and ids of one vault's entries, fuzzy-matched and ranked by how
+// often and how recently each entry was used. Holds no secrets; matching
+// runs over lower-cased copies prepared up front, so a ranking pass per
+// keystroke stays within a few milliseconds for large vaults.
+class FrecencyIndex {
+public:
+    // Weight of one use halves every HalfLifeDays
+    static const int HalfLifeDays = 14;
+
+    struct Item {
+        int id = 0;
+        QString title;
+        QString username;
+        int useCount = 0;
+        // Seconds since the epoch, 0 if never used
+        qint64 lastUsed = 0;
+    };
+
+    void setItems(const QList<Item>& items);
+    void clear();
+    bool isEmpty() const;
+    void noteUse(int id, qint64 now);
+
+    // Best first. An empty query lists the most used entries.
+    QList<Item> rank(const QString& query, int limit, qint64 now) const;
+
+    // 0 when the query's characters do not all appear in order
+    static int fuzzyScore(const QString& query, const QString& text);
+
+private:
+    struct Slot {
+        Item item;
+        QString titleKey;
+        QString usernameKey;
+    };
+
+    double frecency(const Item& item, qint64 now) const;
+
+    QVector<Slot> m_slots;
+};
@@ -0,0 +1,307 @@
+#include "RoaringBitmap.h"
+
+#include <QtAlgorithms>
+#include <algorithm>
+
+namespace {
+
+const int BitmapWords = 65536 / 64;
+
+}
+
+bool RoaringBitmap::Container::contains(quint16 low) const {
+    if (isBitmap()) {
+        return bits.at(low >> 6) & (quint64(1) << (low & 63));
+    }
+    return std::binary_search(array.constBegin(), array.constEnd(), low);
+}
+
+void RoaringBitmap::toBitmap(Container& c) {
+    c.bits.fill(0, BitmapWords);
+    for (quint16 low : c.array) {
+        c.bits[low >> 6] |= quint64(1) << (low & 63);
+    }
+    c.array.clear();
+    c.array.squeeze();
+}
+
+void RoaringBitmap::toArray(Container& c) {
+    c.array.clear();
+    c.array.reserve(c.count);
+    for (int word = 0; word < BitmapWords; ++word) {
+        quint64 w = c.bits.at(word);
+        while (w) {
+            const int bit = qCountTrailingZeroBits(w);
+            c.array.append(quint16(word * 64 + bit));
+            w &= w - 1;
+        }
+    }
+    c.bits.clear();
+    c.bits.squeeze();
+}
+
+void RoaringBitmap::normalize(Container& c) {
+    if (c.isBitmap() && c.count <= ArrayLimit) {
+        toArray(c);
+    } else if (!c.isBitmap() && c.count > ArrayLimit) {
+        toBitmap(c);
+    }
+}
+
+RoaringBitmap::Container RoaringBitmap::intersect(const Container& a, const Container& b) {
+    Container result;
+    if (a.isBitmap() && b.isBitmap()) {
+        result.bits.resize(BitmapWords);
+        for (int i = 0; i < BitmapWords; ++i) {
+            result.bits[i] = a.bits.at(i) & b.bits.at(i);
+            result.count += qPopulationCount(result.bits.at(i));
+        }
+        normalize(result);
+    } else if (a.isBitmap() || b.isBitmap()) {
+        // Probe the bitmap with every value of the array
+        const Container& array = a.isBitmap() ? b : a;
+        const Container& bitmap = a.isBitmap() ? a : b;
+        for (quint16 low : array.array) {
+            if (bitmap.contains(low)) result.array.append(low);
+        }
+        result.count = result.array.size();
+    } else {
+        std::set_intersection(a.array.constBegin(), a.array.constEnd(), b.array.constBegin(), b.array.constEnd(),
+                              std::back_inserter(result.array));
+        result.count = result.array.size();
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::unite(const Container& a, const Container& b) {
+    Container result;
+    if (a.isBitmap() || b.isBitmap()) {
+        result = a.isBitmap() ? a : b;
+        const Container& other = a.isBitmap() ? b : a;
+        if (other.isBitmap()) {
+            for (int i = 0; i < BitmapWords; ++i) {
+                result.bits[i] |= other.bits.at(i);
+            }
+        } else {
+            for (quint16 low : other.array) {
+                result.bits[low >> 6] |= quint64(1) << (low & 63);
+            }
+        }
+        result.count = 0;
+        for (quint64 word : result.bits) {
+            result.count += qPopulationCount(word);
+        }
+    } else {
+        std::set_union(a.array.constBegin(), a.array.constEnd(), b.array.constBegin(), b.array.constEnd(),
+                       std::back_inserter(result.array));
+        result.count = result.array.size();
+        normalize(result);
+    }
+    return result;
+}
+
+RoaringBitmap::Container RoaringBitmap::subtract(const Container& a, const Container& b) {
+    Container result;
+    if (a.isBitmap()) {
+        result = a;
+        if (b.isBitmap()) {
+            for (int i = 0; i < BitmapWords; ++i) {
+                result.bits[i] &= ~b.bits.at(i);
+            }
+        } else {
+            for (quint16 low : b.array) {
+                result.bits[low >> 6] &= ~(quint64(1) << (low & 63));
+            }
+        }
+        result.count = 0;
+        for (quint64 word : result.bits) {
+            result.count += qPopulationCount(word);
+        }
+        normalize(result);
+    } else if (b.isBitmap()) {
+        for (quint16 low : a.array) {
+            if (!b.contains(low)) result.array.append(low);
+        }
+        result.count = result.array.size();
+    } else {
+        std::set_difference(a.array.constBegin(), a.array.constEnd(), b.array.constBegin(), b.array.constEnd(),
+                            std::back_inserter(result.array));
+        result.count = result.array.size();
+    }
+    return result;
+}
+
+int RoaringBitmap::indexOf(quint16 key) const {
+    auto it = std::lower_bound(m_keys.constBegin(), m_keys.constEnd(), key);
+    return (it != m_keys.constEnd() && *it == key) ? int(it - m_keys.constBegin()) : -1;
+}
+
+void RoaringBitmap::add(quint32 value) {
+    const quint16 key = quint16(value >> 16);
+    const quint16 low = quint16(value & 0xFFFF);
+
+    auto it = std::lower_bound(m_keys.begin(), m_keys.end(), key);
+    const int index = int(it - m_keys.begin());
+    if (it == m_keys.end() || *it != key) {
+        m_keys.insert(index, key);
+        m_containers.insert(index, Container());
+    }
+
+    Container& c = m_containers[index];
+    if (c.isBitmap()) {
+        quint64& word = c.bits[low >> 6];
+        const quint64 mask = quint64(1) << (low & 63);
+        if (!(word & mask)) {
+            word |= mask;
+            ++c.count;
+        }
+        return;
+    }
+
+    auto pos = std::lower_bound(c.array.begin(), c.array.end(), low);
+    if (pos != c.array.end() && *pos == low) return;
+    c.array.insert(pos, low);
+    ++c.count;
+    normalize(c);
+}
+
+void RoaringBitmap::remove(quint32 value) {
+    const int index = indexOf(quint16(value >> 16));
+    if (index < 0) return;
+
+    const quint16 low = quint16(value & 0xFFFF);
+    Container& c = m_containers[index];
+    if (c.isBitmap()) {
+        quint64& word = c.bits[low >> 6];
+        const quint64 mask = quint64(1) << (low & 63);
+        if (!(word & mask)) return;
+        word &= ~mask;
+        --c.count;
+        normalize(c);
+    } else {
+        auto pos = std::lower_bound(c.array.begin(), c.array.end(), low);
+        if (pos == c.array.end() || *pos != low) return;
+        c.array.erase(pos);
+        --c.count;
+    }
+
+    if (c.count == 0) {
+        m_keys.remove(index);
+        m_containers.remove(index);
+    }
+}
+
+bool RoaringBitmap::contains(quint32 value) const {
+    const int index = indexOf(quint16(value >> 16));
+    return index >= 0 && m_containers.at(index).contains(quint16(value & 0xFFFF));
+}
+
+bool RoaringBitmap::isEmpty() const {
+    return m_keys.isEmpty();
+}
+
+qint64 RoaringBitmap::cardinality() const {
+    qint64 total = 0;
+    for (const Container& c : m_containers) {
+        total += c.count;
+    }
+    return total;
+}
+
+void RoaringBitmap::clear() {
+    m_keys.clear();
+    m_containers.clear();
+}
+
+QList<int> RoaringBitmap::toList() const {
+    QList<int> list;
+    list.reserve(int(cardinality()));
+    for (int i = 0; i < m_keys.size(); ++i) {
+        const quint32 high = quint32(m_keys.at(i)) << 16;
+        Container c = m_containers.at(i);
+        if (c.isBitmap()) toArray(c);
+        for (quint16 low : c.array) {
+            list.append(int(high | low));
+        }
+    }
+    return list;
+}
+
+RoaringBitmap RoaringBitmap::operator&(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    int i = 0, j = 0;
+    while (i < m_keys.size() && j < other.m_keys.size()) {
+        if (m_keys.at(i) < other.m_keys.at(j)) {
+            ++i;
+        } else if (m_keys.at(i) > other.m_keys.at(j)) {
+            ++j;
+        } else {
+            Container c = intersect(m_containers.at(i), other.m_containers.at(j));
+            if (c.count > 0) {
+                result.m_keys.append(m_keys.at(i));
+                result.m_containers.append(c);
+            }
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator|(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    int i = 0, j = 0;
+    while (i < m_keys.size() || j < other.m_keys.size()) {
+        if (j == other.m_keys.size() || (i < m_keys.size() && m_keys.at(i) < other.m_keys.at(j))) {
+            result.m_keys.append(m_keys.at(i));
+            result.m_containers.append(m_containers.at(i));
+            ++i;
+        } else if (i == m_keys.size() || m_keys.at(i) > other.m_keys.at(j)) {
+            result.m_keys.append(other.m_keys.at(j));
+            result.m_containers.append(other.m_containers.at(j));
+            ++j;
+        } else {
+            result.m_keys.append(m_keys.at(i));
+            result.m_containers.append(unite(m_containers.at(i), other.m_containers.at(j)));
+            ++i;
+            ++j;
+        }
+    }
+    return result;
+}
+
+RoaringBitmap RoaringBitmap::operator-(const RoaringBitmap& other) const {
+    RoaringBitmap result;
+    int j = 0;
+    for (int i = 0; i < m_keys.size(); ++i) {
+        while (j < other.m_keys.size() && other.m_keys.at(j) < m_keys.at(i)) {
+            ++j;
+        }
+        if (j < other.m_keys.size() && other.m_keys.at(j) == m_keys.at(i)) {
+            Container c = subtract(m_containers.at(i), other.m_containers.at(j));
+            if (c.count > 0) {
+                result.m_keys.append(m_keys.at(i));
+                result.m_containers.append(c);
+            }
+        } else {
+            result.m_keys.append(m_keys.at(i));
+            result.m_containers.append(m_containers.at(i));
+        }
+    }
+    return result;
+}
+
+RoaringBitmap& RoaringBitmap::operator&=(const RoaringBitmap& other) {
+    *this = *this & other;
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator|=(const RoaringBitmap& other) {
+    *this = *this | other;
+    return *this;
+}
+
+RoaringBitmap& RoaringBitmap::operator-=(const RoaringBitmap& other) {
+    *this = *this - other;
+    return *this;
+}
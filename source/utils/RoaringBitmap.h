@@ -0,0 +1,57 @@
+#pragma once
+
+#include <QList>
+#include <QVector>
+#include <QtGlobal>
+
+// Compressed set of 32-bit ids, split like a roaring bitmap: ids sharing their
+// high 16 bits go into one container, kept as a sorted array of the low halves
+// while it holds at most ArrayLimit of them and as a 2^16-bit bitmap after
+// that. Set operations work container by container, so sparse and dense sets
+// both stay small and fast to combine.
+class RoaringBitmap {
+public:
+    static const int ArrayLimit = 4096;
+
+    void add(quint32 value);
+    void remove(quint32 value);
+    bool contains(quint32 value) const;
+    bool isEmpty() const;
+    qint64 cardinality() const;
+    void clear();
+    // Ascending
+    QList<int> toList() const;
+
+    RoaringBitmap operator&(const RoaringBitmap& other) const;
+    RoaringBitmap operator|(const RoaringBitmap& other) const;
+    // Values in this set and not in other
+    RoaringBitmap operator-(const RoaringBitmap& other) const;
+    RoaringBitmap& operator&=(const RoaringBitmap& other);
+    RoaringBitmap& operator|=(const RoaringBitmap& other);
+    RoaringBitmap& operator-=(const RoaringBitmap& other);
+
+private:
+    struct Container {
+        QVector<quint16> array;
+        // 1024 words when the container is a bitmap, empty otherwise
+        QVector<quint64> bits;
+        int count = 0;
+
+        bool isBitmap() const { return !bits.isEmpty(); }
+        bool contains(quint16 low) const;
+    };
+
+    static void toBitmap(Container& c);
+    static void toArray(Container& c);
+    // Picks the representation that suits the container's count
+    static void normalize(Container& c);
+    static Container intersect(const Container& a, const Container& b);
+    static Container unite(const Container& a, const Container& b);
+    static Container subtract(const Container& a, const Container& b);
+
+    int indexOf(quint16 key) const;
+
+    // Sorted by key, no empty containers
+    QVector<quint16> m_keys;
+    QVector<Container> m_containers;
+};
@@ -0,0 +1,185 @@
+#include "Totp.h"
+
+#include <QUrl>
+#include <QUrlQuery>
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <cstring>
+
+namespace {
+
+const char* const Base32Alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZ234567";
+const quint32 PowersOfTen[] = {1, 10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000};
+
+const EVP_MD* digestFor(Totp::Algorithm algorithm) {
+    switch (algorithm) {
+    case Totp::Algorithm::Sha256: return EVP_sha256();
+    case Totp::Algorithm::Sha512: return EVP_sha512();
+    case Totp::Algorithm::Sha1: break;
+    }
+    return EVP_sha1();
+}
+
+// Dynamic truncation without indexing by the secret-derived offset: every
+// candidate window is read and all but the selected one are masked out
+quint32 truncate(const unsigned char* mac, unsigned int length) {
+    const quint32 offset = mac[length - 1] & 0x0f;
+    quint32 value = 0;
+    for (quint32 i = 0; i < 16; ++i) {
+        const quint32 mask = 0u - (((i ^ offset) - 1u) >> 31);
+        const quint32 window = (quint32(mac[i] & 0x7f) << 24) | (quint32(mac[i + 1]) << 16)
+                             | (quint32(mac[i + 2]) << 8) | quint32(mac[i + 3]);
+        value |= window & mask;
+    }
+    return value;
+}
+
+}
+
+Totp::Settings Totp::parse(const QString& otp) {
+    Settings settings;
+    const QString text = otp.trimmed();
+    if (!text.startsWith("otpauth://", Qt::CaseInsensitive)) {
+        settings.secret = base32Decode(text);
+        return settings;
+    }
+
+    const QUrl url(text);
+    const QUrlQuery query(url);
+    const QString host = url.host().toLower();
+    if (host == "hotp") {
+        settings.type = Type::Hotp;
+        settings.counter = query.queryItemValue("counter").toULongLong();
+    } else if (host != "totp") {
+        return settings;
+    }
+
+    const QString algorithm = query.queryItemValue("algorithm").toUpper();
+    if (algorithm == "SHA256") {
+        settings.algorithm = Algorithm::Sha256;
+    } else if (algorithm == "SHA512") {
+        settings.algorithm = Algorithm::Sha512;
+    } else if (!algorithm.isEmpty() && algorithm != "SHA1") {
+        return settings;
+    }
+
+    bool ok = false;
+    const int digits = query.queryItemValue("digits").toInt(&ok);
+    if (ok) settings.digits = digits;
+    const int period = query.queryItemValue("period").toInt(&ok);
+    if (ok) settings.period = period;
+    if (settings.digits < 6 || settings.digits > 8 || settings.period < 1) {
+        return settings;
+    }
+
+    settings.secret = base32Decode(query.queryItemValue("secret", QUrl::FullyDecoded));
+    return settings;
+}
+
+QString Totp::toUri(const Settings& settings, const QString& label) {
+    QUrlQuery query;
+    query.addQueryItem("secret", base32Encode(settings.secret));
+    if (settings.algorithm == Algorithm::Sha256) {
+        query.addQueryItem("algorithm", "SHA256");
+    } else if (settings.algorithm == Algorithm::Sha512) {
+        query.addQueryItem("algorithm", "SHA512");
+    }
+    if (settings.digits != 6) query.addQueryItem("digits", QString::number(settings.digits));
+    if (settings.type == Type::Hotp) {
+        query.addQueryItem("counter", QString::number(settings.counter));
+    } else if (settings.period != 30) {
+        query.addQueryItem("period", QString::number(settings.period));
+    }
+
+    QUrl url;
+    url.setScheme("otpauth");
+    url.setHost(settings.type == Type::Hotp ? "hotp" : "totp");
+    url.setPath("/" + (label.isEmpty() ? QString("KeeBox") : label));
+    url.setQuery(query);
+    return url.toString(QUrl::FullyEncoded);
+}
+
+QString Totp::withCounter(const QString& otp, quint64 counter) {
+    QUrl url(otp.trimmed());
+    QUrlQuery query(url);
+    QList<QPair<QString, QString>> items = query.queryItems(QUrl::FullyEncoded);
+    bool replaced = false;
+    for (auto& item : items) {
+        if (item.first == "counter") {
+            item.second = QString::number(counter);
+            replaced = true;
+        }
+    }
+    if (!replaced) items.append({"counter", QString::number(counter)});
+    query.setQueryItems(items);
+    url.setQuery(query);
+    return url.toString(QUrl::FullyEncoded);
+}
+
+quint64 Totp::counterAt(const Settings& settings, qint64 unixTime) {
+    if (settings.type == Type::Hotp) return settings.counter;
+    return quint64(qMax<qint64>(0, unixTime)) / quint64(settings.period);
+}
+
+int Totp::secondsRemaining(const Settings& settings, qint64 unixTime) {
+    if (settings.type == Type::Hotp) return 0;
+    return settings.period - int(quint64(qMax<qint64>(0, unixTime)) % quint64(settings.period));
+}
+
+QString Totp::code(const Settings& settings, quint64 counter) {
+    if (!settings.isValid()) return QString();
+
+    unsigned char message[8];
+    for (int i = 7; i >= 0; --i) {
+        message[i] = (unsigned char)(counter & 0xff);
+        counter >>= 8;
+    }
+
+    unsigned char mac[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    if (!HMAC(digestFor(settings.algorithm), settings.secret.constData(), settings.secret.size(),
+              message, sizeof(message), mac, &length) || length < 20) {
+        return QString();
+    }
+
+    const quint32 value = truncate(mac, length) % PowersOfTen[settings.digits];
+    OPENSSL_cleanse(mac, sizeof(mac));
+    return QString::number(value).rightJustified(settings.digits, '0');
+}
+
+QByteArray Totp::base32Decode(const QString& text) {
+    QByteArray out;
+    quint32 buffer = 0;
+    int bits = 0;
+    for (QChar c : text) {
+        if (c == '=' || c == ' ' || c == '-') continue;
+        const char* found = c.unicode() < 128 ? strchr(Base32Alphabet, c.toUpper().toLatin1()) : nullptr;
+        if (!found || !*found) return QByteArray();
+
+        buffer = (buffer << 5) | quint32(found - Base32Alphabet);
+        bits += 5;
+        if (bits >= 8) {
+            bits -= 8;
+            out.append(char((buffer >> bits) & 0xff));
+        }
+    }
+    return out;
+}
+
+QString Totp::base32Encode(const QByteArray& data) {
+    QString out;
+    quint32 buffer = 0;
+    int bits = 0;
+    for (char byte : data) {
+        buffer = (buffer << 8) | quint8(byte);
+        bits += 8;
+        while (bits >= 5) {
+            bits -= 5;
+            out.append(QLatin1Char(Base32Alphabet[(buffer >> bits) & 0x1f]));
+        }
+    }
+    if (bits > 0) {
+        out.append(QLatin1Char(Base32Alphabet[(buffer << (5 - bits)) & 0x1f]));
+    }
+    return out;
+}
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <QByteArray>
+#include <QString>
+
+// RFC 4226 (HOTP) and RFC 6238 (TOTP) one-time codes. Entries keep their OTP
+// settings as an otpauth:// URI, the format authenticator apps export.
+class Totp {
+public:
+    enum class Type { Totp, Hotp };
+    enum class Algorithm { Sha1, Sha256, Sha512 };
+
+    struct Settings {
+        Type type = Type::Totp;
+        Algorithm algorithm = Algorithm::Sha1;
+        QByteArray secret;
+        int digits = 6;
+        int period = 30;
+        quint64 counter = 0;
+
+        bool isValid() const { return !secret.isEmpty(); }
+    };
+
+    // Accepts otpauth:// URIs and bare base32 secrets; the result is invalid if neither parses
+    static Settings parse(const QString& otp);
+    static QString toUri(const Settings& settings, const QString& label);
+    // The same URI with only its counter item replaced; label, issuer and the rest stay as they are
+    static QString withCounter(const QString& otp, quint64 counter);
+
+    // The moving factor: the time step for TOTP, the stored counter for HOTP
+    static quint64 counterAt(const Settings& settings, qint64 unixTime);
+    // Seconds until the code for unixTime changes; 0 for HOTP
+    static int secondsRemaining(const Settings& settings, qint64 unixTime);
+    static QString code(const Settings& settings, quint64 counter);
+
+    static QByteArray base32Decode(const QString& text);
+    static QString base32Encode(const QByteArray& data);
+};
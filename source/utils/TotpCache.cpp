@@ -0,0 +1,94 @@
+#include "TotpCache.h"
+#include "../database/CipherKey.h"
+
+#include <QDateTime>
+#include <QTimer>
+#include <utility>
+
+TotpCache::TotpCache(QObject* parent)
+    : QObject(parent) {
+    m_timer = new QTimer(this);
+    m_timer->setSingleShot(true);
+    m_timer->setTimerType(Qt::PreciseTimer);
+    connect(m_timer, &QTimer::timeout, this, [this]() {
+        refresh();
+        emit tick();
+        scheduleTick();
+    });
+}
+
+TotpCache::~TotpCache() {
+    clear();
+}
+
+void TotpCache::setEntries(const QHash<int, QString>& otpByEntry) {
+    for (auto it = m_slots.begin(); it != m_slots.end();) {
+        if (otpByEntry.value(it.key()) != it.value().otp) {
+            CipherKey::wipe(it.value().settings.secret);
+            it = m_slots.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    for (auto it = otpByEntry.cbegin(); it != otpByEntry.cend(); ++it) {
+        if (it.value().isEmpty() || m_slots.contains(it.key())) continue;
+        Slot slot;
+        slot.otp = it.value();
+        slot.settings = Totp::parse(it.value());
+        m_slots.insert(it.key(), slot);
+    }
+
+    refresh();
+    scheduleTick();
+}
+
+void TotpCache::clear() {
+    for (Slot& slot : m_slots) {
+        CipherKey::wipe(slot.settings.secret);
+    }
+    m_slots.clear();
+    m_timer->stop();
+}
+
+bool TotpCache::hasOtp(int entryId) const {
+    return m_slots.contains(entryId);
+}
+
+QString TotpCache::code(int entryId) const {
+    return m_slots.value(entryId).code;
+}
+
+int TotpCache::secondsRemaining(int entryId) const {
+    auto it = m_slots.constFind(entryId);
+    if (it == m_slots.cend() || !it->settings.isValid()) return 0;
+    return Totp::secondsRemaining(it->settings, m_now);
+}
+
+void TotpCache::refresh() {
+    // Nearly every code shares the 30 s step, so a rollover recomputes the whole batch at once
+    m_now = QDateTime::currentSecsSinceEpoch();
+    for (Slot& slot : m_slots) {
+        if (!slot.settings.isValid()) continue;
+        const quint64 counter = Totp::counterAt(slot.settings, m_now);
+        if (slot.computed && slot.counter == counter) continue;
+        slot.counter = counter;
+        slot.code = Totp::code(slot.settings, counter);
+        slot.computed = true;
+    }
+}
+
+void TotpCache::scheduleTick() {
+    bool counting = false;
+    for (const Slot& slot : std::as_const(m_slots)) {
+        if (slot.settings.isValid() && slot.settings.type == Totp::Type::Totp) {
+            counting = true;
+            break;
+        }
+    }
+    if (!counting) {
+        m_timer->stop();
+        return;
+    }
+    // Land just after the next second so countdowns and rollovers line up with the clock
+    m_timer->start(1000 - int(QDateTime::currentMSecsSinceEpoch() % 1000) + 5);
+}
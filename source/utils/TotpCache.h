@@ -0,0 +1,49 @@
+#pragma once
+
+#include "Totp.h"
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+
+class QTimer;
+
+// Current OTP codes for the entries on screen. Codes are computed together
+// whenever a time step rolls over and are served from the cache in between;
+// one timer, aligned to whole seconds, drives every countdown.
+class TotpCache : public QObject {
+    Q_OBJECT
+
+public:
+    explicit TotpCache(QObject* parent = nullptr);
+    ~TotpCache() override;
+
+    // Replaces the tracked entries, given as entry id -> OTP field; unchanged ones keep their codes
+    void setEntries(const QHash<int, QString>& otpByEntry);
+    void clear();
+
+    bool hasOtp(int entryId) const;
+    QString code(int entryId) const;
+    // Seconds the cached TOTP code has left; 0 for HOTP and unknown entries
+    int secondsRemaining(int entryId) const;
+
+signals:
+    // Once a second while TOTP entries are tracked, after any expired codes were recomputed
+    void tick();
+
+private:
+    struct Slot {
+        QString otp;
+        Totp::Settings settings;
+        quint64 counter = 0;
+        bool computed = false;
+        QString code;
+    };
+
+    void refresh();
+    void scheduleTick();
+
+    QHash<int, Slot> m_slots;
+    QTimer* m_timer = nullptr;
+    qint64 m_now = 0;
+};
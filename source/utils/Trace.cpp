@@ -0,0 +1,125 @@
+#include "Trace.h"
+
+#include <QCoreApplication>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+namespace {
+
+struct Event {
+    const char* name;
+    const char* category;
+    char phase;
+    qint64 timestamp;
+    qint64 duration;
+    quint64 thread;
+};
+
+struct TraceState {
+    bool enabled = false;
+    QString path;
+    QElapsedTimer clock;
+    QMutex mutex;
+    QVector<Event> events;
+};
+
+TraceState& state() {
+    static TraceState instance;
+    return instance;
+}
+
+quint64 currentThread() {
+    return (quint64)(quintptr)QThread::currentThreadId();
+}
+
+void record(const char* name, const char* category, char phase, qint64 timestamp, qint64 duration) {
+    TraceState& s = state();
+    QMutexLocker locker(&s.mutex);
+    s.events.append({name, category, phase, timestamp, duration, currentThread()});
+}
+
+}
+
+Trace::Span::Span(const char* name, const char* category)
+    : m_name(name), m_category(category), m_start(-1) {
+    if (state().enabled) {
+        m_start = now();
+    }
+}
+
+Trace::Span::~Span() {
+    if (m_start >= 0) {
+        complete(m_name, m_start, m_category);
+    }
+}
+
+void Trace::initialize() {
+    TraceState& s = state();
+    s.path = qEnvironmentVariable("KEEBOX_TRACE");
+    s.enabled = !s.path.isEmpty();
+    if (!s.enabled) return;
+
+    s.clock.start();
+    s.events.reserve(1024);
+}
+
+bool Trace::isEnabled() {
+    return state().enabled;
+}
+
+qint64 Trace::now() {
+    return state().clock.nsecsElapsed() / 1000;
+}
+
+void Trace::complete(const char* name, qint64 startUs, const char* category) {
+    if (!state().enabled) return;
+    record(name, category, 'X', startUs, now() - startUs);
+}
+
+void Trace::instant(const char* name, const char* category) {
+    if (!state().enabled) return;
+    record(name, category, 'i', now(), 0);
+}
+
+void Trace::flush() {
+    TraceState& s = state();
+    if (!s.enabled) return;
+
+    QJsonArray events;
+    QMutexLocker locker(&s.mutex);
+    const qint64 pid = QCoreApplication::applicationPid();
+    for (const Event& event : s.events) {
+        QJsonObject object;
+        object["name"] = QString::fromUtf8(event.name);
+        object["cat"] = QString::fromUtf8(event.category);
+        object["ph"] = QString(QChar(event.phase));
+        object["ts"] = event.timestamp;
+        object["pid"] = pid;
+        object["tid"] = (qint64)event.thread;
+        if (event.phase == 'X') {
+            object["dur"] = event.duration;
+        } else {
+            object["s"] = "t";
+        }
+        events.append(object);
+    }
+    locker.unlock();
+
+    QJsonObject root;
+    root["traceEvents"] = events;
+    root["displayTimeUnit"] = "ms";
+
+    QSaveFile file(s.path);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson(QJsonDocument::Compact)) < 0 || !file.commit()) {
+        qWarning() << "Failed to write trace file:" << s.path;
+    }
+}
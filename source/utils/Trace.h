@@ -0,0 +1,33 @@
+#pragma once
+
+#include <QtGlobal>
+
+// Lightweight span tracing in the Chrome trace event format (chrome://tracing, Perfetto).
+// Disabled unless KEEBOX_TRACE names the output file; a disabled span costs one branch.
+class Trace {
+public:
+    // Records the time between construction and destruction as one complete event
+    class Span {
+    public:
+        explicit Span(const char* name, const char* category = "app");
+        ~Span();
+        Span(const Span&) = delete;
+        Span& operator=(const Span&) = delete;
+
+    private:
+        const char* m_name;
+        const char* m_category;
+        qint64 m_start;
+    };
+
+    static void initialize();
+    static bool isEnabled();
+
+    // Microseconds since initialize(), for spans that do not fit a scope
+    static qint64 now();
+    static void complete(const char* name, qint64 startUs, const char* category = "app");
+    static void instant(const char* name, const char* category = "app");
+
+    // Writes everything recorded so far to the KEEBOX_TRACE file
+    static void flush();
+};
@@ -0,0 +1,130 @@
+#!/usr/bin/env python3
+"""Test client for the KeeBox autofill socket.
+
+Associates once (KeeBox asks for approval), then looks logins up by URL:
+
+    tools/autofill_client.py https://github.com/login
+    tools/autofill_client.py --repeat 1000 github.com
+
+The association key is kept in ~/.config/keebox/autofill-client.json.
+"""
+
+import argparse
+import base64
+import hashlib
+import hmac
+import json
+import os
+import secrets
+import socket
+import sys
+import time
+
+CLIENT_ID = "keebox-test-client"
+
+
+def socket_path():
+    runtime = os.environ.get("XDG_RUNTIME_DIR") or "/tmp"
+    return os.path.join(runtime, "keebox-autofill.sock")
+
+
+def key_file():
+    config = os.environ.get("XDG_CONFIG_HOME") or os.path.expanduser("~/.config")
+    return os.path.join(config, "keebox", "autofill-client.json")
+
+
+class Connection:
+    def __init__(self, path):
+        self.sock = socket.socket(socket.AF_UNIX, socket.SOCK_STREAM)
+        self.sock.connect(path)
+        self.reader = self.sock.makefile("rb")
+        hello = self.receive()
+        self.nonce = base64.b64decode(hello["nonce"])
+
+    def receive(self):
+        line = self.reader.readline()
+        if not line:
+            raise ConnectionError("KeeBox closed the connection")
+        return json.loads(line)
+
+    def request(self, message):
+        self.sock.sendall(json.dumps(message).encode() + b"\n")
+        return self.receive()
+
+
+def load_key():
+    try:
+        with open(key_file()) as f:
+            return base64.b64decode(json.load(f)["key"])
+    except (OSError, KeyError, ValueError):
+        return None
+
+
+def save_key(key):
+    path = key_file()
+    os.makedirs(os.path.dirname(path), exist_ok=True)
+    fd = os.open(path, os.O_WRONLY | os.O_CREAT | os.O_TRUNC, 0o600)
+    with os.fdopen(fd, "w") as f:
+        json.dump({"id": CLIENT_ID, "key": base64.b64encode(key).decode()}, f)
+
+
+def authenticate(conn):
+    key = load_key()
+    if key is None:
+        key = secrets.token_bytes(32)
+        print("Asking KeeBox for access; confirm the prompt in the app...", file=sys.stderr)
+        reply = conn.request({"action": "associate", "id": CLIENT_ID, "key": base64.b64encode(key).decode()})
+        if not reply.get("success"):
+            raise PermissionError(reply.get("error", "association failed"))
+        save_key(key)
+
+    proof = hmac.new(key, conn.nonce, hashlib.sha256).digest()
+    reply = conn.request({"action": "test-associate", "id": CLIENT_ID, "hmac": base64.b64encode(proof).decode()})
+    conn.nonce = base64.b64decode(reply["nonce"])
+    if not reply.get("success"):
+        raise PermissionError(reply.get("error", "not associated"))
+    return reply["vaults"]
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("url")
+    parser.add_argument("--repeat", type=int, default=1, help="look the URL up this many times and report latency")
+    parser.add_argument("--socket", default=socket_path())
+    parser.add_argument("--show-passwords", action="store_true")
+    args = parser.parse_args()
+
+    try:
+        conn = Connection(args.socket)
+        vaults = authenticate(conn)
+    except (OSError, PermissionError) as error:
+        print(f"error: {error}", file=sys.stderr)
+        return 1
+    print(f"Authenticated to {vaults} vault(s)", file=sys.stderr)
+
+    timings = []
+    reply = None
+    for _ in range(args.repeat):
+        begin = time.perf_counter()
+        reply = conn.request({"action": "get-logins", "url": args.url})
+        timings.append(time.perf_counter() - begin)
+        if not reply.get("success"):
+            print(f"error: {reply.get('error')}", file=sys.stderr)
+            return 1
+
+    for entry in reply["entries"]:
+        password = entry["password"] if args.show_passwords else "*" * 8
+        print(f"{entry['vault']}: {entry['name']}  {entry['login']}  {password}  ({entry['url']})")
+    if not reply["entries"]:
+        print("No logins found", file=sys.stderr)
+
+    timings.sort()
+    micros = lambda seconds: seconds * 1e6
+    print(f"round trip: p50 {micros(timings[len(timings) // 2]):.0f} us, "
+          f"p99 {micros(timings[min(len(timings) - 1, len(timings) * 99 // 100)]):.0f} us "
+          f"over {len(timings)} lookup(s)", file=sys.stderr)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
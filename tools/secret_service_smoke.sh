@@ -0,0 +1,39 @@
+#!/usr/bin/env bash
+# Exercises the KeeBox Secret Service provider on a private session bus, so the
+# desktop's own keyring is neither used nor disturbed:
+#
+#     tools/secret_service_smoke.sh build/KeeBox
+#
+# Unlock a vault in the window that opens; the script then stores, looks up,
+# searches and clears an item with secret-tool (libsecret-tools).
+
+set -euo pipefail
+
+if [ -z "${KEEBOX_PRIVATE_BUS:-}" ]; then
+    export KEEBOX_PRIVATE_BUS=1
+    exec dbus-run-session -- "$0" "$@"
+fi
+
+binary="${1:?usage: $0 path/to/KeeBox}"
+"$binary" &
+keebox=$!
+trap 'kill $keebox 2>/dev/null || true' EXIT
+
+echo "Waiting for a vault to be unlocked..." >&2
+until gdbus call --session --dest org.freedesktop.secrets --object-path /org/freedesktop/secrets \
+        --method org.freedesktop.DBus.Properties.Get org.freedesktop.Secret.Service Collections 2>/dev/null \
+        | grep -q collection/; do
+    kill -0 $keebox 2>/dev/null || { echo "KeeBox exited" >&2; exit 1; }
+    sleep 1
+done
+
+secret="smoke-$RANDOM-$RANDOM"
+printf '%s' "$secret" | secret-tool store --label "KeeBox smoke test" service keebox-smoke username tester
+[ "$(secret-tool lookup service keebox-smoke username tester)" = "$secret" ]
+secret-tool search --all service keebox-smoke | grep -q "label = KeeBox smoke test"
+secret-tool clear service keebox-smoke username tester
+if secret-tool lookup service keebox-smoke username tester; then
+    echo "item was not deleted" >&2
+    exit 1
+fi
+echo "Secret Service smoke test passed" >&2